@@ -0,0 +1,221 @@
+#include "health_advice.h"
+#include <stdatomic.h>
+
+// Piece of advice text with its length worked out at compile time
+typedef struct {
+    const char *text;
+    size_t length;
+} TextFragment;
+
+#define FRAGMENT(literal) { literal, sizeof(literal) - 1 }
+
+// Advice for one category: everything before the count of abnormal days and
+// everything after it
+typedef struct {
+    TextFragment head;
+    TextFragment tail;
+} AdviceSection;
+
+// Capacity of every text buffer alive, on any thread
+static atomic_size_t text_buffer_bytes = 0;
+
+static const TextFragment advice_header = FRAGMENT(
+    "Health Overview\n"
+    "===============\n\n");
+
+static const TextFragment advice_all_normal = FRAGMENT(
+    "Everything looked normal in your health data for this period.\n\n"
+    "Health Tips:\n"
+    "• Continue your current healthy habits\n"
+    "• Keep doing regular physical activity\n"
+    "• Drink plenty of water daily (8-10 glasses)\n"
+    "• Get good sleep every night (7-8 hours)\n"
+    "• Visit your doctor for regular check-ups\n"
+    "• Keep tracking your health as you're doing\n"
+    "• Find healthy ways to manage stress\n\n");
+
+static const AdviceSection advice_sections[ADVICE_CATEGORIES] = {
+    {
+        FRAGMENT("Weight Management:\n"
+                 "Unusual weight readings detected on "),
+        FRAGMENT(" day(s).\n\n"
+                 "• Focus on eating balanced, nutritious meals\n"
+                 "• Try to be more active in your daily routine\n"
+                 "• Keep track of what you eat and drink\n"
+                 "• Consider talking to a nutrition expert\n"
+                 "• Set realistic weight goals\n\n")
+    },
+    {
+        FRAGMENT("Blood Pressure Care:\n"
+                 "Unusual blood pressure levels detected on "),
+        FRAGMENT(" day(s).\n\n"
+                 "• Reduce salt in your food\n"
+                 "• Limit coffee and alcohol intake\n"
+                 "• Try relaxation techniques like deep breathing\n"
+                 "• Stay active with regular exercise\n"
+                 "• Schedule a doctor visit soon\n"
+                 "• Monitor your blood pressure regularly\n\n")
+    },
+    {
+        FRAGMENT("Blood Sugar Management:\n"
+                 "Unusual blood sugar levels detected on "),
+        FRAGMENT(" day(s).\n\n"
+                 "• Watch your intake of sweets and carbs\n"
+                 "• Check your blood sugar as recommended\n"
+                 "• Take your medications on time\n"
+                 "• See a diabetes specialist\n"
+                 "• Stay active after meals\n"
+                 "• Eat meals at regular times\n\n")
+    },
+    {
+        FRAGMENT("Temperature Monitoring:\n"
+                 "Unusual temperature readings detected on "),
+        FRAGMENT(" day(s).\n\n"
+                 "• Get plenty of rest and good sleep\n"
+                 "• Drink lots of fluids\n"
+                 "• Watch for other symptoms\n"
+                 "• See a doctor if fever continues\n"
+                 "• Take it easy with physical activities\n\n")
+    }
+};
+
+static const TextFragment advice_footer = FRAGMENT(
+    "General Health Tips:\n"
+    "• Keep up with regular doctor visits\n"
+    "• Continue monitoring your health daily\n"
+    "• Maintain good sleep habits\n"
+    "• Practice stress management\n");
+
+// Makes room for `extra` more bytes and the terminator, growing the buffer
+// geometrically. Returns 0 if it cannot grow.
+int reserve_text_buffer(TextBuffer *buffer, size_t extra) {
+    size_t needed = buffer->length + extra + 1;
+    if (needed <= buffer->capacity) return 1;
+
+    size_t new_capacity = buffer->capacity ? buffer->capacity : 256;
+    while (new_capacity < needed) new_capacity *= 2;
+    char *grown = realloc(buffer->text, new_capacity);
+    if (!grown) return 0;
+    atomic_fetch_add(&text_buffer_bytes, new_capacity - buffer->capacity);
+    buffer->text = grown;
+    buffer->capacity = new_capacity;
+    return 1;
+}
+
+void free_text_buffer(TextBuffer *buffer) {
+    atomic_fetch_sub(&text_buffer_bytes, buffer->capacity);
+    free(buffer->text);
+    buffer->text = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
+
+// Hands the text over as a plain string for the caller to free(), leaving the
+// buffer empty
+char* take_text_buffer(TextBuffer *buffer) {
+    char *text = buffer->text;
+    atomic_fetch_sub(&text_buffer_bytes, buffer->capacity);
+    buffer->text = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+    return text;
+}
+
+// Bytes held by text buffers not yet freed or taken
+size_t get_text_buffer_bytes(void) {
+    return atomic_load(&text_buffer_bytes);
+}
+
+// Digits of a count as written into the advice
+static size_t count_length(int count) {
+    unsigned magnitude = count < 0 ? 0u - (unsigned)count : (unsigned)count;
+    size_t length = count < 0 ? 2 : 1;
+    while (magnitude >= 10) {
+        magnitude /= 10;
+        length++;
+    }
+    return length;
+}
+
+// Writes a count in decimal at `out`, which has room for count_length(count) bytes
+static void write_count(int count, char *out, size_t length) {
+    unsigned magnitude = count < 0 ? 0u - (unsigned)count : (unsigned)count;
+    if (count < 0) out[0] = '-';
+    char *digit = out + length;
+    do {
+        *--digit = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+}
+
+static char* write_fragment(char *out, const TextFragment *fragment) {
+    memcpy(out, fragment->text, fragment->length);
+    return out + fragment->length;
+}
+
+static int has_abnormal_days(const AbnormalitySummary *summary) {
+    for (int c = 0; c < ADVICE_CATEGORIES; c++) {
+        if (summary->days[c] > 0) return 1;
+    }
+    return 0;
+}
+
+// Exact length of the advice for a summary, terminator excluded
+size_t get_health_advice_length(const AbnormalitySummary *summary) {
+    size_t length = advice_header.length;
+    if (!has_abnormal_days(summary)) return length + advice_all_normal.length;
+
+    for (int c = 0; c < ADVICE_CATEGORIES; c++) {
+        if (summary->days[c] <= 0) continue;
+        length += advice_sections[c].head.length + count_length(summary->days[c]) + advice_sections[c].tail.length;
+    }
+    return length + advice_footer.length;
+}
+
+// Writes the advice into space already reserved for it; returns the end
+static char* write_health_advice(char *out, const AbnormalitySummary *summary) {
+    out = write_fragment(out, &advice_header);
+    if (!has_abnormal_days(summary)) return write_fragment(out, &advice_all_normal);
+
+    for (int c = 0; c < ADVICE_CATEGORIES; c++) {
+        if (summary->days[c] <= 0) continue;
+        size_t digits = count_length(summary->days[c]);
+        out = write_fragment(out, &advice_sections[c].head);
+        write_count(summary->days[c], out, digits);
+        out = write_fragment(out + digits, &advice_sections[c].tail);
+    }
+    return write_fragment(out, &advice_footer);
+}
+
+// Appends the advice for one summary: a section for every category with abnormal
+// days, or the all-normal tips. Returns 0 if the buffer cannot grow.
+int append_health_advice(TextBuffer *buffer, const AbnormalitySummary *summary) {
+    if (!reserve_text_buffer(buffer, get_health_advice_length(summary))) return 0;
+
+    char *end = write_health_advice(buffer->text + buffer->length, summary);
+    buffer->length = end - buffer->text;
+    *end = '\0';
+    return 1;
+}
+
+// Appends the advice for `count` summaries in one pass, each report followed by
+// its terminator, so buffer->text + offsets[i] is report i as a string. The space
+// for all of them is reserved up front: one allocation at most, however many
+// patients. Returns the number of reports written (0 if the buffer cannot grow).
+int append_health_advice_batch(TextBuffer *buffer, const AbnormalitySummary *summaries, int count, size_t *offsets) {
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        total += get_health_advice_length(&summaries[i]) + 1;
+    }
+    if (!reserve_text_buffer(buffer, total)) return 0;
+
+    char *out = buffer->text + buffer->length;
+    for (int i = 0; i < count; i++) {
+        offsets[i] = out - buffer->text;
+        out = write_health_advice(out, &summaries[i]);
+        *out++ = '\0';
+    }
+    buffer->length = out - buffer->text;
+    *out = '\0';
+    return count;
+}
@@ -0,0 +1,33 @@
+#ifndef HEALTH_ADVICE_H
+#define HEALTH_ADVICE_H
+
+#include <stdlib.h>
+#include <string.h>
+
+// Abnormality categories that get an advice section: weight, blood pressure,
+// sugar and temperature, in the order of the abnormality table
+#define ADVICE_CATEGORIES 4
+
+// Text that grows as it is appended to, always NUL-terminated after `length`
+// bytes; start zeroed and release with free_text_buffer
+typedef struct {
+    char *text;
+    size_t length;
+    size_t capacity;
+} TextBuffer;
+
+// Days with abnormal readings per category over a report's date range
+typedef struct {
+    int days[ADVICE_CATEGORIES];
+} AbnormalitySummary;
+
+// Function declarations for advice text built from fixed templates
+int reserve_text_buffer(TextBuffer *buffer, size_t extra);
+void free_text_buffer(TextBuffer *buffer);
+char* take_text_buffer(TextBuffer *buffer);
+size_t get_text_buffer_bytes(void);
+size_t get_health_advice_length(const AbnormalitySummary *summary);
+int append_health_advice(TextBuffer *buffer, const AbnormalitySummary *summary);
+int append_health_advice_batch(TextBuffer *buffer, const AbnormalitySummary *summaries, int count, size_t *offsets);
+
+#endif // HEALTH_ADVICE_H
@@ -0,0 +1,287 @@
+#include "health_analysis.h"
+#include "health_sketch.h"
+#include "health_perf.h"
+
+// Rows kept for pairing readings with the ones a few days before them
+#define LAG_RING_SIZE 16
+
+static const char *metric_names[ANALYSIS_METRICS] = {
+    "Height", "Weight", "BP Systolic", "BP Diastolic", "Blood Sugar", "Temperature"
+};
+
+static const char *metric_units[ANALYSIS_METRICS] = {
+    "cm", "kg", "mmHg", "mmHg", "mg/dL", "°C"
+};
+
+// Recent rows of the scan, for the lagged correlations
+typedef struct {
+    int day[LAG_RING_SIZE];
+    double values[LAG_RING_SIZE][ANALYSIS_METRICS];
+    int next;
+    int count;
+} LagRing;
+
+void comoments_add(CoMoments *moments, const double *values) {
+    double delta[ANALYSIS_VARIABLES];
+
+    moments->count++;
+    for (int a = 0; a < ANALYSIS_VARIABLES; a++) {
+        delta[a] = values[a] - moments->mean[a];
+        moments->mean[a] += delta[a] / moments->count;
+    }
+    for (int a = 0; a < ANALYSIS_VARIABLES; a++) {
+        for (int b = 0; b < ANALYSIS_VARIABLES; b++) {
+            moments->comoment[a][b] += delta[a] * (values[b] - moments->mean[b]);
+        }
+    }
+}
+
+// Chan et al. pairwise combination, as for MetricMoments
+void comoments_merge(CoMoments *into, const CoMoments *from) {
+    if (from->count == 0) return;
+    if (into->count == 0) {
+        *into = *from;
+        return;
+    }
+
+    long long count = into->count + from->count;
+    double weight = (double)into->count * from->count / count;
+    double delta[ANALYSIS_VARIABLES];
+    for (int a = 0; a < ANALYSIS_VARIABLES; a++) {
+        delta[a] = from->mean[a] - into->mean[a];
+    }
+    for (int a = 0; a < ANALYSIS_VARIABLES; a++) {
+        for (int b = 0; b < ANALYSIS_VARIABLES; b++) {
+            into->comoment[a][b] += from->comoment[a][b] + delta[a] * delta[b] * weight;
+        }
+        into->mean[a] += delta[a] * from->count / count;
+    }
+    into->count = count;
+}
+
+// Pearson correlation of variables a and b; NAN when either one is constant
+double comoments_correlation(const CoMoments *moments, int a, int b) {
+    double denominator = sqrt(moments->comoment[a][a] * moments->comoment[b][b]);
+    if (moments->count < 3 || denominator <= 0) return NAN;
+    return moments->comoment[a][b] / denominator;
+}
+
+// Least-squares slope of y against x
+double comoments_slope(const CoMoments *moments, int x, int y) {
+    if (moments->count < 2 || moments->comoment[x][x] <= 0) return NAN;
+    return moments->comoment[x][y] / moments->comoment[x][x];
+}
+
+void pair_moments_add(PairMoments *moments, double x, double y) {
+    moments->count++;
+    double delta_x = x - moments->mean_x;
+    double delta_y = y - moments->mean_y;
+    moments->mean_x += delta_x / moments->count;
+    moments->mean_y += delta_y / moments->count;
+    moments->m2_x += delta_x * (x - moments->mean_x);
+    moments->m2_y += delta_y * (y - moments->mean_y);
+    moments->c_xy += delta_x * (y - moments->mean_y);
+}
+
+double pair_moments_correlation(const PairMoments *moments) {
+    double denominator = sqrt(moments->m2_x * moments->m2_y);
+    if (moments->count < 3 || denominator <= 0) return NAN;
+    return moments->c_xy / denominator;
+}
+
+// Pairs the current row with every recent row 1..ANALYSIS_MAX_LAG days before it
+static void add_lagged_pairs(CorrelationResult *result, LagRing *ring, int day, const double *values) {
+    for (int r = 0; r < ring->count; r++) {
+        int lag = day - ring->day[r];
+        if (lag < 1 || lag > ANALYSIS_MAX_LAG) continue;
+
+        for (int a = 0; a < ANALYSIS_METRICS; a++) {
+            for (int b = 0; b < ANALYSIS_METRICS; b++) {
+                pair_moments_add(&result->lagged[lag - 1][a][b], ring->values[r][a], values[b]);
+            }
+        }
+    }
+
+    ring->day[ring->next] = day;
+    memcpy(ring->values[ring->next], values, sizeof(ring->values[0]));
+    ring->next = (ring->next + 1) % LAG_RING_SIZE;
+    if (ring->count < LAG_RING_SIZE) ring->count++;
+}
+
+// Correlations, trends and lagged correlations over [start_day, end_day] of the
+// segment store. Pearson correlations, trend slopes and lagged pairs come from one
+// scan; a second scan turns values into ranks through per-metric digests built in
+// the first one, which gives approximate Spearman correlations.
+// Lagged pairs are only formed between rows close together in input.txt, which
+// after compaction is every pair of readings up to ANALYSIS_MAX_LAG days apart.
+// Returns the number of readings in the range.
+int run_correlation_analysis(int start_day, int end_day, CorrelationResult *result) {
+    PERF_START(perf);
+    memset(result, 0, sizeof(CorrelationResult));
+    if (!refresh_segment_store()) return 0;
+
+    SegmentBlock *block = malloc(sizeof(SegmentBlock));
+    LagRing *ring = calloc(1, sizeof(LagRing));
+    TDigest *digests = malloc(ANALYSIS_METRICS * sizeof(TDigest));
+    if (!block || !ring || !digests) {
+        free(block);
+        free(ring);
+        free(digests);
+        return 0;
+    }
+    for (int m = 0; m < ANALYSIS_METRICS; m++) {
+        tdigest_init(&digests[m]);
+    }
+
+    // Both passes read the same snapshot, so the ranks match the digests
+    const SegmentSnapshot *snapshot = acquire_segment_snapshot();
+    int blocks = get_segment_block_count(snapshot);
+    for (int b = 0; b < blocks; b++) {
+        if (get_segment_block_overlap(snapshot, b, start_day, end_day) == BLOCK_OUTSIDE) continue;
+        int rows = read_segment_block(snapshot, b, block);
+        for (int i = 0; i < rows; i++) {
+            int day = block->values[SEGMENT_DATE][i];
+            if (day < start_day || day > end_day) continue;
+
+            double values[ANALYSIS_VARIABLES];
+            for (int c = 0; c < ANALYSIS_VARIABLES; c++) {
+                values[c] = segment_value(c, block->values[c][i]);
+            }
+            comoments_add(&result->values, values);
+            add_lagged_pairs(result, ring, day, values + 1);
+            for (int m = 0; m < ANALYSIS_METRICS; m++) {
+                tdigest_add(&digests[m], values[m + 1]);
+            }
+        }
+    }
+    PERF_LAP(perf, "correlation.scan");
+
+    if (result->values.count > 0) {
+        for (int b = 0; b < blocks; b++) {
+            if (get_segment_block_overlap(snapshot, b, start_day, end_day) == BLOCK_OUTSIDE) continue;
+            int rows = read_segment_block(snapshot, b, block);
+            for (int i = 0; i < rows; i++) {
+                int day = block->values[SEGMENT_DATE][i];
+                if (day < start_day || day > end_day) continue;
+
+                double ranks[ANALYSIS_VARIABLES];
+                ranks[SEGMENT_DATE] = day;
+                for (int m = 0; m < ANALYSIS_METRICS; m++) {
+                    ranks[m + 1] = tdigest_cdf(&digests[m], segment_value(m + 1, block->values[m + 1][i]));
+                }
+                comoments_add(&result->ranks, ranks);
+            }
+        }
+    }
+    release_segment_snapshot(snapshot);
+    PERF_LAP(perf, "correlation.rank");
+
+    free(block);
+    free(ring);
+    free(digests);
+    return (int)result->values.count;
+}
+
+static void format_correlation(char *text, size_t size, double r) {
+    if (isnan(r))
+        snprintf(text, size, "N/A");
+    else
+        snprintf(text, size, "%.2f", r);
+}
+
+typedef struct {
+    int a;
+    int b;
+    double pearson;
+} MetricPair;
+
+// Strongest correlations first; undefined ones (a constant metric) last
+static int compare_pairs(const void *x, const void *y) {
+    const MetricPair *pair_x = x, *pair_y = y;
+    double strength_x = isnan(pair_x->pearson) ? -1 : fabs(pair_x->pearson);
+    double strength_y = isnan(pair_y->pearson) ? -1 : fabs(pair_y->pearson);
+    return (strength_x < strength_y) - (strength_x > strength_y);
+}
+
+int get_correlation_table_data(int start_day, int end_day, CorrelationTableData **data) {
+    CorrelationResult *result = malloc(sizeof(CorrelationResult));
+    if (!result) return 0;
+    if (run_correlation_analysis(start_day, end_day, result) == 0) {
+        free(result);
+        return 0;
+    }
+
+    PERF_START(perf);
+    int pair_count = ANALYSIS_METRICS * (ANALYSIS_METRICS - 1) / 2;
+    *data = malloc((pair_count + ANALYSIS_METRICS) * sizeof(CorrelationTableData));
+    if (!*data) {
+        free(result);
+        return 0;
+    }
+
+    MetricPair pairs[ANALYSIS_METRICS * (ANALYSIS_METRICS - 1) / 2];
+    int p = 0;
+    for (int a = 0; a < ANALYSIS_METRICS; a++) {
+        for (int b = a + 1; b < ANALYSIS_METRICS; b++) {
+            pairs[p].a = a;
+            pairs[p].b = b;
+            pairs[p].pearson = comoments_correlation(&result->values, a + 1, b + 1);
+            p++;
+        }
+    }
+    qsort(pairs, pair_count, sizeof(MetricPair), compare_pairs);
+
+    int row = 0;
+    for (p = 0; p < pair_count; p++) {
+        int a = pairs[p].a, b = pairs[p].b;
+        CorrelationTableData *out = &(*data)[row++];
+        char pearson[20], spearman[20], lagged[20];
+
+        snprintf(out->measure, sizeof(out->measure), "%s vs %s", metric_names[a], metric_names[b]);
+        format_correlation(pearson, sizeof(pearson), pairs[p].pearson);
+        snprintf(out->value, sizeof(out->value), "r = %s", pearson);
+
+        // Strongest lag in either direction: +n means b follows a by n days
+        int best_lag = 0;
+        double best = NAN;
+        for (int lag = 1; lag <= ANALYSIS_MAX_LAG; lag++) {
+            double forward = pair_moments_correlation(&result->lagged[lag - 1][a][b]);
+            double backward = pair_moments_correlation(&result->lagged[lag - 1][b][a]);
+            if (!isnan(forward) && (isnan(best) || fabs(forward) > fabs(best))) {
+                best = forward;
+                best_lag = lag;
+            }
+            if (!isnan(backward) && (isnan(best) || fabs(backward) > fabs(best))) {
+                best = backward;
+                best_lag = -lag;
+            }
+        }
+
+        format_correlation(spearman, sizeof(spearman), comoments_correlation(&result->ranks, a + 1, b + 1));
+        if (isnan(best)) {
+            snprintf(out->detail, sizeof(out->detail), "Spearman %s, lagged N/A", spearman);
+        } else {
+            format_correlation(lagged, sizeof(lagged), best);
+            snprintf(out->detail, sizeof(out->detail), "Spearman %s, strongest lag %+d d (r %s)",
+                     spearman, best_lag, lagged);
+        }
+    }
+
+    for (int m = 0; m < ANALYSIS_METRICS; m++) {
+        CorrelationTableData *out = &(*data)[row++];
+        double slope = comoments_slope(&result->values, SEGMENT_DATE, m + 1);
+        char trend[20];
+
+        snprintf(out->measure, sizeof(out->measure), "Trend of %s", metric_names[m]);
+        if (isnan(slope))
+            snprintf(out->value, sizeof(out->value), "N/A");
+        else
+            snprintf(out->value, sizeof(out->value), "%+.2f %s / 30 days", slope * 30, metric_units[m]);
+        format_correlation(trend, sizeof(trend), comoments_correlation(&result->values, SEGMENT_DATE, m + 1));
+        snprintf(out->detail, sizeof(out->detail), "r with time %s over %lld readings", trend, result->values.count);
+    }
+    PERF_LAP(perf, "correlation.format");
+
+    free(result);
+    return row;
+}
@@ -0,0 +1,55 @@
+#ifndef HEALTH_ANALYSIS_H
+#define HEALTH_ANALYSIS_H
+
+#include "health_logic.h"
+#include "health_segment.h"
+
+// Variables of the co-moment matrix: the day number followed by the six metrics,
+// in segment column order
+#define ANALYSIS_VARIABLES SEGMENT_COLUMNS
+#define ANALYSIS_METRICS (SEGMENT_COLUMNS - 1)
+// Lagged correlations pair readings 1..ANALYSIS_MAX_LAG days apart
+#define ANALYSIS_MAX_LAG 7
+
+// Count, means and co-moments (sums of products of deviations) of a vector of
+// variables; like MetricMoments, two of these merge exactly
+typedef struct {
+    long long count;
+    double mean[ANALYSIS_VARIABLES];
+    double comoment[ANALYSIS_VARIABLES][ANALYSIS_VARIABLES];
+} CoMoments;
+
+// Co-moments of one pair of variables
+typedef struct {
+    long long count;
+    double mean_x;
+    double mean_y;
+    double m2_x;
+    double m2_y;
+    double c_xy;
+} PairMoments;
+
+typedef struct {
+    CoMoments values;                    // Pearson correlations and trend slopes
+    CoMoments ranks;                     // Spearman correlations (digest ranks)
+    // lagged[lag - 1][a][b]: metric a on one day against metric b `lag` days later
+    PairMoments lagged[ANALYSIS_MAX_LAG][ANALYSIS_METRICS][ANALYSIS_METRICS];
+} CorrelationResult;
+
+typedef struct {
+    char measure[60];
+    char value[30];
+    char detail[100];
+} CorrelationTableData;
+
+// Function declarations for correlation and trend analysis
+void comoments_add(CoMoments *moments, const double *values);
+void comoments_merge(CoMoments *into, const CoMoments *from);
+double comoments_correlation(const CoMoments *moments, int a, int b);
+double comoments_slope(const CoMoments *moments, int x, int y);
+void pair_moments_add(PairMoments *moments, double x, double y);
+double pair_moments_correlation(const PairMoments *moments);
+int run_correlation_analysis(int start_day, int end_day, CorrelationResult *result);
+int get_correlation_table_data(int start_day, int end_day, CorrelationTableData **data);
+
+#endif // HEALTH_ANALYSIS_H
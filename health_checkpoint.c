@@ -0,0 +1,143 @@
+#include "health_checkpoint.h"
+#include "health_series.h"
+#include "health_segment.h"
+#include "health_perf.h"
+
+// Start of a checkpoint file. The layout sizes make a checkpoint written by a
+// differently built program (other struct sizes) fail validation.
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t layout[4];
+    int64_t offset;           // bytes of input.txt the checkpoint covers
+    uint64_t fingerprint;     // data_file_fingerprint of those bytes
+    DataFileIdentity identity;  // input.txt when the checkpoint was saved
+} CheckpointHeader;
+
+static void fill_header(CheckpointHeader *header, long offset, uint64_t fingerprint) {
+    memset(header, 0, sizeof(CheckpointHeader));
+    memcpy(header->magic, CHECKPOINT_MAGIC, 4);
+    header->version = CHECKPOINT_VERSION;
+    header->layout[0] = sizeof(HealthData);
+    header->layout[1] = sizeof(TDigest);
+    header->layout[2] = sizeof(Segment);
+    header->layout[3] = SEGMENT_ROWS;
+    header->offset = offset;
+    header->fingerprint = fingerprint;
+}
+
+static uint64_t fnv1a(uint64_t hash, const unsigned char *bytes, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Hash of the first `length` bytes of a data file, every one of them. Appends do
+// not change it; any edit inside those bytes does.
+uint64_t data_file_fingerprint(FILE *file, long length) {
+    uint64_t hash = 14695981039346656037ULL;
+    int64_t length_bytes = length;
+    hash = fnv1a(hash, (const unsigned char*)&length_bytes, sizeof(length_bytes));
+
+    unsigned char *buffer = malloc(CHECKPOINT_HASH_BUFFER);
+    if (!buffer) return 0;
+    fseek(file, 0, SEEK_SET);
+    long left = length;
+    while (left > 0) {
+        size_t want = left < CHECKPOINT_HASH_BUFFER ? (size_t)left : CHECKPOINT_HASH_BUFFER;
+        size_t read = fread(buffer, 1, want, file);
+        if (read == 0) break;
+        hash = fnv1a(hash, buffer, read);
+        left -= (long)read;
+    }
+    free(buffer);
+    return hash;
+}
+
+// Writes the series and the segment store, both up to date with input.txt, to
+// CHECKPOINT_FILE. The file is built next to the old one and swapped in with a
+// rename. Returns 0 if nothing was written.
+int save_health_checkpoint(void) {
+    PERF_START(perf);
+    refresh_health_series();
+
+    FILE *file = fopen(CHECKPOINT_FILE ".tmp", "wb");
+    if (!file) return 0;
+
+    CheckpointHeader header;
+    fill_header(&header, 0, 0);
+    long series_offset = 0, segment_offset = 0;
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             save_series_checkpoint(file, &series_offset) &&
+             save_segment_checkpoint(file, &segment_offset) &&
+             fwrite(CHECKPOINT_MAGIC, 1, 4, file) == 4;
+
+    // Both parts must cover the same bytes; they differ if input.txt grew in between
+    FILE *data = ok && series_offset == segment_offset ? fopen("input.txt", "rb") : NULL;
+    if (data) {
+        fill_header(&header, series_offset, data_file_fingerprint(data, series_offset));
+        ok = read_data_file_identity(data, &header.identity);
+        fclose(data);
+        ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    } else {
+        ok = 0;
+    }
+
+    ok = fclose(file) == 0 && ok;
+    if (!ok || !replace_file(CHECKPOINT_FILE ".tmp", CHECKPOINT_FILE)) {
+        remove(CHECKPOINT_FILE ".tmp");
+        return 0;
+    }
+    PERF_LAP(perf, "checkpoint.save");
+    return 1;
+}
+
+// Restores the series and the segment store from CHECKPOINT_FILE if it was built
+// from the current input.txt (or a prefix of it), then reads only the rows appended
+// since. The file must be the same one (device and inode) the checkpoint was saved
+// from; if its size or modification time has moved since, the covered bytes are
+// hashed again in full. A missing, damaged or stale checkpoint is ignored and
+// everything is built from input.txt on first use, as without one. Returns 1 if
+// the checkpoint was used.
+int load_health_checkpoint(void) {
+    PERF_START(perf);
+    FILE *file = fopen(CHECKPOINT_FILE, "rb");
+    if (!file) return 0;
+
+    CheckpointHeader header, expected;
+    int ok = fread(&header, sizeof(header), 1, file) == 1;
+    fill_header(&expected, ok ? (long)header.offset : 0, ok ? header.fingerprint : 0);
+    if (ok) expected.identity = header.identity;
+    ok = ok && memcmp(&header, &expected, sizeof(header)) == 0;
+
+    FILE *data = ok ? fopen("input.txt", "rb") : NULL;
+    if (data) {
+        DataFileIdentity identity;
+        ok = read_data_file_identity(data, &identity) && identity.size >= header.offset &&
+             identity.device == header.identity.device && identity.inode == header.identity.inode;
+        int untouched = identity.size == header.identity.size && identity.mtime_ns == header.identity.mtime_ns;
+        ok = ok && (untouched || data_file_fingerprint(data, (long)header.offset) == header.fingerprint);
+        fclose(data);
+    } else {
+        ok = 0;
+    }
+    PERF_LAP(perf, "checkpoint.validate");
+
+    char magic[4];
+    ok = ok && load_series_checkpoint(file, (long)header.offset) &&
+         load_segment_checkpoint(file, (long)header.offset) &&
+         fread(magic, 1, 4, file) == 4 && memcmp(magic, CHECKPOINT_MAGIC, 4) == 0;
+    fclose(file);
+    if (!ok) {
+        invalidate_health_series();
+        invalidate_segment_store();
+        return 0;
+    }
+    PERF_LAP(perf, "checkpoint.load");
+
+    refresh_health_series();
+    refresh_segment_store();
+    PERF_LAP(perf, "checkpoint.replay");
+    return 1;
+}
@@ -0,0 +1,20 @@
+#ifndef HEALTH_CHECKPOINT_H
+#define HEALTH_CHECKPOINT_H
+
+#include <stdint.h>
+#include "health_logic.h"
+
+// Sidecar file holding the series and the segment store built from input.txt
+#define CHECKPOINT_FILE "input.txt.ckpt"
+#define CHECKPOINT_MAGIC "HCKP"
+// Bump whenever the layout of a checkpoint section changes
+#define CHECKPOINT_VERSION 5
+// Bytes of input.txt read at a time while hashing it
+#define CHECKPOINT_HASH_BUFFER 65536
+
+// Function declarations for checkpoints of the derived state
+uint64_t data_file_fingerprint(FILE *file, long length);
+int save_health_checkpoint(void);
+int load_health_checkpoint(void);
+
+#endif // HEALTH_CHECKPOINT_H
@@ -0,0 +1,473 @@
+#include "health_cohort.h"
+#include "health_perf.h"
+#include <dirent.h>
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// Tasks owned by one worker. The owner pops the newest task from the bottom and
+// idle workers steal the oldest one from the top.
+typedef struct {
+    int *tasks;
+    int top;
+    int bottom;
+    pthread_mutex_t lock;
+} TaskDeque;
+
+typedef struct CohortRun CohortRun;
+
+typedef struct {
+    CohortRun *run;
+    int id;
+    pthread_t thread;
+    CohortResult partial;
+} CohortWorker;
+
+struct CohortRun {
+    char **paths;
+    int start_day;
+    int end_day;
+    TaskDeque *deques;
+    CohortWorker *workers;
+    int worker_count;
+};
+
+static const char *metric_names[COHORT_METRICS] = {
+    "Height (cm)", "Weight (kg)", "BP Systolic (mmHg)",
+    "BP Diastolic (mmHg)", "Blood Sugar (mg/dL)", "Temperature (°C)"
+};
+
+static const char *abnormal_names[COHORT_ABNORMAL_KINDS] = {
+    "Weight", "BP", "Sugar", "Temperature"
+};
+
+void moments_add(MetricMoments *moments, double value) {
+    if (moments->count == 0) {
+        moments->min = value;
+        moments->max = value;
+    }
+    if (value < moments->min) moments->min = value;
+    if (value > moments->max) moments->max = value;
+
+    moments->count++;
+    double delta = value - moments->mean;
+    moments->mean += delta / moments->count;
+    moments->m2 += delta * (value - moments->mean);
+}
+
+// Chan et al. pairwise combination of two sets of moments
+void moments_merge(MetricMoments *into, const MetricMoments *from) {
+    if (from->count == 0) return;
+    if (into->count == 0) {
+        *into = *from;
+        return;
+    }
+
+    long long count = into->count + from->count;
+    double delta = from->mean - into->mean;
+    into->mean += delta * from->count / count;
+    into->m2 += from->m2 + delta * delta * ((double)into->count * from->count / count);
+    into->count = count;
+    if (from->min < into->min) into->min = from->min;
+    if (from->max > into->max) into->max = from->max;
+}
+
+void cohort_result_merge(CohortResult *into, const CohortResult *from) {
+    into->patients += from->patients;
+    into->patients_with_data += from->patients_with_data;
+    into->readings += from->readings;
+    into->malformed_rows += from->malformed_rows;
+
+    for (int k = 0; k < COHORT_ABNORMAL_KINDS; k++) {
+        into->patients_abnormal[k] += from->patients_abnormal[k];
+        into->abnormal_days[k] += from->abnormal_days[k];
+    }
+    for (int m = 0; m < COHORT_METRICS; m++) {
+        moments_merge(&into->metrics[m], &from->metrics[m]);
+    }
+    moments_merge(&into->patient_mean_sugar, &from->patient_mean_sugar);
+    histogram_merge(&into->patient_mean_sugar_histogram, &from->patient_mean_sugar_histogram);
+    for (int m = 0; m < 3; m++) {
+        tdigest_merge(&into->quantiles[m], &from->quantiles[m]);
+    }
+}
+
+static void init_cohort_result(CohortResult *result) {
+    memset(result, 0, sizeof(CohortResult));
+    histogram_init(&result->patient_mean_sugar_histogram, COHORT_SUGAR_BIN_START, COHORT_SUGAR_BIN_WIDTH);
+    for (int m = 0; m < 3; m++) {
+        tdigest_init(&result->quantiles[m]);
+    }
+}
+
+// One reading of a patient file, with its position in the file
+typedef struct {
+    int day;
+    int line;
+    double values[COHORT_METRICS];
+} PatientReading;
+
+static int compare_patient_readings(const void *a, const void *b) {
+    const PatientReading *x = a, *y = b;
+    if (x->day != y->day) return x->day < y->day ? -1 : 1;
+    return x->line < y->line ? -1 : x->line > y->line;
+}
+
+// Reads a patient's readings in [start_day, end_day], one per date: like input.txt
+// for a single patient, a later row for a date replaces the earlier ones. Counts
+// lines that do not parse in `malformed`. Returns the number of readings (sorted
+// by date; free *readings), or -1 if the file cannot be opened or read.
+static int read_patient_readings(const char *path, int start_day, int end_day,
+                                 PatientReading **readings, long long *malformed) {
+    FILE *file = fopen(path, "r");
+    *readings = NULL;
+    if (!file) {
+        return -1;
+    }
+
+    LineBuffer line = {0};
+    HealthRow row;
+    int count = 0, capacity = 0, lines = 0, ok = 1;
+
+    while (ok && read_line(file, &line)) {
+        lines++;
+        RowResult parsed = parse_health_row(line.text, line.length, &row);
+        if (parsed != ROW_OK) {
+            *malformed += parsed != ROW_BLANK;
+            continue;
+        }
+        if (row.day < start_day || row.day > end_day)
+            continue;
+
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            PatientReading *grown = realloc(*readings, capacity * sizeof(PatientReading));
+            if (!grown) {
+                ok = 0;
+                break;
+            }
+            *readings = grown;
+        }
+        PatientReading *reading = &(*readings)[count++];
+        reading->day = row.day;
+        reading->line = lines;
+        memcpy(reading->values, row.values, sizeof(reading->values));
+    }
+    free_line(&line);
+    fclose(file);
+    if (!ok) {
+        free(*readings);
+        *readings = NULL;
+        return -1;
+    }
+
+    // Sorted by date and then file order, the last reading of each date wins
+    qsort(*readings, count, sizeof(PatientReading), compare_patient_readings);
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        if (kept > 0 && (*readings)[kept - 1].day == (*readings)[i].day) kept--;
+        (*readings)[kept++] = (*readings)[i];
+    }
+    return kept;
+}
+
+// Fold one patient's readings in [start_day, end_day] into a partial result
+static void scan_patient_file(const char *path, int start_day, int end_day,
+                              CohortResult *partial) {
+    PatientReading *readings;
+    partial->patients++;
+    int count = read_patient_readings(path, start_day, end_day, &readings, &partial->malformed_rows);
+    if (count <= 0) {
+        free(readings);
+        return;
+    }
+
+    long long abnormal[COHORT_ABNORMAL_KINDS] = {0, 0, 0, 0};
+    double sugar_sum = 0;
+
+    for (int i = 0; i < count; i++) {
+        // Cohort metric order is the column order of input.txt
+        const double *values = readings[i].values;
+        for (int m = 0; m < COHORT_METRICS; m++) {
+            moments_add(&partial->metrics[m], values[m]);
+        }
+        tdigest_add(&partial->quantiles[0], values[COHORT_BP_SYS]);
+        tdigest_add(&partial->quantiles[1], values[COHORT_BP_DIA]);
+        tdigest_add(&partial->quantiles[2], values[COHORT_SUGAR]);
+
+        count_reading_abnormalities(values, abnormal);
+        sugar_sum += values[COHORT_SUGAR];
+    }
+    free(readings);
+
+    partial->patients_with_data++;
+    partial->readings += count;
+    for (int k = 0; k < COHORT_ABNORMAL_KINDS; k++) {
+        partial->abnormal_days[k] += abnormal[k];
+        if (abnormal[k] > 0) partial->patients_abnormal[k]++;
+    }
+
+    double mean_sugar = sugar_sum / count;
+    moments_add(&partial->patient_mean_sugar, mean_sugar);
+    histogram_add(&partial->patient_mean_sugar_histogram, mean_sugar);
+}
+
+// Counts one patient's abnormal readings in [start_day, end_day] per category,
+// one reading per date. Returns the number of readings in range, or -1 if the
+// file cannot be read.
+int scan_patient_abnormalities(const char *path, int start_day, int end_day,
+                               long long abnormal[COHORT_ABNORMAL_KINDS]) {
+    PatientReading *readings;
+    long long malformed = 0;
+    memset(abnormal, 0, COHORT_ABNORMAL_KINDS * sizeof(long long));
+    int count = read_patient_readings(path, start_day, end_day, &readings, &malformed);
+
+    for (int i = 0; i < count; i++) {
+        count_reading_abnormalities(readings[i].values, abnormal);
+    }
+    free(readings);
+    return count;
+}
+
+static int pop_task(TaskDeque *deque, int *task) {
+    int found = 0;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->bottom > deque->top) {
+        *task = deque->tasks[--deque->bottom];
+        found = 1;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static int steal_task(TaskDeque *deque, int *task) {
+    int found = 0;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->bottom > deque->top) {
+        *task = deque->tasks[deque->top++];
+        found = 1;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static void* cohort_worker_main(void *arg) {
+    CohortWorker *worker = arg;
+    CohortRun *run = worker->run;
+    int task;
+
+    for (;;) {
+        if (!pop_task(&run->deques[worker->id], &task)) {
+            // Own deque is empty: try the others, starting with the next worker.
+            // No task creates new tasks, so once every deque is empty we are done.
+            int stolen = 0;
+            for (int i = 1; i < run->worker_count && !stolen; i++) {
+                stolen = steal_task(&run->deques[(worker->id + i) % run->worker_count], &task);
+            }
+            if (!stolen) break;
+        }
+        scan_patient_file(run->paths[task], run->start_day, run->end_day, &worker->partial);
+    }
+    return NULL;
+}
+
+static int get_cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+// Collects the patient files (*.txt) in a directory. The caller frees each path
+// and the array; returns -1 if the directory cannot be read.
+int list_patient_files(const char *directory, char ***paths) {
+    DIR *dir = opendir(directory);
+    if (!dir) {
+        return -1;
+    }
+
+    int count = 0, capacity = 0;
+    *paths = NULL;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if (length < 5 || strcmp(entry->d_name + length - 4, ".txt") != 0)
+            continue;
+
+        if (count == capacity) {
+            int new_capacity = capacity ? capacity * 2 : 256;
+            char **grown = realloc(*paths, new_capacity * sizeof(char*));
+            if (!grown) break;
+            *paths = grown;
+            capacity = new_capacity;
+        }
+
+        size_t size = strlen(directory) + length + 2;
+        char *path = malloc(size);
+        if (!path) break;
+        snprintf(path, size, "%s/%s", directory, entry->d_name);
+        (*paths)[count++] = path;
+    }
+    closedir(dir);
+    return count;
+}
+
+// Scans every patient file in `directory` on a work-stealing pool of `threads`
+// workers (0 means one per CPU). Each worker folds its patients into a private
+// partial result and the partials are merged at the end, so workers share nothing
+// but the task deques. Returns 0 if the directory cannot be read.
+int run_cohort_query(const char *directory, int start_day, int end_day,
+                     int threads, CohortResult *result) {
+    PERF_START(perf);
+    init_cohort_result(result);
+
+    char **paths;
+    int count = list_patient_files(directory, &paths);
+    if (count < 0) return 0;
+    PERF_LAP(perf, "cohort.list");
+
+    if (threads <= 0) threads = get_cpu_count();
+    if (threads > count) threads = count > 0 ? count : 1;
+
+    CohortRun run = { paths, start_day, end_day, NULL, NULL, threads };
+    run.deques = calloc(threads, sizeof(TaskDeque));
+    run.workers = calloc(threads, sizeof(CohortWorker));
+    int *tasks = malloc((count > 0 ? count : 1) * sizeof(int));
+    if (!run.deques || !run.workers || !tasks) {
+        free(run.deques);
+        free(run.workers);
+        free(tasks);
+        for (int i = 0; i < count; i++) free(paths[i]);
+        free(paths);
+        return 0;
+    }
+
+    // Deal the patients out in contiguous slices; stealing evens out the rest
+    for (int w = 0; w < threads; w++) {
+        int first = (int)((long long)count * w / threads);
+        int last = (int)((long long)count * (w + 1) / threads);
+        run.deques[w].tasks = tasks;
+        run.deques[w].top = first;
+        run.deques[w].bottom = last;
+        pthread_mutex_init(&run.deques[w].lock, NULL);
+        for (int t = first; t < last; t++) tasks[t] = t;
+
+        run.workers[w].run = &run;
+        run.workers[w].id = w;
+        init_cohort_result(&run.workers[w].partial);
+    }
+
+    // Worker 0 runs on the calling thread
+    for (int w = 1; w < threads; w++) {
+        if (pthread_create(&run.workers[w].thread, NULL, cohort_worker_main, &run.workers[w]) != 0) {
+            run.workers[w].id = -1;
+        }
+    }
+    cohort_worker_main(&run.workers[0]);
+
+    for (int w = 0; w < threads; w++) {
+        if (w > 0 && run.workers[w].id >= 0) pthread_join(run.workers[w].thread, NULL);
+        cohort_result_merge(result, &run.workers[w].partial);
+        pthread_mutex_destroy(&run.deques[w].lock);
+    }
+    PERF_LAP(perf, "cohort.scan");
+
+    free(run.deques);
+    free(run.workers);
+    free(tasks);
+    for (int i = 0; i < count; i++) free(paths[i]);
+    free(paths);
+    return 1;
+}
+
+static void add_cohort_row(CohortTableData *rows, int *row, const char *measure,
+                           const char *value, const char *detail) {
+    snprintf(rows[*row].measure, sizeof(rows[*row].measure), "%s", measure);
+    snprintf(rows[*row].value, sizeof(rows[*row].value), "%s", value);
+    snprintf(rows[*row].detail, sizeof(rows[*row].detail), "%s", detail);
+    (*row)++;
+}
+
+int get_cohort_table_data(const char *directory, int start_day, int end_day,
+                          CohortTableData **data) {
+    CohortResult result;
+    if (!run_cohort_query(directory, start_day, end_day, 0, &result) || result.patients_with_data == 0) {
+        return 0;
+    }
+
+    int max_rows = 4 + COHORT_ABNORMAL_KINDS + COHORT_METRICS + 3 + 1 + HISTOGRAM_BINS;
+    *data = malloc(max_rows * sizeof(CohortTableData));
+    if (!*data) return 0;
+
+    int row = 0;
+    char value[30], detail[60], measure[60];
+
+    snprintf(value, sizeof(value), "%d", result.patients);
+    add_cohort_row(*data, &row, "Patients scanned", value, "");
+    snprintf(value, sizeof(value), "%d", result.patients_with_data);
+    add_cohort_row(*data, &row, "Patients with readings in range", value, "");
+    snprintf(value, sizeof(value), "%lld", result.readings);
+    add_cohort_row(*data, &row, "Readings", value, "");
+    if (result.malformed_rows > 0) {
+        snprintf(value, sizeof(value), "%lld", result.malformed_rows);
+        add_cohort_row(*data, &row, "Malformed rows skipped", value, "Wrong field count, date or number");
+    }
+
+    for (int k = 0; k < COHORT_ABNORMAL_KINDS; k++) {
+        snprintf(measure, sizeof(measure), "Patients with abnormal %s days", abnormal_names[k]);
+        snprintf(value, sizeof(value), "%d", result.patients_abnormal[k]);
+        snprintf(detail, sizeof(detail), "%.1f%% of patients, %lld days",
+                 100.0 * result.patients_abnormal[k] / result.patients_with_data, result.abnormal_days[k]);
+        add_cohort_row(*data, &row, measure, value, detail);
+    }
+
+    for (int m = 0; m < COHORT_METRICS; m++) {
+        const MetricMoments *moments = &result.metrics[m];
+        snprintf(measure, sizeof(measure), "Average %s", metric_names[m]);
+        snprintf(value, sizeof(value), "%.1f", moments->mean);
+        snprintf(detail, sizeof(detail), "SD %.1f, range %.1f - %.1f",
+                 sqrt(moments->m2 / moments->count), moments->min, moments->max);
+        add_cohort_row(*data, &row, measure, value, detail);
+    }
+
+    static const char *quantile_names[3] = { "BP Systolic (mmHg)", "BP Diastolic (mmHg)", "Blood Sugar (mg/dL)" };
+    for (int m = 0; m < 3; m++) {
+        snprintf(measure, sizeof(measure), "Median %s", quantile_names[m]);
+        snprintf(value, sizeof(value), "%.1f", tdigest_quantile(&result.quantiles[m], 0.5));
+        snprintf(detail, sizeof(detail), "p90 %.1f, p99 %.1f",
+                 tdigest_quantile(&result.quantiles[m], 0.9), tdigest_quantile(&result.quantiles[m], 0.99));
+        add_cohort_row(*data, &row, measure, value, detail);
+    }
+
+    snprintf(value, sizeof(value), "%.1f", result.patient_mean_sugar.mean);
+    snprintf(detail, sizeof(detail), "SD %.1f across patients",
+             sqrt(result.patient_mean_sugar.m2 / result.patient_mean_sugar.count));
+    add_cohort_row(*data, &row, "Per-patient average sugar", value, detail);
+
+    const MetricHistogram *histogram = &result.patient_mean_sugar_histogram;
+    for (int b = 0; b < HISTOGRAM_BINS; b++) {
+        if (histogram->bins[b] == 0) continue;
+
+        double low = histogram->start + b * histogram->width;
+        if (b == 0)
+            snprintf(measure, sizeof(measure), "  Average sugar below %.0f", low + histogram->width);
+        else if (b == HISTOGRAM_BINS - 1)
+            snprintf(measure, sizeof(measure), "  Average sugar %.0f and above", low);
+        else
+            snprintf(measure, sizeof(measure), "  Average sugar %.0f - %.0f", low, low + histogram->width);
+        snprintf(value, sizeof(value), "%lld", histogram->bins[b]);
+        snprintf(detail, sizeof(detail), "%.1f%% of patients",
+                 100.0 * histogram->bins[b] / result.patients_with_data);
+        add_cohort_row(*data, &row, measure, value, detail);
+    }
+
+    return row;
+}
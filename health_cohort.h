@@ -0,0 +1,72 @@
+#ifndef HEALTH_COHORT_H
+#define HEALTH_COHORT_H
+
+#include "health_logic.h"
+#include "health_sketch.h"
+
+// Per-patient average sugar histogram: 10 mg/dL bins from 50, clamped at both ends
+#define COHORT_SUGAR_BIN_START 50.0
+#define COHORT_SUGAR_BIN_WIDTH 10.0
+
+// Metric order used by the cohort aggregates
+enum {
+    COHORT_HEIGHT,
+    COHORT_WEIGHT,
+    COHORT_BP_SYS,
+    COHORT_BP_DIA,
+    COHORT_SUGAR,
+    COHORT_TEMP,
+    COHORT_METRICS
+};
+
+// Abnormality categories, as counted by count_reading_abnormalities
+enum {
+    COHORT_ABNORMAL_WEIGHT = ABNORMAL_WEIGHT,
+    COHORT_ABNORMAL_BP = ABNORMAL_BP,
+    COHORT_ABNORMAL_SUGAR = ABNORMAL_SUGAR,
+    COHORT_ABNORMAL_TEMP = ABNORMAL_TEMP,
+    COHORT_ABNORMAL_KINDS = ABNORMAL_KINDS
+};
+
+// Count, mean and sum of squared deviations; two of these merge exactly
+typedef struct {
+    long long count;
+    double mean;
+    double m2;
+    double min;
+    double max;
+} MetricMoments;
+
+// Mergeable partial result of a cohort query
+typedef struct {
+    int patients;
+    int patients_with_data;
+    int patients_abnormal[COHORT_ABNORMAL_KINDS];
+    long long readings;
+    long long malformed_rows;   // lines that did not parse (blank lines excluded)
+    long long abnormal_days[COHORT_ABNORMAL_KINDS];
+    MetricMoments metrics[COHORT_METRICS];
+    MetricMoments patient_mean_sugar;
+    MetricHistogram patient_mean_sugar_histogram;
+    TDigest quantiles[3];   // systolic, diastolic and sugar readings
+} CohortResult;
+
+typedef struct {
+    char measure[60];
+    char value[30];
+    char detail[60];
+} CohortTableData;
+
+// Function declarations for cohort-wide queries over a directory of patient files
+void moments_add(MetricMoments *moments, double value);
+void moments_merge(MetricMoments *into, const MetricMoments *from);
+void cohort_result_merge(CohortResult *into, const CohortResult *from);
+int list_patient_files(const char *directory, char ***paths);
+int scan_patient_abnormalities(const char *path, int start_day, int end_day,
+                               long long abnormal[COHORT_ABNORMAL_KINDS]);
+int run_cohort_query(const char *directory, int start_day, int end_day,
+                     int threads, CohortResult *result);
+int get_cohort_table_data(const char *directory, int start_day, int end_day,
+                          CohortTableData **data);
+
+#endif // HEALTH_COHORT_H
@@ -0,0 +1,165 @@
+#include "health_epoch.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+
+// One reading thread: the global epoch when its outermost read section began, or 0
+// while it is not reading. Slots sit on their own cache lines so readers on
+// different cores do not slow each other down.
+typedef struct {
+    _Alignas(64) _Atomic unsigned long epoch;
+    atomic_int in_use;
+    int depth;   // nesting of read sections; only touched by the owning thread
+} ReaderSlot;
+
+typedef struct RetiredItem {
+    void *item;
+    void (*release)(void *item);
+    unsigned long epoch;
+    struct RetiredItem *next;
+} RetiredItem;
+
+static ReaderSlot reader_slots[EPOCH_MAX_READERS];
+// Read sections of threads that found no free slot; nothing is reclaimed while any is open
+static atomic_int overflow_readers = 0;
+static char overflow_marker;
+static _Atomic unsigned long global_epoch = 1;
+
+static RetiredItem *retired = NULL;
+static pthread_mutex_t retired_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_key_t slot_key;
+static pthread_once_t slot_key_once = PTHREAD_ONCE_INIT;
+
+// Gives the slot back when its thread exits
+static void release_slot(void *value) {
+    if (value != &overflow_marker) atomic_store(&((ReaderSlot *)value)->in_use, 0);
+}
+
+static void create_slot_key(void) {
+    pthread_key_create(&slot_key, release_slot);
+}
+
+// The calling thread's slot, claimed on first use; NULL for a thread that found
+// them all taken, which then counts as an overflow reader for the rest of its life
+static ReaderSlot* get_reader_slot(void) {
+    pthread_once(&slot_key_once, create_slot_key);
+    void *value = pthread_getspecific(slot_key);
+    if (value) return value == &overflow_marker ? NULL : value;
+
+    for (int i = 0; i < EPOCH_MAX_READERS; i++) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&reader_slots[i].in_use, &expected, 1)) {
+            reader_slots[i].depth = 0;
+            pthread_setspecific(slot_key, &reader_slots[i]);
+            return &reader_slots[i];
+        }
+    }
+    pthread_setspecific(slot_key, &overflow_marker);
+    return NULL;
+}
+
+// Starts a read section. Whatever the reader loads from a published pointer after
+// this stays valid until the matching epoch_read_end.
+void epoch_read_begin(void) {
+    ReaderSlot *slot = get_reader_slot();
+    if (!slot) {
+        atomic_fetch_add(&overflow_readers, 1);
+        return;
+    }
+    if (slot->depth++ == 0) atomic_store(&slot->epoch, atomic_load(&global_epoch));
+}
+
+void epoch_read_end(void) {
+    ReaderSlot *slot = get_reader_slot();
+    if (!slot) {
+        atomic_fetch_sub(&overflow_readers, 1);
+        return;
+    }
+    if (--slot->depth == 0) atomic_store(&slot->epoch, 0);
+}
+
+// Oldest epoch any open read section started in; ULONG_MAX when none is open and
+// 0 while an overflow reader blocks everything
+static unsigned long oldest_reader_epoch(void) {
+    if (atomic_load(&overflow_readers) > 0) return 0;
+
+    unsigned long oldest = ULONG_MAX;
+    for (int i = 0; i < EPOCH_MAX_READERS; i++) {
+        unsigned long epoch = atomic_load(&reader_slots[i].epoch);
+        if (epoch != 0 && epoch < oldest) oldest = epoch;
+    }
+    return oldest;
+}
+
+// Releases retired items no open read section can still see. Returns how many.
+int epoch_reclaim(void) {
+    unsigned long oldest = oldest_reader_epoch();
+    RetiredItem *ready = NULL;
+
+    pthread_mutex_lock(&retired_lock);
+    RetiredItem **link = &retired;
+    while (*link) {
+        RetiredItem *entry = *link;
+        // Readers that started in the retiring epoch may have loaded the old pointer
+        if (entry->epoch < oldest) {
+            *link = entry->next;
+            entry->next = ready;
+            ready = entry;
+        } else {
+            link = &entry->next;
+        }
+    }
+    pthread_mutex_unlock(&retired_lock);
+
+    int released = 0;
+    while (ready) {
+        RetiredItem *entry = ready;
+        ready = entry->next;
+        entry->release(entry->item);
+        free(entry);
+        released++;
+    }
+    return released;
+}
+
+// Hands an item that was just unpublished to the reclaimer; `release` runs once
+// every read section that might hold it has ended. Safe from any thread, but not
+// from inside a read section if memory runs out (it then waits for the readers).
+void epoch_retire(void *item, void (*release)(void *item)) {
+    RetiredItem *entry = malloc(sizeof(RetiredItem));
+    if (!entry) {
+        epoch_synchronize();
+        release(item);
+        return;
+    }
+    entry->item = item;
+    entry->release = release;
+    entry->epoch = atomic_fetch_add(&global_epoch, 1);
+
+    pthread_mutex_lock(&retired_lock);
+    entry->next = retired;
+    retired = entry;
+    pthread_mutex_unlock(&retired_lock);
+
+    epoch_reclaim();
+}
+
+// Waits until every read section open at the call has ended. Never call it from
+// inside a read section.
+void epoch_synchronize(void) {
+    unsigned long epoch = atomic_fetch_add(&global_epoch, 1);
+    while (oldest_reader_epoch() <= epoch) {
+#ifdef _WIN32
+        Sleep(0);
+#else
+        sched_yield();
+#endif
+    }
+}
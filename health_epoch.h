@@ -0,0 +1,18 @@
+#ifndef HEALTH_EPOCH_H
+#define HEALTH_EPOCH_H
+
+// Threads that can be inside a read section at once with their own slot; further
+// readers still work but hold off all reclamation while they read
+#define EPOCH_MAX_READERS 128
+
+// Function declarations for epoch-based reclamation. Readers bracket every use of
+// published data with epoch_read_begin/epoch_read_end (sections may nest); writers
+// swap in a new version and hand the old one to epoch_retire, which releases it once
+// no read section that might have seen it is still open.
+void epoch_read_begin(void);
+void epoch_read_end(void);
+void epoch_retire(void *item, void (*release)(void *item));
+int epoch_reclaim(void);
+void epoch_synchronize(void);
+
+#endif // HEALTH_EPOCH_H
@@ -0,0 +1,569 @@
+#include "health_export.h"
+#include "health_segment.h"
+#include "health_cohort.h"
+#include "health_advice.h"
+#include "health_grid.h"
+#include "health_perf.h"
+
+// Bytes of one column chunk of the current row group
+typedef struct {
+    unsigned char *bytes;
+    size_t length;
+    size_t capacity;
+} ColumnChunk;
+
+struct ExportWriter {
+    FILE *file;
+    ExportFormat format;
+    const ExportColumn *columns;
+    int column_count;
+    long long rows;
+    int ok;
+    // Columnar format only
+    ColumnChunk *chunks;
+    int group_rows;
+    long long *group_offsets;
+    int group_count;
+    int group_capacity;
+};
+
+ExportFormat get_export_format(const char *path) {
+    const char *extension = strrchr(path, '.');
+    if (extension && strcmp(extension, ".json") == 0) return EXPORT_JSON;
+    if (extension && strcmp(extension, ".hcol") == 0) return EXPORT_COLUMNAR;
+    return EXPORT_CSV;
+}
+
+static void write_csv_text(FILE *file, const char *text) {
+    if (!strpbrk(text, ",\"\r\n")) {
+        fputs(text, file);
+        return;
+    }
+    fputc('"', file);
+    for (const char *c = text; *c; c++) {
+        if (*c == '"') fputc('"', file);
+        fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+static void write_json_text(FILE *file, const char *text) {
+    fputc('"', file);
+    for (const unsigned char *c = (const unsigned char*)text; *c; c++) {
+        if (*c == '"' || *c == '\\')
+            fprintf(file, "\\%c", *c);
+        else if (*c == '\n')
+            fputs("\\n", file);
+        else if (*c < 0x20)
+            fprintf(file, "\\u%04x", *c);
+        else
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+static int chunk_append(ColumnChunk *chunk, const void *bytes, size_t length) {
+    if (chunk->length + length > chunk->capacity) {
+        size_t new_capacity = chunk->capacity ? chunk->capacity * 2 : 4096;
+        while (new_capacity < chunk->length + length) new_capacity *= 2;
+        unsigned char *grown = realloc(chunk->bytes, new_capacity);
+        if (!grown) return 0;
+        chunk->bytes = grown;
+        chunk->capacity = new_capacity;
+    }
+    memcpy(chunk->bytes + chunk->length, bytes, length);
+    chunk->length += length;
+    return 1;
+}
+
+// Little-endian integers, whatever the host byte order
+static int chunk_append_uint(ColumnChunk *chunk, unsigned long long value, int size) {
+    unsigned char bytes[8];
+    for (int i = 0; i < size; i++) bytes[i] = (unsigned char)(value >> (8 * i));
+    return chunk_append(chunk, bytes, size);
+}
+
+static void write_uint(FILE *file, unsigned long long value, int size) {
+    for (int i = 0; i < size; i++) fputc((int)((value >> (8 * i)) & 0xff), file);
+}
+
+// Row group: uint32 row count, then per column a uint64 byte length and the chunk
+static int flush_row_group(ExportWriter *writer) {
+    if (writer->group_rows == 0) return 1;
+
+    if (writer->group_count == writer->group_capacity) {
+        int new_capacity = writer->group_capacity ? writer->group_capacity * 2 : 16;
+        long long *grown = realloc(writer->group_offsets, new_capacity * sizeof(long long));
+        if (!grown) return 0;
+        writer->group_offsets = grown;
+        writer->group_capacity = new_capacity;
+    }
+    writer->group_offsets[writer->group_count++] = ftell(writer->file);
+
+    write_uint(writer->file, writer->group_rows, 4);
+    for (int c = 0; c < writer->column_count; c++) {
+        ColumnChunk *chunk = &writer->chunks[c];
+        write_uint(writer->file, chunk->length, 8);
+        fwrite(chunk->bytes, 1, chunk->length, writer->file);
+        chunk->length = 0;
+    }
+    writer->group_rows = 0;
+    return !ferror(writer->file);
+}
+
+// Opens `path` and writes the header for the given columns. Rows are written as
+// they come; only the columnar format buffers, one row group at a time.
+ExportWriter* export_begin(const char *path, ExportFormat format, const ExportColumn *columns, int column_count) {
+    ExportWriter *writer = calloc(1, sizeof(ExportWriter));
+    if (!writer) return NULL;
+
+    writer->file = fopen(path, "wb");
+    writer->format = format;
+    writer->columns = columns;
+    writer->column_count = column_count;
+    writer->ok = 1;
+    if (format == EXPORT_COLUMNAR) writer->chunks = calloc(column_count, sizeof(ColumnChunk));
+    if (!writer->file || (format == EXPORT_COLUMNAR && !writer->chunks)) {
+        if (writer->file) fclose(writer->file);
+        free(writer->chunks);
+        free(writer);
+        return NULL;
+    }
+
+    if (format == EXPORT_CSV) {
+        for (int c = 0; c < column_count; c++) {
+            if (c > 0) fputc(',', writer->file);
+            write_csv_text(writer->file, columns[c].name);
+        }
+        fputs("\r\n", writer->file);
+    } else if (format == EXPORT_JSON) {
+        fputs("[", writer->file);
+    } else {
+        fwrite(EXPORT_COLUMNAR_MAGIC "\0\0\0\1", 1, 8, writer->file);
+    }
+    return writer;
+}
+
+int export_row(ExportWriter *writer, const ExportValue *values) {
+    FILE *file = writer->file;
+    char date[DATE_TEXT_SIZE];
+
+    if (writer->format == EXPORT_COLUMNAR) {
+        for (int c = 0; c < writer->column_count && writer->ok; c++) {
+            ColumnChunk *chunk = &writer->chunks[c];
+            switch (writer->columns[c].type) {
+            case EXPORT_TEXT: {
+                size_t length = strlen(values[c].text);
+                writer->ok = chunk_append_uint(chunk, length, 4) && chunk_append(chunk, values[c].text, length);
+                break;
+            }
+            case EXPORT_DATE:
+                writer->ok = chunk_append_uint(chunk, (unsigned int)values[c].day, 4);
+                break;
+            case EXPORT_INTEGER:
+                writer->ok = chunk_append_uint(chunk, (unsigned long long)values[c].integer, 8);
+                break;
+            case EXPORT_REAL: {
+                unsigned long long bits;
+                memcpy(&bits, &values[c].real, sizeof(bits));
+                writer->ok = chunk_append_uint(chunk, bits, 8);
+                break;
+            }
+            }
+        }
+        writer->rows++;
+        if (++writer->group_rows == EXPORT_ROW_GROUP && writer->ok) writer->ok = flush_row_group(writer);
+        return writer->ok;
+    }
+
+    if (writer->format == EXPORT_JSON) fputs(writer->rows > 0 ? ",\n  {" : "\n  {", file);
+    for (int c = 0; c < writer->column_count; c++) {
+        if (writer->format == EXPORT_JSON) {
+            if (c > 0) fputs(", ", file);
+            write_json_text(file, writer->columns[c].name);
+            fputs(": ", file);
+        } else if (c > 0) {
+            fputc(',', file);
+        }
+
+        switch (writer->columns[c].type) {
+        case EXPORT_TEXT:
+            if (writer->format == EXPORT_JSON)
+                write_json_text(file, values[c].text);
+            else
+                write_csv_text(file, values[c].text);
+            break;
+        case EXPORT_DATE:
+            format_day_number(values[c].day, date);
+            fprintf(file, writer->format == EXPORT_JSON ? "\"%s\"" : "%s", date);
+            break;
+        case EXPORT_INTEGER:
+            fprintf(file, "%lld", values[c].integer);
+            break;
+        case EXPORT_REAL:
+            if (isnan(values[c].real))
+                fputs(writer->format == EXPORT_JSON ? "null" : "", file);
+            else
+                fprintf(file, "%.10g", values[c].real);
+            break;
+        }
+    }
+    fputs(writer->format == EXPORT_JSON ? "}" : "\r\n", file);
+    writer->rows++;
+    return writer->ok = writer->ok && !ferror(file);
+}
+
+// Finishes the file and frees the writer. The columnar footer holds the schema
+// (column count, then per column a type byte and a length-prefixed name), the row
+// group count and their offsets, followed by the footer offset and the magic.
+int export_end(ExportWriter *writer) {
+    FILE *file = writer->file;
+    int ok = writer->ok;
+
+    if (writer->format == EXPORT_JSON) {
+        fputs(writer->rows > 0 ? "\n]\n" : "]\n", file);
+    } else if (writer->format == EXPORT_COLUMNAR) {
+        ok = ok && flush_row_group(writer);
+
+        long long footer = ftell(file);
+        write_uint(file, writer->column_count, 4);
+        for (int c = 0; c < writer->column_count; c++) {
+            size_t length = strlen(writer->columns[c].name);
+            fputc(writer->columns[c].type, file);
+            write_uint(file, length, 4);
+            fwrite(writer->columns[c].name, 1, length, file);
+        }
+        write_uint(file, writer->rows, 8);
+        write_uint(file, writer->group_count, 4);
+        for (int g = 0; g < writer->group_count; g++) {
+            write_uint(file, writer->group_offsets[g], 8);
+        }
+        write_uint(file, footer, 8);
+        fwrite(EXPORT_COLUMNAR_MAGIC, 1, 4, file);
+
+        for (int c = 0; c < writer->column_count; c++) {
+            free(writer->chunks[c].bytes);
+        }
+    }
+
+    ok = !ferror(file) && ok;
+    ok = fclose(file) == 0 && ok;
+    free(writer->chunks);
+    free(writer->group_offsets);
+    free(writer);
+    return ok;
+}
+
+static const ExportColumn reading_columns[] = {
+    { "date", EXPORT_DATE },
+    { "height_cm", EXPORT_REAL },
+    { "weight_kg", EXPORT_REAL },
+    { "bp_systolic_mmhg", EXPORT_REAL },
+    { "bp_diastolic_mmhg", EXPORT_REAL },
+    { "blood_sugar_mgdl", EXPORT_REAL },
+    { "temperature_c", EXPORT_REAL }
+};
+
+// Streams the readings of input.txt in [start_day, end_day] in file order, one
+// decoded segment at a time. Returns the number of rows written, or -1 on failure.
+int export_readings(const char *path, int start_day, int end_day) {
+    PERF_START(perf);
+    if (!refresh_segment_store()) return -1;
+
+    SegmentBlock *block = malloc(sizeof(SegmentBlock));
+    ExportWriter *writer = block ? export_begin(path, get_export_format(path), reading_columns, SEGMENT_COLUMNS) : NULL;
+    if (!writer) {
+        free(block);
+        return -1;
+    }
+
+    const SegmentSnapshot *snapshot = acquire_segment_snapshot();
+    int blocks = get_segment_block_count(snapshot);
+    int ok = 1, rows = 0;
+    for (int b = 0; b < blocks && ok; b++) {
+        if (get_segment_block_overlap(snapshot, b, start_day, end_day) == BLOCK_OUTSIDE) continue;
+        int count = read_segment_block(snapshot, b, block);
+        for (int i = 0; i < count && ok; i++) {
+            int day = block->values[SEGMENT_DATE][i];
+            if (day < start_day || day > end_day) continue;
+
+            ExportValue values[SEGMENT_COLUMNS];
+            values[SEGMENT_DATE].day = day;
+            for (int c = SEGMENT_HEIGHT; c < SEGMENT_COLUMNS; c++) {
+                values[c].real = segment_value(c, block->values[c][i]);
+            }
+            ok = export_row(writer, values);
+            rows++;
+        }
+    }
+    release_segment_snapshot(snapshot);
+    free(block);
+    ok = export_end(writer) && ok;
+    PERF_LAP(perf, "export.readings");
+    return ok ? rows : -1;
+}
+
+static const ExportColumn daily_reading_columns[] = {
+    { "date", EXPORT_DATE },
+    { "metric", EXPORT_TEXT },
+    { "value", EXPORT_REAL },
+    { "state", EXPORT_TEXT },
+    { "average_7d", EXPORT_REAL },
+    { "change", EXPORT_REAL }
+};
+
+static const char *grid_state_names[] = { "missing", "observed", "interpolated" };
+
+// Exports the readings of [start_day, end_day] on the daily grid, one row per day
+// and metric: gaps of up to GRID_INTERPOLATE_DAYS filled in and marked so, longer
+// ones left empty, with the trailing GRID_AVERAGE_DAYS average and the change
+// from the day before. Returns the number of rows written, or -1 on failure.
+int export_daily_readings(const char *path, int start_day, int end_day) {
+    PERF_START(perf);
+    DailyGrid grid;
+    if (build_daily_grid(start_day, end_day, &grid) < 0) return -1;
+    interpolate_daily_grid(&grid, GRID_INTERPOLATE_DAYS);
+    PERF_LAP(perf, "export.daily.grid");
+
+    double *averages = malloc((size_t)(grid.day_count + 1) * GRID_METRICS * sizeof(double));
+    double *changes = malloc((size_t)(grid.day_count + 1) * GRID_METRICS * sizeof(double));
+    ExportWriter *writer = averages && changes ? export_begin(path, get_export_format(path), daily_reading_columns, 6) : NULL;
+    if (!writer) {
+        free(averages);
+        free(changes);
+        free_daily_grid(&grid);
+        return -1;
+    }
+    for (int m = 0; m < GRID_METRICS; m++) {
+        grid_moving_average(&grid, m, GRID_AVERAGE_DAYS, averages + (size_t)m * grid.day_count);
+        grid_day_changes(&grid, m, 1, changes + (size_t)m * grid.day_count);
+    }
+
+    int ok = 1, rows = 0;
+    for (int i = 0; i < grid.day_count && ok; i++) {
+        for (int m = 0; m < GRID_METRICS && ok; m++) {
+            size_t slot = (size_t)m * grid.day_count + i;
+            ExportValue values[6];
+            values[0].day = grid.first_day + i;
+            values[1].text = reading_columns[m + 1].name;
+            values[2].real = grid.values[m][i];
+            values[3].text = grid_state_names[grid.states[m][i]];
+            values[4].real = averages[slot];
+            values[5].real = changes[slot];
+            ok = export_row(writer, values);
+            rows++;
+        }
+    }
+
+    free(averages);
+    free(changes);
+    free_daily_grid(&grid);
+    ok = export_end(writer) && ok;
+    PERF_LAP(perf, "export.daily.write");
+    return ok ? rows : -1;
+}
+
+static const ExportColumn cohort_reading_columns[] = {
+    { "patient", EXPORT_TEXT },
+    { "date", EXPORT_DATE },
+    { "height_cm", EXPORT_REAL },
+    { "weight_kg", EXPORT_REAL },
+    { "bp_systolic_mmhg", EXPORT_REAL },
+    { "bp_diastolic_mmhg", EXPORT_REAL },
+    { "blood_sugar_mgdl", EXPORT_REAL },
+    { "temperature_c", EXPORT_REAL }
+};
+
+// Streams every patient's readings in [start_day, end_day], one line at a time,
+// tagged with the patient file name. Returns the number of rows written, or -1.
+int export_cohort_readings(const char *path, const char *directory, int start_day, int end_day) {
+    PERF_START(perf);
+    char **paths;
+    int count = list_patient_files(directory, &paths);
+    if (count < 0) return -1;
+
+    ExportWriter *writer = export_begin(path, get_export_format(path), cohort_reading_columns, 8);
+    int ok = writer != NULL, rows = 0;
+    LineBuffer line = {0};
+    HealthRow row;
+
+    for (int p = 0; p < count && ok; p++) {
+        FILE *file = fopen(paths[p], "r");
+        if (!file) continue;
+
+        const char *patient = strrchr(paths[p], '/') + 1;
+        while (ok && read_line(file, &line)) {
+            if (parse_health_row(line.text, line.length, &row) != ROW_OK ||
+                row.day < start_day || row.day > end_day)
+                continue;
+
+            ExportValue values[8];
+            values[0].text = patient;
+            values[1].day = row.day;
+            for (int f = 0; f < ROW_FIELDS - 1; f++) {
+                values[f + 2].real = row.values[f];
+            }
+            ok = export_row(writer, values);
+            rows++;
+        }
+        fclose(file);
+    }
+
+    free_line(&line);
+    for (int p = 0; p < count; p++) free(paths[p]);
+    free(paths);
+    if (writer) ok = export_end(writer) && ok;
+    PERF_LAP(perf, "export.cohort_readings");
+    return ok ? rows : -1;
+}
+
+static const ExportColumn comparison_columns[] = {
+    { "date", EXPORT_TEXT }, { "metric", EXPORT_TEXT }, { "current", EXPORT_TEXT },
+    { "previous", EXPORT_TEXT }, { "change", EXPORT_TEXT }, { "status", EXPORT_TEXT }
+};
+
+static const ExportColumn stats_columns[] = {
+    { "metric", EXPORT_TEXT }, { "average", EXPORT_TEXT }, { "std_deviation", EXPORT_TEXT },
+    { "median", EXPORT_TEXT }, { "p90", EXPORT_TEXT }, { "p99", EXPORT_TEXT }, { "status", EXPORT_TEXT }
+};
+
+static const ExportColumn abnormality_columns[] = {
+    { "category", EXPORT_TEXT }, { "abnormal_days", EXPORT_TEXT }, { "advice", EXPORT_TEXT }
+};
+
+static const ExportColumn recommendation_columns[] = {
+    { "section", EXPORT_TEXT }, { "text", EXPORT_TEXT }
+};
+
+static const ExportColumn cohort_recommendation_columns[] = {
+    { "patient", EXPORT_TEXT }, { "section", EXPORT_TEXT }, { "text", EXPORT_TEXT }
+};
+
+// Writes the recommendations text as (section, line) rows, led by the patient
+// when one is given; a line ending in ':' starts a new section and underlines
+// are dropped
+static int export_recommendation_lines(ExportWriter *writer, const char *patient, char *text, int *rows) {
+    const char *section = "";
+    int ok = 1;
+    for (char *line = strtok(text, "\n"); line && ok; line = strtok(NULL, "\n")) {
+        size_t length = strlen(line);
+        if (strspn(line, "=") == length) continue;
+        if (line[length - 1] == ':') {
+            line[length - 1] = '\0';
+            section = line;
+            continue;
+        }
+
+        ExportValue values[3];
+        int v = 0;
+        if (patient) values[v++].text = patient;
+        values[v++].text = section;
+        values[v].text = line;
+        ok = export_row(writer, values);
+        (*rows)++;
+    }
+    return ok;
+}
+
+// Advice for every patient with readings in [start_day, end_day], as (patient,
+// section, line) rows. All reports are formatted in one batch into a single
+// buffer. Returns the number of rows written, or -1.
+int export_cohort_recommendations(const char *path, const char *directory, int start_day, int end_day) {
+    PERF_START(perf);
+    char **paths;
+    int count = list_patient_files(directory, &paths);
+    if (count < 0) return -1;
+
+    AbnormalitySummary *summaries = malloc((count + 1) * sizeof(AbnormalitySummary));
+    int *patients = malloc((count + 1) * sizeof(int));
+    size_t *offsets = malloc((count + 1) * sizeof(size_t));
+    int ok = summaries && patients && offsets, reports = 0, rows = 0;
+
+    for (int p = 0; p < count && ok; p++) {
+        long long abnormal[COHORT_ABNORMAL_KINDS];
+        if (scan_patient_abnormalities(paths[p], start_day, end_day, abnormal) <= 0)
+            continue;
+        for (int k = 0; k < COHORT_ABNORMAL_KINDS; k++) {
+            summaries[reports].days[k] = abnormal[k] > INT_MAX ? INT_MAX : (int)abnormal[k];
+        }
+        patients[reports++] = p;
+    }
+    PERF_LAP(perf, "export.cohort_recommendations.scan");
+
+    TextBuffer advice = {0};
+    if (ok) ok = append_health_advice_batch(&advice, summaries, reports, offsets) == reports;
+    PERF_LAP(perf, "export.cohort_recommendations.format");
+
+    ExportWriter *writer = ok ? export_begin(path, get_export_format(path), cohort_recommendation_columns, 3) : NULL;
+    ok = ok && writer != NULL;
+    for (int r = 0; r < reports && ok; r++) {
+        const char *patient = strrchr(paths[patients[r]], '/') + 1;
+        ok = export_recommendation_lines(writer, patient, advice.text + offsets[r], &rows);
+    }
+
+    free_text_buffer(&advice);
+    free(offsets);
+    free(patients);
+    free(summaries);
+    for (int p = 0; p < count; p++) free(paths[p]);
+    free(paths);
+    if (writer) ok = export_end(writer) && ok;
+    PERF_LAP(perf, "export.cohort_recommendations.write");
+    return ok ? rows : -1;
+}
+
+// Exports one report for [start_day, end_day] (the comparison report uses start_day
+// as its date). Returns the number of rows written, or -1 on failure.
+int export_report(const char *path, ReportKind kind, int start_day, int end_day) {
+    if (kind == REPORT_READINGS) return export_readings(path, start_day, end_day);
+    if (kind == REPORT_DAILY_READINGS) return export_daily_readings(path, start_day, end_day);
+
+    ExportFormat format = get_export_format(path);
+    ExportWriter *writer = NULL;
+    int ok = 1, rows = 0;
+
+    if (kind == REPORT_COMPARISON) {
+        ComparisonTableData *data;
+        int count = get_comparison_table_data(start_day, &data);
+        writer = export_begin(path, format, comparison_columns, 6);
+        for (int i = 0; i < count && writer && ok; i++) {
+            ExportValue values[6] = { { data[i].date }, { data[i].metric }, { data[i].current_value },
+                                      { data[i].previous_value }, { data[i].change }, { data[i].status } };
+            ok = export_row(writer, values);
+            rows++;
+        }
+        if (count > 0) free(data);
+    } else if (kind == REPORT_STATS) {
+        StatsTableData *data;
+        int count = get_stats_table_data(start_day, end_day, &data);
+        writer = export_begin(path, format, stats_columns, 7);
+        for (int i = 0; i < count && writer && ok; i++) {
+            ExportValue values[7] = { { data[i].metric }, { data[i].average }, { data[i].std_deviation },
+                                      { data[i].median }, { data[i].p90 }, { data[i].p99 }, { data[i].status } };
+            ok = export_row(writer, values);
+            rows++;
+        }
+        if (count > 0) free(data);
+    } else if (kind == REPORT_ABNORMALITIES) {
+        AbnormalityTableData *data;
+        int count = get_abnormality_table_data(start_day, end_day, &data);
+        writer = export_begin(path, format, abnormality_columns, 3);
+        for (int i = 0; i < count && writer && ok; i++) {
+            ExportValue values[3] = { { data[i].category }, { data[i].count }, { data[i].advice } };
+            ok = export_row(writer, values);
+            rows++;
+        }
+        if (count > 0) free(data);
+    } else if (kind == REPORT_RECOMMENDATIONS) {
+        char *text = get_health_recommendations(start_day, end_day);
+        writer = export_begin(path, format, recommendation_columns, 2);
+        if (text && writer) ok = export_recommendation_lines(writer, NULL, text, &rows);
+        free(text);
+    } else {
+        return -1;
+    }
+
+    if (!writer) return -1;
+    ok = export_end(writer) && ok;
+    return ok ? rows : -1;
+}
@@ -0,0 +1,64 @@
+#ifndef HEALTH_EXPORT_H
+#define HEALTH_EXPORT_H
+
+#include "health_logic.h"
+
+// Rows buffered per row group of the columnar format; the only rows held in memory
+#define EXPORT_ROW_GROUP 4096
+// File magic of the columnar format, at the start and at the very end
+#define EXPORT_COLUMNAR_MAGIC "HCOL"
+
+typedef enum {
+    EXPORT_CSV,
+    EXPORT_JSON,
+    EXPORT_COLUMNAR
+} ExportFormat;
+
+// Column types; the columnar format stores dates as int32 day numbers, integers as
+// int64, reals as float64 and text as length-prefixed UTF-8, all little-endian
+typedef enum {
+    EXPORT_TEXT,
+    EXPORT_DATE,
+    EXPORT_INTEGER,
+    EXPORT_REAL
+} ExportType;
+
+typedef struct {
+    const char *name;
+    ExportType type;
+} ExportColumn;
+
+typedef union {
+    const char *text;
+    int day;
+    long long integer;
+    double real;
+} ExportValue;
+
+// What a report window can export
+typedef enum {
+    REPORT_READINGS,
+    REPORT_DAILY_READINGS,
+    REPORT_COMPARISON,
+    REPORT_STATS,
+    REPORT_ABNORMALITIES,
+    REPORT_RECOMMENDATIONS,
+    REPORT_COHORT_READINGS,
+    REPORT_COHORT_RECOMMENDATIONS
+} ReportKind;
+
+typedef struct ExportWriter ExportWriter;
+
+// Function declarations for streaming export
+ExportFormat get_export_format(const char *path);
+ExportWriter* export_begin(const char *path, ExportFormat format, const ExportColumn *columns, int column_count);
+int export_row(ExportWriter *writer, const ExportValue *values);
+int export_end(ExportWriter *writer);
+
+int export_readings(const char *path, int start_day, int end_day);
+int export_daily_readings(const char *path, int start_day, int end_day);
+int export_cohort_readings(const char *path, const char *directory, int start_day, int end_day);
+int export_cohort_recommendations(const char *path, const char *directory, int start_day, int end_day);
+int export_report(const char *path, ReportKind kind, int start_day, int end_day);
+
+#endif // HEALTH_EXPORT_H
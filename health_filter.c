@@ -0,0 +1,579 @@
+#include "health_filter.h"
+#include "health_perf.h"
+#include <ctype.h>
+
+typedef enum {
+    TOKEN_END,
+    TOKEN_WORD,
+    TOKEN_NUMBER,
+    TOKEN_DATE,
+    TOKEN_OPERATOR,
+    TOKEN_OPEN,
+    TOKEN_CLOSE,
+    TOKEN_AND,
+    TOKEN_OR,
+    TOKEN_NOT,
+    TOKEN_BAD
+} TokenKind;
+
+typedef struct {
+    TokenKind kind;
+    const char *text;
+    int length;
+    double number;
+    int day;
+    FilterOp op;
+} FilterToken;
+
+typedef struct {
+    const char *text;
+    const char *next;
+    FilterToken token;
+    FilterProgram *program;
+    int depth;
+    char *error;
+    size_t error_size;
+} FilterParser;
+
+typedef struct {
+    const char *name;
+    int column;
+} ColumnName;
+
+static const ColumnName column_names[] = {
+    { "date", SEGMENT_DATE },
+    { "height", SEGMENT_HEIGHT },
+    { "weight", SEGMENT_WEIGHT },
+    { "systolic", SEGMENT_BP_SYS },
+    { "bp_sys", SEGMENT_BP_SYS },
+    { "diastolic", SEGMENT_BP_DIA },
+    { "bp_dia", SEGMENT_BP_DIA },
+    { "sugar", SEGMENT_SUGAR },
+    { "temp", SEGMENT_TEMP },
+    { "temperature", SEGMENT_TEMP }
+};
+
+// Case-insensitive match of a word token against a lowercase word
+static int word_is(const FilterToken *token, const char *word) {
+    if (token->kind != TOKEN_WORD || (int)strlen(word) != token->length) return 0;
+    for (int i = 0; i < token->length; i++) {
+        if (tolower((unsigned char)token->text[i]) != word[i]) return 0;
+    }
+    return 1;
+}
+
+// Records the first error only, with the position it was found at
+static int filter_error(FilterParser *parser, const char *message) {
+    if (parser->error && parser->error[0] == '\0') {
+        snprintf(parser->error, parser->error_size, "%s at position %d",
+                 message, (int)(parser->token.text - parser->text) + 1);
+    }
+    return -1;
+}
+
+static void next_token(FilterParser *parser) {
+    const char *p = parser->next;
+    while (isspace((unsigned char)*p)) p++;
+
+    FilterToken *token = &parser->token;
+    token->text = p;
+    token->length = 1;
+
+    if (*p == '\0') {
+        token->kind = TOKEN_END;
+        token->length = 0;
+    } else if (isalpha((unsigned char)*p) || *p == '_') {
+        token->kind = TOKEN_WORD;
+        while (isalnum((unsigned char)p[token->length]) || p[token->length] == '_') token->length++;
+    } else if (isdigit((unsigned char)*p) || *p == '.' || *p == '-') {
+        // A date is exactly YYYY-MM-DD; anything else numeric goes through strtod
+        char date[DATE_TEXT_SIZE];
+        int is_date = isdigit((unsigned char)*p) && strlen(p) >= DATE_TEXT_SIZE - 1 && p[4] == '-';
+        if (is_date) {
+            memcpy(date, p, DATE_TEXT_SIZE - 1);
+            date[DATE_TEXT_SIZE - 1] = '\0';
+            is_date = parse_day_number(date, &token->day) && !isalnum((unsigned char)p[DATE_TEXT_SIZE - 1]);
+        }
+        if (is_date) {
+            token->kind = TOKEN_DATE;
+            token->length = DATE_TEXT_SIZE - 1;
+        } else {
+            char *end;
+            token->number = strtod(p, &end);
+            token->kind = end > p && isfinite(token->number) ? TOKEN_NUMBER : TOKEN_BAD;
+            if (end > p) token->length = (int)(end - p);
+        }
+    } else if (*p == '(') {
+        token->kind = TOKEN_OPEN;
+    } else if (*p == ')') {
+        token->kind = TOKEN_CLOSE;
+    } else if ((*p == '&' || *p == '|') && p[1] == *p) {
+        token->kind = *p == '&' ? TOKEN_AND : TOKEN_OR;
+        token->length = 2;
+    } else if (*p == '!' && p[1] != '=') {
+        token->kind = TOKEN_NOT;
+    } else if (*p == '<' || *p == '>' || *p == '=' || *p == '!') {
+        int equals = p[1] == '=';
+        token->kind = TOKEN_OPERATOR;
+        token->length = equals ? 2 : 1;
+        if (*p == '<' && p[1] == '>') {
+            token->op = FILTER_NE;
+            token->length = 2;
+        } else if (*p == '<') {
+            token->op = equals ? FILTER_LE : FILTER_LT;
+        } else if (*p == '>') {
+            token->op = equals ? FILTER_GE : FILTER_GT;
+        } else {
+            token->op = *p == '=' ? FILTER_EQ : FILTER_NE;
+        }
+    } else {
+        token->kind = TOKEN_BAD;
+    }
+    parser->next = p + token->length;
+}
+
+// The keywords and, or and not, spelled out or as &&, || and !
+static int is_keyword(const FilterToken *token, TokenKind symbol, const char *word) {
+    return token->kind == symbol || word_is(token, word);
+}
+
+static int add_node(FilterParser *parser, FilterNode node) {
+    FilterProgram *program = parser->program;
+    if (program->node_count == FILTER_MAX_NODES) return filter_error(parser, "Filter has too many terms");
+    program->nodes[program->node_count] = node;
+    return program->node_count++;
+}
+
+static int add_constant(FilterParser *parser, int value) {
+    FilterNode node = {0};
+    node.kind = value ? FILTER_TRUE : FILTER_FALSE;
+    return add_node(parser, node);
+}
+
+// Compiles `column op value` into a comparison of the stored fixed-point integers.
+// Stored values are rounded to the column's precision, so the constant is rounded
+// the same way up or down as the operator requires; an equality with a constant
+// that falls between two stored values can never hold and becomes a constant.
+static int add_comparison(FilterParser *parser, int column, FilterOp op, double value) {
+    double scaled = value * get_segment_scale(column);
+    double nearest = round(scaled);
+    if (fabs(scaled - nearest) < 1e-6) scaled = nearest;
+    int integral = scaled == nearest;
+
+    if (scaled > INT32_MAX || scaled < INT32_MIN) {
+        int above = scaled > INT32_MAX;
+        switch (op) {
+        case FILTER_LT: case FILTER_LE: return add_constant(parser, above);
+        case FILTER_GT: case FILTER_GE: return add_constant(parser, !above);
+        case FILTER_EQ: return add_constant(parser, 0);
+        case FILTER_NE: return add_constant(parser, 1);
+        }
+    }
+    if (!integral && op == FILTER_EQ) return add_constant(parser, 0);
+    if (!integral && op == FILTER_NE) return add_constant(parser, 1);
+
+    FilterNode node = {0};
+    node.kind = FILTER_COMPARE;
+    node.column = column;
+    node.op = op;
+    node.constant = (int32_t)(op == FILTER_GE || op == FILTER_LT ? ceil(scaled) : floor(scaled));
+    return add_node(parser, node);
+}
+
+static int parse_or(FilterParser *parser);
+
+static int parse_comparison(FilterParser *parser) {
+    FilterToken *token = &parser->token;
+
+    // last N days: the N days up to and including the end of the queried range
+    if (word_is(token, "last")) {
+        next_token(parser);
+        if (token->kind != TOKEN_NUMBER || token->number < 1 || token->number > 1000000 ||
+            token->number != floor(token->number))
+            return filter_error(parser, "Expected a number of days");
+        FilterNode node = {0};
+        node.kind = FILTER_COMPARE;
+        node.column = SEGMENT_DATE;
+        node.op = FILTER_GE;
+        node.constant = (int32_t)token->number - 1;
+        node.relative = 1;
+        next_token(parser);
+        if (!word_is(token, "days") && !word_is(token, "day")) return filter_error(parser, "Expected 'days'");
+        next_token(parser);
+        return add_node(parser, node);
+    }
+
+    if (token->kind != TOKEN_WORD) return filter_error(parser, "Expected a column name");
+    int column = -1;
+    for (size_t i = 0; i < sizeof(column_names) / sizeof(column_names[0]); i++) {
+        if (word_is(token, column_names[i].name)) column = column_names[i].column;
+    }
+    if (column < 0) return filter_error(parser, "Unknown column");
+
+    next_token(parser);
+    if (token->kind != TOKEN_OPERATOR) return filter_error(parser, "Expected a comparison operator");
+    FilterOp op = token->op;
+
+    next_token(parser);
+    double value;
+    if (column == SEGMENT_DATE && token->kind == TOKEN_DATE) {
+        value = token->day;
+    } else if (column != SEGMENT_DATE && token->kind == TOKEN_NUMBER) {
+        value = token->number;
+    } else {
+        return filter_error(parser, column == SEGMENT_DATE ? "Expected a date (YYYY-MM-DD)" : "Expected a number");
+    }
+    next_token(parser);
+    return add_comparison(parser, column, op, value);
+}
+
+static int parse_not(FilterParser *parser) {
+    FilterToken *token = &parser->token;
+
+    if (is_keyword(token, TOKEN_NOT, "not")) {
+        next_token(parser);
+        int operand = parse_not(parser);
+        if (operand < 0) return -1;
+        FilterNode node = {0};
+        node.kind = FILTER_NOT;
+        node.left = operand;
+        return add_node(parser, node);
+    }
+    if (token->kind == TOKEN_OPEN) {
+        if (++parser->depth > FILTER_MAX_DEPTH) return filter_error(parser, "Filter is nested too deeply");
+        next_token(parser);
+        int inner = parse_or(parser);
+        if (inner < 0) return -1;
+        if (token->kind != TOKEN_CLOSE) return filter_error(parser, "Expected ')'");
+        parser->depth--;
+        next_token(parser);
+        return inner;
+    }
+    return parse_comparison(parser);
+}
+
+static int parse_and(FilterParser *parser) {
+    int left = parse_not(parser);
+    while (left >= 0 && is_keyword(&parser->token, TOKEN_AND, "and")) {
+        next_token(parser);
+        int right = parse_not(parser);
+        if (right < 0) return -1;
+        FilterNode node = {0};
+        node.kind = FILTER_AND;
+        node.left = left;
+        node.right = right;
+        left = add_node(parser, node);
+    }
+    return left;
+}
+
+static int parse_or(FilterParser *parser) {
+    int left = parse_and(parser);
+    while (left >= 0 && is_keyword(&parser->token, TOKEN_OR, "or")) {
+        next_token(parser);
+        int right = parse_and(parser);
+        if (right < 0) return -1;
+        FilterNode node = {0};
+        node.kind = FILTER_OR;
+        node.left = left;
+        node.right = right;
+        left = add_node(parser, node);
+    }
+    return left;
+}
+
+// Parses a filter such as "sugar > 180 and systolic > 130 and last 90 days" into
+// `program`. Columns are date, height, weight, systolic (bp_sys), diastolic
+// (bp_dia), sugar and temp; conditions combine with and, or, not and parentheses.
+// An empty filter matches every reading. Returns 0 and describes the problem in
+// `error` if the text does not parse.
+int compile_filter(const char *text, FilterProgram *program, char *error, size_t error_size) {
+    FilterParser parser = {0};
+    parser.text = text;
+    parser.next = text;
+    parser.program = program;
+    parser.error = error;
+    parser.error_size = error_size;
+    if (error && error_size > 0) error[0] = '\0';
+    program->node_count = 0;
+
+    next_token(&parser);
+    if (parser.token.kind == TOKEN_END) {
+        program->root = add_constant(&parser, 1);
+        return 1;
+    }
+    program->root = parse_or(&parser);
+    if (program->root >= 0 && parser.token.kind != TOKEN_END) {
+        program->root = filter_error(&parser, "Unexpected text");
+    }
+    return program->root >= 0;
+}
+
+// Whether a block whose column ranges are `zone` has every row (1), no row (0) or
+// possibly some rows (-1) matching node `index`
+static int decide_from_zone(const FilterProgram *program, int index, const SegmentZone *zone) {
+    const FilterNode *node = &program->nodes[index];
+    switch (node->kind) {
+    case FILTER_TRUE:
+        return 1;
+    case FILTER_FALSE:
+        return 0;
+    case FILTER_NOT: {
+        int operand = decide_from_zone(program, node->left, zone);
+        return operand < 0 ? -1 : !operand;
+    }
+    case FILTER_AND: {
+        int left = decide_from_zone(program, node->left, zone);
+        if (left == 0) return 0;
+        int right = decide_from_zone(program, node->right, zone);
+        if (right == 0) return 0;
+        return left == 1 && right == 1 ? 1 : -1;
+    }
+    case FILTER_OR: {
+        int left = decide_from_zone(program, node->left, zone);
+        if (left == 1) return 1;
+        int right = decide_from_zone(program, node->right, zone);
+        if (right == 1) return 1;
+        return left == 0 && right == 0 ? 0 : -1;
+    }
+    case FILTER_COMPARE:
+        break;
+    }
+
+    int32_t min = zone->min[node->column], max = zone->max[node->column], k = node->constant;
+    switch (node->op) {
+    case FILTER_LT: return max < k ? 1 : min >= k ? 0 : -1;
+    case FILTER_LE: return max <= k ? 1 : min > k ? 0 : -1;
+    case FILTER_GT: return min > k ? 1 : max <= k ? 0 : -1;
+    case FILTER_GE: return min >= k ? 1 : max < k ? 0 : -1;
+    case FILTER_EQ: return min == k && max == k ? 1 : k < min || k > max ? 0 : -1;
+    case FILTER_NE: return min == k && max == k ? 0 : k < min || k > max ? 1 : -1;
+    }
+    return -1;
+}
+
+// Narrows the selection `in` to the rows where `column op k` holds. The loops store
+// every candidate and advance only on a match, so they run without branching on
+// the data.
+static int select_compare(const int32_t *column, FilterOp op, int32_t k, const uint16_t *in, int n, uint16_t *out) {
+    int count = 0;
+    switch (op) {
+    case FILTER_LT:
+        for (int i = 0; i < n; i++) { out[count] = in[i]; count += column[in[i]] < k; }
+        break;
+    case FILTER_LE:
+        for (int i = 0; i < n; i++) { out[count] = in[i]; count += column[in[i]] <= k; }
+        break;
+    case FILTER_GT:
+        for (int i = 0; i < n; i++) { out[count] = in[i]; count += column[in[i]] > k; }
+        break;
+    case FILTER_GE:
+        for (int i = 0; i < n; i++) { out[count] = in[i]; count += column[in[i]] >= k; }
+        break;
+    case FILTER_EQ:
+        for (int i = 0; i < n; i++) { out[count] = in[i]; count += column[in[i]] == k; }
+        break;
+    case FILTER_NE:
+        for (int i = 0; i < n; i++) { out[count] = in[i]; count += column[in[i]] != k; }
+        break;
+    }
+    return count;
+}
+
+// Selection vectors of one block for every node, so evaluation never allocates
+typedef struct {
+    uint16_t rows[FILTER_MAX_NODES][2][SEGMENT_ROWS];
+} FilterScratch;
+
+// Writes to `out` the rows of the ascending selection `in` matching node `index`;
+// returns how many there are, still in ascending order
+static int select_rows(const FilterProgram *program, int index, const SegmentBlock *block,
+                       FilterScratch *scratch, const uint16_t *in, int n, uint16_t *out) {
+    const FilterNode *node = &program->nodes[index];
+    uint16_t *first = scratch->rows[index][0];
+    uint16_t *second = scratch->rows[index][1];
+
+    switch (node->kind) {
+    case FILTER_COMPARE:
+        return select_compare(block->values[node->column], node->op, node->constant, in, n, out);
+    case FILTER_TRUE:
+        memcpy(out, in, n * sizeof(uint16_t));
+        return n;
+    case FILTER_FALSE:
+        return 0;
+    case FILTER_AND: {
+        int left = select_rows(program, node->left, block, scratch, in, n, first);
+        return left == 0 ? 0 : select_rows(program, node->right, block, scratch, first, left, out);
+    }
+    case FILTER_OR: {
+        int left = select_rows(program, node->left, block, scratch, in, n, first);
+        if (left == n) {
+            memcpy(out, in, n * sizeof(uint16_t));
+            return n;
+        }
+        // Only the rows the left side rejected are left for the right side
+        int rest = 0;
+        for (int i = 0, j = 0; i < n; i++) {
+            int taken = j < left && first[j] == in[i];
+            second[rest] = in[i];
+            rest += !taken;
+            j += taken;
+        }
+        int right = select_rows(program, node->right, block, scratch, second, rest, second);
+        int count = 0, i = 0, j = 0;
+        while (i < left && j < right) out[count++] = first[i] < second[j] ? first[i++] : second[j++];
+        while (i < left) out[count++] = first[i++];
+        while (j < right) out[count++] = second[j++];
+        return count;
+    }
+    case FILTER_NOT: {
+        int matched = select_rows(program, node->left, block, scratch, in, n, first);
+        int count = 0;
+        for (int i = 0, j = 0; i < n; i++) {
+            int taken = j < matched && first[j] == in[i];
+            out[count] = in[i];
+            count += !taken;
+            j += taken;
+        }
+        return count;
+    }
+    }
+    return 0;
+}
+
+// Runs a compiled filter over the readings dated [start_day, end_day] of the
+// segment store, a block and a column at a time. Blocks whose zone maps settle the
+// filter are counted or passed over without being decoded. Up to `max_rows`
+// matches are copied to `rows` in input.txt order and their number stored in
+// `row_count`. Returns the number of matching readings, or -1 on failure.
+long long run_filter(const FilterProgram *program, int start_day, int end_day,
+                     FilterRow *rows, int max_rows, int *row_count) {
+    PERF_START(perf);
+    *row_count = 0;
+    if (!refresh_segment_store()) return -1;
+
+    // "last N days" is resolved once, against the end of the range
+    FilterProgram resolved = *program;
+    for (int i = 0; i < resolved.node_count; i++) {
+        FilterNode *node = &resolved.nodes[i];
+        if (node->relative) {
+            node->constant = end_day - node->constant;
+            node->relative = 0;
+        }
+    }
+
+    SegmentBlock *block = malloc(sizeof(SegmentBlock));
+    FilterScratch *scratch = malloc(sizeof(FilterScratch));
+    uint16_t *in = malloc(2 * SEGMENT_ROWS * sizeof(uint16_t));
+    if (!block || !scratch || !in) {
+        free(block);
+        free(scratch);
+        free(in);
+        return -1;
+    }
+    uint16_t *out = in + SEGMENT_ROWS;
+
+    long long matches = 0;
+    const SegmentSnapshot *snapshot = acquire_segment_snapshot();
+    int blocks = get_segment_block_count(snapshot);
+    for (int b = 0; b < blocks; b++) {
+        BlockOverlap overlap = get_segment_block_overlap(snapshot, b, start_day, end_day);
+        if (overlap == BLOCK_OUTSIDE) continue;
+
+        SegmentZone zone;
+        int block_rows = read_segment_zone(snapshot, b, &zone);
+        int decision = decide_from_zone(&resolved, resolved.root, &zone);
+        if (decision == 0) continue;
+        if (decision == 1 && overlap == BLOCK_INSIDE && *row_count >= max_rows) {
+            matches += block_rows;
+            continue;
+        }
+
+        block_rows = read_segment_block(snapshot, b, block);
+        int n = 0;
+        if (overlap == BLOCK_INSIDE) {
+            for (int i = 0; i < block_rows; i++) in[i] = (uint16_t)i;
+            n = block_rows;
+        } else {
+            const int32_t *days = block->values[SEGMENT_DATE];
+            for (int i = 0; i < block_rows; i++) {
+                in[n] = (uint16_t)i;
+                n += days[i] >= start_day && days[i] <= end_day;
+            }
+        }
+
+        const uint16_t *selected = in;
+        if (decision < 0) {
+            n = select_rows(&resolved, resolved.root, block, scratch, in, n, out);
+            selected = out;
+        }
+        matches += n;
+
+        for (int i = 0; i < n && *row_count < max_rows; i++) {
+            FilterRow *row = &rows[(*row_count)++];
+            row->day = block->values[SEGMENT_DATE][selected[i]];
+            for (int c = 1; c < SEGMENT_COLUMNS; c++) {
+                row->values[c - 1] = segment_value(c, block->values[c][selected[i]]);
+            }
+        }
+    }
+    release_segment_snapshot(snapshot);
+    PERF_LAP(perf, "filter.run");
+
+    free(block);
+    free(scratch);
+    free(in);
+    return matches;
+}
+
+// Formats a matching reading at the precision of the entry form
+void format_filter_row(const FilterRow *row, FilterTableData *text) {
+    format_day_number(row->day, text->date);
+    for (int c = 0; c < SEGMENT_COLUMNS - 1; c++) {
+        int decimals = get_segment_decimals(c + 1);
+        snprintf(text->values[c], sizeof(text->values[c]), "%.*f", decimals, row->values[c]);
+    }
+}
+
+// Compiles and runs `text` for the query window. Returns the number of rows listed
+// (at most FILTER_TABLE_ROWS) and the number of matches in `matches`, or -1 with a
+// message in `error` if the filter does not compile or cannot run.
+int get_filter_table_data(const char *text, int start_day, int end_day, FilterTableData **data,
+                          long long *matches, char *error, size_t error_size) {
+    FilterProgram *program = malloc(sizeof(FilterProgram));
+    FilterRow *rows = malloc(FILTER_TABLE_ROWS * sizeof(FilterRow));
+    *data = NULL;
+    *matches = 0;
+    if (!program || !rows) {
+        free(program);
+        free(rows);
+        snprintf(error, error_size, "Out of memory");
+        return -1;
+    }
+    if (!compile_filter(text, program, error, error_size)) {
+        free(program);
+        free(rows);
+        return -1;
+    }
+
+    int row_count = 0;
+    *matches = run_filter(program, start_day, end_day, rows, FILTER_TABLE_ROWS, &row_count);
+    free(program);
+    if (*matches < 0) {
+        free(rows);
+        snprintf(error, error_size, "Could not read input.txt");
+        return -1;
+    }
+
+    *data = malloc((row_count > 0 ? row_count : 1) * sizeof(FilterTableData));
+    if (!*data) {
+        free(rows);
+        snprintf(error, error_size, "Out of memory");
+        return -1;
+    }
+    for (int r = 0; r < row_count; r++) {
+        format_filter_row(&rows[r], &(*data)[r]);
+    }
+    free(rows);
+    return row_count;
+}
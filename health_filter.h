@@ -0,0 +1,71 @@
+#ifndef HEALTH_FILTER_H
+#define HEALTH_FILTER_H
+
+#include "health_logic.h"
+#include "health_segment.h"
+
+// Most nodes (comparisons and and/or/not) in one filter expression
+#define FILTER_MAX_NODES 64
+// Deepest nesting of and/or/not; every level uses two selection vectors of scratch
+#define FILTER_MAX_DEPTH 16
+// Matching rows listed in the query window; all matches are still counted
+#define FILTER_TABLE_ROWS 1000
+
+typedef enum {
+    FILTER_COMPARE,
+    FILTER_AND,
+    FILTER_OR,
+    FILTER_NOT,
+    FILTER_TRUE,
+    FILTER_FALSE
+} FilterNodeKind;
+
+typedef enum {
+    FILTER_LT,
+    FILTER_LE,
+    FILTER_GT,
+    FILTER_GE,
+    FILTER_EQ,
+    FILTER_NE
+} FilterOp;
+
+// One node of a compiled filter. A comparison holds a segment column and a
+// constant already converted to the column's fixed-point scale; for "last N days"
+// the constant is N and is resolved against the end of the queried range.
+typedef struct {
+    FilterNodeKind kind;
+    int column;
+    FilterOp op;
+    int32_t constant;
+    int relative;
+    int left;      // operand nodes of and/or/not
+    int right;
+} FilterNode;
+
+// A filter expression parsed once into a flat array of nodes
+typedef struct {
+    FilterNode nodes[FILTER_MAX_NODES];
+    int node_count;
+    int root;
+} FilterProgram;
+
+// One matching reading in input.txt units
+typedef struct {
+    int day;
+    double values[SEGMENT_COLUMNS - 1];
+} FilterRow;
+
+typedef struct {
+    char date[DATE_TEXT_SIZE];
+    char values[SEGMENT_COLUMNS - 1][16];
+} FilterTableData;
+
+// Function declarations for ad-hoc reading queries
+int compile_filter(const char *text, FilterProgram *program, char *error, size_t error_size);
+long long run_filter(const FilterProgram *program, int start_day, int end_day,
+                     FilterRow *rows, int max_rows, int *row_count);
+void format_filter_row(const FilterRow *row, FilterTableData *text);
+int get_filter_table_data(const char *text, int start_day, int end_day, FilterTableData **data,
+                          long long *matches, char *error, size_t error_size);
+
+#endif // HEALTH_FILTER_H
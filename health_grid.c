@@ -0,0 +1,156 @@
+#include "health_grid.h"
+#include "health_segment.h"
+#include "health_stream.h"
+#include "health_perf.h"
+
+// Resamples input.txt and the device readings over [start_day, end_day] onto a
+// daily grid. A day with several rows keeps the last one, as the series does, and
+// a day with device readings takes their mean instead of its row, as the tables
+// do. Safe from any thread.
+// Returns the number of days on the grid, or -1 if it cannot be allocated.
+int build_daily_grid(int start_day, int end_day, DailyGrid *grid) {
+    PERF_START(perf);
+    memset(grid, 0, sizeof(DailyGrid));
+    if (start_day > end_day) return 0;
+
+    int days = end_day - start_day + 1;
+    double *values = malloc((size_t)days * GRID_METRICS * sizeof(double));
+    unsigned char *states = calloc((size_t)days * GRID_METRICS, 1);
+    SegmentBlock *block = malloc(sizeof(SegmentBlock));
+    if (!values || !states || !block) {
+        free(values);
+        free(states);
+        free(block);
+        return -1;
+    }
+
+    grid->first_day = start_day;
+    grid->day_count = days;
+    for (int m = 0; m < GRID_METRICS; m++) {
+        grid->values[m] = values + (size_t)m * days;
+        grid->states[m] = states + (size_t)m * days;
+    }
+    for (size_t i = 0; i < (size_t)days * GRID_METRICS; i++) {
+        values[i] = NAN;
+    }
+
+    // Rows come in file order, so a later row of the same day overwrites
+    int stored = refresh_segment_store();
+    refresh_stream_readings();
+    const SegmentSnapshot *snapshot = acquire_segment_snapshot();
+    int blocks = stored ? get_segment_block_count(snapshot) : 0;
+    for (int b = 0; b < blocks; b++) {
+        if (get_segment_block_overlap(snapshot, b, start_day, end_day) == BLOCK_OUTSIDE) continue;
+        int rows = read_segment_block(snapshot, b, block);
+        const int32_t *row_days = block->values[SEGMENT_DATE];
+
+        for (int i = 0; i < rows; i++) {
+            if (row_days[i] < start_day || row_days[i] > end_day) continue;
+
+            int slot = row_days[i] - start_day;
+            for (int m = 0; m < GRID_METRICS; m++) {
+                grid->values[m][slot] = segment_value(m + 1, block->values[m + 1][i]);
+                grid->states[m][slot] = GRID_OBSERVED;
+            }
+        }
+    }
+    release_segment_snapshot(snapshot);
+    free(block);
+    PERF_LAP(perf, "grid.rows");
+
+    // Only the days that have device readings are visited, newest first
+    for (int m = 0; m < GRID_METRICS; m++) {
+        int day = end_day + 1;
+        while (get_stream_day_before(m, day, &day) && day >= start_day) {
+            StreamTotals totals;
+            get_stream_totals(m, day, day, &totals);
+            grid->values[m][day - start_day] = get_stream_mean(m, &totals);
+            grid->states[m][day - start_day] = GRID_OBSERVED;
+        }
+    }
+    PERF_LAP(perf, "grid.streams");
+
+    return days;
+}
+
+void free_daily_grid(DailyGrid *grid) {
+    // Every metric's array is a slice of the first one
+    free(grid->values[0]);
+    free(grid->states[0]);
+    memset(grid, 0, sizeof(DailyGrid));
+}
+
+// Fills runs of up to `max_gap` missing days that have an observed day on both
+// sides, on a straight line between the two. Longer gaps and the ends of the grid
+// stay missing. Returns the number of slots filled.
+int interpolate_daily_grid(DailyGrid *grid, int max_gap) {
+    int filled = 0;
+    for (int m = 0; m < GRID_METRICS; m++) {
+        double *values = grid->values[m];
+        unsigned char *states = grid->states[m];
+        int previous = -1;
+
+        for (int i = 0; i < grid->day_count; i++) {
+            if (states[i] != GRID_OBSERVED) continue;
+
+            int gap = i - previous - 1;
+            if (previous >= 0 && gap > 0 && gap <= max_gap) {
+                double step = (values[i] - values[previous]) / (gap + 1);
+                for (int j = previous + 1; j < i; j++) {
+                    values[j] = values[previous] + step * (j - previous);
+                    states[j] = GRID_INTERPOLATED;
+                }
+                filled += gap;
+            }
+            previous = i;
+        }
+    }
+    return filled;
+}
+
+// Latest slot before `slot` where the metric is observed, at most `max_gap` days
+// earlier, or -1 if there is none
+int find_grid_slot_before(const DailyGrid *grid, int metric, int slot, int max_gap) {
+    int first = slot - max_gap < 0 ? 0 : slot - max_gap;
+    for (int i = slot - 1; i >= first; i--) {
+        if (grid->states[metric][i] == GRID_OBSERVED) return i;
+    }
+    return -1;
+}
+
+// Trailing mean over the last `window` days of every slot, counting only the
+// slots that hold a value; NaN where the whole window is missing. One running sum
+// over the dense array, whatever the window.
+void grid_moving_average(const DailyGrid *grid, int metric, int window, double *out) {
+    const double *values = grid->values[metric];
+    const unsigned char *states = grid->states[metric];
+    double sum = 0;
+    int count = 0;
+
+    for (int i = 0; i < grid->day_count; i++) {
+        if (states[i] != GRID_MISSING) {
+            sum += values[i];
+            count++;
+        }
+        if (i >= window && states[i - window] != GRID_MISSING) {
+            sum -= values[i - window];
+            count--;
+        }
+        out[i] = count > 0 ? sum / count : NAN;
+    }
+}
+
+// Change of every slot from the slot `lag` days before; NaN where either is
+// missing, which the NaN in missing slots gives for free. The first `lag` slots
+// have nothing to compare with.
+void grid_day_changes(const DailyGrid *grid, int metric, int lag, double *out) {
+    const double *values = grid->values[metric];
+    int head = lag < grid->day_count ? lag : grid->day_count;
+
+    for (int i = 0; i < head; i++) {
+        out[i] = NAN;
+    }
+    for (int i = head; i < grid->day_count; i++) {
+        out[i] = values[i] - values[i - lag];
+    }
+}
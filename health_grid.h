@@ -0,0 +1,37 @@
+#ifndef HEALTH_GRID_H
+#define HEALTH_GRID_H
+
+#include "health_logic.h"
+
+// Metrics held by the grid, in input.txt field order (height .. temperature)
+#define GRID_METRICS (ROW_FIELDS - 1)
+// Daily exports fill gaps of up to this many days and average over this many
+#define GRID_INTERPOLATE_DAYS 3
+#define GRID_AVERAGE_DAYS 7
+
+// What a slot of the grid holds
+typedef enum {
+    GRID_MISSING,           // no reading that day; the value is NaN
+    GRID_OBSERVED,
+    GRID_INTERPOLATED       // filled in between the observed days either side
+} GridState;
+
+// Readings resampled onto a regular daily grid: slot i of every metric is day
+// first_day + i. Values are dense arrays, one per metric, with NaN in missing
+// slots, so windowed work is plain arithmetic on neighbouring slots.
+typedef struct {
+    int first_day;
+    int day_count;
+    double *values[GRID_METRICS];
+    unsigned char *states[GRID_METRICS];    // GridState of every slot
+} DailyGrid;
+
+// Function declarations for the daily grid
+int build_daily_grid(int start_day, int end_day, DailyGrid *grid);
+void free_daily_grid(DailyGrid *grid);
+int interpolate_daily_grid(DailyGrid *grid, int max_gap);
+int find_grid_slot_before(const DailyGrid *grid, int metric, int slot, int max_gap);
+void grid_moving_average(const DailyGrid *grid, int metric, int window, double *out);
+void grid_day_changes(const DailyGrid *grid, int metric, int lag, double *out);
+
+#endif // HEALTH_GRID_H
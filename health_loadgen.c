@@ -0,0 +1,454 @@
+#include "health_logic.h"
+#include "health_perf.h"
+#include "health_memory.h"
+#include "health_protocol.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define LOADGEN_MAX_THREADS 64
+// Seconds without any answer before a run is given up
+#define LOADGEN_TIMEOUT 10
+
+typedef struct {
+    int fd;
+    int in_flight;
+    uint32_t events;
+    unsigned char *in;
+    size_t in_length;
+    size_t in_capacity;
+    unsigned char *out;
+    size_t out_length;
+    size_t out_sent;
+    size_t out_capacity;
+} ClientConnection;
+
+// What every client thread is told to do
+typedef struct {
+    const char *socket_path;
+    int connections;
+    long long requests;
+    int depth;
+    int kind;               // a RequestKind, or 0 for a mix of the query kinds
+    int start_day;
+    int end_day;
+    int random_ranges;      // random sub-ranges of [start_day, end_day] instead of the whole range
+    const char *filter;
+} LoadOptions;
+
+typedef struct {
+    const LoadOptions *options;
+    int connections;
+    long long requests;
+    unsigned int seed;
+    long long issued;
+    long long answered;
+    long long *sent_at;     // nanoseconds, by request id
+    long long *latencies;   // nanoseconds, one per answered request
+    long long status_counts[RESPONSE_BUSY + 1];
+    long long rows;
+    int failed;
+} ClientThread;
+
+static const struct {
+    const char *name;
+    int kind;
+} kind_names[] = {
+    { "mixed", 0 },
+    { "ping", REQUEST_PING },
+    { "stats", REQUEST_STATS },
+    { "abnormalities", REQUEST_ABNORMALITIES },
+    { "comparison", REQUEST_COMPARISON },
+    { "readings", REQUEST_READINGS },
+    { "filter", REQUEST_FILTER }
+};
+
+static int grow_buffer(unsigned char **data, size_t *capacity, size_t needed) {
+    if (needed <= *capacity) return 1;
+    size_t new_capacity = *capacity ? *capacity : 4096;
+    while (new_capacity < needed) new_capacity *= 2;
+    unsigned char *grown = realloc(*data, new_capacity);
+    if (!grown) return 0;
+    *data = grown;
+    *capacity = new_capacity;
+    return 1;
+}
+
+static int connect_to_server(const char *path) {
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) return -1;
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Appends the next request of the run to the connection's output
+static int issue_request(ClientThread *thread, ClientConnection *connection) {
+    const LoadOptions *options = thread->options;
+    static const int mixed_kinds[] = {
+        REQUEST_STATS, REQUEST_ABNORMALITIES, REQUEST_COMPARISON, REQUEST_READINGS, REQUEST_FILTER
+    };
+
+    HealthRequest request = {0};
+    request.id = (uint32_t)thread->issued;
+    request.kind = (uint8_t)(options->kind ? options->kind : mixed_kinds[rand_r(&thread->seed) % 5]);
+    request.start_day = options->start_day;
+    request.end_day = options->end_day;
+    if (options->random_ranges) {
+        int span = options->end_day - options->start_day + 1;
+        request.start_day = options->start_day + rand_r(&thread->seed) % span;
+        request.end_day = request.start_day + rand_r(&thread->seed) % (options->end_day - request.start_day + 1);
+    }
+    if (request.kind == REQUEST_COMPARISON) request.start_day = request.end_day;
+    if (request.kind == REQUEST_FILTER) {
+        request.text = options->filter;
+        request.text_length = strlen(options->filter);
+    }
+
+    if (!grow_buffer(&connection->out, &connection->out_capacity,
+                     connection->out_length + PROTOCOL_LENGTH_BYTES + PROTOCOL_MAX_REQUEST))
+        return 0;
+    size_t size = encode_request(&request, connection->out + connection->out_length,
+                                 connection->out_capacity - connection->out_length);
+    if (size == 0) return 0;
+    connection->out_length += size;
+    connection->in_flight++;
+    thread->sent_at[thread->issued++] = health_perf_now();
+    return 1;
+}
+
+// Sends what the socket takes and watches for writability if anything is left
+static int flush_requests(int epoll_fd, ClientConnection *connection) {
+    while (connection->out_sent < connection->out_length) {
+        ssize_t sent = send(connection->fd, connection->out + connection->out_sent,
+                            connection->out_length - connection->out_sent, MSG_NOSIGNAL);
+        if (sent > 0) {
+            connection->out_sent += (size_t)sent;
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            return 0;
+        }
+    }
+    if (connection->out_sent == connection->out_length) {
+        connection->out_sent = 0;
+        connection->out_length = 0;
+    }
+
+    uint32_t events = EPOLLIN | (connection->out_length > 0 ? EPOLLOUT : 0);
+    if (events != connection->events) {
+        struct epoll_event event = { .events = events, .data.ptr = connection };
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+        connection->events = events;
+    }
+    return 1;
+}
+
+// Reads the answers that have arrived and issues a new request for each one
+static int read_responses(ClientThread *thread, ClientConnection *connection) {
+    for (;;) {
+        if (!grow_buffer(&connection->in, &connection->in_capacity, connection->in_length + 65536)) return 0;
+        ssize_t received = recv(connection->fd, connection->in + connection->in_length,
+                                connection->in_capacity - connection->in_length, 0);
+        if (received > 0) {
+            connection->in_length += (size_t)received;
+            continue;
+        }
+        if (received < 0 && errno == EINTR) continue;
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        return 0;
+    }
+
+    size_t used = 0;
+    for (;;) {
+        long size = get_frame_size(connection->in + used, connection->in_length - used, (size_t)-1 / 2);
+        if (size <= 0) break;
+
+        HealthResponse response;
+        const unsigned char *payload = connection->in + used + PROTOCOL_LENGTH_BYTES;
+        if (!decode_response(payload, (size_t)size - PROTOCOL_LENGTH_BYTES, &response) ||
+            response.id >= thread->issued || response.status > RESPONSE_BUSY)
+            return 0;
+
+        thread->latencies[thread->answered++] = health_perf_now() - thread->sent_at[response.id];
+        thread->status_counts[response.status]++;
+        thread->rows += response.rows;
+        connection->in_flight--;
+        used += (size_t)size;
+
+        if (thread->issued < thread->requests && !issue_request(thread, connection)) return 0;
+    }
+    memmove(connection->in, connection->in + used, connection->in_length - used);
+    connection->in_length -= used;
+    return 1;
+}
+
+static void* client_main(void *arg) {
+    ClientThread *thread = arg;
+    const LoadOptions *options = thread->options;
+    ClientConnection *connections = calloc(thread->connections, sizeof(ClientConnection));
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (!connections || epoll_fd < 0) {
+        thread->failed = 1;
+        free(connections);
+        return NULL;
+    }
+
+    int opened = 0;
+    for (; opened < thread->connections; opened++) {
+        ClientConnection *connection = &connections[opened];
+        connection->fd = connect_to_server(options->socket_path);
+        connection->events = EPOLLIN;
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = connection };
+        if (connection->fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connection->fd, &event) != 0) {
+            thread->failed = 1;
+            break;
+        }
+    }
+
+    for (int c = 0; c < opened && !thread->failed; c++) {
+        for (int d = 0; d < options->depth && thread->issued < thread->requests; d++) {
+            if (!issue_request(thread, &connections[c])) thread->failed = 1;
+        }
+        if (!flush_requests(epoll_fd, &connections[c])) thread->failed = 1;
+    }
+
+    struct epoll_event events[64];
+    while (!thread->failed && thread->answered < thread->issued) {
+        int ready = epoll_wait(epoll_fd, events, 64, LOADGEN_TIMEOUT * 1000);
+        if (ready == 0) {
+            fprintf(stderr, "No answer for %d seconds\n", LOADGEN_TIMEOUT);
+            thread->failed = 1;
+        }
+        for (int i = 0; i < ready && !thread->failed; i++) {
+            ClientConnection *connection = events[i].data.ptr;
+            if ((events[i].events & EPOLLIN) && !read_responses(thread, connection)) thread->failed = 1;
+            if (!thread->failed && !flush_requests(epoll_fd, connection)) thread->failed = 1;
+            if (!thread->failed && (events[i].events & (EPOLLERR | EPOLLHUP)) && connection->in_flight > 0) {
+                thread->failed = 1;
+            }
+        }
+    }
+
+    for (int c = 0; c < opened; c++) {
+        close(connections[c].fd);
+        free(connections[c].in);
+        free(connections[c].out);
+    }
+    free(connections);
+    close(epoll_fd);
+    return NULL;
+}
+
+static int compare_latencies(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile_us(const long long *sorted, long long count, double fraction) {
+    return sorted[(long long)(fraction * (count - 1))] / 1000.0;
+}
+
+static int parse_range(const char *text, int *start_day, int *end_day) {
+    char start[DATE_TEXT_SIZE], end[DATE_TEXT_SIZE];
+    const char *colon = strchr(text, ':');
+    if (!colon || colon - text != DATE_TEXT_SIZE - 1 || strlen(colon + 1) != DATE_TEXT_SIZE - 1) return 0;
+    memcpy(start, text, DATE_TEXT_SIZE - 1);
+    start[DATE_TEXT_SIZE - 1] = '\0';
+    strcpy(end, colon + 1);
+    return parse_day_number(start, start_day) && parse_day_number(end, end_day) && *start_day <= *end_day;
+}
+
+// Asks the server what memory it holds and prints it, one subsystem per line
+static int print_memory_report(const char *socket_path) {
+    int fd = connect_to_server(socket_path);
+    if (fd < 0 || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK) != 0) {
+        fprintf(stderr, "Could not connect to %s\n", socket_path);
+        if (fd >= 0) close(fd);
+        return 0;
+    }
+
+    HealthRequest request = {0};
+    request.kind = REQUEST_MEMORY;
+    unsigned char frame[PROTOCOL_LENGTH_BYTES + PROTOCOL_REQUEST_HEADER];
+    size_t size = encode_request(&request, frame, sizeof(frame));
+    int ok = size > 0 && send(fd, frame, size, MSG_NOSIGNAL) == (ssize_t)size;
+
+    unsigned char *in = NULL;
+    size_t length = 0, capacity = 0;
+    long frame_size = 0;
+    while (ok && (frame_size = get_frame_size(in, length, (size_t)-1 / 2)) == 0) {
+        ssize_t received = -1;
+        if (grow_buffer(&in, &capacity, length + 4096)) received = recv(fd, in + length, capacity - length, 0);
+        if (received > 0)
+            length += (size_t)received;
+        else
+            ok = 0;
+    }
+    close(fd);
+
+    HealthResponse response;
+    ok = ok && frame_size > 0 &&
+         decode_response(in + PROTOCOL_LENGTH_BYTES, (size_t)frame_size - PROTOCOL_LENGTH_BYTES, &response) &&
+         response.status == RESPONSE_OK;
+    if (ok) {
+        // Rows are "subsystem<TAB>bytes"
+        const char *row = response.body, *end = response.body + response.body_length;
+        while (row < end) {
+            const char *newline = memchr(row, '\n', end - row);
+            const char *tab = memchr(row, '\t', (newline ? newline : end) - row);
+            if (!newline || !tab) break;
+            char text[24];
+            format_memory_size((size_t)strtoull(tab + 1, NULL, 10), text, sizeof(text));
+            printf("%-16.*s %10s\n", (int)(tab - row), row, text);
+            row = newline + 1;
+        }
+        char text[24];
+        format_memory_size((size_t)response.total, text, sizeof(text));
+        printf("%-16s %10s\n", "total", text);
+    } else {
+        fprintf(stderr, "No memory report from %s\n", socket_path);
+    }
+    free(in);
+    return ok;
+}
+
+// Measures the query server with many concurrent clients, each keeping `depth`
+// requests in flight, and prints throughput and latency percentiles:
+//   health_loadgen [-s socket] [-c connections] [-t threads] [-n requests] [-d depth]
+//                  [-k mixed|ping|stats|abnormalities|comparison|readings|filter]
+//                  [-r YYYY-MM-DD:YYYY-MM-DD] [-x] [-f filter]
+//   health_loadgen [-s socket] -M
+// -x asks for random sub-ranges of the -r range. -M prints the server's memory
+// footprint instead of measuring it. Exits with 1 if a connection failed or a
+// request went unanswered.
+int main(int argc, char *argv[]) {
+    LoadOptions options = {0};
+    options.socket_path = PROTOCOL_SOCKET;
+    options.connections = 64;
+    options.requests = 100000;
+    options.depth = 1;
+    options.start_day = make_day_number(1970, 1, 1);
+    options.end_day = make_day_number(2099, 12, 31);
+    options.filter = "sugar > 180 and systolic > 130";
+    int thread_count = 4;
+    int memory_report = 0;
+
+    int option;
+    while ((option = getopt(argc, argv, "s:c:t:n:d:k:r:xf:M")) != -1) {
+        int known = 1;
+        switch (option) {
+        case 's': options.socket_path = optarg; break;
+        case 'c': options.connections = atoi(optarg); break;
+        case 't': thread_count = atoi(optarg); break;
+        case 'n': options.requests = atoll(optarg); break;
+        case 'd': options.depth = atoi(optarg); break;
+        case 'x': options.random_ranges = 1; break;
+        case 'f': options.filter = optarg; break;
+        case 'M': memory_report = 1; break;
+        case 'r': known = parse_range(optarg, &options.start_day, &options.end_day); break;
+        case 'k':
+            known = 0;
+            for (size_t i = 0; i < sizeof(kind_names) / sizeof(kind_names[0]); i++) {
+                if (strcmp(optarg, kind_names[i].name) == 0) {
+                    options.kind = kind_names[i].kind;
+                    known = 1;
+                }
+            }
+            break;
+        default: known = 0; break;
+        }
+        if (!known) {
+            fprintf(stderr, "usage: %s [-s socket] [-c connections] [-t threads] [-n requests] [-d depth]\n"
+                            "       [-k mixed|ping|stats|abnormalities|comparison|readings|filter]\n"
+                            "       [-r YYYY-MM-DD:YYYY-MM-DD] [-x] [-f filter]\n"
+                            "       %s [-s socket] -M\n", argv[0], argv[0]);
+            return 2;
+        }
+    }
+    if (memory_report) return print_memory_report(options.socket_path) ? 0 : 1;
+    if (thread_count < 1) thread_count = 1;
+    if (thread_count > LOADGEN_MAX_THREADS) thread_count = LOADGEN_MAX_THREADS;
+    if (options.connections < thread_count) options.connections = thread_count;
+    if (options.depth < 1) options.depth = 1;
+    if (options.requests < 1) options.requests = 1;
+
+    ClientThread threads[LOADGEN_MAX_THREADS] = {0};
+    pthread_t ids[LOADGEN_MAX_THREADS];
+    long long *latencies = malloc(options.requests * sizeof(long long));
+    long long *sent_at = malloc(options.requests * sizeof(long long));
+    if (!latencies || !sent_at) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    long long start = health_perf_now();
+    long long offset = 0;
+    int started = 0;
+    for (int t = 0; t < thread_count; t++) {
+        ClientThread *thread = &threads[t];
+        thread->options = &options;
+        thread->connections = options.connections / thread_count + (t < options.connections % thread_count);
+        thread->requests = options.requests / thread_count + (t < options.requests % thread_count);
+        thread->seed = 12345u + t;
+        thread->latencies = latencies + offset;
+        thread->sent_at = sent_at + offset;
+        offset += thread->requests;
+        if (pthread_create(&ids[t], NULL, client_main, thread) != 0) {
+            thread->failed = 1;
+            break;
+        }
+        started++;
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    double seconds = (health_perf_now() - start) / 1e9;
+
+    // Answered latencies are at the front of each thread's share; gather them
+    long long answered = 0, rows = 0, status_counts[RESPONSE_BUSY + 1] = {0};
+    int failed = started < thread_count;
+    for (int t = 0; t < started; t++) {
+        memmove(latencies + answered, threads[t].latencies, threads[t].answered * sizeof(long long));
+        answered += threads[t].answered;
+        rows += threads[t].rows;
+        failed |= threads[t].failed;
+        for (int s = 0; s <= RESPONSE_BUSY; s++) status_counts[s] += threads[t].status_counts[s];
+    }
+
+    printf("%lld of %lld requests answered in %.3f s: %.0f requests/s\n",
+           answered, options.requests, seconds, answered / seconds);
+    printf("%d connections on %d threads, %d in flight each\n", options.connections, thread_count, options.depth);
+    if (answered > 0) {
+        qsort(latencies, answered, sizeof(long long), compare_latencies);
+        printf("latency us: p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+               percentile_us(latencies, answered, 0.50), percentile_us(latencies, answered, 0.90),
+               percentile_us(latencies, answered, 0.99), percentile_us(latencies, answered, 0.999),
+               latencies[answered - 1] / 1000.0);
+    }
+    printf("ok %lld  bad request %lld  failed %lld  busy %lld  rows %lld\n",
+           status_counts[RESPONSE_OK], status_counts[RESPONSE_BAD_REQUEST],
+           status_counts[RESPONSE_FAILED], status_counts[RESPONSE_BUSY], rows);
+
+    free(latencies);
+    free(sent_at);
+    return failed || answered < options.requests ? 1 : 0;
+}
+
+// Linux only (epoll). Start health_server first, then for example:
+// gcc health_logic.c health_series.c health_stream.c health_advice.c health_memory.c health_grid.c health_perf.c health_sketch.c health_segment.c health_epoch.c health_protocol.c health_loadgen.c -o health_loadgen -lm -pthread
+// ./health_loadgen -c 1000 -n 1000000 -k stats
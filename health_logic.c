@@ -1,13 +1,622 @@
 #include "health_logic.h"
+#include "health_series.h"
+#include "health_segment.h"
+#include "health_stream.h"
+#include "health_advice.h"
+#include "health_memory.h"
+#include "health_grid.h"
+#include "health_perf.h"
+#include <sys/stat.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
-void write_data_to_file(const char *date, const char *height, const char *weight, 
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Bounded LRU cache of range query results. Entries are keyed on the query kind,
+// the date range and the data version they were computed at; a write moves the
+// version forward, dropping entries whose range covers the changed dates and
+// re-keying the rest, which are still correct.
+typedef enum {
+    QUERY_STATS,
+    QUERY_ABNORMALITIES
+} QueryKind;
+
+typedef struct {
+    int used;
+    QueryKind kind;
+    int start_day;
+    int end_day;
+    unsigned long version;
+    unsigned long last_used;
+    int row_count;
+    StatsTableData stats[6];
+    int abnormal[4];
+} ResultCacheEntry;
+
+// The cache is split into shards by key, each under its own lock, so queries on
+// different ranges do not wait for one another. Locks are held only to copy an
+// entry in or out, never while a result is computed.
+#define RESULT_CACHE_SHARDS 8
+#define RESULT_SHARD_SIZE (RESULT_CACHE_SIZE / RESULT_CACHE_SHARDS)
+
+typedef struct {
+    pthread_mutex_t lock;
+    unsigned long tick;
+    ResultCacheEntry entries[RESULT_SHARD_SIZE];
+} ResultCacheShard;
+
+static ResultCacheShard result_shards[RESULT_CACHE_SHARDS];
+static pthread_once_t result_cache_once = PTHREAD_ONCE_INIT;
+static atomic_ulong data_version = 1;
+
+// Identity of input.txt when the cache was last brought up to date (zeroed while
+// there is no input.txt). Nanosecond mtime and the inode catch a rewrite of the
+// same size within one second and a file replaced by rename.
+static pthread_mutex_t stamp_lock = PTHREAD_MUTEX_INITIALIZER;
+static DataFileIdentity data_file_stamp = { 0, 0, -1, -1 };
+
+static ResultCacheShard* result_shard(QueryKind kind, int start_day, int end_day) {
+    unsigned hash = (unsigned)start_day * 2654435761u ^ (unsigned)end_day * 40503u ^ (unsigned)kind;
+    return &result_shards[(hash >> 16) % RESULT_CACHE_SHARDS];
+}
+
+// Moves the data version forward. Entries overlapping [first_day, last_day]
+// are dropped; INT_MIN..INT_MAX drops everything. Entries stored at an older
+// version by a query that raced an earlier change are dropped too.
+static void init_result_cache(void);
+
+static void invalidate_cached_results(int first_day, int last_day) {
+    pthread_once(&result_cache_once, init_result_cache);
+    unsigned long previous = atomic_fetch_add(&data_version, 1);
+    for (int s = 0; s < RESULT_CACHE_SHARDS; s++) {
+        ResultCacheShard *shard = &result_shards[s];
+        pthread_mutex_lock(&shard->lock);
+        for (int i = 0; i < RESULT_SHARD_SIZE; i++) {
+            ResultCacheEntry *entry = &shard->entries[i];
+            if (!entry->used) continue;
+
+            if (entry->version != previous || (entry->start_day <= last_day && entry->end_day >= first_day))
+                entry->used = 0;
+            else
+                entry->version = previous + 1;
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+
+    DataFileIdentity identity;
+    stat_data_file_identity("input.txt", &identity);
+    pthread_mutex_lock(&stamp_lock);
+    data_file_stamp = identity;
+    pthread_mutex_unlock(&stamp_lock);
+}
+
+unsigned long get_health_data_version(void) {
+    return atomic_load(&data_version);
+}
+
+static void init_result_cache(void) {
+    for (int s = 0; s < RESULT_CACHE_SHARDS; s++) {
+        pthread_mutex_init(&result_shards[s].lock, NULL);
+    }
+    add_health_series_listener(invalidate_cached_results);
+    add_stream_listener(invalidate_cached_results);
+}
+
+// Copies the cached result for the query into `result`, if there is one computed
+// at the current data version. Either way `version` is set to the version a
+// result computed now is to be stored at.
+static int lookup_cached_result(QueryKind kind, int start_day, int end_day,
+                                ResultCacheEntry *result, unsigned long *version) {
+    pthread_once(&result_cache_once, init_result_cache);
+
+    // Catch writers we were not told about (no file watcher, series not loaded),
+    // bringing the series the percentiles come from up to date with them. Device
+    // readings appended since the last query drop the entries they touch.
+    refresh_stream_readings();
+    DataFileIdentity identity;
+    stat_data_file_identity("input.txt", &identity);
+    pthread_mutex_lock(&stamp_lock);
+    int changed = !same_data_file_identity(&identity, &data_file_stamp);
+    pthread_mutex_unlock(&stamp_lock);
+    if (changed) {
+        refresh_health_series();
+        invalidate_cached_results(INT_MIN, INT_MAX);
+    }
+
+    *version = atomic_load(&data_version);
+    ResultCacheShard *shard = result_shard(kind, start_day, end_day);
+    int found = 0;
+    pthread_mutex_lock(&shard->lock);
+    for (int i = 0; i < RESULT_SHARD_SIZE; i++) {
+        ResultCacheEntry *entry = &shard->entries[i];
+        if (entry->used && entry->kind == kind && entry->version == *version &&
+            entry->start_day == start_day && entry->end_day == end_day) {
+            entry->last_used = ++shard->tick;
+            *result = *entry;
+            found = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return found;
+}
+
+// Bytes held by the cache entries in use
+size_t get_result_cache_bytes(void) {
+    pthread_once(&result_cache_once, init_result_cache);
+    size_t bytes = 0;
+    for (int s = 0; s < RESULT_CACHE_SHARDS; s++) {
+        pthread_mutex_lock(&result_shards[s].lock);
+        for (int i = 0; i < RESULT_SHARD_SIZE; i++) {
+            if (result_shards[s].entries[i].used) bytes += sizeof(ResultCacheEntry);
+        }
+        pthread_mutex_unlock(&result_shards[s].lock);
+    }
+    return bytes;
+}
+
+// Drops every cached result; each is computed again on its next query
+void clear_result_cache(void) {
+    pthread_once(&result_cache_once, init_result_cache);
+    for (int s = 0; s < RESULT_CACHE_SHARDS; s++) {
+        pthread_mutex_lock(&result_shards[s].lock);
+        for (int i = 0; i < RESULT_SHARD_SIZE; i++) {
+            result_shards[s].entries[i].used = 0;
+        }
+        pthread_mutex_unlock(&result_shards[s].lock);
+    }
+}
+
+// Stores a result computed at `version` (from lookup_cached_result), evicting the
+// least recently used entry of its shard. Over the memory budget the whole cache
+// is dropped first (see reserve_memory).
+static void store_cached_result(QueryKind kind, int start_day, int end_day, unsigned long version,
+                                const ResultCacheEntry *result) {
+    reserve_memory(sizeof(ResultCacheEntry));
+    ResultCacheShard *shard = result_shard(kind, start_day, end_day);
+    pthread_mutex_lock(&shard->lock);
+    ResultCacheEntry *slot = &shard->entries[0];
+    for (int i = 0; i < RESULT_SHARD_SIZE; i++) {
+        if (!shard->entries[i].used) {
+            slot = &shard->entries[i];
+            break;
+        }
+        if (shard->entries[i].last_used < slot->last_used) slot = &shard->entries[i];
+    }
+
+    *slot = *result;
+    slot->used = 1;
+    slot->kind = kind;
+    slot->start_day = start_day;
+    slot->end_day = end_day;
+    slot->version = version;
+    slot->last_used = ++shard->tick;
+    pthread_mutex_unlock(&shard->lock);
+}
+
+// Days since 1970-01-01 of a valid calendar date (month 1-12)
+int make_day_number(int year, int month, int mday) {
+    // Count years from March so the leap day comes last
+    int y = year - (month <= 2);
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int year_of_era = y - era * 400;
+    int day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + mday - 1;
+    int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+// Parses the 10 characters YYYY-MM-DD at `date`, whatever follows them
+int parse_date_digits(const char *date, int *day) {
+    for (int i = 0; i < 10; i++) {
+        if (i == 4 || i == 7 ? date[i] != '-' : (date[i] < '0' || date[i] > '9'))
+            return 0;
+    }
+
+    int year = (date[0] - '0') * 1000 + (date[1] - '0') * 100 + (date[2] - '0') * 10 + (date[3] - '0');
+    int month = (date[5] - '0') * 10 + (date[6] - '0');
+    int mday = (date[8] - '0') * 10 + (date[9] - '0');
+
+    static const int month_days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    int leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    if (month < 1 || month > 12 || mday < 1 || mday > month_days[month - 1] + (month == 2 && leap))
+        return 0;
+
+    *day = make_day_number(year, month, mday);
+    return 1;
+}
+
+// Parses a YYYY-MM-DD date into a day number. Returns 0 for anything that is not
+// a real calendar date in exactly that form.
+int parse_day_number(const char *date, int *day) {
+    return parse_date_digits(date, day) && date[10] == '\0';
+}
+
+static void fill_data_file_identity(const struct stat *st, DataFileIdentity *identity) {
+    identity->device = (uint64_t)st->st_dev;
+    identity->inode = (uint64_t)st->st_ino;
+    identity->size = st->st_size;
+#ifdef _WIN32
+    identity->mtime_ns = (int64_t)st->st_mtime * 1000000000;
+#else
+    identity->mtime_ns = (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+#endif
+}
+
+// Identity of an open data file. Returns 0 (and a zeroed identity) if it cannot
+// be read.
+int read_data_file_identity(FILE *file, DataFileIdentity *identity) {
+    struct stat st;
+    memset(identity, 0, sizeof(DataFileIdentity));
+    if (fstat(fileno(file), &st) != 0) return 0;
+    fill_data_file_identity(&st, identity);
+    return 1;
+}
+
+// Identity of the file at `path`. Returns 0 (and a zeroed identity) if there is none.
+int stat_data_file_identity(const char *path, DataFileIdentity *identity) {
+    struct stat st;
+    memset(identity, 0, sizeof(DataFileIdentity));
+    if (stat(path, &st) != 0) return 0;
+    fill_data_file_identity(&st, identity);
+    return 1;
+}
+
+int same_data_file_identity(const DataFileIdentity *a, const DataFileIdentity *b) {
+    return a->device == b->device && a->inode == b->inode && a->size == b->size && a->mtime_ns == b->mtime_ns;
+}
+
+// Hash of the DATA_FILE_TAIL_CHECK bytes of a data file before `offset` (fewer
+// near the start). Moves the file position.
+uint64_t data_file_tail_hash(FILE *file, long offset) {
+    unsigned char buffer[DATA_FILE_TAIL_CHECK];
+    long start = offset > DATA_FILE_TAIL_CHECK ? offset - DATA_FILE_TAIL_CHECK : 0;
+    size_t length = 0;
+    if (fseek(file, start, SEEK_SET) == 0) length = fread(buffer, 1, (size_t)(offset - start), file);
+
+    uint64_t hash = 14695981039346656037ULL ^ (uint64_t)length;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ buffer[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Whether `file`, now `identity`, is the file that was read up to `offset` when
+// it was `read`, with at most bytes appended since, so reading can go on from
+// `offset`. A replaced file (new inode), one that shrank, one rewritten without
+// growing, and one whose bytes before `offset` moved or changed (as far as the
+// last DATA_FILE_TAIL_CHECK of them show) must be read again from the start.
+int data_file_appended(FILE *file, const DataFileIdentity *identity, const DataFileIdentity *read,
+                       long offset, uint64_t tail_hash) {
+    if (identity->device != read->device || identity->inode != read->inode || identity->size < offset)
+        return 0;
+    if (identity->size <= read->size) return same_data_file_identity(identity, read);
+    return data_file_tail_hash(file, offset) == tail_hash;
+}
+
+// Reads one line, newline included, into a buffer that grows to fit it, so a long
+// line is never split into two rows. A last line without a newline is returned as
+// it is. Returns 0 at end of file (or if the buffer cannot grow).
+int read_line(FILE *file, LineBuffer *line) {
+    line->length = 0;
+    for (;;) {
+        if (line->capacity - line->length < 2) {
+            size_t new_capacity = line->capacity ? line->capacity * 2 : 256;
+            char *grown = realloc(line->text, new_capacity);
+            if (!grown) return 0;
+            line->text = grown;
+            line->capacity = new_capacity;
+        }
+        if (!fgets(line->text + line->length, (int)(line->capacity - line->length), file)) break;
+
+        line->length += strlen(line->text + line->length);
+        if (line->text[line->length - 1] == '\n') break;
+    }
+    return line->length > 0;
+}
+
+void free_line(LineBuffer *line) {
+    free(line->text);
+    line->text = NULL;
+    line->length = 0;
+    line->capacity = 0;
+}
+
+static const double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+};
+
+// Parses a decimal number [+-]digits[.digits] spanning [start, end) exactly, with
+// blanks allowed around it. Up to 15 significant digits are converted by a single
+// correctly rounded division (the same double strtod gives); longer numbers, after
+// the syntax check, go to strtod, which stops at the field end. `places` is set to
+// the digits after the point, not counting trailing zeros.
+static int scan_decimal(const char *start, const char *end, double *value, int *places) {
+    while (start < end && (*start == ' ' || *start == '\t')) start++;
+    while (end > start && (end[-1] == ' ' || end[-1] == '\t')) end--;
+
+    const char *c = start;
+    int negative = 0;
+    if (c < end && (*c == '-' || *c == '+')) negative = *c++ == '-';
+
+    unsigned long long mantissa = 0;
+    int digits = 0, decimals = 0, seen_point = 0;
+    *places = 0;
+    for (; c < end; c++) {
+        unsigned d = (unsigned)(*c - '0');
+        if (d <= 9) {
+            mantissa = mantissa * 10 + d;
+            digits++;
+            decimals += seen_point;
+            if (seen_point && d != 0) *places = decimals;
+        } else if (*c == '.' && !seen_point) {
+            seen_point = 1;
+        } else {
+            return 0;
+        }
+    }
+    if (digits == 0) return 0;
+
+    if (digits <= 15) {
+        *value = (double)mantissa / powers_of_ten[decimals];
+        if (negative) *value = -*value;
+    } else {
+        *value = strtod(start, NULL);
+    }
+    return 1;
+}
+
+int parse_decimal(const char *start, const char *end, double *value) {
+    int places;
+    return scan_decimal(start, end, value, &places);
+}
+
+// Parses one reading: a decimal number with at most READING_DECIMALS digits after
+// the point and below READING_LIMIT in magnitude. Every reading that passes is held
+// exactly by the fixed-point stores, so all reports see the value that was entered.
+int parse_reading(const char *start, const char *end, double *value) {
+    int places;
+    return scan_decimal(start, end, value, &places) && places <= READING_DECIMALS &&
+           fabs(*value) < READING_LIMIT;
+}
+
+// Splits one input.txt line into its seven fields and converts them in the same
+// pass: exactly seven comma-separated fields, a YYYY-MM-DD date and six readings
+// (see parse_reading). Trailing blanks and line endings are ignored. Nothing is copied; `text`
+// must be NUL-terminated at or after text[length].
+RowResult parse_health_row(const char *text, size_t length, HealthRow *row) {
+    const char *end = text + length;
+    while (end > text && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t')) end--;
+    if (end == text) return ROW_BLANK;
+
+    const char *field = text;
+    for (int f = 0; f < ROW_FIELDS; f++) {
+        const char *comma = memchr(field, ',', end - field);
+        const char *field_end = comma ? comma : end;
+        if ((comma != NULL) != (f < ROW_FIELDS - 1)) return ROW_BAD_FIELD_COUNT;
+
+        row->field[f] = field;
+        row->field_length[f] = (int)(field_end - field);
+        field = field_end + 1;
+    }
+
+    if (row->field_length[0] != 10 || !parse_date_digits(row->field[0], &row->day)) return ROW_BAD_DATE;
+    for (int f = 1; f < ROW_FIELDS; f++) {
+        if (!parse_reading(row->field[f], row->field[f] + row->field_length[f], &row->values[f - 1]))
+            return ROW_BAD_NUMBER;
+    }
+    return ROW_OK;
+}
+
+// Formats a day number as YYYY-MM-DD into `date` (at least DATE_TEXT_SIZE bytes)
+void format_day_number(int day, char *date) {
+    int z = day + 719468;
+    int era = (z >= 0 ? z : z - 146096) / 146097;
+    int day_of_era = z - era * 146097;
+    int year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    int day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    int mp = (5 * day_of_year + 2) / 153;
+    int mday = day_of_year - (153 * mp + 2) / 5 + 1;
+    int month = mp < 10 ? mp + 3 : mp - 9;
+    int year = year_of_era + era * 400 + (month <= 2);
+    sprintf(date, "%04d-%02d-%02d", year, month, mday);
+}
+
+// Held while input.txt is appended to or rewritten, so the background writer and
+// compaction never interleave
+static pthread_mutex_t data_file_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int flush_to_disk(FILE *file) {
+    if (fflush(file) != 0) return 0;
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+// Atomically replace `path` with `tmp_path`
+int replace_file(const char *tmp_path, const char *path) {
+#ifdef _WIN32
+    return MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(tmp_path, path) == 0;
+#endif
+}
+
+// Formats one input.txt line, newline included. Returns 0 if it does not fit.
+int format_data_row(int day, const char *height, const char *weight, const char *bp_sys,
+                    const char *bp_dia, const char *blood_sugar, const char *temp,
+                    char *row, size_t size) {
+    char date[DATE_TEXT_SIZE];
+    format_day_number(day, date);
+
+    int length = snprintf(row, size, "%s,%s,%s,%s,%s,%s,%s\n", date, height, weight, bp_sys, bp_dia, blood_sugar, temp);
+    return length > 0 && (size_t)length < size;
+}
+
+// Appends complete rows to input.txt and waits until they are on disk. Safe to call
+// from any thread. Returns 0 if the rows may not have been stored.
+int append_data_rows(const char *rows, size_t length) {
+    pthread_mutex_lock(&data_file_lock);
+    FILE *file = fopen("input.txt", "ab");
+    int ok = 0;
+    if (file) {
+        ok = fwrite(rows, 1, length, file) == length;
+        ok = flush_to_disk(file) && ok;
+        ok = fclose(file) == 0 && ok;
+    }
+    pthread_mutex_unlock(&data_file_lock);
+    return ok;
+}
+
+// Brings the in-memory state up to date after rows for [first_day, last_day] were
+// appended, compacting input.txt if it has become too dirty. Safe from any thread.
+void data_rows_appended(int first_day, int last_day) {
+    invalidate_cached_results(first_day, last_day);
+    refresh_health_series();
+
+    if (get_health_data_dirty_ratio() > COMPACT_DIRTY_THRESHOLD) {
+        compact_data_file();
+    }
+}
+
+void write_data_to_file(int day, const char *height, const char *weight, 
                        const char *bp_sys, const char *bp_dia, const char *blood_sugar, 
                        const char *temp) {
-    FILE *file = fopen("input.txt", "a");
+    char row[256];
+    if (format_data_row(day, height, weight, bp_sys, bp_dia, blood_sugar, temp, row, sizeof(row))) {
+        append_data_rows(row, strlen(row));
+    }
+    data_rows_appended(day, day);
+}
+
+// One line of input.txt as read by the compaction job
+typedef struct {
+    char *text;
+    int day;
+    int order;
+} DataFileRow;
+
+static void free_data_file_rows(DataFileRow *rows, int count) {
+    for (int i = 0; i < count; i++) {
+        free(rows[i].text);
+    }
+    free(rows);
+}
+
+static int compare_rows_by_date(const void *a, const void *b) {
+    const DataFileRow *row_a = a, *row_b = b;
+    if (row_a->day != row_b->day) return row_a->day < row_b->day ? -1 : 1;
+    return row_a->order - row_b->order;
+}
+
+static int compact_locked_data_file(void) {
+    FILE *file = fopen("input.txt", "rb");
+    if (!file) {
+        return 0;
+    }
+
+    DataFileRow *rows = NULL;
+    int count = 0, capacity = 0;
+    LineBuffer line = {0};
+    HealthRow row;
+    FILE *rejected = NULL;
+    int ok = 1;
+
+    while (ok && read_line(file, &line)) {
+        size_t length = line.length;
+        while (length > 0 && (line.text[length - 1] == '\n' || line.text[length - 1] == '\r' || line.text[length - 1] == ' '))
+            line.text[--length] = '\0';
+
+        RowResult parsed = parse_health_row(line.text, length, &row);
+        if (parsed == ROW_BLANK) continue;
+        if (parsed != ROW_OK) {
+            if (!rejected) rejected = fopen("input.txt.rejected", "a");
+            if (rejected) fprintf(rejected, "%s\n", line.text);
+            continue;
+        }
+
+        if (count == capacity) {
+            int new_capacity = capacity ? capacity * 2 : 256;
+            DataFileRow *grown = realloc(rows, new_capacity * sizeof(DataFileRow));
+            if (!grown) {
+                ok = 0;
+                break;
+            }
+            rows = grown;
+            capacity = new_capacity;
+        }
+        rows[count].text = malloc(length + 1);
+        if (!rows[count].text) {
+            ok = 0;
+            break;
+        }
+        memcpy(rows[count].text, line.text, length + 1);
+        rows[count].day = row.day;
+        rows[count].order = count;
+        count++;
+    }
+    long size = ftell(file);
+    fclose(file);
+    free_line(&line);
+    if (rejected) fclose(rejected);
+    if (!ok) {
+        free_data_file_rows(rows, count);
+        return 0;
+    }
+
+    qsort(rows, count, sizeof(DataFileRow), compare_rows_by_date);
+
+    FILE *out = fopen("input.txt.tmp", "wb");
+    if (!out) {
+        free_data_file_rows(rows, count);
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        if (i + 1 < count && rows[i].day == rows[i + 1].day)
+            continue;
+        fprintf(out, "%s\n", rows[i].text);
+    }
+    free_data_file_rows(rows, count);
+
+    ok = flush_to_disk(out);
+    ok = fclose(out) == 0 && ok;
+
+    // Abort if another writer appended while we were compacting
+    file = fopen("input.txt", "rb");
     if (file) {
-        fprintf(file, "%s,%s,%s,%s,%s,%s,%s\n", date, height, weight, bp_sys, bp_dia, blood_sugar, temp);
+        fseek(file, 0, SEEK_END);
+        ok = ok && ftell(file) == size;
         fclose(file);
     }
+
+    if (!ok || !replace_file("input.txt.tmp", "input.txt")) {
+        remove("input.txt.tmp");
+        return 0;
+    }
+    return 1;
+}
+
+// Rewrites input.txt sorted by date with one row per date, keeping the row written
+// last. The new file is built next to the old one and swapped in with a rename, so
+// readers see either the old or the new file. Rows that do not parse are moved to
+// input.txt.rejected. If the file grows while compacting (another process appended),
+// nothing is replaced and 0 is returned.
+int compact_data_file(void) {
+    pthread_mutex_lock(&data_file_lock);
+    int ok = compact_locked_data_file();
+    pthread_mutex_unlock(&data_file_lock);
+    if (!ok) return 0;
+
+    invalidate_health_series();
+    invalidate_segment_store();
+    invalidate_cached_results(INT_MIN, INT_MAX);
+    return 1;
 }
 
 // Helper function to get status indicators for health metrics
@@ -33,36 +642,144 @@ const char* get_bp_status(int systolic, int diastolic) {
         return "Normal";
 }
 
-void check_for_abnormalities_typewise_in_range(const char *start_date, const char *end_date, 
+// Counts the categories one reading (values in input.txt field order) is abnormal
+// in. Blood pressure and sugar are compared in whole units, truncated as (int)
+// truncates; weight and temperature as read. The range checks and the cohort
+// queries both count rows through here.
+void count_reading_abnormalities(const double values[ROW_FIELDS - 1], long long counts[ABNORMAL_KINDS]) {
+    counts[ABNORMAL_WEIGHT] += is_weight_abnormal(values[1]);
+    counts[ABNORMAL_BP] += is_bp_abnormal((int)values[2], (int)values[3]);
+    counts[ABNORMAL_SUGAR] += is_sugar_abnormal((int)values[4]);
+    counts[ABNORMAL_TEMP] += is_temp_abnormal(values[5]);
+}
+
+// Abnormality rules behind count_reading_abnormalities and the zone map checks
+int is_weight_abnormal(double weight) {
+    return weight < 30.0 || weight > 100.0;
+}
+
+int is_bp_abnormal(int systolic, int diastolic) {
+    return systolic > 140 || diastolic > 90;
+}
+
+int is_sugar_abnormal(int sugar) {
+    return sugar > 200;
+}
+
+int is_temp_abnormal(double temp) {
+    return temp > 38.0 || temp < 35.0;
+}
+
+// Result of one abnormality check over every row of a block, as far as its zone
+// map proves it: 0 (no row abnormal), 1 (all rows) or -1 (the rows must be read).
+// Weight and temperature are normal inside an interval, so both ends of the zone
+// being normal proves every row normal; blood pressure and sugar only get worse
+// as values rise, so the zone maximum and minimum decide them.
+static int zone_interval_check(int (*is_abnormal)(double), double min, double max) {
+    if (!is_abnormal(min) && !is_abnormal(max)) return 0;
+    if (min == max) return 1;
+    return -1;
+}
+
+// Fills counts (weight, blood pressure, sugar, temperature) for a block lying
+// wholly inside the queried range from its zone map alone. Returns 0 if the zone
+// map cannot settle every check and the block has to be decoded.
+static int count_abnormal_from_zone(const SegmentZone *zone, int rows, int counts[4]) {
+    int checks[4];
+    checks[0] = zone_interval_check(is_weight_abnormal, segment_value(SEGMENT_WEIGHT, zone->min[SEGMENT_WEIGHT]),
+                                    segment_value(SEGMENT_WEIGHT, zone->max[SEGMENT_WEIGHT]));
+    checks[1] = is_bp_abnormal(segment_whole(SEGMENT_BP_SYS, zone->min[SEGMENT_BP_SYS]),
+                               segment_whole(SEGMENT_BP_DIA, zone->min[SEGMENT_BP_DIA])) ? 1 :
+                !is_bp_abnormal(segment_whole(SEGMENT_BP_SYS, zone->max[SEGMENT_BP_SYS]),
+                                segment_whole(SEGMENT_BP_DIA, zone->max[SEGMENT_BP_DIA])) ? 0 : -1;
+    checks[2] = is_sugar_abnormal(segment_whole(SEGMENT_SUGAR, zone->min[SEGMENT_SUGAR])) ? 1 :
+                !is_sugar_abnormal(segment_whole(SEGMENT_SUGAR, zone->max[SEGMENT_SUGAR])) ? 0 : -1;
+    checks[3] = zone_interval_check(is_temp_abnormal, segment_value(SEGMENT_TEMP, zone->min[SEGMENT_TEMP]),
+                                    segment_value(SEGMENT_TEMP, zone->max[SEGMENT_TEMP]));
+
+    for (int k = 0; k < 4; k++) {
+        if (checks[k] < 0) return 0;
+        counts[k] = checks[k] * rows;
+    }
+    return 1;
+}
+
+void check_for_abnormalities_typewise_in_range(int start_day, int end_day, 
                                              int *abnormal_weight, int *abnormal_bp, 
                                              int *abnormal_sugar, int *abnormal_temp) {
-    FILE *file = fopen("input.txt", "r");
-    if (!file) {
-        printf("Error: Could not open input.txt\n");
+    PERF_START(perf);
+    ResultCacheEntry cached;
+    unsigned long version;
+    if (lookup_cached_result(QUERY_ABNORMALITIES, start_day, end_day, &cached, &version)) {
+        *abnormal_weight = cached.abnormal[0];
+        *abnormal_bp = cached.abnormal[1];
+        *abnormal_sugar = cached.abnormal[2];
+        *abnormal_temp = cached.abnormal[3];
+        PERF_LAP(perf, "abnormalities.cache_hit");
         return;
     }
 
-    char line[256], date[20], height[10], weight[10], bp_sys[10], bp_dia[10], sugar[10], temp[10];
-    int found = 0;
-
     *abnormal_weight = 0;
     *abnormal_bp = 0;
     *abnormal_sugar = 0;
     *abnormal_temp = 0;
 
-    while (fgets(line, sizeof(line), file)) {
-        sscanf(line, "%[^,],%[^,],%[^,],%[^,],%[^,],%[^,],%s", date, height, weight, bp_sys, bp_dia, sugar, temp);
+    if (!refresh_segment_store()) {
+        printf("Error: Could not open input.txt\n");
+        return;
+    }
+    PERF_LAP(perf, "abnormalities.open");
+
+    int found = 0;
+    SegmentBlock *block = malloc(sizeof(SegmentBlock));
+    if (!block) return;
+
+    const SegmentSnapshot *snapshot = acquire_segment_snapshot();
+    int blocks = get_segment_block_count(snapshot);
+    for (int b = 0; b < blocks; b++) {
+        BlockOverlap overlap = get_segment_block_overlap(snapshot, b, start_day, end_day);
+        if (overlap == BLOCK_OUTSIDE) continue;
 
-        if (strcmp(date, start_date) >= 0 && strcmp(date, end_date) <= 0) {
-            if (atof(weight) < 30.0 || atof(weight) > 100.0) (*abnormal_weight)++;
-            if (atoi(bp_sys) > 140 || atoi(bp_dia) > 90) (*abnormal_bp)++;
-            if (atoi(sugar) > 200) (*abnormal_sugar)++;
-            if (atof(temp) > 38.0 || atof(temp) < 35.0) (*abnormal_temp)++;
+        SegmentZone zone;
+        int rows = read_segment_zone(snapshot, b, &zone);
+        int zone_counts[4];
+        if (overlap == BLOCK_INSIDE && count_abnormal_from_zone(&zone, rows, zone_counts)) {
+            *abnormal_weight += zone_counts[0];
+            *abnormal_bp += zone_counts[1];
+            *abnormal_sugar += zone_counts[2];
+            *abnormal_temp += zone_counts[3];
             found = 1;
+            continue;
         }
+
+        rows = read_segment_block(snapshot, b, block);
+        const int32_t *days = block->values[SEGMENT_DATE];
+        long long row_counts[ABNORMAL_KINDS] = {0, 0, 0, 0};
+
+        for (int i = 0; i < rows; i++) {
+            if (days[i] < start_day || days[i] > end_day) continue;
+
+            double values[ROW_FIELDS - 1];
+            for (int c = SEGMENT_HEIGHT; c < SEGMENT_COLUMNS; c++) {
+                values[c - 1] = segment_value(c, block->values[c][i]);
+            }
+            count_reading_abnormalities(values, row_counts);
+            found = 1;
+        }
+        *abnormal_weight += (int)row_counts[ABNORMAL_WEIGHT];
+        *abnormal_bp += (int)row_counts[ABNORMAL_BP];
+        *abnormal_sugar += (int)row_counts[ABNORMAL_SUGAR];
+        *abnormal_temp += (int)row_counts[ABNORMAL_TEMP];
     }
+    release_segment_snapshot(snapshot);
+    free(block);
+    PERF_LAP(perf, "abnormalities.parse");
 
-    fclose(file);
+    cached.abnormal[0] = *abnormal_weight;
+    cached.abnormal[1] = *abnormal_bp;
+    cached.abnormal[2] = *abnormal_sugar;
+    cached.abnormal[3] = *abnormal_temp;
+    store_cached_result(QUERY_ABNORMALITIES, start_day, end_day, version, &cached);
 
     if (!found) {
         printf("No data found in the given range.\n");
@@ -75,312 +792,281 @@ int get_all_health_data(HealthData **data) {
         return 0;
     }
 
-    char line[256];
+    LineBuffer line = {0};
+    HealthRow row;
     int count = 0;
-    while (fgets(line, sizeof(line), file)) {
+    while (read_line(file, &line)) {
         count++;
     }
     
     if (count == 0) {
+        free_line(&line);
         fclose(file);
         return 0;
     }
 
     *data = malloc(count * sizeof(HealthData));
     if (!*data) {
+        free_line(&line);
         fclose(file);
         return 0;
     }
 
     rewind(file);
     int index = 0;
-    char date[20], height[10], weight[10], bp_sys[10], bp_dia[10], sugar[10], temp[10];
     
-    while (fgets(line, sizeof(line), file) && index < count) {
-        sscanf(line, "%[^,],%[^,],%[^,],%[^,],%[^,],%[^,],%s", 
-               date, height, weight, bp_sys, bp_dia, sugar, temp);
+    while (read_line(file, &line) && index < count) {
+        if (parse_health_row(line.text, line.length, &row) != ROW_OK)
+            continue;
         
-        strcpy((*data)[index].date, date);
-        (*data)[index].bp_systolic = atof(bp_sys);
-        (*data)[index].bp_diastolic = atof(bp_dia);
-        (*data)[index].blood_sugar = atof(sugar);
+        (*data)[index].day = row.day;
+        (*data)[index].bp_systolic = row.values[2];
+        (*data)[index].bp_diastolic = row.values[3];
+        (*data)[index].blood_sugar = row.values[4];
         index++;
     }
 
+    free_line(&line);
     fclose(file);
-    return count;
+    return index;
 }
 
-int get_comparison_table_data(const char *current_date, ComparisonTableData **data) {
-    FILE *file = fopen("input.txt", "r");
-    if (!file) {
-        return 0;
-    }
+// Units and change formats of the comparison rows. Height is not compared, and a
+// change within `threshold` reads as no change.
+static const struct {
+    const char *metric;
+    const char *change_format;
+    double threshold;
+} comparison_metrics[ROW_FIELDS - 1] = {
+    { "Height (cm)", NULL, 0 },
+    { "Weight (kg)", "%+.1f kg", 0.1 },
+    { "BP Systolic (mmHg)", "%+.0f mmHg", 0.5 },
+    { "BP Diastolic (mmHg)", "%+.0f mmHg", 0.5 },
+    { "Blood Sugar (mg/dL)", "%+.0f mg/dL", 0.5 },
+    { "Temperature (°C)", "%+.1f °C", 0.1 }
+};
 
-    char line[256];
-    char date[20], prev_date[20] = "", height[10], weight[10], bp_sys[10], bp_dia[10], sugar[10], temp[10];
-    char prev_height[10] = "", prev_weight[10] = "", prev_bp_sys[10] = "", prev_bp_dia[10] = "", prev_sugar[10] = "", prev_temp[10] = "";
-    int found = 0, prev_found = 0;
+// Text of a metric's value on one grid slot at the precision of the entry form;
+// a day of device readings also shows how many readings its mean covers
+static void format_grid_value(const DailyGrid *grid, int metric, int slot, char *text) {
+    int decimals = get_segment_decimals(metric + 1);
+    int day = grid->first_day + slot;
+    StreamTotals totals;
+    if (get_stream_totals(metric, day, day, &totals) > 0)
+        snprintf(text, 20, "%.*f (n=%lld)", decimals, grid->values[metric][slot], totals.count);
+    else
+        snprintf(text, 20, "%.*f", decimals, grid->values[metric][slot]);
+}
 
-    while (fgets(line, sizeof(line), file)) {
-        sscanf(line, "%[^,],%[^,],%[^,],%[^,],%[^,],%[^,],%s", date, height, weight, bp_sys, bp_dia, sugar, temp);
+int get_comparison_table_data(int current_day, ComparisonTableData **data) {
+    PERF_START(perf);
 
-        if (strcmp(date, current_date) == 0) {
-            found = 1;
-            break;
-        }
+    // The current day and the COMPARISON_MAX_GAP days before it on the daily grid.
+    // The earlier value is each metric's latest observed day in that window, so a
+    // reading weeks old is never passed off as the previous one.
+    DailyGrid grid;
+    char current_date[DATE_TEXT_SIZE];
+    format_day_number(current_day, current_date);
+    if (build_daily_grid(current_day - COMPARISON_MAX_GAP, current_day, &grid) <= 0) return 0;
+    PERF_LAP(perf, "comparison.grid");
 
-        strcpy(prev_date, date);
-        strcpy(prev_height, height);
-        strcpy(prev_weight, weight);
-        strcpy(prev_bp_sys, bp_sys);
-        strcpy(prev_bp_dia, bp_dia);
-        strcpy(prev_sugar, sugar);
-        strcpy(prev_temp, temp);
-        prev_found = 1;
+    double values[2][ROW_FIELDS - 1];
+    char texts[2][ROW_FIELDS - 1][20];
+    int known[2][ROW_FIELDS - 1];
+    int any_known = 0;
+    int now = grid.day_count - 1;
+    for (int m = 0; m < ROW_FIELDS - 1; m++) {
+        int before = find_grid_slot_before(&grid, m, now, COMPARISON_MAX_GAP);
+        known[0][m] = grid.states[m][now] == GRID_OBSERVED;
+        known[1][m] = before >= 0;
+        if (known[0][m]) {
+            values[0][m] = grid.values[m][now];
+            format_grid_value(&grid, m, now, texts[0][m]);
+        }
+        if (known[1][m]) {
+            values[1][m] = grid.values[m][before];
+            format_grid_value(&grid, m, before, texts[1][m]);
+        }
+        any_known |= known[0][m];
     }
+    free_daily_grid(&grid);
 
-    fclose(file);
-
-    if (!found) {
+    if (!any_known) {
         return 0;
     }
 
     *data = malloc(6 * sizeof(ComparisonTableData));
     if (!*data) return 0;
 
-    int row = 0;
+    for (int m = 0; m < ROW_FIELDS - 1; m++) {
+        ComparisonTableData *out = &(*data)[m];
+        strcpy(out->date, current_date);
+        strcpy(out->metric, comparison_metrics[m].metric);
+        strcpy(out->current_value, known[0][m] ? texts[0][m] : "N/A");
+        strcpy(out->previous_value, known[1][m] ? texts[1][m] : "N/A");
+        strcpy(out->status, "N/A");
 
-    // Height
-    strcpy((*data)[row].date, current_date);
-    strcpy((*data)[row].metric, "Height (cm)");
-    strcpy((*data)[row].current_value, height);
-    strcpy((*data)[row].previous_value, prev_found ? prev_height : "N/A");
-    strcpy((*data)[row].change, prev_found ? "No change" : "N/A");
-    strcpy((*data)[row].status, "N/A");
-    row++;
-
-    // Weight
-    strcpy((*data)[row].date, current_date);
-    strcpy((*data)[row].metric, "Weight (kg)");
-    strcpy((*data)[row].current_value, weight);
-    strcpy((*data)[row].previous_value, prev_found ? prev_weight : "N/A");
-    if (prev_found) {
-        double change = atof(weight) - atof(prev_weight);
-        char change_str[20];
-        if (change > 0.1) {
-            snprintf(change_str, sizeof(change_str), "+%.1f kg", change);
-        } else if (change < -0.1) {
-            snprintf(change_str, sizeof(change_str), "%.1f kg", change);
+        if (!known[0][m] || !known[1][m]) {
+            strcpy(out->change, "N/A");
+        } else if (!comparison_metrics[m].change_format || fabs(values[0][m] - values[1][m]) <= comparison_metrics[m].threshold) {
+            strcpy(out->change, "No change");
         } else {
-            strcpy(change_str, "No change");
+            snprintf(out->change, sizeof(out->change), comparison_metrics[m].change_format, values[0][m] - values[1][m]);
         }
-        strcpy((*data)[row].change, change_str);
-    } else {
-        strcpy((*data)[row].change, "N/A");
     }
-    strcpy((*data)[row].status, get_status_indicator(atof(weight), 30, 55, 65));
-    row++;
 
-    // Blood Pressure Systolic
-    strcpy((*data)[row].date, current_date);
-    strcpy((*data)[row].metric, "BP Systolic (mmHg)");
-    strcpy((*data)[row].current_value, bp_sys);
-    strcpy((*data)[row].previous_value, prev_found ? prev_bp_sys : "N/A");
-    if (prev_found) {
-        double change = atof(bp_sys) - atof(prev_bp_sys);
-        char change_str[20];
-        if (change > 0) {
-            snprintf(change_str, sizeof(change_str), "+%.0f mmHg", change);
-        } else if (change < 0) {
-            snprintf(change_str, sizeof(change_str), "%.0f mmHg", change);
-        } else {
-            strcpy(change_str, "No change");
-        }
-        strcpy((*data)[row].change, change_str);
-    } else {
-        strcpy((*data)[row].change, "N/A");
+    if (known[0][1]) strcpy((*data)[1].status, get_status_indicator(values[0][1], 30, 55, 65));
+    if (known[0][2] && known[0][3]) {
+        strcpy((*data)[2].status, get_bp_status((int)values[0][2], (int)values[0][3]));
+        strcpy((*data)[3].status, (*data)[2].status);
     }
-    strcpy((*data)[row].status, get_bp_status(atoi(bp_sys), atoi(bp_dia)));
-    row++;
+    if (known[0][4]) strcpy((*data)[4].status, get_status_indicator(values[0][4], 70.0, 99.0, 126.0));
+    if (known[0][5]) strcpy((*data)[5].status, get_status_indicator(values[0][5], 36.1, 37.0, 38.0));
+    PERF_LAP(perf, "comparison.format");
 
-    // Blood Pressure Diastolic
-    strcpy((*data)[row].date, current_date);
-    strcpy((*data)[row].metric, "BP Diastolic (mmHg)");
-    strcpy((*data)[row].current_value, bp_dia);
-    strcpy((*data)[row].previous_value, prev_found ? prev_bp_dia : "N/A");
-    if (prev_found) {
-        double change = atof(bp_dia) - atof(prev_bp_dia);
-        char change_str[20];
-        if (change > 0) {
-            snprintf(change_str, sizeof(change_str), "+%.0f mmHg", change);
-        } else if (change < 0) {
-            snprintf(change_str, sizeof(change_str), "%.0f mmHg", change);
-        } else {
-            strcpy(change_str, "No change");
-        }
-        strcpy((*data)[row].change, change_str);
-    } else {
-        strcpy((*data)[row].change, "N/A");
-    }
-    strcpy((*data)[row].status, get_bp_status(atoi(bp_sys), atoi(bp_dia)));
-    row++;
+    return 6;
+}
 
-    // Blood Sugar
-    strcpy((*data)[row].date, current_date);
-    strcpy((*data)[row].metric, "Blood Sugar (mg/dL)");
-    strcpy((*data)[row].current_value, sugar);
-    strcpy((*data)[row].previous_value, prev_found ? prev_sugar : "N/A");
-    if (prev_found) {
-        double change = atof(sugar) - atof(prev_sugar);
-        char change_str[20];
-        if (change > 0) {
-            snprintf(change_str, sizeof(change_str), "+%.0f mg/dL", change);
-        } else if (change < 0) {
-            snprintf(change_str, sizeof(change_str), "%.0f mg/dL", change);
-        } else {
-            strcpy(change_str, "No change");
-        }
-        strcpy((*data)[row].change, change_str);
-    } else {
-        strcpy((*data)[row].change, "N/A");
+int get_stats_table_data(int start_day, int end_day, StatsTableData **data) {
+    PERF_START(perf);
+    ResultCacheEntry cached;
+    unsigned long version;
+    if (lookup_cached_result(QUERY_STATS, start_day, end_day, &cached, &version)) {
+        if (cached.row_count == 0) return 0;
+        *data = malloc(cached.row_count * sizeof(StatsTableData));
+        if (!*data) return 0;
+        memcpy(*data, cached.stats, cached.row_count * sizeof(StatsTableData));
+        PERF_LAP(perf, "stats.cache_hit");
+        return cached.row_count;
     }
-    strcpy((*data)[row].status, get_status_indicator(atof(sugar), 70.0, 99.0, 126.0));
-    row++;
 
-    // Temperature
-    strcpy((*data)[row].date, current_date);
-    strcpy((*data)[row].metric, "Temperature (°C)");
-    strcpy((*data)[row].current_value, temp);
-    strcpy((*data)[row].previous_value, prev_found ? prev_temp : "N/A");
-    if (prev_found) {
-        double change = atof(temp) - atof(prev_temp);
-        char change_str[20];
-        if (change > 0.1) {
-            snprintf(change_str, sizeof(change_str), "+%.1f °C", change);
-        } else if (change < -0.1) {
-            snprintf(change_str, sizeof(change_str), "%.1f °C", change);
-        } else {
-            strcpy(change_str, "No change");
-        }
-        strcpy((*data)[row].change, change_str);
-    } else {
-        strcpy((*data)[row].change, "N/A");
-    }
-    strcpy((*data)[row].status, get_status_indicator(atof(temp), 36.1, 37.0, 38.0));
+    int stored = refresh_segment_store();
+    PERF_LAP(perf, "stats.open");
 
-    return 6;
-}
+    // Fixed-point sums are exact (the squares in 128 bits), so one pass gives both
+    // mean and variance. Device readings are kept at the same scale, so their
+    // totals add straight in.
+    long long count[SEGMENT_COLUMNS] = {0}, sum[SEGMENT_COLUMNS] = {0};
+    FixedSquareSum sum_squares[SEGMENT_COLUMNS] = {0};
+    int rows = 0;
+    SegmentBlock *block = malloc(sizeof(SegmentBlock));
+    if (!block) return 0;
 
-int get_stats_table_data(const char *start_date, const char *end_date, StatsTableData **data) {
-    FILE *file = fopen("input.txt", "r");
-    if (!file) {
-        return 0;
-    }
+    const SegmentSnapshot *snapshot = acquire_segment_snapshot();
+    int blocks = stored ? get_segment_block_count(snapshot) : 0;
+    for (int b = 0; b < blocks; b++) {
+        if (get_segment_block_overlap(snapshot, b, start_day, end_day) == BLOCK_OUTSIDE) continue;
+        int block_rows = read_segment_block(snapshot, b, block);
+        const int32_t *days = block->values[SEGMENT_DATE];
 
-    double height_sum = 0, weight_sum = 0, bp_sys_sum = 0, bp_dia_sum = 0, sugar_sum = 0, temp_sum = 0;
-    int count = 0;
-    
-    char line[256], date[20], height[10], weight[10], bp_sys[10], bp_dia[10], sugar[10], temp[10];
-    while (fgets(line, sizeof(line), file)) {
-        sscanf(line, "%[^,],%[^,],%[^,],%[^,],%[^,],%[^,],%s", date, height, weight, bp_sys, bp_dia, sugar, temp);
-
-        if (strcmp(date, start_date) >= 0 && strcmp(date, end_date) <= 0) {
-            height_sum += atof(height);
-            weight_sum += atof(weight);
-            bp_sys_sum += atof(bp_sys);
-            bp_dia_sum += atof(bp_dia);
-            sugar_sum += atof(sugar);
-            temp_sum += atof(temp);
-            count++;
+        for (int i = 0; i < block_rows; i++) {
+            if (days[i] < start_day || days[i] > end_day) continue;
+
+            for (int c = SEGMENT_HEIGHT; c < SEGMENT_COLUMNS; c++) {
+                long long value = block->values[c][i];
+                sum[c] += value;
+                sum_squares[c] += (FixedSquareSum)value * value;
+            }
+            rows++;
         }
     }
+    release_segment_snapshot(snapshot);
+    free(block);
+    PERF_LAP(perf, "stats.parse");
 
-    if (count == 0) {
-        fclose(file);
-        return 0;
+    long long readings = rows;
+    for (int c = SEGMENT_HEIGHT; c < SEGMENT_COLUMNS; c++) {
+        StreamTotals totals;
+        get_stream_totals(c - 1, start_day, end_day, &totals);
+        count[c] = rows + totals.count;
+        sum[c] += totals.sum;
+        sum_squares[c] += totals.sum_squares;
+        readings += totals.count;
     }
 
-    double height_avg = height_sum / count;
-    double weight_avg = weight_sum / count;
-    double bp_sys_avg = bp_sys_sum / count;
-    double bp_dia_avg = bp_dia_sum / count;
-    double sugar_avg = sugar_sum / count;
-    double temp_avg = temp_sum / count;
-
-    rewind(file);
-    double height_var = 0, weight_var = 0, bp_sys_var = 0, bp_dia_var = 0, sugar_var = 0, temp_var = 0;
-    
-    while (fgets(line, sizeof(line), file)) {
-        sscanf(line, "%[^,],%[^,],%[^,],%[^,],%[^,],%[^,],%s", date, height, weight, bp_sys, bp_dia, sugar, temp);
-
-        if (strcmp(date, start_date) >= 0 && strcmp(date, end_date) <= 0) {
-            height_var += pow(atof(height) - height_avg, 2);
-            weight_var += pow(atof(weight) - weight_avg, 2);
-            bp_sys_var += pow(atof(bp_sys) - bp_sys_avg, 2);
-            bp_dia_var += pow(atof(bp_dia) - bp_dia_avg, 2);
-            sugar_var += pow(atof(sugar) - sugar_avg, 2);
-            temp_var += pow(atof(temp) - temp_avg, 2);
-        }
+    if (readings == 0) {
+        cached.row_count = 0;
+        store_cached_result(QUERY_STATS, start_day, end_day, version, &cached);
+        return 0;
     }
 
-    fclose(file);
+    double mean[SEGMENT_COLUMNS], variance[SEGMENT_COLUMNS];
+    for (int c = SEGMENT_HEIGHT; c < SEGMENT_COLUMNS; c++) {
+        if (count[c] == 0) continue;
+        // n * sum of squares - sum^2 is n^2 times the variance, worked out in
+        // integers so nothing cancels in floating point
+        FixedSquareSum spread = sum_squares[c] * count[c] - (FixedSquareSum)sum[c] * sum[c];
+        double fixed_mean = (double)sum[c] / count[c];
+        double fixed_variance = (double)spread / ((double)count[c] * count[c]);
+        mean[c] = segment_value(c, 1) * fixed_mean;
+        variance[c] = fixed_variance > 0 ? pow(segment_value(c, 1), 2) * fixed_variance : 0;
+    }
+    PERF_LAP(perf, "stats.aggregate");
 
     *data = malloc(6 * sizeof(StatsTableData));
     if (!*data) return 0;
 
-    int row = 0;
-
-    // Height
-    strcpy((*data)[row].metric, "Height (cm)");
-    snprintf((*data)[row].average, sizeof((*data)[row].average), "%.1f", height_avg);
-    snprintf((*data)[row].std_deviation, sizeof((*data)[row].std_deviation), "%.1f", sqrt(height_var / count));
-    strcpy((*data)[row].status, "N/A");
-    row++;
-
-    // Weight
-    strcpy((*data)[row].metric, "Weight (kg)");
-    snprintf((*data)[row].average, sizeof((*data)[row].average), "%.1f", weight_avg);
-    snprintf((*data)[row].std_deviation, sizeof((*data)[row].std_deviation), "%.1f", sqrt(weight_var / count));
-    strcpy((*data)[row].status, get_status_indicator(weight_avg, 30, 55, 65));
-    row++;
-
-    // BP Systolic
-    strcpy((*data)[row].metric, "BP Systolic (mmHg)");
-    snprintf((*data)[row].average, sizeof((*data)[row].average), "%.1f", bp_sys_avg);
-    snprintf((*data)[row].std_deviation, sizeof((*data)[row].std_deviation), "%.1f", sqrt(bp_sys_var / count));
-    strcpy((*data)[row].status, get_bp_status((int)bp_sys_avg, (int)bp_dia_avg));
-    row++;
+    static const char *metric_names[6] = {
+        "Height (cm)", "Weight (kg)", "BP Systolic (mmHg)", "BP Diastolic (mmHg)",
+        "Blood Sugar (mg/dL)", "Temperature (°C)"
+    };
+    int has_bp = count[SEGMENT_BP_SYS] > 0 && count[SEGMENT_BP_DIA] > 0;
+    for (int row = 0; row < 6; row++) {
+        int c = row + 1;
+        StatsTableData *out = &(*data)[row];
+        strcpy(out->metric, metric_names[row]);
+        strcpy(out->status, "N/A");
+        if (count[c] == 0) {
+            strcpy(out->average, "N/A");
+            strcpy(out->std_deviation, "N/A");
+            continue;
+        }
+        snprintf(out->average, sizeof(out->average), "%.1f", mean[c]);
+        snprintf(out->std_deviation, sizeof(out->std_deviation), "%.1f", sqrt(variance[c]));
 
-    // BP Diastolic
-    strcpy((*data)[row].metric, "BP Diastolic (mmHg)");
-    snprintf((*data)[row].average, sizeof((*data)[row].average), "%.1f", bp_dia_avg);
-    snprintf((*data)[row].std_deviation, sizeof((*data)[row].std_deviation), "%.1f", sqrt(bp_dia_var / count));
-    strcpy((*data)[row].status, get_bp_status((int)bp_sys_avg, (int)bp_dia_avg));
-    row++;
+        if (c == SEGMENT_WEIGHT)
+            strcpy(out->status, get_status_indicator(mean[c], 30, 55, 65));
+        else if ((c == SEGMENT_BP_SYS || c == SEGMENT_BP_DIA) && has_bp)
+            strcpy(out->status, get_bp_status((int)mean[SEGMENT_BP_SYS], (int)mean[SEGMENT_BP_DIA]));
+        else if (c == SEGMENT_SUGAR)
+            strcpy(out->status, get_status_indicator(mean[c], 70.0, 99.0, 126.0));
+        else if (c == SEGMENT_TEMP)
+            strcpy(out->status, get_status_indicator(mean[c], 36.1, 37.0, 38.0));
+    }
 
-    // Blood Sugar
-    strcpy((*data)[row].metric, "Blood Sugar (mg/dL)");
-    snprintf((*data)[row].average, sizeof((*data)[row].average), "%.1f", sugar_avg);
-    snprintf((*data)[row].std_deviation, sizeof((*data)[row].std_deviation), "%.1f", sqrt(sugar_var / count));
-    strcpy((*data)[row].status, get_status_indicator(sugar_avg, 70.0, 99.0, 126.0));
-    row++;
+    // Median and upper percentiles of BP and sugar come from the quantile sketches
+    // of the series and of the device readings
+    TDigest sketches[3];
+    int sketched = get_health_sketches_in_range(start_day, end_day, sketches);
+    for (int row = 0; row < 6; row++) {
+        int metric = row == 2 ? 0 : row == 3 ? 1 : row == 4 ? 2 : -1;
+        if (metric < 0 || sketched + get_stream_sketch_in_range(row, start_day, end_day, &sketches[metric]) == 0) {
+            strcpy((*data)[row].median, "N/A");
+            strcpy((*data)[row].p90, "N/A");
+            strcpy((*data)[row].p99, "N/A");
+            continue;
+        }
+        snprintf((*data)[row].median, sizeof((*data)[row].median), "%.1f", tdigest_quantile(&sketches[metric], 0.5));
+        snprintf((*data)[row].p90, sizeof((*data)[row].p90), "%.1f", tdigest_quantile(&sketches[metric], 0.9));
+        snprintf((*data)[row].p99, sizeof((*data)[row].p99), "%.1f", tdigest_quantile(&sketches[metric], 0.99));
+    }
+    PERF_LAP(perf, "stats.format");
 
-    // Temperature
-    strcpy((*data)[row].metric, "Temperature (°C)");
-    snprintf((*data)[row].average, sizeof((*data)[row].average), "%.1f", temp_avg);
-    snprintf((*data)[row].std_deviation, sizeof((*data)[row].std_deviation), "%.1f", sqrt(temp_var / count));
-    strcpy((*data)[row].status, get_status_indicator(temp_avg, 36.1, 37.0, 38.0));
+    cached.row_count = 6;
+    memcpy(cached.stats, *data, 6 * sizeof(StatsTableData));
+    store_cached_result(QUERY_STATS, start_day, end_day, version, &cached);
 
     return 6;
 }
 
-int get_abnormality_table_data(const char *start_date, const char *end_date, AbnormalityTableData **data) {
+int get_abnormality_table_data(int start_day, int end_day, AbnormalityTableData **data) {
     int abnormal_weight = 0, abnormal_bp = 0, abnormal_sugar = 0, abnormal_temp = 0;
     
-    check_for_abnormalities_typewise_in_range(start_date, end_date, 
+    PERF_START(perf);
+    check_for_abnormalities_typewise_in_range(start_day, end_day, 
                                             &abnormal_weight, &abnormal_bp, 
                                             &abnormal_sugar, &abnormal_temp);
+    PERF_LAP(perf, "abnormality_table.aggregate");
 
     *data = malloc(4 * sizeof(AbnormalityTableData));
     if (!*data) return 0;
@@ -405,98 +1091,26 @@ int get_abnormality_table_data(const char *start_date, const char *end_date, Abn
     strcpy((*data)[row].category, "Body Temperature");
     snprintf((*data)[row].count, sizeof((*data)[row].count), "%d", abnormal_temp);
     strcpy((*data)[row].advice, abnormal_temp > 0 ? "Needs attention" : "Good condition");
+    PERF_LAP(perf, "abnormality_table.format");
 
     return 4;
 }
 
-char* get_health_recommendations(const char *start_date, const char *end_date) {
-    int abnormal_weight = 0, abnormal_bp = 0, abnormal_sugar = 0, abnormal_temp = 0;
+char* get_health_recommendations(int start_day, int end_day) {
+    AbnormalitySummary summary;
     
-    check_for_abnormalities_typewise_in_range(start_date, end_date, 
-                                            &abnormal_weight, &abnormal_bp, 
-                                            &abnormal_sugar, &abnormal_temp);
+    PERF_START(perf);
+    check_for_abnormalities_typewise_in_range(start_day, end_day, 
+                                            &summary.days[0], &summary.days[1], 
+                                            &summary.days[2], &summary.days[3]);
+    PERF_LAP(perf, "recommendations.aggregate");
 
-    char* recommendations = malloc(2000);
-    if (!recommendations) return NULL;
-    
-    if (abnormal_weight == 0 && abnormal_bp == 0 && abnormal_sugar == 0 && abnormal_temp == 0) {
-        strcpy(recommendations, 
-               "Health Overview\n"
-               "===============\n\n"
-               "Everything looked normal in your health data for this period.\n\n"
-               "Health Tips:\n"
-               "• Continue your current healthy habits\n"
-               "• Keep doing regular physical activity\n"
-               "• Drink plenty of water daily (8-10 glasses)\n"
-               "• Get good sleep every night (7-8 hours)\n"
-               "• Visit your doctor for regular check-ups\n"
-               "• Keep tracking your health as you're doing\n"
-               "• Find healthy ways to manage stress\n\n");
-        return recommendations;
+    TextBuffer recommendations = {0};
+    if (!append_health_advice(&recommendations, &summary)) {
+        free_text_buffer(&recommendations);
+        return NULL;
     }
-    
-    strcpy(recommendations, "Health Overview\n");
-    strcat(recommendations, "===============\n\n");
-    
-    if (abnormal_weight > 0) {
-        strcat(recommendations, "Weight Management:\n");
-        char weight_info[200];
-        snprintf(weight_info, sizeof(weight_info), 
-                "Unusual weight readings detected on %d day(s).\n\n", abnormal_weight);
-        strcat(recommendations, weight_info);
-        strcat(recommendations, "• Focus on eating balanced, nutritious meals\n");
-        strcat(recommendations, "• Try to be more active in your daily routine\n");
-        strcat(recommendations, "• Keep track of what you eat and drink\n");
-        strcat(recommendations, "• Consider talking to a nutrition expert\n");
-        strcat(recommendations, "• Set realistic weight goals\n\n");
-    }
-
-    if (abnormal_bp > 0) {
-        strcat(recommendations, "Blood Pressure Care:\n");
-        char bp_info[200];
-        snprintf(bp_info, sizeof(bp_info), 
-                "Unusual blood pressure levels detected on %d day(s).\n\n", abnormal_bp);
-        strcat(recommendations, bp_info);
-        strcat(recommendations, "• Reduce salt in your food\n");
-        strcat(recommendations, "• Limit coffee and alcohol intake\n");
-        strcat(recommendations, "• Try relaxation techniques like deep breathing\n");
-        strcat(recommendations, "• Stay active with regular exercise\n");
-        strcat(recommendations, "• Schedule a doctor visit soon\n");
-        strcat(recommendations, "• Monitor your blood pressure regularly\n\n");
-    }
-
-    if (abnormal_sugar > 0) {
-        strcat(recommendations, "Blood Sugar Management:\n");
-        char sugar_info[200];
-        snprintf(sugar_info, sizeof(sugar_info), 
-                "Unusual blood sugar levels detected on %d day(s).\n\n", abnormal_sugar);
-        strcat(recommendations, sugar_info);
-        strcat(recommendations, "• Watch your intake of sweets and carbs\n");
-        strcat(recommendations, "• Check your blood sugar as recommended\n");
-        strcat(recommendations, "• Take your medications on time\n");
-        strcat(recommendations, "• See a diabetes specialist\n");
-        strcat(recommendations, "• Stay active after meals\n");
-        strcat(recommendations, "• Eat meals at regular times\n\n");
-    }
-
-    if (abnormal_temp > 0) {
-        strcat(recommendations, "Temperature Monitoring:\n");
-        char temp_info[200];
-        snprintf(temp_info, sizeof(temp_info), 
-                "Unusual temperature readings detected on %d day(s).\n\n", abnormal_temp);
-        strcat(recommendations, temp_info);
-        strcat(recommendations, "• Get plenty of rest and good sleep\n");
-        strcat(recommendations, "• Drink lots of fluids\n");
-        strcat(recommendations, "• Watch for other symptoms\n");
-        strcat(recommendations, "• See a doctor if fever continues\n");
-        strcat(recommendations, "• Take it easy with physical activities\n\n");
-    }
-
-    strcat(recommendations, "General Health Tips:\n");
-    strcat(recommendations, "• Keep up with regular doctor visits\n");
-    strcat(recommendations, "• Continue monitoring your health daily\n");
-    strcat(recommendations, "• Maintain good sleep habits\n");
-    strcat(recommendations, "• Practice stress management\n");
-
-    return recommendations;
+    PERF_LAP(perf, "recommendations.format");
+
+    return take_text_buffer(&recommendations);
 }
\ No newline at end of file
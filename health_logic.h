@@ -5,19 +5,121 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <limits.h>
+#include <stdint.h>
+
+// Compaction runs once this share of input.txt rows is superseded or out of date order
+#define COMPACT_DIRTY_THRESHOLD 0.25
+// Number of stats/abnormality results kept in the LRU result cache
+#define RESULT_CACHE_SIZE 32
+// The comparison table looks at most this many days back for the previous reading
+#define COMPARISON_MAX_GAP 7
+
+// Dates are carried as day numbers (days since 1970-01-01); ISO strings are only
+// parsed when reading input.txt and produced for display
+#define DATE_TEXT_SIZE 11
+
+// Fields of an input.txt row: the date, then height, weight, systolic, diastolic,
+// sugar and temperature
+#define ROW_FIELDS 7
+
+// Readings carry at most this many digits after the point and stay below this
+// magnitude, so the fixed-point stores hold them exactly (see parse_reading)
+#define READING_DECIMALS 3
+#define READING_LIMIT 1000000.0
+// Sums of squared fixed-point readings. A reading near READING_LIMIT is close to
+// 1e9 at scale 1000, so a handful of squares would overflow a long long; 128 bits
+// hold the squares of any number of rows an int can count.
+typedef __int128 FixedSquareSum;
+
+// Abnormality categories, in the order of the abnormality table
+enum {
+    ABNORMAL_WEIGHT,
+    ABNORMAL_BP,
+    ABNORMAL_SUGAR,
+    ABNORMAL_TEMP,
+    ABNORMAL_KINDS
+};
+
+// Outcome of parsing one line of input.txt
+typedef enum {
+    ROW_OK,
+    ROW_BLANK,
+    ROW_BAD_FIELD_COUNT,
+    ROW_BAD_DATE,
+    ROW_BAD_NUMBER,
+    ROW_RESULTS
+} RowResult;
+
+// One line of input.txt split in place. The field spans point into the line, so
+// they are only valid until the line buffer is reused.
+typedef struct {
+    int day;
+    double values[ROW_FIELDS - 1];
+    const char *field[ROW_FIELDS];
+    int field_length[ROW_FIELDS];
+} HealthRow;
+
+// Line of any length read by read_line; start zeroed and release with free_line
+typedef struct {
+    char *text;
+    size_t length;      // bytes of the line, newline included
+    size_t capacity;
+} LineBuffer;
+
+// Which file input.txt is and how it looked when last read. Any write moves the
+// size or the nanosecond mtime, and a file replaced by rename has a new inode.
+typedef struct {
+    uint64_t device;
+    uint64_t inode;
+    int64_t size;
+    int64_t mtime_ns;
+} DataFileIdentity;
+
+// Bytes before the offset a reader of input.txt stopped at that are hashed to
+// tell an append from an edit or a replaced file (see data_file_appended)
+#define DATA_FILE_TAIL_CHECK 4096
 
 // Function declarations for core logic
-void write_data_to_file(const char *date, const char *height, const char *weight, 
+int make_day_number(int year, int month, int mday);
+int parse_day_number(const char *date, int *day);
+int parse_date_digits(const char *date, int *day);
+int parse_decimal(const char *start, const char *end, double *value);
+int parse_reading(const char *start, const char *end, double *value);
+void format_day_number(int day, char *date);
+int read_data_file_identity(FILE *file, DataFileIdentity *identity);
+int stat_data_file_identity(const char *path, DataFileIdentity *identity);
+int same_data_file_identity(const DataFileIdentity *a, const DataFileIdentity *b);
+uint64_t data_file_tail_hash(FILE *file, long offset);
+int data_file_appended(FILE *file, const DataFileIdentity *identity, const DataFileIdentity *read,
+                       long offset, uint64_t tail_hash);
+int read_line(FILE *file, LineBuffer *line);
+void free_line(LineBuffer *line);
+RowResult parse_health_row(const char *text, size_t length, HealthRow *row);
+int compact_data_file(void);
+int replace_file(const char *tmp_path, const char *path);
+int format_data_row(int day, const char *height, const char *weight, const char *bp_sys,
+                    const char *bp_dia, const char *blood_sugar, const char *temp,
+                    char *row, size_t size);
+int append_data_rows(const char *rows, size_t length);
+void data_rows_appended(int first_day, int last_day);
+void write_data_to_file(int day, const char *height, const char *weight, 
                        const char *bp_sys, const char *bp_dia, const char *blood_sugar, 
                        const char *temp);
 
-void check_for_abnormalities_typewise_in_range(const char *start_date, const char *end_date, 
+void count_reading_abnormalities(const double values[ROW_FIELDS - 1], long long counts[ABNORMAL_KINDS]);
+int is_weight_abnormal(double weight);
+int is_bp_abnormal(int systolic, int diastolic);
+int is_sugar_abnormal(int sugar);
+int is_temp_abnormal(double temp);
+
+void check_for_abnormalities_typewise_in_range(int start_day, int end_day, 
                                               int *abnormal_weight, int *abnormal_bp, 
                                               int *abnormal_sugar, int *abnormal_temp);
 
 // Structure for graph data
 typedef struct {
-    char date[20];
+    int day;
     double bp_systolic;
     double bp_diastolic;
     double blood_sugar;
@@ -37,6 +139,9 @@ typedef struct {
     char metric[30];
     char average[20];
     char std_deviation[20];
+    char median[20];
+    char p90[20];
+    char p99[20];
     char status[20];
 } StatsTableData;
 
@@ -48,9 +153,12 @@ typedef struct {
 
 // Function declarations
 int get_all_health_data(HealthData **data);
-int get_comparison_table_data(const char *current_date, ComparisonTableData **data);
-int get_stats_table_data(const char *start_date, const char *end_date, StatsTableData **data);
-int get_abnormality_table_data(const char *start_date, const char *end_date, AbnormalityTableData **data);
-char* get_health_recommendations(const char *start_date, const char *end_date);
+int get_comparison_table_data(int current_day, ComparisonTableData **data);
+int get_stats_table_data(int start_day, int end_day, StatsTableData **data);
+int get_abnormality_table_data(int start_day, int end_day, AbnormalityTableData **data);
+char* get_health_recommendations(int start_day, int end_day);
+unsigned long get_health_data_version(void);
+size_t get_result_cache_bytes(void);
+void clear_result_cache(void);
 
 #endif // HEALTH_LOGIC_H
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include "health_memory.h"
+#include "health_logic.h"
+#include "health_series.h"
+#include "health_segment.h"
+#include "health_stream.h"
+#include "health_advice.h"
+#include <ctype.h>
+#include <stdint.h>
+
+static const char *subsystem_names[MEMORY_SUBSYSTEMS] = {
+    "series", "series index", "segments", "device readings", "result cache", "reports"
+};
+
+// Bytes the accounted subsystems may hold together; 0 means no limit
+static size_t memory_budget = 0;
+
+const char* get_memory_subsystem_name(int subsystem) {
+    return subsystem >= 0 && subsystem < MEMORY_SUBSYSTEMS ? subsystem_names[subsystem] : "";
+}
+
+// Heap bytes held by each subsystem right now. Safe from any thread; the series
+// reports its footprint as of its last change.
+void get_memory_usage(MemoryUsage *usage) {
+    get_health_series_bytes(&usage->bytes[MEMORY_SERIES], &usage->bytes[MEMORY_SERIES_INDEX]);
+    usage->bytes[MEMORY_SEGMENTS] = get_segment_store_bytes();
+    usage->bytes[MEMORY_STREAMS] = get_stream_bytes();
+    usage->bytes[MEMORY_RESULT_CACHE] = get_result_cache_bytes();
+    usage->bytes[MEMORY_REPORTS] = get_text_buffer_bytes();
+
+    usage->total = 0;
+    for (int s = 0; s < MEMORY_SUBSYSTEMS; s++) {
+        usage->total += usage->bytes[s];
+    }
+    usage->budget = memory_budget;
+    usage->series_streaming = is_health_series_streaming();
+}
+
+// Parses a size in bytes with an optional K, M or G suffix (powers of 1024), as in
+// 512K or 64M. Returns 0 if the text is not a size.
+int parse_memory_size(const char *text, size_t *bytes) {
+    const char *p = text;
+    unsigned long long value = 0;
+    if (!isdigit((unsigned char)*p)) return 0;
+    while (isdigit((unsigned char)*p)) {
+        if (value > (unsigned long long)SIZE_MAX / 10) return 0;
+        value = value * 10 + (unsigned long long)(*p++ - '0');
+    }
+
+    int shift = 0;
+    switch (toupper((unsigned char)*p)) {
+    case 'K': shift = 10; p++; break;
+    case 'M': shift = 20; p++; break;
+    case 'G': shift = 30; p++; break;
+    }
+    if (shift && toupper((unsigned char)*p) == 'B') p++;
+    if (*p != '\0' || value > (unsigned long long)SIZE_MAX >> shift) return 0;
+
+    *bytes = (size_t)(value << shift);
+    return 1;
+}
+
+void format_memory_size(size_t bytes, char *text, size_t size) {
+    if (bytes < 1024)
+        snprintf(text, size, "%zu B", bytes);
+    else if (bytes < 1024 * 1024)
+        snprintf(text, size, "%.1f KB", bytes / 1024.0);
+    else if (bytes < 1024UL * 1024 * 1024)
+        snprintf(text, size, "%.1f MB", bytes / (1024.0 * 1024));
+    else
+        snprintf(text, size, "%.2f GB", bytes / (1024.0 * 1024 * 1024));
+}
+
+// Sets the budget; 0 removes it. Takes effect as the subsystems next grow, and a
+// series that is already loaded goes to streaming mode on its next reload.
+void set_memory_budget(size_t bytes) {
+    memory_budget = bytes;
+}
+
+size_t get_memory_budget(void) {
+    return memory_budget;
+}
+
+// Asks whether `bytes` more fit in the budget. If they do not, the result cache
+// is dropped first; returns 0 if they still do not fit, in which case the caller
+// does without (the series switches to streaming mode). Safe from any thread, and
+// takes no lock the series holds while growing.
+int reserve_memory(size_t bytes) {
+    if (memory_budget == 0) return 1;
+
+    MemoryUsage usage;
+    get_memory_usage(&usage);
+    if (usage.total + bytes <= memory_budget) return 1;
+
+    clear_result_cache();
+    get_memory_usage(&usage);
+    return usage.total + bytes <= memory_budget;
+}
@@ -0,0 +1,33 @@
+#ifndef HEALTH_MEMORY_H
+#define HEALTH_MEMORY_H
+
+#include <stddef.h>
+
+// Where the accounted memory goes
+typedef enum {
+    MEMORY_SERIES,          // sorted readings of input.txt, or its day bitmap when streaming
+    MEMORY_SERIES_INDEX,    // summary pyramid and block sketches over the series
+    MEMORY_SEGMENTS,        // compressed columnar copy of input.txt
+    MEMORY_STREAMS,         // device readings with their daily indexes and sketches
+    MEMORY_RESULT_CACHE,    // cached stats and abnormality results
+    MEMORY_REPORTS,         // report text being built
+    MEMORY_SUBSYSTEMS
+} MemorySubsystem;
+
+typedef struct {
+    size_t bytes[MEMORY_SUBSYSTEMS];
+    size_t total;
+    size_t budget;          // 0 when there is none
+    int series_streaming;   // the series went over the budget and reads input.txt per query
+} MemoryUsage;
+
+// Function declarations for memory accounting and the memory budget
+const char* get_memory_subsystem_name(int subsystem);
+void get_memory_usage(MemoryUsage *usage);
+int parse_memory_size(const char *text, size_t *bytes);
+void format_memory_size(size_t bytes, char *text, size_t size);
+void set_memory_budget(size_t bytes);
+size_t get_memory_budget(void);
+int reserve_memory(size_t bytes);
+
+#endif // HEALTH_MEMORY_H
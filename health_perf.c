@@ -0,0 +1,215 @@
+#include "health_perf.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static HealthPerfProbe *probe_list = NULL;
+// Scans run on several threads at once (query server workers), so recording is serialized
+static pthread_mutex_t probe_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Latency budget of one operation: the most its mean time may be
+typedef struct {
+    char name[64];
+    long long max_ns;
+} HealthPerfBudget;
+
+static HealthPerfBudget budgets[PERF_MAX_BUDGETS];
+static int budget_count = 0;
+
+// Monotonic clock in nanoseconds
+long long health_perf_now(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (long long)(counter.QuadPart * (1000000000.0 / frequency.QuadPart));
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+static int get_bucket_index(long long elapsed_ns) {
+    long long us = elapsed_ns / 1000;
+    int bucket = 0;
+    while (us > 0 && bucket < PERF_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void health_perf_record(HealthPerfProbe *probe, long long elapsed_ns) {
+    pthread_mutex_lock(&probe_lock);
+    if (!probe->registered) {
+        probe->registered = 1;
+        probe->target = probe;
+        for (HealthPerfProbe *other = probe_list; other; other = other->next) {
+            if (strcmp(other->name, probe->name) == 0) {
+                probe->target = other;
+                break;
+            }
+        }
+        if (probe->target == probe) {
+            probe->next = probe_list;
+            probe_list = probe;
+        }
+    }
+    probe = probe->target;
+
+    probe->count++;
+    probe->total_ns += elapsed_ns;
+    if (elapsed_ns > probe->max_ns) probe->max_ns = elapsed_ns;
+    probe->buckets[get_bucket_index(elapsed_ns)]++;
+    probe->history[probe->history_next] = elapsed_ns;
+    probe->history_next = (probe->history_next + 1) % PERF_HISTORY;
+    pthread_mutex_unlock(&probe_lock);
+}
+
+// Copies the stats of every probe into `*stats` (free it when done), the most
+// recently registered first. Recording threads are held off only while the copy
+// is made. Returns the number of probes, or -1 if there is no memory for the copy.
+int health_perf_snapshot(HealthPerfStats **stats) {
+    pthread_mutex_lock(&probe_lock);
+    int count = 0;
+    for (const HealthPerfProbe *probe = probe_list; probe; probe = probe->next) {
+        count++;
+    }
+    *stats = malloc((count ? count : 1) * sizeof(HealthPerfStats));
+    if (!*stats) {
+        pthread_mutex_unlock(&probe_lock);
+        return -1;
+    }
+
+    HealthPerfStats *copy = *stats;
+    for (const HealthPerfProbe *probe = probe_list; probe; probe = probe->next, copy++) {
+        copy->name = probe->name;
+        copy->count = probe->count;
+        copy->total_ns = probe->total_ns;
+        copy->max_ns = probe->max_ns;
+        memcpy(copy->buckets, probe->buckets, sizeof(copy->buckets));
+        copy->history_count = probe->count < PERF_HISTORY ? (int)probe->count : PERF_HISTORY;
+        for (int i = 0; i < copy->history_count; i++) {
+            copy->history[i] = probe->history[(probe->history_next - 1 - i + PERF_HISTORY) % PERF_HISTORY];
+        }
+    }
+    pthread_mutex_unlock(&probe_lock);
+    return count;
+}
+
+void health_perf_dump(FILE *out) {
+    HealthPerfStats *stats;
+    int count = health_perf_snapshot(&stats);
+    if (count < 0) return;
+
+    fprintf(out, "%-32s %10s %12s %12s %12s\n", "operation", "count", "mean (us)", "max (us)", "budget (us)");
+    for (int i = 0; i < count; i++) {
+        const HealthPerfStats *probe = &stats[i];
+        long long budget = health_perf_budget(probe->name);
+        fprintf(out, "%-32s %10lld %12.1f %12.1f", probe->name, probe->count,
+                probe->total_ns / 1000.0 / probe->count, probe->max_ns / 1000.0);
+        if (budget > 0)
+            fprintf(out, " %12.1f%s\n", budget / 1000.0, health_perf_over_budget(probe) ? " OVER" : "");
+        else
+            fprintf(out, " %12s\n", "-");
+
+        for (int b = 0; b < PERF_BUCKETS; b++) {
+            if (probe->buckets[b] == 0) continue;
+            fprintf(out, "    < %8lld us: %lld\n", 1LL << b, probe->buckets[b]);
+        }
+    }
+    free(stats);
+}
+
+void health_perf_dump_json(FILE *out) {
+    HealthPerfStats *stats;
+    int count = health_perf_snapshot(&stats);
+    if (count < 0) return;
+
+    fprintf(out, "{\n  \"operations\": [");
+    for (int i = 0; i < count; i++) {
+        const HealthPerfStats *probe = &stats[i];
+        fprintf(out, "%s\n    {\"name\": \"%s\", \"count\": %lld, \"total_ns\": %lld, \"max_ns\": %lld, ",
+                i == 0 ? "" : ",", probe->name, probe->count, probe->total_ns, probe->max_ns);
+        fprintf(out, "\"budget_ns\": %lld, \"over_budget\": %s, \"histogram_us\": [",
+                health_perf_budget(probe->name), health_perf_over_budget(probe) ? "true" : "false");
+
+        // Each histogram entry is the upper bound of the bucket and its count
+        int first = 1;
+        for (int b = 0; b < PERF_BUCKETS; b++) {
+            if (probe->buckets[b] == 0) continue;
+            fprintf(out, "%s[%lld, %lld]", first ? "" : ", ", 1LL << b, probe->buckets[b]);
+            first = 0;
+        }
+        fprintf(out, "]}");
+    }
+    fprintf(out, "\n  ]\n}\n");
+    free(stats);
+}
+
+// Reads latency budgets from a text file with one "<operation> <max mean ms>" per
+// line; blank lines and lines starting with '#' are skipped. Budgets for the same
+// operation replace earlier ones. Returns the number of budgets read, or -1 if the
+// file cannot be opened.
+int health_perf_load_budgets(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) return -1;
+
+    char line[256], name[64];
+    double max_ms;
+    int read = 0;
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#' || sscanf(line, "%63s %lf", name, &max_ms) != 2) continue;
+
+        int b = 0;
+        while (b < budget_count && strcmp(budgets[b].name, name) != 0) b++;
+        if (b == PERF_MAX_BUDGETS) break;
+        if (b == budget_count) budget_count++;
+
+        strcpy(budgets[b].name, name);
+        budgets[b].max_ns = (long long)(max_ms * 1e6);
+        read++;
+    }
+    fclose(file);
+    return read;
+}
+
+// Budget of an operation in nanoseconds, or 0 if it has none
+long long health_perf_budget(const char *name) {
+    for (int b = 0; b < budget_count; b++) {
+        if (strcmp(budgets[b].name, name) == 0) return budgets[b].max_ns;
+    }
+    return 0;
+}
+
+// Whether the mean time of an operation exceeds its budget. The mean rather than
+// the maximum is compared, so a single slow first call (cold file cache, building
+// the series) does not count as a regression.
+int health_perf_over_budget(const HealthPerfStats *stats) {
+    long long budget = health_perf_budget(stats->name);
+    return budget > 0 && stats->count > 0 && stats->total_ns / stats->count > budget;
+}
+
+// Lists the operations over budget and returns how many there are
+int health_perf_check_budgets(FILE *out) {
+    HealthPerfStats *stats;
+    int count = health_perf_snapshot(&stats);
+    int over = 0;
+    for (int i = 0; i < count; i++) {
+        const HealthPerfStats *probe = &stats[i];
+        if (!health_perf_over_budget(probe)) continue;
+        fprintf(out, "%s over budget: mean %.3f ms, budget %.3f ms (%lld calls)\n", probe->name,
+                probe->total_ns / 1e6 / probe->count, health_perf_budget(probe->name) / 1e6, probe->count);
+        over++;
+    }
+    if (count >= 0) free(stats);
+    return over;
+}
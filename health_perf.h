@@ -0,0 +1,65 @@
+#ifndef HEALTH_PERF_H
+#define HEALTH_PERF_H
+
+#include <stdio.h>
+
+// Latency histogram buckets are powers of two in microseconds (<1us .. >=2^22us)
+#define PERF_BUCKETS 24
+// Number of most recent timings kept per operation
+#define PERF_HISTORY 16
+// Most latency budgets a budget file may set
+#define PERF_MAX_BUDGETS 64
+
+// One timed operation, e.g. "stats.parse". Probes register themselves on first use.
+typedef struct HealthPerfProbe {
+    const char *name;
+    int registered;
+    long long count;
+    long long total_ns;
+    long long max_ns;
+    long long buckets[PERF_BUCKETS];
+    long long history[PERF_HISTORY];
+    int history_next;
+    struct HealthPerfProbe *next;
+    struct HealthPerfProbe *target;   // probe that owns the stats when a name is timed at several sites
+} HealthPerfProbe;
+
+// Copy of one probe's stats, taken under the probe lock by health_perf_snapshot, so
+// it can be read while other threads go on recording
+typedef struct {
+    const char *name;
+    long long count;
+    long long total_ns;
+    long long max_ns;
+    long long buckets[PERF_BUCKETS];
+    long long history[PERF_HISTORY];    // most recent timings, newest first
+    int history_count;
+} HealthPerfStats;
+
+long long health_perf_now(void);
+void health_perf_record(HealthPerfProbe *probe, long long elapsed_ns);
+int health_perf_snapshot(HealthPerfStats **stats);
+void health_perf_dump(FILE *out);
+void health_perf_dump_json(FILE *out);
+int health_perf_load_budgets(const char *path);
+long long health_perf_budget(const char *name);
+int health_perf_over_budget(const HealthPerfStats *stats);
+int health_perf_check_budgets(FILE *out);
+
+// PERF_START(t) starts a stopwatch; PERF_LAP(t, name) records the time since the
+// last lap under `name` and restarts it. Build with -DHEALTH_PERF_DISABLE to
+// compile every probe out.
+#ifndef HEALTH_PERF_DISABLE
+#define PERF_START(t) long long t = health_perf_now()
+#define PERF_LAP(t, probe_name) do { \
+        static HealthPerfProbe perf_probe_ = { .name = probe_name }; \
+        long long perf_now_ = health_perf_now(); \
+        health_perf_record(&perf_probe_, perf_now_ - (t)); \
+        (t) = perf_now_; \
+    } while (0)
+#else
+#define PERF_START(t) do { } while (0)
+#define PERF_LAP(t, probe_name) do { } while (0)
+#endif
+
+#endif // HEALTH_PERF_H
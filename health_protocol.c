@@ -0,0 +1,82 @@
+#include "health_protocol.h"
+#include <string.h>
+
+static void put_u32(unsigned char *p, uint32_t value) {
+    p[0] = (unsigned char)value;
+    p[1] = (unsigned char)(value >> 8);
+    p[2] = (unsigned char)(value >> 16);
+    p[3] = (unsigned char)(value >> 24);
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put_u64(unsigned char *p, uint64_t value) {
+    put_u32(p, (uint32_t)value);
+    put_u32(p + 4, (uint32_t)(value >> 32));
+}
+
+static uint64_t get_u64(const unsigned char *p) {
+    return (uint64_t)get_u32(p) | (uint64_t)get_u32(p + 4) << 32;
+}
+
+// Bytes taken by the frame at the start of `data`, length prefix included. Returns
+// 0 if it has not fully arrived yet and -1 if its payload is over `max_payload`.
+long get_frame_size(const unsigned char *data, size_t available, size_t max_payload) {
+    if (available < PROTOCOL_LENGTH_BYTES) return 0;
+    size_t payload = get_u32(data);
+    if (payload > max_payload) return -1;
+    return PROTOCOL_LENGTH_BYTES + payload <= available ? (long)(PROTOCOL_LENGTH_BYTES + payload) : 0;
+}
+
+// Writes one request frame to `frame`. Returns its size, or 0 if it does not fit
+// in `size` bytes or exceeds PROTOCOL_MAX_REQUEST.
+size_t encode_request(const HealthRequest *request, unsigned char *frame, size_t size) {
+    size_t payload = PROTOCOL_REQUEST_HEADER + request->text_length;
+    if (payload > PROTOCOL_MAX_REQUEST || PROTOCOL_LENGTH_BYTES + payload > size) return 0;
+
+    put_u32(frame, (uint32_t)payload);
+    unsigned char *p = frame + PROTOCOL_LENGTH_BYTES;
+    put_u32(p, request->id);
+    p[4] = request->kind;
+    put_u32(p + 5, (uint32_t)request->start_day);
+    put_u32(p + 9, (uint32_t)request->end_day);
+    if (request->text_length > 0) memcpy(p + PROTOCOL_REQUEST_HEADER, request->text, request->text_length);
+    return PROTOCOL_LENGTH_BYTES + payload;
+}
+
+// Splits a request payload (the frame without its length). The text points into
+// the payload. Returns 0 if the payload is too short.
+int decode_request(const unsigned char *payload, size_t length, HealthRequest *request) {
+    if (length < PROTOCOL_REQUEST_HEADER) return 0;
+    request->id = get_u32(payload);
+    request->kind = payload[4];
+    request->start_day = (int32_t)get_u32(payload + 5);
+    request->end_day = (int32_t)get_u32(payload + 9);
+    request->text = (const char *)payload + PROTOCOL_REQUEST_HEADER;
+    request->text_length = length - PROTOCOL_REQUEST_HEADER;
+    return 1;
+}
+
+// Writes the length prefix and header of a response; the body follows them
+void encode_response_header(const HealthResponse *response, unsigned char *frame) {
+    put_u32(frame, (uint32_t)(PROTOCOL_RESPONSE_HEADER + response->body_length));
+    unsigned char *p = frame + PROTOCOL_LENGTH_BYTES;
+    put_u32(p, response->id);
+    p[4] = response->status;
+    put_u32(p + 5, response->rows);
+    put_u64(p + 9, (uint64_t)response->total);
+}
+
+// Splits a response payload; the body points into it. Returns 0 if it is too short.
+int decode_response(const unsigned char *payload, size_t length, HealthResponse *response) {
+    if (length < PROTOCOL_RESPONSE_HEADER) return 0;
+    response->id = get_u32(payload);
+    response->status = payload[4];
+    response->rows = get_u32(payload + 5);
+    response->total = (int64_t)get_u64(payload + 9);
+    response->body = (const char *)payload + PROTOCOL_RESPONSE_HEADER;
+    response->body_length = length - PROTOCOL_RESPONSE_HEADER;
+    return 1;
+}
@@ -0,0 +1,65 @@
+#ifndef HEALTH_PROTOCOL_H
+#define HEALTH_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Socket the query server listens on unless told otherwise, relative to the
+// directory holding input.txt
+#define PROTOCOL_SOCKET "health_analyzer.sock"
+// Every message is a frame: the little-endian uint32 length of the payload, then
+// the payload. Requests start with id u32, kind u8, start_day i32, end_day i32;
+// responses with id u32, status u8, rows u32, total i64. Integers are little-endian.
+#define PROTOCOL_LENGTH_BYTES 4
+#define PROTOCOL_REQUEST_HEADER 13
+#define PROTOCOL_RESPONSE_HEADER 17
+// Largest request payload; whatever follows the header is filter text
+#define PROTOCOL_MAX_REQUEST 1024
+// Most readings listed by one readings or filter response; all are still counted
+#define PROTOCOL_MAX_ROWS 4096
+
+typedef enum {
+    REQUEST_PING = 1,       // empty answer, for measuring the server itself
+    REQUEST_STATS,          // Report Summary rows for [start_day, end_day]
+    REQUEST_ABNORMALITIES,  // Health Check rows for [start_day, end_day]
+    REQUEST_COMPARISON,     // Daily Report rows for start_day
+    REQUEST_READINGS,       // raw readings dated [start_day, end_day]
+    REQUEST_FILTER,         // readings in the range matching the filter text
+    REQUEST_MEMORY          // bytes held per subsystem; the total is the sum
+} RequestKind;
+
+typedef enum {
+    RESPONSE_OK,
+    RESPONSE_BAD_REQUEST,   // body holds the reason
+    RESPONSE_FAILED,        // input.txt could not be read
+    RESPONSE_BUSY           // the server queue is full; try again later
+} ResponseStatus;
+
+typedef struct {
+    uint32_t id;            // echoed in the response, so requests can be pipelined
+    uint8_t kind;
+    int32_t start_day;
+    int32_t end_day;
+    const char *text;       // filter expression, not terminated
+    size_t text_length;
+} HealthRequest;
+
+// Rows are sent as text, one line per row with tab-separated fields in the
+// column order of the matching window
+typedef struct {
+    uint32_t id;
+    uint8_t status;
+    uint32_t rows;
+    int64_t total;          // readings matched; more than `rows` if the list was cut short
+    const char *body;
+    size_t body_length;
+} HealthResponse;
+
+// Function declarations for the query server protocol
+long get_frame_size(const unsigned char *data, size_t available, size_t max_payload);
+size_t encode_request(const HealthRequest *request, unsigned char *frame, size_t size);
+int decode_request(const unsigned char *payload, size_t length, HealthRequest *request);
+void encode_response_header(const HealthResponse *response, unsigned char *frame);
+int decode_response(const unsigned char *payload, size_t length, HealthResponse *response);
+
+#endif // HEALTH_PROTOCOL_H
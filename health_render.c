@@ -0,0 +1,360 @@
+#include "health_render.h"
+#include "health_perf.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+// One image to draw; the request owns the points
+typedef struct {
+    int width;
+    int height;
+    HealthData *points;
+    int count;
+} GraphFrame;
+
+struct GraphRenderer {
+    GraphRenderedCallback callback;
+    void *user_data;
+    _Atomic unsigned long generation;   // moved on by every request and by destroy
+
+    // Guarded by render_lock
+    GraphFrame pending;
+    int has_pending;                    // pending is set and the renderer is queued
+    int rendering;
+    int closed;
+    cairo_surface_t *surface;           // latest finished image
+    GraphRenderer *next;
+};
+
+// Renderers with a pending frame, oldest request first
+static GraphRenderer *queue_head = NULL;
+static GraphRenderer *queue_tail = NULL;
+static int render_running = 0;
+static pthread_t render_thread;
+static pthread_mutex_t render_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t render_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t render_done = PTHREAD_COND_INITIALIZER;
+
+// A render stops at the next check once a newer request has come in
+static int render_superseded(GraphRenderer *renderer, unsigned long generation) {
+    return atomic_load(&renderer->generation) != generation;
+}
+
+// A line is broken where neighbouring points are more than this many days apart
+// and more than twice the average spacing, so missing stretches show as gaps
+#define GRAPH_GAP_DAYS 7
+
+// X of every point in proportion to its day rather than its index, so the axis
+// is a regular daily grid: one multiply-add per point
+static void compute_day_positions(const HealthData *data, int count, int left, int width, double *x) {
+    int span = data[count - 1].day - data[0].day;
+    double pixels_per_day = span > 0 ? (double)width / span : 0;
+    for (int i = 0; i < count; i++) {
+        x[i] = left + (data[i].day - data[0].day) * pixels_per_day;
+    }
+}
+
+static double point_value(const HealthData *point, int metric) {
+    if (metric == 0) return point->bp_systolic;
+    if (metric == 1) return point->bp_diastolic;
+    return point->blood_sugar;
+}
+
+// Strokes one metric (0 systolic, 1 diastolic, 2 sugar) scaled to [min, max],
+// lifting the pen over gaps longer than `max_gap` days
+static void stroke_metric(cairo_t *cr, const HealthData *data, int count, const double *x, int metric,
+                          double min, double max, int top, int height, int max_gap) {
+    for (int i = 0; i < count; i++) {
+        double y = top + height - ((point_value(&data[i], metric) - min) / (max - min)) * height;
+        if (i == 0 || data[i].day - data[i - 1].day > max_gap)
+            cairo_move_to(cr, x[i], y);
+        else
+            cairo_line_to(cr, x[i], y);
+    }
+    cairo_stroke(cr);
+}
+
+// Draws the trend graph of a frame. Returns 0 if a newer request superseded it
+// part way.
+static int draw_graph(cairo_t *cr, const GraphFrame *frame, GraphRenderer *renderer, unsigned long generation) {
+    const HealthData *data = frame->points;
+    int data_count = frame->count;
+    int width = frame->width;
+    int height = frame->height;
+
+    int margin_left = GRAPH_MARGIN_LEFT, margin_right = GRAPH_MARGIN_RIGHT;
+    int margin_top = GRAPH_MARGIN_TOP, margin_bottom = GRAPH_MARGIN_BOTTOM;
+    int graph_width = width - margin_left - margin_right;
+    int graph_height = height - margin_top - margin_bottom;
+
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_paint(cr);
+
+    if (data_count == 0) {
+        cairo_set_source_rgb(cr, 0, 0, 0);
+        cairo_select_font_face(cr, "Arial", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
+        cairo_set_font_size(cr, 20);
+        cairo_move_to(cr, 200, 200);
+        cairo_show_text(cr, "No data available");
+        return 1;
+    }
+
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    cairo_set_line_width(cr, 2);
+    cairo_rectangle(cr, margin_left, margin_top, graph_width, graph_height);
+    cairo_stroke(cr);
+
+    double min_bp = 1000, max_bp = 0, min_sugar = 1000, max_sugar = 0;
+    for (int i = 0; i < data_count; i++) {
+        if (data[i].bp_systolic < min_bp) min_bp = data[i].bp_systolic;
+        if (data[i].bp_systolic > max_bp) max_bp = data[i].bp_systolic;
+        if (data[i].bp_diastolic < min_bp) min_bp = data[i].bp_diastolic;
+        if (data[i].bp_diastolic > max_bp) max_bp = data[i].bp_diastolic;
+        if (data[i].blood_sugar < min_sugar) min_sugar = data[i].blood_sugar;
+        if (data[i].blood_sugar > max_sugar) max_sugar = data[i].blood_sugar;
+    }
+
+    double bp_range = max_bp - min_bp;
+    double sugar_range = max_sugar - min_sugar;
+    if (bp_range > 0) {
+        min_bp -= bp_range * 0.1;
+        max_bp += bp_range * 0.1;
+    }
+    if (sugar_range > 0) {
+        min_sugar -= sugar_range * 0.1;
+        max_sugar += sugar_range * 0.1;
+    }
+
+    cairo_set_font_size(cr, 12);
+    cairo_set_source_rgb(cr, 1, 0, 0);
+    cairo_move_to(cr, margin_left + 20, margin_top - 30);
+    cairo_show_text(cr, "Systolic BP");
+
+    cairo_set_source_rgb(cr, 0, 0, 1);
+    cairo_move_to(cr, margin_left + 120, margin_top - 30);
+    cairo_show_text(cr, "Diastolic BP");
+
+    cairo_set_source_rgb(cr, 0, 0.7, 0);
+    cairo_move_to(cr, margin_left + 220, margin_top - 30);
+    cairo_show_text(cr, "Blood Sugar");
+
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    cairo_set_font_size(cr, 10);
+    for (int i = 0; i <= 5; i++) {
+        double bp_value = min_bp + (max_bp - min_bp) * i / 5.0;
+        int y = margin_top + graph_height - (graph_height * i / 5);
+        cairo_move_to(cr, margin_left - 50, y + 5);
+        char label[20];
+        snprintf(label, sizeof(label), "%.0f", bp_value);
+        cairo_show_text(cr, label);
+
+        cairo_set_source_rgba(cr, 0.8, 0.8, 0.8, 0.5);
+        cairo_move_to(cr, margin_left, y);
+        cairo_line_to(cr, margin_left + graph_width, y);
+        cairo_stroke(cr);
+        cairo_set_source_rgb(cr, 0, 0, 0);
+    }
+
+    for (int i = 0; i <= 5; i++) {
+        double sugar_value = min_sugar + (max_sugar - min_sugar) * i / 5.0;
+        int y = margin_top + graph_height - (graph_height * i / 5);
+        cairo_move_to(cr, margin_left + graph_width + 10, y + 5);
+        char label[20];
+        snprintf(label, sizeof(label), "%.0f", sugar_value);
+        cairo_show_text(cr, label);
+    }
+
+    double *x = malloc(data_count * sizeof(double));
+    if (!x) return 1;
+    compute_day_positions(data, data_count, margin_left, graph_width, x);
+
+    // Date labels at even steps along the day axis
+    int span = data[data_count - 1].day - data[0].day;
+    int labels = span < 10 ? span : 10;
+    for (int k = 0; k <= labels; k++) {
+        int day = data[0].day + (labels > 0 ? (int)((long long)span * k / labels) : 0);
+        char date[DATE_TEXT_SIZE];
+        format_day_number(day, date);
+        cairo_move_to(cr, margin_left + (labels > 0 ? graph_width * k / labels : 0) - 20, margin_top + graph_height + 20);
+        cairo_show_text(cr, date + 5);
+    }
+    if (render_superseded(renderer, generation)) {
+        free(x);
+        return 0;
+    }
+
+    if (data_count > 1) {
+        int spacing = 2 * span / (data_count - 1);
+        int max_gap = spacing > GRAPH_GAP_DAYS ? spacing : GRAPH_GAP_DAYS;
+        double mins[3] = { min_bp, min_bp, min_sugar };
+        double maxes[3] = { max_bp, max_bp, max_sugar };
+        const double colors[3][3] = { { 1, 0, 0 }, { 0, 0, 1 }, { 0, 0.7, 0 } };
+
+        cairo_set_line_width(cr, 3);
+        for (int metric = 0; metric < 3; metric++) {
+            cairo_set_source_rgb(cr, colors[metric][0], colors[metric][1], colors[metric][2]);
+            stroke_metric(cr, data, data_count, x, metric, mins[metric], maxes[metric],
+                          margin_top, graph_height, max_gap);
+            if (render_superseded(renderer, generation)) {
+                free(x);
+                return 0;
+            }
+        }
+    }
+    free(x);
+
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    cairo_set_font_size(cr, 14);
+
+    cairo_save(cr);
+    cairo_translate(cr, 20, margin_top + graph_height/2);
+    cairo_rotate(cr, -M_PI/2);
+    cairo_move_to(cr, 0, 0);
+    cairo_show_text(cr, "Blood Pressure (mmHg)");
+    cairo_restore(cr);
+
+    cairo_save(cr);
+    cairo_translate(cr, width - 20, margin_top + graph_height/2);
+    cairo_rotate(cr, M_PI/2);
+    cairo_move_to(cr, 0, 0);
+    cairo_show_text(cr, "Blood Sugar (mg/dL)");
+    cairo_restore(cr);
+
+    cairo_move_to(cr, margin_left + graph_width/2 - 30, height - 20);
+    cairo_show_text(cr, "Date");
+
+    cairo_set_font_size(cr, 16);
+    cairo_move_to(cr, margin_left + graph_width/2 - 100, 30);
+    cairo_show_text(cr, "Health Parameter Trends");
+
+    cairo_set_font_size(cr, 10);
+    cairo_set_source_rgb(cr, 0.4, 0.4, 0.4);
+    cairo_move_to(cr, margin_left, height - 20);
+    cairo_show_text(cr, "Scroll to zoom, drag to pan, double-click to reset");
+    return 1;
+}
+
+// Takes the oldest pending frame, draws it into a new image surface and swaps
+// that in as the renderer's latest image, unless a newer request arrived first
+static void* render_main(void *arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&render_lock);
+        while (!queue_head) {
+            pthread_cond_wait(&render_ready, &render_lock);
+        }
+        GraphRenderer *renderer = queue_head;
+        queue_head = renderer->next;
+        if (!queue_head) queue_tail = NULL;
+        GraphFrame frame = renderer->pending;
+        renderer->has_pending = 0;
+        renderer->rendering = 1;
+        unsigned long generation = atomic_load(&renderer->generation);
+        pthread_mutex_unlock(&render_lock);
+
+        PERF_START(perf);
+        cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, frame.width, frame.height);
+        cairo_t *cr = cairo_create(surface);
+        int drawn = draw_graph(cr, &frame, renderer, generation);
+        cairo_destroy(cr);
+        free(frame.points);
+        if (drawn) PERF_LAP(perf, "graph.render");
+
+        pthread_mutex_lock(&render_lock);
+        int ready = drawn && cairo_surface_status(surface) == CAIRO_STATUS_SUCCESS &&
+                    !renderer->closed && !render_superseded(renderer, generation);
+        cairo_surface_t *old = ready ? renderer->surface : surface;
+        if (ready) renderer->surface = surface;
+        pthread_mutex_unlock(&render_lock);
+        if (old) cairo_surface_destroy(old);
+
+        if (ready) renderer->callback(renderer->user_data);
+
+        pthread_mutex_lock(&render_lock);
+        renderer->rendering = 0;
+        pthread_cond_broadcast(&render_done);
+        pthread_mutex_unlock(&render_lock);
+    }
+    return NULL;
+}
+
+GraphRenderer* create_graph_renderer(GraphRenderedCallback callback, void *user_data) {
+    GraphRenderer *renderer = calloc(1, sizeof(GraphRenderer));
+    if (!renderer) return NULL;
+    renderer->callback = callback;
+    renderer->user_data = user_data;
+    atomic_init(&renderer->generation, 0);
+    return renderer;
+}
+
+// Queues a frame of `count` points at width x height, taking ownership of the
+// points. A frame still waiting is dropped and a render under way stops early.
+// Starts the render thread on first use. Returns 0 (freeing the points) if the
+// thread cannot be started.
+int request_graph_render(GraphRenderer *renderer, int width, int height, HealthData *points, int count) {
+    pthread_mutex_lock(&render_lock);
+    if (!render_running) {
+        render_running = pthread_create(&render_thread, NULL, render_main, NULL) == 0;
+        if (render_running) pthread_detach(render_thread);
+    }
+    if (!render_running || renderer->closed || width <= 0 || height <= 0) {
+        pthread_mutex_unlock(&render_lock);
+        free(points);
+        return 0;
+    }
+
+    atomic_fetch_add(&renderer->generation, 1);
+    if (renderer->has_pending) {
+        free(renderer->pending.points);
+    } else {
+        renderer->next = NULL;
+        if (queue_tail)
+            queue_tail->next = renderer;
+        else
+            queue_head = renderer;
+        queue_tail = renderer;
+        renderer->has_pending = 1;
+    }
+    renderer->pending.width = width;
+    renderer->pending.height = height;
+    renderer->pending.points = points;
+    renderer->pending.count = count;
+    pthread_cond_signal(&render_ready);
+    pthread_mutex_unlock(&render_lock);
+    return 1;
+}
+
+// Latest finished image, or NULL before the first one. The caller releases it
+// with cairo_surface_destroy.
+cairo_surface_t* get_graph_surface(GraphRenderer *renderer) {
+    pthread_mutex_lock(&render_lock);
+    cairo_surface_t *surface = renderer->surface ? cairo_surface_reference(renderer->surface) : NULL;
+    pthread_mutex_unlock(&render_lock);
+    return surface;
+}
+
+// Stops any render of this graph and frees it. No callback runs once this returns.
+void destroy_graph_renderer(GraphRenderer *renderer) {
+    if (!renderer) return;
+
+    pthread_mutex_lock(&render_lock);
+    renderer->closed = 1;
+    atomic_fetch_add(&renderer->generation, 1);
+    if (renderer->has_pending) {
+        GraphRenderer **link = &queue_head, *previous = NULL;
+        while (*link != renderer) {
+            previous = *link;
+            link = &(*link)->next;
+        }
+        *link = renderer->next;
+        if (queue_tail == renderer) queue_tail = previous;
+        free(renderer->pending.points);
+        renderer->has_pending = 0;
+    }
+    while (renderer->rendering) {
+        pthread_cond_wait(&render_done, &render_lock);
+    }
+    pthread_mutex_unlock(&render_lock);
+
+    if (renderer->surface) cairo_surface_destroy(renderer->surface);
+    free(renderer);
+}
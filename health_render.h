@@ -0,0 +1,27 @@
+#ifndef HEALTH_RENDER_H
+#define HEALTH_RENDER_H
+
+#include <cairo.h>
+#include "health_logic.h"
+
+// Graph layout shared by rendering and the zoom/pan handlers
+#define GRAPH_MARGIN_LEFT 80
+#define GRAPH_MARGIN_RIGHT 80
+#define GRAPH_MARGIN_TOP 50
+#define GRAPH_MARGIN_BOTTOM 80
+
+// Run on the render thread whenever a newer image of the graph is ready
+typedef void (*GraphRenderedCallback)(void *user_data);
+
+// Draws the plot of one graph window into image surfaces on a background thread.
+// Only the latest request is drawn: a newer one replaces a request still waiting
+// and stops a render already under way.
+typedef struct GraphRenderer GraphRenderer;
+
+// Function declarations for the background graph renderer
+GraphRenderer* create_graph_renderer(GraphRenderedCallback callback, void *user_data);
+int request_graph_render(GraphRenderer *renderer, int width, int height, HealthData *points, int count);
+cairo_surface_t* get_graph_surface(GraphRenderer *renderer);
+void destroy_graph_renderer(GraphRenderer *renderer);
+
+#endif // HEALTH_RENDER_H
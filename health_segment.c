@@ -0,0 +1,730 @@
+#include "health_segment.h"
+#include "health_epoch.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Fixed-point scale per column: whole days, then thousandths of every metric, which
+// holds any reading parse_reading accepts exactly
+static const int segment_scale[SEGMENT_COLUMNS] = { 1, 1000, 1000, 1000, 1000, 1000, 1000 };
+// Digits after the point the entry form shows: mmHg and mg/dL whole, the rest in tenths
+static const int segment_decimals[SEGMENT_COLUMNS] = { 0, 1, 1, 0, 0, 0, 1 };
+
+// Words of the superseded bitmap per block; row r of the store (sealed segments
+// hold SEGMENT_ROWS rows each, the tail follows them) is bit r
+#define SEGMENT_WORDS (SEGMENT_ROWS / 64)
+
+// What readers see: the sealed segments and a copy of the open tail as of one
+// refresh. Sealed segments never change, so every snapshot shares them. A row
+// followed later in input.txt by a row for the same date has its bit set in
+// `superseded`; rows past the end of the bitmap are all current.
+struct SegmentSnapshot {
+    unsigned long version;
+    const Segment *segments;
+    int segment_count;
+    int tail_rows;
+    SegmentZone tail_zone;
+    int32_t tail[SEGMENT_COLUMNS][SEGMENT_ROWS];
+    const uint64_t *superseded;
+    size_t superseded_words;
+};
+
+// Latest row of one date, for finding the row a new one supersedes
+typedef struct {
+    int day;
+    int row;            // -1 for an empty slot
+} LatestRow;
+
+// Writer side, guarded by store_lock: sealed segments in input.txt row order,
+// followed by the open (uncompressed) tail
+static pthread_mutex_t store_lock = PTHREAD_MUTEX_INITIALIZER;
+static Segment *segments = NULL;
+static int segment_count = 0;
+static int segment_capacity = 0;
+static int32_t tail[SEGMENT_COLUMNS][SEGMENT_ROWS];
+static SegmentZone tail_zone;
+static int tail_rows = 0;
+static int store_loaded = 0;
+static long store_offset = 0;   // bytes of input.txt already folded into the store
+// input.txt as the store last read it, and the hash of the bytes before
+// store_offset then, to tell an append from an edit (see data_file_appended)
+static DataFileIdentity store_identity;
+static uint64_t store_tail_hash = 0;
+static unsigned long store_version = 0;
+static int snapshot_stale = 1;  // the writer side has changed since the last publish
+// Superseded bitmap (whole blocks of words) and the latest row of every date. Once
+// published the bitmap is shared with readers, so the next change copies it.
+static uint64_t *superseded = NULL;
+static size_t superseded_words = 0;
+static int superseded_shared = 0;
+static LatestRow *latest_rows = NULL;
+static int latest_capacity = 0;
+static int latest_count = 0;
+
+// input.txt as the published snapshot is up to date with it. While `refreshed` is
+// 0 the next refresh must take store_lock to find out.
+static pthread_mutex_t refreshed_lock = PTHREAD_MUTEX_INITIALIZER;
+static DataFileIdentity refreshed_identity;
+static int refreshed = 0;
+
+static SegmentSnapshot *_Atomic published_snapshot = NULL;
+static const SegmentSnapshot empty_snapshot;
+
+// A segment array taken out of the store together with the columns and the
+// superseded bitmap that go with it
+typedef struct {
+    Segment *segments;
+    int count;
+    uint64_t *superseded;
+} RetiredSegments;
+
+// Memory the published snapshot may still reach. It waits here until a publish
+// has swapped in a snapshot that no longer does, and only then goes to
+// epoch_retire; retiring it any earlier would let a reader that pins an epoch
+// afterwards still load the old snapshot and read freed memory.
+typedef struct PendingRelease {
+    void *item;
+    void (*release)(void *item);
+    struct PendingRelease *next;
+} PendingRelease;
+
+static PendingRelease *pending_releases = NULL;
+
+static void free_segments(Segment *array, int count) {
+    for (int s = 0; s < count; s++) {
+        for (int c = 0; c < SEGMENT_COLUMNS; c++) {
+            free(array[s].columns[c].words);
+        }
+    }
+    free(array);
+}
+
+static void free_retired_segments(void *item) {
+    RetiredSegments *retired = item;
+    free_segments(retired->segments, retired->count);
+    free(retired->superseded);
+    free(retired);
+}
+
+// Queues memory for release after the next publish. Returns 0 (queueing nothing)
+// if there is no memory for the entry.
+static int defer_release(void *item, void (*release)(void *item)) {
+    PendingRelease *entry = malloc(sizeof(PendingRelease));
+    if (!entry) return 0;
+    entry->item = item;
+    entry->release = release;
+    entry->next = pending_releases;
+    pending_releases = entry;
+    return 1;
+}
+
+// Hands everything queued by defer_release to the reclaimer, or releases it on
+// the spot when no reader can reach it any more
+static void flush_pending_releases(int readers_done) {
+    while (pending_releases) {
+        PendingRelease *entry = pending_releases;
+        pending_releases = entry->next;
+        if (readers_done)
+            entry->release(entry->item);
+        else
+            epoch_retire(entry->item, entry->release);
+        free(entry);
+    }
+}
+
+// Last resort when memory runs out: readers fall back to the empty snapshot, and
+// once the ones holding the old snapshot are done everything it reached is freed
+static void withdraw_snapshot(void) {
+    SegmentSnapshot *old = atomic_exchange(&published_snapshot, NULL);
+    epoch_synchronize();
+    free(old);
+    flush_pending_releases(1);
+    snapshot_stale = 1;
+}
+
+// Empties the writer side. The published snapshot keeps reading the old segments
+// until the next publish replaces it; they are released after that.
+static void reset_segment_store(void) {
+    RetiredSegments *retired = malloc(sizeof(RetiredSegments));
+    if (retired) {
+        retired->segments = segments;
+        retired->count = segment_count;
+        retired->superseded = superseded;
+    }
+    if (!retired || !defer_release(retired, free_retired_segments)) {
+        free(retired);
+        withdraw_snapshot();
+        free_segments(segments, segment_count);
+        free(superseded);
+    }
+    free(latest_rows);
+    segments = NULL;
+    segment_count = 0;
+    segment_capacity = 0;
+    superseded = NULL;
+    superseded_words = 0;
+    superseded_shared = 0;
+    latest_rows = NULL;
+    latest_capacity = 0;
+    latest_count = 0;
+    tail_rows = 0;
+    store_offset = 0;
+    store_loaded = 0;
+    snapshot_stale = 1;
+}
+
+// Makes the writer side visible to readers, then retires the old snapshot and
+// whatever only it could reach. Returns 0 (readers keep the previous snapshot,
+// which stays whole, until the next refresh) if there is no memory for the copy
+// of the tail.
+static int publish_snapshot(void) {
+    if (!snapshot_stale) return 1;
+
+    SegmentSnapshot *snapshot = malloc(sizeof(SegmentSnapshot));
+    if (!snapshot) return 0;
+    snapshot->version = ++store_version;
+    snapshot->segments = segments;
+    snapshot->segment_count = segment_count;
+    snapshot->tail_rows = tail_rows;
+    snapshot->tail_zone = tail_zone;
+    for (int c = 0; c < SEGMENT_COLUMNS; c++) {
+        memcpy(snapshot->tail[c], tail[c], tail_rows * sizeof(int32_t));
+    }
+    snapshot->superseded = superseded;
+    snapshot->superseded_words = superseded_words;
+    superseded_shared = superseded != NULL;
+
+    SegmentSnapshot *old = atomic_exchange(&published_snapshot, snapshot);
+    if (old) epoch_retire(old, free);
+    flush_pending_releases(0);
+    snapshot_stale = 0;
+    return 1;
+}
+
+static uint64_t zigzag_encode(int64_t delta) {
+    return ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+}
+
+static int64_t zigzag_decode(uint64_t raw) {
+    return (int64_t)(raw >> 1) ^ -(int64_t)(raw & 1);
+}
+
+// Packs the deltas of `values` at the smallest width that holds all of them
+static int encode_column(SegmentColumn *column, const int32_t *values, int rows) {
+    uint64_t widest = 0;
+    for (int i = 1; i < rows; i++) {
+        widest |= zigzag_encode((int64_t)values[i] - values[i - 1]);
+    }
+
+    column->base = values[0];
+    column->bits = 0;
+    while (column->bits < 64 && (widest >> column->bits) != 0) column->bits++;
+    column->words = NULL;
+    if (column->bits == 0) return 1;
+
+    size_t words = ((size_t)(rows - 1) * column->bits + 63) / 64;
+    column->words = calloc(words, sizeof(uint64_t));
+    if (!column->words) return 0;
+
+    uint64_t position = 0;
+    for (int i = 1; i < rows; i++) {
+        uint64_t raw = zigzag_encode((int64_t)values[i] - values[i - 1]);
+        size_t word = position >> 6;
+        int shift = position & 63;
+
+        column->words[word] |= raw << shift;
+        if (shift + column->bits > 64) column->words[word + 1] |= raw >> (64 - shift);
+        position += column->bits;
+    }
+    return 1;
+}
+
+// Scan kernel: unpacks one column into `out`, keeping the running value in a register
+static void decode_column(const SegmentColumn *column, int rows, int32_t *out) {
+    int64_t value = column->base;
+    out[0] = column->base;
+
+    if (column->bits == 0) {
+        for (int i = 1; i < rows; i++) out[i] = column->base;
+        return;
+    }
+
+    const uint64_t *words = column->words;
+    const int bits = column->bits;
+    const uint64_t mask = bits == 64 ? ~0ULL : (1ULL << bits) - 1;
+    uint64_t position = 0;
+    for (int i = 1; i < rows; i++) {
+        size_t word = position >> 6;
+        int shift = position & 63;
+        uint64_t raw = words[word] >> shift;
+        if (shift + bits > 64) raw |= words[word + 1] << (64 - shift);
+
+        value += zigzag_decode(raw & mask);
+        out[i] = (int32_t)value;
+        position += bits;
+    }
+}
+
+// Makes room for one more sealed segment. Snapshots may still be reading the old
+// array, so it is copied rather than reallocated and released after the next
+// publish; the columns move over to the new array.
+static int grow_segments(void) {
+    if (segment_count < segment_capacity) return 1;
+
+    int new_capacity = segment_capacity ? segment_capacity * 2 : 16;
+    Segment *grown = malloc(new_capacity * sizeof(Segment));
+    if (!grown) return 0;
+    if (segments && !defer_release(segments, free)) {
+        free(grown);
+        return 0;
+    }
+    if (segment_count > 0) memcpy(grown, segments, segment_count * sizeof(Segment));
+    segments = grown;
+    segment_capacity = new_capacity;
+    return 1;
+}
+
+// Compresses the full tail into a new sealed segment
+static int seal_tail(void) {
+    if (!grow_segments()) return 0;
+
+    Segment *segment = &segments[segment_count];
+    segment->rows = tail_rows;
+    segment->zone = tail_zone;
+    for (int c = 0; c < SEGMENT_COLUMNS; c++) {
+        if (!encode_column(&segment->columns[c], tail[c], tail_rows)) {
+            while (--c >= 0) free(segment->columns[c].words);
+            return 0;
+        }
+    }
+    segment_count++;
+    tail_rows = 0;
+    return 1;
+}
+
+static int32_t to_fixed_point(int column, double value) {
+    return (int32_t)lround(value * segment_scale[column]);
+}
+
+static unsigned latest_slot(int day) {
+    return ((unsigned)day * 2654435761u) & (unsigned)(latest_capacity - 1);
+}
+
+// Records `row` as the latest row of `day`. Returns the row it replaces, -1 if it
+// is the first row of the day, or -2 if the table cannot grow.
+static int replace_latest_row(int day, int row) {
+    if (2 * (latest_count + 1) > latest_capacity) {
+        int new_capacity = latest_capacity ? latest_capacity * 2 : 1024;
+        LatestRow *grown = malloc(new_capacity * sizeof(LatestRow));
+        if (!grown) return -2;
+        for (int i = 0; i < new_capacity; i++) grown[i].row = -1;
+
+        LatestRow *old = latest_rows;
+        int old_capacity = latest_capacity;
+        latest_rows = grown;
+        latest_capacity = new_capacity;
+        for (int i = 0; i < old_capacity; i++) {
+            if (old[i].row < 0) continue;
+            unsigned slot = latest_slot(old[i].day);
+            while (latest_rows[slot].row >= 0) slot = (slot + 1) & (latest_capacity - 1);
+            latest_rows[slot] = old[i];
+        }
+        free(old);
+    }
+
+    unsigned slot = latest_slot(day);
+    while (latest_rows[slot].row >= 0 && latest_rows[slot].day != day) {
+        slot = (slot + 1) & (latest_capacity - 1);
+    }
+    int previous = latest_rows[slot].row;
+    if (previous < 0) latest_count++;
+    latest_rows[slot].day = day;
+    latest_rows[slot].row = row;
+    return previous;
+}
+
+// Sets the superseded bit of `row`, copying the bitmap first if readers share it
+static int mark_superseded(int row) {
+    size_t word = (size_t)row / 64;
+    if (word >= superseded_words || superseded_shared) {
+        size_t words = superseded_words;
+        if (word >= words) {
+            words = words ? words * 2 : SEGMENT_WORDS;
+            while (word >= words) words *= 2;
+        }
+        uint64_t *copy = calloc(words, sizeof(uint64_t));
+        if (!copy) return 0;
+        if (superseded_words > 0) memcpy(copy, superseded, superseded_words * sizeof(uint64_t));
+        if (superseded_shared && !defer_release(superseded, free)) {
+            free(copy);
+            return 0;
+        }
+        if (!superseded_shared) free(superseded);
+        superseded = copy;
+        superseded_words = words;
+        superseded_shared = 0;
+    }
+    superseded[word] |= 1ULL << (row & 63);
+    return 1;
+}
+
+// Last write wins per date, as in the series: a new row for a date marks the
+// row it replaces as superseded. Returns 0 if there is no memory to record it.
+static int supersede_earlier_row(int day, int row) {
+    int previous = replace_latest_row(day, row);
+    if (previous == -2) return 0;
+    return previous < 0 || mark_superseded(previous);
+}
+
+// Folds the complete lines after store_offset into the store, like the series
+// does. Malformed rows are skipped. Returns 0 on failure.
+static int read_appended_rows(FILE *file) {
+    LineBuffer line = {0};
+    HealthRow row;
+    int ok = 1;
+
+    fseek(file, store_offset, SEEK_SET);
+    while (ok && read_line(file, &line)) {
+        if (line.text[line.length - 1] != '\n') break;
+        store_offset += line.length;
+
+        if (parse_health_row(line.text, line.length, &row) != ROW_OK) continue;
+
+        if (!supersede_earlier_row(row.day, segment_count * SEGMENT_ROWS + tail_rows)) {
+            ok = 0;
+            break;
+        }
+        tail[SEGMENT_DATE][tail_rows] = row.day;
+        for (int c = SEGMENT_HEIGHT; c < SEGMENT_COLUMNS; c++) {
+            tail[c][tail_rows] = to_fixed_point(c, row.values[c - 1]);
+        }
+        for (int c = 0; c < SEGMENT_COLUMNS; c++) {
+            int32_t value = tail[c][tail_rows];
+            if (tail_rows == 0 || value < tail_zone.min[c]) tail_zone.min[c] = value;
+            if (tail_rows == 0 || value > tail_zone.max[c]) tail_zone.max[c] = value;
+        }
+        tail_rows++;
+        snapshot_stale = 1;
+
+        if (tail_rows == SEGMENT_ROWS) ok = seal_tail();
+    }
+    free_line(&line);
+    return ok;
+}
+
+// Records the input.txt the snapshot is now up to date with; NULL for none
+static void set_refreshed_identity(const DataFileIdentity *identity) {
+    pthread_mutex_lock(&refreshed_lock);
+    refreshed = identity != NULL;
+    if (identity) refreshed_identity = *identity;
+    pthread_mutex_unlock(&refreshed_lock);
+}
+
+static int is_refreshed_identity(const DataFileIdentity *identity) {
+    pthread_mutex_lock(&refreshed_lock);
+    int current = refreshed && same_data_file_identity(identity, &refreshed_identity);
+    pthread_mutex_unlock(&refreshed_lock);
+    return current;
+}
+
+// Drop the store so the next refresh rebuilds it from input.txt
+void invalidate_segment_store(void) {
+    pthread_mutex_lock(&store_lock);
+    set_refreshed_identity(NULL);
+    reset_segment_store();
+    publish_snapshot();
+    pthread_mutex_unlock(&store_lock);
+}
+
+// Brings the store up to date with input.txt and publishes it. `identity` is set
+// to the file as it was before reading.
+static int refresh_locked_segment_store(DataFileIdentity *identity) {
+    FILE *file = fopen("input.txt", "rb");
+    if (!file || !read_data_file_identity(file, identity)) {
+        if (file) fclose(file);
+        reset_segment_store();
+        publish_snapshot();
+        return 0;
+    }
+
+    if (store_loaded && !data_file_appended(file, identity, &store_identity, store_offset, store_tail_hash))
+        reset_segment_store();
+
+    int ok = 1;
+    if (identity->size > store_offset || !store_loaded) {
+        ok = read_appended_rows(file);
+    }
+    if (ok) {
+        store_identity = *identity;
+        store_tail_hash = data_file_tail_hash(file, store_offset);
+    }
+    fclose(file);
+
+    if (!ok) {
+        reset_segment_store();
+        publish_snapshot();
+        return 0;
+    }
+    store_loaded = 1;
+    return publish_snapshot();
+}
+
+// Brings the store up to date with input.txt, reading only appended bytes. A file
+// edited in place, replaced or truncated is read again from the start. Safe from
+// any thread: one refresh runs at a time and readers keep the snapshot they hold,
+// and a file that has not changed since is answered without store_lock. Returns 0
+// if input.txt cannot be read.
+int refresh_segment_store(void) {
+    DataFileIdentity identity;
+    if (stat_data_file_identity("input.txt", &identity) && is_refreshed_identity(&identity)) return 1;
+
+    pthread_mutex_lock(&store_lock);
+    int ok = refresh_locked_segment_store(&identity);
+    set_refreshed_identity(ok ? &identity : NULL);
+    pthread_mutex_unlock(&store_lock);
+    return ok;
+}
+
+// Writes the sealed segments and the open tail to a checkpoint file. Returns 0 on failure.
+int save_segment_checkpoint(FILE *file, long *offset) {
+    pthread_mutex_lock(&store_lock);
+    DataFileIdentity identity;
+    if (!refresh_locked_segment_store(&identity)) {
+        pthread_mutex_unlock(&store_lock);
+        return 0;
+    }
+
+    int ok = fwrite(&segment_count, sizeof(int), 1, file) == 1;
+    for (int s = 0; s < segment_count && ok; s++) {
+        const Segment *segment = &segments[s];
+        ok = fwrite(&segment->rows, sizeof(int), 1, file) == 1 &&
+             fwrite(&segment->zone, sizeof(SegmentZone), 1, file) == 1;
+        for (int c = 0; c < SEGMENT_COLUMNS && ok; c++) {
+            const SegmentColumn *column = &segment->columns[c];
+            size_t words = ((size_t)(segment->rows - 1) * column->bits + 63) / 64;
+            ok = fwrite(&column->base, sizeof(int32_t), 1, file) == 1 &&
+                 fwrite(&column->bits, sizeof(int), 1, file) == 1 &&
+                 fwrite(column->words, sizeof(uint64_t), words, file) == words;
+        }
+    }
+    ok = ok && fwrite(&tail_rows, sizeof(int), 1, file) == 1 &&
+         fwrite(&tail_zone, sizeof(SegmentZone), 1, file) == 1;
+    for (int c = 0; c < SEGMENT_COLUMNS && ok; c++) {
+        ok = fwrite(tail[c], sizeof(int32_t), tail_rows, file) == (size_t)tail_rows;
+    }
+
+    *offset = store_offset;
+    pthread_mutex_unlock(&store_lock);
+    return ok;
+}
+
+// Restores the store from a checkpoint covering the first `offset` bytes of
+// input.txt; the next refresh reads only what was appended since. Returns 0
+// (leaving the store empty) if the checkpoint is damaged.
+int load_segment_checkpoint(FILE *file, long offset) {
+    pthread_mutex_lock(&store_lock);
+    set_refreshed_identity(NULL);
+    reset_segment_store();
+
+    int count;
+    int ok = fread(&count, sizeof(int), 1, file) == 1 && count >= 0;
+    for (int s = 0; s < count && ok; s++) {
+        if (!grow_segments()) {
+            ok = 0;
+            break;
+        }
+
+        Segment *segment = &segments[segment_count];
+        memset(segment, 0, sizeof(Segment));
+        ok = fread(&segment->rows, sizeof(int), 1, file) == 1 && segment->rows == SEGMENT_ROWS &&
+             fread(&segment->zone, sizeof(SegmentZone), 1, file) == 1;
+        for (int c = 0; c < SEGMENT_COLUMNS && ok; c++) {
+            SegmentColumn *column = &segment->columns[c];
+            ok = fread(&column->base, sizeof(int32_t), 1, file) == 1 &&
+                 fread(&column->bits, sizeof(int), 1, file) == 1 &&
+                 column->bits >= 0 && column->bits <= 64;
+            if (!ok || column->bits == 0) continue;
+
+            size_t words = ((size_t)(segment->rows - 1) * column->bits + 63) / 64;
+            column->words = malloc(words ? words * sizeof(uint64_t) : sizeof(uint64_t));
+            ok = column->words && fread(column->words, sizeof(uint64_t), words, file) == words;
+        }
+        // Counted even when damaged, so reset_segment_store frees what was read
+        segment_count++;
+    }
+
+    ok = ok && fread(&tail_rows, sizeof(int), 1, file) == 1 && tail_rows >= 0 && tail_rows < SEGMENT_ROWS &&
+         fread(&tail_zone, sizeof(SegmentZone), 1, file) == 1;
+    for (int c = 0; c < SEGMENT_COLUMNS && ok; c++) {
+        ok = fread(tail[c], sizeof(int32_t), tail_rows, file) == (size_t)tail_rows;
+    }
+
+    // The superseded rows follow from the dates, so they are worked out again
+    // rather than stored
+    int32_t days[SEGMENT_ROWS];
+    for (int s = 0; s < segment_count && ok; s++) {
+        decode_column(&segments[s].columns[SEGMENT_DATE], SEGMENT_ROWS, days);
+        for (int i = 0; i < SEGMENT_ROWS && ok; i++) {
+            ok = supersede_earlier_row(days[i], s * SEGMENT_ROWS + i);
+        }
+    }
+    for (int i = 0; i < tail_rows && ok; i++) {
+        ok = supersede_earlier_row(tail[SEGMENT_DATE][i], segment_count * SEGMENT_ROWS + i);
+    }
+
+    if (!ok) {
+        reset_segment_store();
+        publish_snapshot();
+        pthread_mutex_unlock(&store_lock);
+        return 0;
+    }
+    // The checkpoint was checked against input.txt as it is now
+    FILE *data = fopen("input.txt", "rb");
+    if (data && read_data_file_identity(data, &store_identity)) {
+        store_tail_hash = data_file_tail_hash(data, offset);
+    } else {
+        memset(&store_identity, 0, sizeof(DataFileIdentity));
+    }
+    if (data) fclose(data);
+    store_offset = offset;
+    store_loaded = 1;
+    snapshot_stale = 1;
+    publish_snapshot();
+    pthread_mutex_unlock(&store_lock);
+    return 1;
+}
+
+// Pins the current snapshot of the store for a scan; pair with
+// release_segment_snapshot. Never NULL: before the first refresh it is empty.
+const SegmentSnapshot* acquire_segment_snapshot(void) {
+    epoch_read_begin();
+    const SegmentSnapshot *snapshot = atomic_load(&published_snapshot);
+    return snapshot ? snapshot : &empty_snapshot;
+}
+
+void release_segment_snapshot(const SegmentSnapshot *snapshot) {
+    (void)snapshot;
+    epoch_read_end();
+}
+
+// Sealed segments plus the open tail, if it holds any rows
+int get_segment_block_count(const SegmentSnapshot *snapshot) {
+    return snapshot->segment_count + (snapshot->tail_rows > 0);
+}
+
+// Superseded bits of block `index`, or NULL if none of its rows is superseded
+static const uint64_t* block_superseded(const SegmentSnapshot *snapshot, int index) {
+    size_t first = (size_t)index * SEGMENT_WORDS;
+    if (first >= snapshot->superseded_words) return NULL;
+    return snapshot->superseded + first;
+}
+
+static int count_superseded(const uint64_t *bits) {
+    int count = 0;
+    for (int w = 0; bits && w < SEGMENT_WORDS; w++) {
+        count += __builtin_popcountll(bits[w]);
+    }
+    return count;
+}
+
+// Decodes block `index` in input.txt row order, leaving out the rows superseded
+// by a later row for the same date, so every scan sees one row per date like the
+// series. Returns the number of rows kept.
+int read_segment_block(const SegmentSnapshot *snapshot, int index, SegmentBlock *block) {
+    if (index < 0 || index >= get_segment_block_count(snapshot)) return 0;
+
+    if (index == snapshot->segment_count) {
+        block->rows = snapshot->tail_rows;
+        for (int c = 0; c < SEGMENT_COLUMNS; c++) {
+            memcpy(block->values[c], snapshot->tail[c], snapshot->tail_rows * sizeof(int32_t));
+        }
+    } else {
+        const Segment *segment = &snapshot->segments[index];
+        block->rows = segment->rows;
+        for (int c = 0; c < SEGMENT_COLUMNS; c++) {
+            decode_column(&segment->columns[c], segment->rows, block->values[c]);
+        }
+    }
+
+    const uint64_t *bits = block_superseded(snapshot, index);
+    if (count_superseded(bits) == 0) return block->rows;
+
+    int kept = 0;
+    for (int i = 0; i < block->rows; i++) {
+        if (bits[i >> 6] >> (i & 63) & 1) continue;
+        for (int c = 0; c < SEGMENT_COLUMNS; c++) {
+            block->values[c][kept] = block->values[c][i];
+        }
+        kept++;
+    }
+    block->rows = kept;
+    return kept;
+}
+
+// Zone map of block `index`, without decoding it. The zone covers superseded rows
+// too, so it bounds the rows kept. Returns the number of rows read_segment_block
+// keeps (0 if there is no such block or none is current).
+int read_segment_zone(const SegmentSnapshot *snapshot, int index, SegmentZone *zone) {
+    if (index < 0 || index >= get_segment_block_count(snapshot)) return 0;
+    int rows;
+    if (index == snapshot->segment_count) {
+        *zone = snapshot->tail_zone;
+        rows = snapshot->tail_rows;
+    } else {
+        *zone = snapshot->segments[index].zone;
+        rows = snapshot->segments[index].rows;
+    }
+    return rows - count_superseded(block_superseded(snapshot, index));
+}
+
+// Tells from the zone map alone whether block `index` has rows in [start_day,
+// end_day], so range scans decode only the blocks that do
+BlockOverlap get_segment_block_overlap(const SegmentSnapshot *snapshot, int index, int start_day, int end_day) {
+    SegmentZone zone;
+    if (!read_segment_zone(snapshot, index, &zone)) return BLOCK_OUTSIDE;
+
+    if (zone.max[SEGMENT_DATE] < start_day || zone.min[SEGMENT_DATE] > end_day) return BLOCK_OUTSIDE;
+    if (zone.min[SEGMENT_DATE] >= start_day && zone.max[SEGMENT_DATE] <= end_day) return BLOCK_INSIDE;
+    return BLOCK_PARTLY_INSIDE;
+}
+
+// Version of the snapshot; every publish moves it forward
+unsigned long get_segment_snapshot_version(const SegmentSnapshot *snapshot) {
+    return snapshot->version;
+}
+
+// Converts a stored fixed-point value of `column` back to its unit
+double segment_value(int column, int32_t value) {
+    return (double)value / segment_scale[column];
+}
+
+// Whole units of a stored value, truncated toward zero as (int) truncates the
+// reading; the abnormality thresholds on mmHg and mg/dL compare these
+int segment_whole(int column, int32_t value) {
+    return value / segment_scale[column];
+}
+
+// Stored units per unit of `column`: 1000 for thousandths, 1 for whole days
+int get_segment_scale(int column) {
+    return segment_scale[column];
+}
+
+// Digits after the point that `column` is displayed with
+int get_segment_decimals(int column) {
+    return segment_decimals[column];
+}
+
+// Heap bytes held by the sealed segments, the open tail and the current snapshot
+size_t get_segment_store_bytes(void) {
+    pthread_mutex_lock(&store_lock);
+    size_t bytes = segment_capacity * sizeof(Segment) + sizeof(tail) + sizeof(SegmentSnapshot) +
+                   superseded_words * sizeof(uint64_t) + latest_capacity * sizeof(LatestRow);
+    for (int s = 0; s < segment_count; s++) {
+        for (int c = 0; c < SEGMENT_COLUMNS; c++) {
+            const SegmentColumn *column = &segments[s].columns[c];
+            if (column->bits > 0)
+                bytes += ((size_t)(segments[s].rows - 1) * column->bits + 63) / 64 * sizeof(uint64_t);
+        }
+    }
+    pthread_mutex_unlock(&store_lock);
+    return bytes;
+}
@@ -0,0 +1,79 @@
+#ifndef HEALTH_SEGMENT_H
+#define HEALTH_SEGMENT_H
+
+#include <stdint.h>
+#include "health_logic.h"
+
+// Rows per compressed segment; the newest rows stay uncompressed until a segment fills
+#define SEGMENT_ROWS 1024
+
+// Columns of the segment store. Dates are day numbers; the metrics are fixed-point
+// integers that hold every accepted reading exactly (see segment_value).
+enum {
+    SEGMENT_DATE,
+    SEGMENT_HEIGHT,
+    SEGMENT_WEIGHT,
+    SEGMENT_BP_SYS,
+    SEGMENT_BP_DIA,
+    SEGMENT_SUGAR,
+    SEGMENT_TEMP,
+    SEGMENT_COLUMNS
+};
+
+// One column of a sealed segment: the first value, then the zigzag-encoded
+// deltas between neighbouring rows packed at `bits` bits each
+typedef struct {
+    int32_t base;
+    int bits;
+    uint64_t *words;
+} SegmentColumn;
+
+// Zone map of a block: the smallest and largest value of every column, so scans
+// can pass over blocks outside a date range or that cannot match a condition
+typedef struct {
+    int32_t min[SEGMENT_COLUMNS];
+    int32_t max[SEGMENT_COLUMNS];
+} SegmentZone;
+
+typedef struct {
+    int rows;
+    SegmentZone zone;
+    SegmentColumn columns[SEGMENT_COLUMNS];
+} Segment;
+
+// Where the rows of a block fall relative to a date range
+typedef enum {
+    BLOCK_OUTSIDE,
+    BLOCK_PARTLY_INSIDE,
+    BLOCK_INSIDE
+} BlockOverlap;
+
+// Rows of one segment decoded back to fixed-point integers, column by column
+typedef struct {
+    int rows;
+    int32_t values[SEGMENT_COLUMNS][SEGMENT_ROWS];
+} SegmentBlock;
+
+// Immutable view of the store as of one refresh. Scans read through a snapshot, so
+// refreshes on other threads never change the blocks under them.
+typedef struct SegmentSnapshot SegmentSnapshot;
+
+// Function declarations for the compressed columnar copy of input.txt
+void invalidate_segment_store(void);
+int refresh_segment_store(void);
+const SegmentSnapshot* acquire_segment_snapshot(void);
+void release_segment_snapshot(const SegmentSnapshot *snapshot);
+unsigned long get_segment_snapshot_version(const SegmentSnapshot *snapshot);
+int get_segment_block_count(const SegmentSnapshot *snapshot);
+int read_segment_block(const SegmentSnapshot *snapshot, int index, SegmentBlock *block);
+int read_segment_zone(const SegmentSnapshot *snapshot, int index, SegmentZone *zone);
+BlockOverlap get_segment_block_overlap(const SegmentSnapshot *snapshot, int index, int start_day, int end_day);
+double segment_value(int column, int32_t value);
+int segment_whole(int column, int32_t value);
+int get_segment_scale(int column);
+int get_segment_decimals(int column);
+size_t get_segment_store_bytes(void);
+int save_segment_checkpoint(FILE *file, long *offset);
+int load_segment_checkpoint(FILE *file, long offset);
+
+#endif // HEALTH_SEGMENT_H
@@ -0,0 +1,970 @@
+#include "health_series.h"
+#include "health_memory.h"
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// Sums over a run of consecutive readings: systolic, diastolic and sugar
+typedef struct {
+    int count;
+    double sum[3];
+} PyramidBucket;
+
+typedef struct {
+    PyramidBucket *buckets;
+    int count;
+    int capacity;
+} PyramidLevel;
+
+// Readings sorted by date; level 0 of the pyramid is this array itself
+static HealthData *series_data = NULL;
+static int series_count = 0;
+static int series_capacity = 0;
+static int series_loaded = 0;
+static long series_offset = 0;   // bytes of input.txt already folded into the series
+// input.txt as the series last read it, and the hash of the bytes before
+// series_offset then, to tell an append from an edit (see data_file_appended)
+static DataFileIdentity series_identity;
+static uint64_t series_tail_hash = 0;
+
+// Rows of input.txt that a compaction would drop or move
+static int series_superseded = 0;
+static int series_out_of_order = 0;
+// Lines of input.txt folded in so far, by parse outcome
+static long long series_parse_counts[ROW_RESULTS];
+
+static HealthSeriesListener listeners[SERIES_MAX_LISTENERS];
+static int listener_count = 0;
+
+// Queries share the series under the read lock; loading, refreshing and dropping
+// it takes the write lock. Listeners run after it is released.
+static pthread_rwlock_t series_lock = PTHREAD_RWLOCK_INITIALIZER;
+// Footprint and mode as of the last change, for memory accounting without the
+// lock (the series itself asks for memory while holding it)
+static atomic_size_t published_data_bytes = 0;
+static atomic_size_t published_index_bytes = 0;
+static atomic_int published_streaming = 0;
+
+static PyramidLevel pyramid[SERIES_MAX_LEVELS];
+
+// Quantile sketches of systolic, diastolic and sugar per block of SERIES_SKETCH_BLOCK readings
+typedef struct {
+    TDigest metrics[3];
+} SketchBlock;
+
+static SketchBlock *sketch_blocks = NULL;
+static int sketch_block_count = 0;
+static int sketch_block_capacity = 0;
+
+// Projected footprint of one reading: its place in the array, its share of the
+// pyramid (half a bucket per level above 0, so about one bucket) and of the sketches
+#define SERIES_READING_BYTES (sizeof(HealthData) + sizeof(PyramidBucket) + sizeof(SketchBlock) / SERIES_SKETCH_BLOCK)
+
+// Streaming mode, taken when the series would not fit in the memory budget: only
+// which days have a reading is kept, one bit per day plus a running count per word,
+// and range queries read their values back from input.txt. Since a day holds at
+// most one reading, the bitmap is bounded by the span of dates, not the row count.
+static int series_streaming = 0;
+static uint64_t *day_bits = NULL;
+static int *day_counts = NULL;      // readings on the days before each word
+static int day_word_count = 0;
+static long long day_base = 0;      // day of bit 0 of the first word, a multiple of 64
+static int day_counts_stale = 0;
+static int streaming_last_day = INT_MIN;  // latest day with a reading
+
+static void get_point_values(const HealthData *point, double values[3]) {
+    values[0] = point->bp_systolic;
+    values[1] = point->bp_diastolic;
+    values[2] = point->blood_sugar;
+}
+
+static void free_summaries(void) {
+    for (int k = 0; k < SERIES_MAX_LEVELS; k++) {
+        free(pyramid[k].buckets);
+        pyramid[k].buckets = NULL;
+        pyramid[k].count = 0;
+        pyramid[k].capacity = 0;
+    }
+
+    free(sketch_blocks);
+    sketch_blocks = NULL;
+    sketch_block_count = 0;
+    sketch_block_capacity = 0;
+}
+
+static void free_day_bitmap(void) {
+    free(day_bits);
+    free(day_counts);
+    day_bits = NULL;
+    day_counts = NULL;
+    day_word_count = 0;
+    streaming_last_day = INT_MIN;
+    series_streaming = 0;
+}
+
+static void reset_series(void) {
+    free(series_data);
+    series_data = NULL;
+    series_count = 0;
+    series_capacity = 0;
+    series_offset = 0;
+    series_superseded = 0;
+    series_out_of_order = 0;
+    memset(series_parse_counts, 0, sizeof(series_parse_counts));
+    free_summaries();
+    series_loaded = 0;
+    free_day_bitmap();
+}
+
+static long long floor_div64(long long value) {
+    return value >= 0 ? value / 64 : -((-value + 63) / 64);
+}
+
+// Word of the day bitmap holding `day`, which may lie before the first word
+static long long day_word(long long day) {
+    return floor_div64(day - day_base);
+}
+
+// Marks a day as having a reading, growing the bitmap at either end. Returns 2 if
+// it already had one, 1 if it is new and 0 if the bitmap cannot grow.
+static int set_streaming_day(int day) {
+    if (day_word_count == 0) day_base = floor_div64(day) * 64;
+    long long word = day_word(day);
+
+    long long before = word < 0 ? -word : 0;
+    long long after = word >= day_word_count ? word - day_word_count + 1 : 0;
+    if (before + after > 0) {
+        long long new_count = day_word_count + before + after;
+        if (new_count > INT_MAX) return 0;
+        uint64_t *bits = realloc(day_bits, new_count * sizeof(uint64_t));
+        if (bits) day_bits = bits;
+        int *counts = realloc(day_counts, new_count * sizeof(int));
+        if (counts) day_counts = counts;
+        if (!bits || !counts) return 0;
+
+        memmove(&day_bits[before], day_bits, day_word_count * sizeof(uint64_t));
+        memset(day_bits, 0, before * sizeof(uint64_t));
+        memset(&day_bits[before + day_word_count], 0, after * sizeof(uint64_t));
+        day_word_count = (int)new_count;
+        day_base -= before * 64;
+        word += before;
+    }
+
+    uint64_t bit = 1ULL << ((day - day_base) % 64);
+    if (day_bits[word] & bit) return 2;
+    day_bits[word] |= bit;
+    day_counts_stale = 1;
+    if (day > streaming_last_day) streaming_last_day = day;
+    return 1;
+}
+
+static void update_day_counts(void) {
+    if (!day_counts_stale) return;
+    int count = 0;
+    for (int w = 0; w < day_word_count; w++) {
+        day_counts[w] = count;
+        count += __builtin_popcountll(day_bits[w]);
+    }
+    day_counts_stale = 0;
+}
+
+// Number of readings dated before `day`
+static int streaming_days_before(long long day) {
+    if (day_word_count == 0 || day <= day_base) return 0;
+    long long word = day_word(day);
+    if (word >= day_word_count) return series_count;
+
+    update_day_counts();
+    uint64_t below = (1ULL << ((day - day_base) % 64)) - 1;
+    return day_counts[word] + __builtin_popcountll(day_bits[word] & below);
+}
+
+// Day of the reading at `index` (0 <= index < series_count)
+static int streaming_day_at(int index) {
+    update_day_counts();
+    int lo = 0, hi = day_word_count - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (day_counts[mid] <= index)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    uint64_t bits = day_bits[lo];
+    for (int skip = index - day_counts[lo]; skip > 0; skip--) {
+        bits &= bits - 1;
+    }
+    return (int)(day_base + (long long)lo * 64 + __builtin_ctzll(bits));
+}
+
+static int get_series_last_day(void) {
+    return series_streaming ? streaming_last_day : series_data[series_count - 1].day;
+}
+
+// First index whose day is >= day
+static int series_lower_bound(int day) {
+    if (series_streaming) return streaming_days_before(day);
+    int lo = 0, hi = series_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (series_data[mid].day < day)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// First index whose day is > day
+static int series_upper_bound(int day) {
+    if (series_streaming) return streaming_days_before((long long)day + 1);
+    int lo = 0, hi = series_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (series_data[mid].day <= day)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Heap bytes held by the readings (or the day bitmap) and by the summaries over them
+static void count_series_bytes(size_t *data_bytes, size_t *index_bytes) {
+    if (series_streaming) {
+        *data_bytes = (size_t)day_word_count * (sizeof(uint64_t) + sizeof(int));
+        *index_bytes = 0;
+        return;
+    }
+
+    *data_bytes = (size_t)series_capacity * sizeof(HealthData);
+    *index_bytes = (size_t)sketch_block_capacity * sizeof(SketchBlock);
+    for (int k = 0; k < SERIES_MAX_LEVELS; k++) {
+        *index_bytes += (size_t)pyramid[k].capacity * sizeof(PyramidBucket);
+    }
+}
+
+static void publish_series_bytes(void) {
+    size_t data_bytes, index_bytes;
+    count_series_bytes(&data_bytes, &index_bytes);
+    atomic_store(&published_data_bytes, data_bytes);
+    atomic_store(&published_index_bytes, index_bytes);
+    atomic_store(&published_streaming, series_streaming);
+}
+
+// Footprint as of the last change to the series. Safe from any thread.
+void get_health_series_bytes(size_t *data_bytes, size_t *index_bytes) {
+    *data_bytes = atomic_load(&published_data_bytes);
+    *index_bytes = atomic_load(&published_index_bytes);
+}
+
+int is_health_series_streaming(void) {
+    return atomic_load(&published_streaming);
+}
+
+// Whether a series of `capacity` readings and its summaries fit in the memory budget
+static int reserve_series_growth(int capacity) {
+    size_t data_bytes, index_bytes;
+    publish_series_bytes();
+    count_series_bytes(&data_bytes, &index_bytes);
+    size_t projected = (size_t)capacity * SERIES_READING_BYTES;
+    size_t held = data_bytes + index_bytes;
+    return reserve_memory(projected > held ? projected - held : 0);
+}
+
+// Trades the readings and their summaries for the day bitmap. Returns 0 (leaving
+// the series as it was) if the bitmap cannot be built.
+static int enter_streaming_mode(void) {
+    series_streaming = 1;
+    for (int i = 0; i < series_count; i++) {
+        if (!set_streaming_day(series_data[i].day)) {
+            free_day_bitmap();
+            return 0;
+        }
+    }
+
+    free(series_data);
+    series_data = NULL;
+    series_capacity = 0;
+    free_summaries();
+    return 1;
+}
+
+// Insert a reading keeping the series sorted. A later reading for a date already
+// in the series replaces it (last write wins); returns 2 in that case.
+static int series_insert(const HealthData *point) {
+    if (series_streaming) {
+        int result = set_streaming_day(point->day);
+        if (result == 1) series_count++;
+        if (result == 2) series_superseded++;
+        return result;
+    }
+
+    int pos = series_upper_bound(point->day);
+    if (pos > 0 && series_data[pos - 1].day == point->day) {
+        series_data[pos - 1] = *point;
+        series_superseded++;
+        return 2;
+    }
+
+    if (series_count == series_capacity) {
+        int new_capacity = series_capacity ? series_capacity * 2 : 256;
+        if (!reserve_series_growth(new_capacity)) {
+            return enter_streaming_mode() ? series_insert(point) : 0;
+        }
+        HealthData *grown = realloc(series_data, new_capacity * sizeof(HealthData));
+        if (!grown) return 0;
+        series_data = grown;
+        series_capacity = new_capacity;
+    }
+
+    if (pos < series_count) {
+        memmove(&series_data[pos + 1], &series_data[pos], (series_count - pos) * sizeof(HealthData));
+    }
+    series_data[pos] = *point;
+    series_count++;
+    return 1;
+}
+
+// Fold reading `index` into the bucket that covers it on every level above 0
+static int pyramid_add(int index) {
+    double values[3];
+    get_point_values(&series_data[index], values);
+
+    for (int k = 1; k < SERIES_MAX_LEVELS; k++) {
+        PyramidLevel *level = &pyramid[k];
+        int b = index >> k;
+
+        if (b == level->count) {
+            if (level->count == level->capacity) {
+                int new_capacity = level->capacity ? level->capacity * 2 : 64;
+                PyramidBucket *grown = realloc(level->buckets, new_capacity * sizeof(PyramidBucket));
+                if (!grown) return 0;
+                level->buckets = grown;
+                level->capacity = new_capacity;
+            }
+            PyramidBucket *bucket = &level->buckets[level->count++];
+            memset(bucket, 0, sizeof(PyramidBucket));
+        }
+
+        PyramidBucket *bucket = &level->buckets[b];
+        bucket->count++;
+        for (int m = 0; m < 3; m++) {
+            bucket->sum[m] += values[m];
+        }
+    }
+    return 1;
+}
+
+// Fold reading `index` into the quantile sketches of its block
+static int sketch_add(int index) {
+    int b = index / SERIES_SKETCH_BLOCK;
+
+    if (b == sketch_block_count) {
+        if (sketch_block_count == sketch_block_capacity) {
+            int new_capacity = sketch_block_capacity ? sketch_block_capacity * 2 : 16;
+            SketchBlock *grown = realloc(sketch_blocks, new_capacity * sizeof(SketchBlock));
+            if (!grown) return 0;
+            sketch_blocks = grown;
+            sketch_block_capacity = new_capacity;
+        }
+        for (int m = 0; m < 3; m++) {
+            tdigest_init(&sketch_blocks[sketch_block_count].metrics[m]);
+        }
+        sketch_block_count++;
+    }
+
+    double values[3];
+    get_point_values(&series_data[index], values);
+    for (int m = 0; m < 3; m++) {
+        tdigest_add(&sketch_blocks[b].metrics[m], values[m]);
+    }
+    return 1;
+}
+
+// Rebuild the pyramid and block sketches from the sorted readings; a streaming
+// series has none
+static int rebuild_summaries(void) {
+    if (series_streaming) return 1;
+    for (int k = 0; k < SERIES_MAX_LEVELS; k++) {
+        pyramid[k].count = 0;
+    }
+    sketch_block_count = 0;
+
+    for (int i = 0; i < series_count; i++) {
+        if (!pyramid_add(i) || !sketch_add(i)) return 0;
+    }
+    return 1;
+}
+
+// Runs the listeners, without any lock held so they may query the series
+static void notify_series_changed(int first_day, int last_day) {
+    HealthSeriesListener copies[SERIES_MAX_LISTENERS];
+    pthread_rwlock_rdlock(&series_lock);
+    int count = listener_count;
+    memcpy(copies, listeners, count * sizeof(HealthSeriesListener));
+    pthread_rwlock_unlock(&series_lock);
+
+    for (int i = 0; i < count; i++) {
+        copies[i](first_day, last_day);
+    }
+}
+
+// Leaves the series ready for readers under the read lock: the day counts of a
+// streaming series are brought up to date here rather than by the first query
+// after a change, and the footprint is published
+static void finish_series_update(void) {
+    if (series_streaming) update_day_counts();
+    publish_series_bytes();
+}
+
+// Folds the complete lines after series_offset into the series. A trailing line
+// without its newline is left for the next call, since the writer may still be
+// in the middle of it. Returns the number of readings added, or -1 on failure.
+static int read_appended_lines(FILE *file, int *first_day, int *last_day, int *in_order) {
+    LineBuffer line = {0};
+    HealthRow row;
+    int added = 0;
+
+    fseek(file, series_offset, SEEK_SET);
+    while (read_line(file, &line)) {
+        if (line.text[line.length - 1] != '\n') break;
+        series_offset += line.length;
+
+        RowResult result = parse_health_row(line.text, line.length, &row);
+        series_parse_counts[result]++;
+        if (result != ROW_OK) continue;
+
+        int day = row.day;
+        HealthData point;
+        point.day = day;
+        point.bp_systolic = row.values[2];
+        point.bp_diastolic = row.values[3];
+        point.blood_sugar = row.values[4];
+
+        if (series_count > 0 && day < get_series_last_day()) {
+            series_out_of_order++;
+            *in_order = 0;
+        }
+        int inserted = series_insert(&point);
+        if (!inserted) {
+            free_line(&line);
+            return -1;
+        }
+        if (inserted == 2) *in_order = 0;
+
+        if (added == 0 || day < *first_day) *first_day = day;
+        if (added == 0 || day > *last_day) *last_day = day;
+        added++;
+    }
+    free_line(&line);
+    return added;
+}
+
+// Notes which file the series has read up to series_offset
+static void remember_series_file(FILE *file, const DataFileIdentity *identity) {
+    series_identity = *identity;
+    series_tail_hash = data_file_tail_hash(file, series_offset);
+}
+
+static int load_series(void) {
+    reset_series();
+
+    DataFileIdentity identity;
+    FILE *file = fopen("input.txt", "rb");
+    if (!file || !read_data_file_identity(file, &identity)) {
+        if (file) fclose(file);
+        finish_series_update();
+        return 0;
+    }
+
+    int first_day, last_day;
+    int in_order = 1;
+    int added = read_appended_lines(file, &first_day, &last_day, &in_order);
+    if (added >= 0) remember_series_file(file, &identity);
+    fclose(file);
+
+    if (added < 0 || !rebuild_summaries()) {
+        reset_series();
+        finish_series_update();
+        return 0;
+    }
+
+    series_loaded = 1;
+    finish_series_update();
+    return 1;
+}
+
+// Takes the read lock with the series loaded, loading it first if need be.
+// Returns 0, holding nothing, if input.txt cannot be read.
+static int lock_series_for_reading(void) {
+    pthread_rwlock_rdlock(&series_lock);
+    while (!series_loaded) {
+        pthread_rwlock_unlock(&series_lock);
+        pthread_rwlock_wrlock(&series_lock);
+        int ok = series_loaded || load_series();
+        pthread_rwlock_unlock(&series_lock);
+        if (!ok) return 0;
+        pthread_rwlock_rdlock(&series_lock);
+    }
+    return 1;
+}
+
+// Drop the cached series so the next query reloads it from input.txt
+void invalidate_health_series(void) {
+    pthread_rwlock_wrlock(&series_lock);
+    reset_series();
+    finish_series_update();
+    pthread_rwlock_unlock(&series_lock);
+    notify_series_changed(INT_MIN, INT_MAX);
+}
+
+// Body of refresh_health_series, under the write lock. Sets the range of days the
+// listeners are to hear about, if any.
+static int refresh_locked_series(int *first_day, int *last_day, int *changed) {
+    if (!series_loaded) return 0;
+
+    FILE *file = fopen("input.txt", "rb");
+    if (!file) {
+        reset_series();
+        *first_day = INT_MIN;
+        *last_day = INT_MAX;
+        *changed = 1;
+        return 0;
+    }
+
+    // Anything but an append (an edit, a replaced or truncated file) is read again
+    DataFileIdentity identity;
+    if (!read_data_file_identity(file, &identity) ||
+        !data_file_appended(file, &identity, &series_identity, series_offset, series_tail_hash)) {
+        fclose(file);
+        load_series();
+        *first_day = INT_MIN;
+        *last_day = INT_MAX;
+        *changed = 1;
+        return series_count;
+    }
+    if (identity.size == series_offset) {
+        series_identity = identity;
+        fclose(file);
+        return 0;
+    }
+
+    int old_count = series_count;
+    int in_order = 1;
+    int added = read_appended_lines(file, first_day, last_day, &in_order);
+    if (added >= 0) remember_series_file(file, &identity);
+    fclose(file);
+
+    if (added < 0) {
+        reset_series();
+        *first_day = INT_MIN;
+        *last_day = INT_MAX;
+        *changed = 1;
+        return 0;
+    }
+    if (added == 0) return 0;
+
+    // A streaming series (possibly only since this read) has no summaries to extend
+    int ok = 1;
+    if (in_order && !series_streaming) {
+        for (int i = old_count; i < series_count && ok; i++) {
+            ok = pyramid_add(i) && sketch_add(i);
+        }
+    } else {
+        ok = rebuild_summaries();
+    }
+    if (!ok) {
+        reset_series();
+        *first_day = INT_MIN;
+        *last_day = INT_MAX;
+        *changed = 1;
+        return 0;
+    }
+
+    *changed = 1;
+    return added;
+}
+
+// Whether the series is unloaded or input.txt is still the file it last read,
+// untouched since. Checked under the read lock, so queries that find nothing new
+// do not queue up.
+static int series_up_to_date(void) {
+    DataFileIdentity identity;
+    int found = stat_data_file_identity("input.txt", &identity);
+
+    pthread_rwlock_rdlock(&series_lock);
+    int current = !series_loaded || (found && same_data_file_identity(&identity, &series_identity));
+    pthread_rwlock_unlock(&series_lock);
+    return current;
+}
+
+// Picks up readings appended to input.txt since the series was loaded, reading
+// only the new bytes. In-order appends extend the pyramid in place; a file edited
+// in place, replaced or truncated is reloaded from scratch. Listeners are told
+// which dates changed. Safe from any thread. Returns the number of readings added
+// or replaced.
+int refresh_health_series(void) {
+    if (series_up_to_date()) return 0;
+
+    int first_day = 0, last_day = 0, changed = 0;
+    pthread_rwlock_wrlock(&series_lock);
+    int added = refresh_locked_series(&first_day, &last_day, &changed);
+    finish_series_update();
+    pthread_rwlock_unlock(&series_lock);
+
+    if (changed) notify_series_changed(first_day, last_day);
+    return added;
+}
+
+// Writes the series, its pyramid and its block sketches to a checkpoint file.
+// Returns 0 on failure, and for a streaming series, which is rebuilt by one scan
+// of input.txt instead.
+int save_series_checkpoint(FILE *file, long *offset) {
+    if (!lock_series_for_reading()) return 0;
+    if (series_streaming) {
+        pthread_rwlock_unlock(&series_lock);
+        return 0;
+    }
+
+    int ok = fwrite(&series_count, sizeof(int), 1, file) == 1 &&
+             fwrite(series_data, sizeof(HealthData), series_count, file) == (size_t)series_count &&
+             fwrite(&series_superseded, sizeof(int), 1, file) == 1 &&
+             fwrite(&series_out_of_order, sizeof(int), 1, file) == 1 &&
+             fwrite(series_parse_counts, sizeof(series_parse_counts), 1, file) == 1;
+    for (int k = 1; k < SERIES_MAX_LEVELS && ok; k++) {
+        ok = fwrite(&pyramid[k].count, sizeof(int), 1, file) == 1 &&
+             fwrite(pyramid[k].buckets, sizeof(PyramidBucket), pyramid[k].count, file) == (size_t)pyramid[k].count;
+    }
+    ok = ok && fwrite(&sketch_block_count, sizeof(int), 1, file) == 1 &&
+         fwrite(sketch_blocks, sizeof(SketchBlock), sketch_block_count, file) == (size_t)sketch_block_count;
+
+    *offset = series_offset;
+    pthread_rwlock_unlock(&series_lock);
+    return ok;
+}
+
+// Reads arrays of `count` items written by save_series_checkpoint
+static void* read_checkpoint_array(FILE *file, int *count, int max_count, size_t size) {
+    if (fread(count, sizeof(int), 1, file) != 1 || *count < 0 || *count > max_count) return NULL;
+
+    void *items = malloc(*count ? *count * size : size);
+    if (items && fread(items, size, *count, file) != (size_t)*count) {
+        free(items);
+        return NULL;
+    }
+    return items;
+}
+
+// Restores the series from a checkpoint covering the first `offset` bytes of
+// input.txt; refresh_health_series then picks up whatever was appended since.
+// Returns 0 (leaving the series unloaded) if the checkpoint is damaged.
+int load_series_checkpoint(FILE *file, long offset) {
+    pthread_rwlock_wrlock(&series_lock);
+    reset_series();
+
+    series_data = read_checkpoint_array(file, &series_count, INT_MAX / (int)sizeof(HealthData), sizeof(HealthData));
+    int ok = series_data != NULL;
+    series_capacity = series_count;
+    ok = ok && fread(&series_superseded, sizeof(int), 1, file) == 1 &&
+         fread(&series_out_of_order, sizeof(int), 1, file) == 1 &&
+         fread(series_parse_counts, sizeof(series_parse_counts), 1, file) == 1;
+
+    for (int k = 1; k < SERIES_MAX_LEVELS && ok; k++) {
+        int expected = series_count ? ((series_count - 1) >> k) + 1 : 0;
+        pyramid[k].buckets = read_checkpoint_array(file, &pyramid[k].count, expected, sizeof(PyramidBucket));
+        pyramid[k].capacity = pyramid[k].count;
+        ok = pyramid[k].buckets != NULL && pyramid[k].count == expected;
+    }
+
+    if (ok) {
+        int expected = (series_count + SERIES_SKETCH_BLOCK - 1) / SERIES_SKETCH_BLOCK;
+        sketch_blocks = read_checkpoint_array(file, &sketch_block_count, expected, sizeof(SketchBlock));
+        sketch_block_capacity = sketch_block_count;
+        ok = sketch_blocks != NULL && sketch_block_count == expected;
+    }
+
+    // A checkpoint written under a larger budget may not fit this one
+    if (ok && !reserve_memory(0)) ok = enter_streaming_mode();
+    if (!ok) reset_series();
+    if (ok) {
+        // The checkpoint was checked against input.txt as it is now
+        DataFileIdentity identity;
+        FILE *data = fopen("input.txt", "rb");
+        series_offset = offset;
+        series_loaded = 1;
+        if (data && read_data_file_identity(data, &identity)) remember_series_file(data, &identity);
+        else memset(&series_identity, 0, sizeof(DataFileIdentity));
+        if (data) fclose(data);
+    }
+    finish_series_update();
+    pthread_rwlock_unlock(&series_lock);
+    return ok;
+}
+
+// Share of rows in input.txt that are superseded duplicates or out of date order
+double get_health_data_dirty_ratio(void) {
+    if (!lock_series_for_reading()) return 0;
+
+    int rows = series_count + series_superseded;
+    double ratio = rows ? (double)(series_superseded + series_out_of_order) / rows : 0;
+    pthread_rwlock_unlock(&series_lock);
+    return ratio;
+}
+
+// Registers a callback run whenever readings in [first_day, last_day] change;
+// the range is INT_MIN..INT_MAX when the whole series was reloaded
+int add_health_series_listener(HealthSeriesListener listener) {
+    pthread_rwlock_wrlock(&series_lock);
+    int added = listener_count < SERIES_MAX_LISTENERS;
+    if (added) listeners[listener_count++] = listener;
+    pthread_rwlock_unlock(&series_lock);
+    return added;
+}
+
+// Copies how many lines of input.txt parsed to each RowResult; everything but
+// ROW_OK and ROW_BLANK was skipped as malformed
+void get_health_data_parse_counts(long long counts[ROW_RESULTS]) {
+    if (!lock_series_for_reading()) {
+        memset(counts, 0, sizeof(series_parse_counts));
+        return;
+    }
+    memcpy(counts, series_parse_counts, sizeof(series_parse_counts));
+    pthread_rwlock_unlock(&series_lock);
+}
+
+int get_health_data_count(void) {
+    if (!lock_series_for_reading()) return 0;
+    int count = series_count;
+    pthread_rwlock_unlock(&series_lock);
+    return count;
+}
+
+int get_health_day_at(int index, int *day) {
+    if (!lock_series_for_reading()) return 0;
+    int found = index >= 0 && index < series_count;
+    if (found) *day = series_streaming ? streaming_day_at(index) : series_data[index].day;
+    pthread_rwlock_unlock(&series_lock);
+    return found;
+}
+
+// A day of a streaming query's range and the values of its reading, if it has one
+typedef struct {
+    int present;
+    double values[3];
+} StreamingDay;
+
+// Values of the readings dated [first_day, last_day], read back from the part of
+// input.txt the series covers. The last reading of a day wins, as in the series.
+static StreamingDay* read_streaming_days(int first_day, int last_day) {
+    StreamingDay *days = calloc((size_t)((long long)last_day - first_day + 1), sizeof(StreamingDay));
+    FILE *file = days ? fopen("input.txt", "rb") : NULL;
+    if (!file) {
+        free(days);
+        return NULL;
+    }
+
+    LineBuffer line = {0};
+    HealthRow row;
+    long offset = 0;
+    while (offset < series_offset && read_line(file, &line)) {
+        offset += line.length;
+        if (parse_health_row(line.text, line.length, &row) != ROW_OK ||
+            row.day < first_day || row.day > last_day)
+            continue;
+
+        StreamingDay *day = &days[row.day - first_day];
+        day->present = 1;
+        day->values[0] = row.values[2];
+        day->values[1] = row.values[3];
+        day->values[2] = row.values[4];
+    }
+    free_line(&line);
+    fclose(file);
+    return days;
+}
+
+// Reads back the readings at first..last. Returns NULL if input.txt no longer
+// holds exactly the days the bitmap has (it was rewritten since the last refresh).
+static StreamingDay* read_streaming_readings(int first, int last, int *first_day, int *last_day) {
+    *first_day = streaming_day_at(first);
+    *last_day = streaming_day_at(last);
+    StreamingDay *days = read_streaming_days(*first_day, *last_day);
+    if (!days) return NULL;
+
+    int present = 0;
+    for (long long d = *first_day; d <= *last_day; d++) {
+        present += days[d - *first_day].present;
+    }
+    if (present != last - first + 1) {
+        free(days);
+        return NULL;
+    }
+    return days;
+}
+
+static void finish_point(HealthData *point, const double sum[3], int count) {
+    point->bp_systolic = sum[0] / count;
+    point->bp_diastolic = sum[1] / count;
+    point->blood_sugar = sum[2] / count;
+}
+
+// Streaming counterpart of the pyramid: averages readings first..last in buckets
+// of 2^level consecutive readings, as get_health_data_in_range does from memory
+static int fill_streaming_points(int first, int last, int level, HealthData *points) {
+    int first_day, last_day;
+    StreamingDay *days = read_streaming_readings(first, last, &first_day, &last_day);
+    if (!days) return 0;
+
+    int bucket_first = first >> level;
+    int index = first, bucket = -1, n = 0;
+    double sum[3] = {0, 0, 0};
+    for (long long d = first_day; d <= last_day; d++) {
+        const StreamingDay *day = &days[d - first_day];
+        if (!day->present) continue;
+
+        int b = (index++ >> level) - bucket_first;
+        if (b != bucket) {
+            if (n > 0) finish_point(&points[bucket], sum, n);
+            bucket = b;
+            points[b].day = (int)d;
+            n = 0;
+            sum[0] = sum[1] = sum[2] = 0;
+        }
+        for (int m = 0; m < 3; m++) sum[m] += day->values[m];
+        n++;
+    }
+    if (n > 0) finish_point(&points[bucket], sum, n);
+    free(days);
+    return 1;
+}
+
+// Returns at most max_points readings covering [start_day, end_day]. Wide ranges
+// are answered from the coarsest pyramid level that still gives max_points buckets,
+// so the cost depends on max_points rather than on the length of the range. A
+// streaming series reads the range back from input.txt instead.
+static int read_locked_range(int start_day, int end_day, int max_points, HealthData **data) {
+    int first = series_lower_bound(start_day);
+    int last = series_upper_bound(end_day) - 1;
+    if (first > last) return 0;
+    if (max_points < 1) max_points = 1;
+
+    int level = 0;
+    while (level + 1 < SERIES_MAX_LEVELS && (last >> level) - (first >> level) + 1 > max_points) {
+        level++;
+    }
+
+    int bucket_first = first >> level;
+    int bucket_last = last >> level;
+    int count = bucket_last - bucket_first + 1;
+
+    *data = malloc(count * sizeof(HealthData));
+    if (!*data) return 0;
+
+    if (series_streaming) {
+        if (fill_streaming_points(first, last, level, *data)) return count;
+        free(*data);
+        *data = NULL;
+        return 0;
+    }
+
+    if (level == 0) {
+        memcpy(*data, &series_data[first], count * sizeof(HealthData));
+        return count;
+    }
+
+    for (int b = bucket_first; b <= bucket_last; b++) {
+        PyramidBucket *bucket = &pyramid[level].buckets[b];
+        int lo = b << level;
+        int hi = lo + bucket->count - 1;
+        HealthData *point = &(*data)[b - bucket_first];
+        double sum[3] = {0, 0, 0};
+        int n;
+
+        if (lo >= first && hi <= last) {
+            for (int m = 0; m < 3; m++) sum[m] = bucket->sum[m];
+            n = bucket->count;
+        } else {
+            // Edge bucket only partly inside the range: sum the raw readings
+            if (lo < first) lo = first;
+            if (hi > last) hi = last;
+            for (int i = lo; i <= hi; i++) {
+                double values[3];
+                get_point_values(&series_data[i], values);
+                for (int m = 0; m < 3; m++) sum[m] += values[m];
+            }
+            n = hi - lo + 1;
+        }
+
+        point->day = series_data[lo].day;
+        point->bp_systolic = sum[0] / n;
+        point->bp_diastolic = sum[1] / n;
+        point->blood_sugar = sum[2] / n;
+    }
+
+    return count;
+}
+
+int get_health_data_in_range(int start_day, int end_day, int max_points, HealthData **data) {
+    if (!lock_series_for_reading()) return 0;
+    int count = read_locked_range(start_day, end_day, max_points, data);
+    pthread_rwlock_unlock(&series_lock);
+    return count;
+}
+
+// Merges quantile sketches of systolic, diastolic and sugar over [start_day, end_day]
+// into `sketches`. Whole blocks inside the range contribute their stored sketch;
+// only the readings in the partial blocks at either end are added one by one (all
+// of them, read back from input.txt, for a streaming series). Returns the number
+// of readings covered.
+static int merge_locked_sketches(int start_day, int end_day, TDigest sketches[3]) {
+    int first = series_lower_bound(start_day);
+    int last = series_upper_bound(end_day) - 1;
+    if (first > last) return 0;
+
+    if (series_streaming) {
+        int first_day, last_day;
+        StreamingDay *days = read_streaming_readings(first, last, &first_day, &last_day);
+        if (!days) return 0;
+        for (long long d = first_day; d <= last_day; d++) {
+            if (!days[d - first_day].present) continue;
+            for (int m = 0; m < 3; m++) {
+                tdigest_add(&sketches[m], days[d - first_day].values[m]);
+            }
+        }
+        free(days);
+        return last - first + 1;
+    }
+
+    int i = first;
+    while (i <= last) {
+        int b = i / SERIES_SKETCH_BLOCK;
+        int block_end = (b + 1) * SERIES_SKETCH_BLOCK - 1;
+
+        if (i == b * SERIES_SKETCH_BLOCK && block_end <= last) {
+            for (int m = 0; m < 3; m++) {
+                tdigest_merge(&sketches[m], &sketch_blocks[b].metrics[m]);
+            }
+            i = block_end + 1;
+        } else {
+            double values[3];
+            get_point_values(&series_data[i], values);
+            for (int m = 0; m < 3; m++) {
+                tdigest_add(&sketches[m], values[m]);
+            }
+            i++;
+        }
+    }
+    return last - first + 1;
+}
+
+int get_health_sketches_in_range(int start_day, int end_day, TDigest sketches[3]) {
+    for (int m = 0; m < 3; m++) {
+        tdigest_init(&sketches[m]);
+    }
+    if (!lock_series_for_reading()) return 0;
+    int covered = merge_locked_sketches(start_day, end_day, sketches);
+    pthread_rwlock_unlock(&series_lock);
+    return covered;
+}
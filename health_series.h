@@ -0,0 +1,31 @@
+#ifndef HEALTH_SERIES_H
+#define HEALTH_SERIES_H
+
+#include "health_logic.h"
+#include "health_sketch.h"
+
+// Number of levels in the summary pyramid; a level k bucket covers 2^k readings
+#define SERIES_MAX_LEVELS 24
+#define SERIES_MAX_LISTENERS 8
+// Readings per block of stored quantile sketches
+#define SERIES_SKETCH_BLOCK 1024
+
+// Called with the day range whose readings changed, or INT_MIN..INT_MAX after a full reload
+typedef void (*HealthSeriesListener)(int first_day, int last_day);
+
+// Function declarations for the in-memory series used by range queries
+void invalidate_health_series(void);
+int refresh_health_series(void);
+int add_health_series_listener(HealthSeriesListener listener);
+int get_health_data_count(void);
+double get_health_data_dirty_ratio(void);
+void get_health_data_parse_counts(long long counts[ROW_RESULTS]);
+int get_health_day_at(int index, int *day);
+int get_health_data_in_range(int start_day, int end_day, int max_points, HealthData **data);
+int get_health_sketches_in_range(int start_day, int end_day, TDigest sketches[3]);
+void get_health_series_bytes(size_t *data_bytes, size_t *index_bytes);
+int is_health_series_streaming(void);
+int save_series_checkpoint(FILE *file, long *offset);
+int load_series_checkpoint(FILE *file, long offset);
+
+#endif // HEALTH_SERIES_H
@@ -0,0 +1,602 @@
+// For accept4
+#define _GNU_SOURCE
+#include "health_logic.h"
+#include "health_series.h"
+#include "health_stream.h"
+#include "health_segment.h"
+#include "health_filter.h"
+#include "health_checkpoint.h"
+#include "health_memory.h"
+#include "health_perf.h"
+#include "health_protocol.h"
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Requests waiting for a worker; beyond this the server answers RESPONSE_BUSY
+#define SERVER_QUEUE_SIZE 4096
+// Requests one connection may have queued or running at a time
+#define SERVER_MAX_PENDING 1024
+// Unsent response bytes at which the server stops reading a connection's requests
+// until the client has read some of them. A connection then holds at most this
+// plus the answers to its SERVER_MAX_PENDING requests in flight.
+#define SERVER_MAX_OUTPUT (1 << 20)
+#define SERVER_MAX_WORKERS 64
+#define SERVER_EVENTS 256
+
+// One client. The event loop alone reads requests and closes connections; workers
+// append responses to `out` and send what the socket takes, under `lock`.
+typedef struct {
+    int fd;
+    pthread_mutex_t lock;
+    int closed;        // out of epoll; freed once no job refers to it
+    int draining;      // the client stopped sending; closed once everything is answered
+    int pending;       // requests queued or running
+    uint32_t events;   // what epoll is watching for
+    unsigned char *in;
+    size_t in_length;
+    size_t in_capacity;
+    unsigned char *out;
+    size_t out_length;
+    size_t out_sent;
+    size_t out_capacity;
+} Connection;
+
+typedef struct {
+    Connection *connection;
+    HealthRequest request;
+    char *text;        // terminated copy of the filter text, or NULL
+} Job;
+
+// Response frame being built by a worker
+typedef struct {
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+    uint32_t rows;
+} Reply;
+
+static int epoll_fd = -1;
+static volatile sig_atomic_t stop_requested = 0;
+
+// Bounded ring of requests for the worker pool
+static Job jobs[SERVER_QUEUE_SIZE];
+static int job_head = 0;
+static int job_count = 0;
+static int workers_stopping = 0;
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_ready = PTHREAD_COND_INITIALIZER;
+
+static void on_stop_signal(int signal_number) {
+    (void)signal_number;
+    stop_requested = 1;
+}
+
+static int grow_buffer(unsigned char **data, size_t *capacity, size_t needed) {
+    if (needed <= *capacity) return 1;
+    size_t new_capacity = *capacity ? *capacity : 4096;
+    while (new_capacity < needed) new_capacity *= 2;
+    unsigned char *grown = realloc(*data, new_capacity);
+    if (!grown) return 0;
+    *data = grown;
+    *capacity = new_capacity;
+    return 1;
+}
+
+static void free_connection(Connection *connection) {
+    close(connection->fd);
+    pthread_mutex_destroy(&connection->lock);
+    free(connection->in);
+    free(connection->out);
+    free(connection);
+}
+
+// Sends as much queued output as the socket takes. Caller holds the lock.
+static void flush_output(Connection *connection) {
+    while (connection->out_sent < connection->out_length) {
+        ssize_t sent = send(connection->fd, connection->out + connection->out_sent,
+                            connection->out_length - connection->out_sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent > 0) {
+            connection->out_sent += (size_t)sent;
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else {
+            if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                // The client is gone; epoll reports the error and the loop closes it
+                connection->out_sent = connection->out_length;
+            }
+            break;
+        }
+    }
+    if (connection->out_sent == connection->out_length) {
+        connection->out_sent = 0;
+        connection->out_length = 0;
+    }
+}
+
+// Watches for writability while output is waiting, or once a draining connection
+// has nothing left to answer so the loop gets to close it. Requests are read only
+// while less than SERVER_MAX_OUTPUT is unsent: a client that pipelines requests
+// and never reads the answers is held back by its socket instead of growing `out`.
+// Caller holds the lock.
+static void update_events(Connection *connection) {
+    if (connection->closed) return;
+    int backlogged = connection->out_length - connection->out_sent >= SERVER_MAX_OUTPUT;
+    uint32_t events = connection->draining || backlogged ? 0 : EPOLLIN;
+    if (connection->out_length > 0 || (connection->draining && connection->pending == 0)) events |= EPOLLOUT;
+    if (events == connection->events) return;
+
+    struct epoll_event event = { .events = events, .data.ptr = connection };
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+    connection->events = events;
+}
+
+// Queues a whole response frame and sends what fits now. Caller holds the lock.
+static void queue_output(Connection *connection, const unsigned char *frame, size_t length) {
+    if (connection->closed) return;
+    if (!grow_buffer(&connection->out, &connection->out_capacity, connection->out_length + length)) return;
+    memcpy(connection->out + connection->out_length, frame, length);
+    connection->out_length += length;
+    flush_output(connection);
+    update_events(connection);
+}
+
+// Answers without a body, from the event loop (queue full) or a worker (no memory)
+static void queue_status(Connection *connection, uint32_t id, ResponseStatus status) {
+    unsigned char frame[PROTOCOL_LENGTH_BYTES + PROTOCOL_RESPONSE_HEADER];
+    HealthResponse response = {0};
+    response.id = id;
+    response.status = (uint8_t)status;
+    encode_response_header(&response, frame);
+    queue_output(connection, frame, sizeof(frame));
+}
+
+// Called by the event loop only
+static void close_connection(Connection *connection) {
+    pthread_mutex_lock(&connection->lock);
+    connection->closed = 1;
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    shutdown(connection->fd, SHUT_RDWR);
+    int unused = connection->pending == 0;
+    pthread_mutex_unlock(&connection->lock);
+    if (unused) free_connection(connection);
+}
+
+static int reply_append(Reply *reply, const char *text, size_t length) {
+    if (!grow_buffer(&reply->data, &reply->capacity, reply->length + length)) return 0;
+    memcpy(reply->data + reply->length, text, length);
+    reply->length += length;
+    return 1;
+}
+
+// Appends one row as tab-separated fields; tabs and newlines inside a field become
+// spaces so they cannot break the framing of the rows
+static int reply_row(Reply *reply, const char *const *fields, int count) {
+    for (int f = 0; f < count; f++) {
+        size_t start = reply->length;
+        if (!reply_append(reply, fields[f], strlen(fields[f])) ||
+            !reply_append(reply, f + 1 < count ? "\t" : "\n", 1))
+            return 0;
+        for (size_t i = start; i < reply->length - 1; i++) {
+            if (reply->data[i] == '\t' || reply->data[i] == '\n') reply->data[i] = ' ';
+        }
+    }
+    reply->rows++;
+    return 1;
+}
+
+static int reply_readings(Reply *reply, const FilterRow *rows, int row_count) {
+    for (int r = 0; r < row_count; r++) {
+        FilterTableData text;
+        format_filter_row(&rows[r], &text);
+        const char *fields[SEGMENT_COLUMNS] = { text.date, text.values[0], text.values[1], text.values[2],
+                                                text.values[3], text.values[4], text.values[5] };
+        if (!reply_row(reply, fields, SEGMENT_COLUMNS)) return 0;
+    }
+    return 1;
+}
+
+// Runs one request and fills in `reply` after its header; returns the status
+static ResponseStatus answer_request(const Job *job, Reply *reply, int64_t *total) {
+    const HealthRequest *request = &job->request;
+    int ok = 1;
+    int start_day = request->start_day, end_day = request->end_day;
+    *total = 0;
+
+    if (request->kind != REQUEST_PING && request->kind != REQUEST_COMPARISON &&
+        request->kind != REQUEST_MEMORY && start_day > end_day) {
+        const char *message = "start_day is after end_day";
+        reply_append(reply, message, strlen(message));
+        return RESPONSE_BAD_REQUEST;
+    }
+
+    switch (request->kind) {
+    case REQUEST_PING:
+        break;
+
+    case REQUEST_STATS: {
+        StatsTableData *data;
+        int rows = get_stats_table_data(start_day, end_day, &data);
+        for (int i = 0; i < rows && ok; i++) {
+            const char *fields[] = { data[i].metric, data[i].average, data[i].std_deviation, data[i].median,
+                                     data[i].p90, data[i].p99, data[i].status };
+            ok = reply_row(reply, fields, 7);
+        }
+        if (rows > 0) free(data);
+        break;
+    }
+
+    case REQUEST_ABNORMALITIES: {
+        AbnormalityTableData *data;
+        int rows = get_abnormality_table_data(start_day, end_day, &data);
+        for (int i = 0; i < rows && ok; i++) {
+            const char *fields[] = { data[i].category, data[i].count, data[i].advice };
+            ok = reply_row(reply, fields, 3);
+        }
+        if (rows > 0) free(data);
+        break;
+    }
+
+    case REQUEST_COMPARISON: {
+        ComparisonTableData *data;
+        int rows = get_comparison_table_data(start_day, &data);
+        for (int i = 0; i < rows && ok; i++) {
+            const char *fields[] = { data[i].date, data[i].metric, data[i].current_value, data[i].previous_value,
+                                     data[i].change, data[i].status };
+            ok = reply_row(reply, fields, 6);
+        }
+        if (rows > 0) free(data);
+        break;
+    }
+
+    case REQUEST_READINGS:
+    case REQUEST_FILTER: {
+        FilterProgram *program = malloc(sizeof(FilterProgram));
+        FilterRow *rows = malloc(PROTOCOL_MAX_ROWS * sizeof(FilterRow));
+        char error[200];
+        const char *text = request->kind == REQUEST_FILTER && job->text ? job->text : "";
+        if (!program || !rows) {
+            ok = 0;
+        } else if (!compile_filter(text, program, error, sizeof(error))) {
+            free(program);
+            free(rows);
+            reply_append(reply, error, strlen(error));
+            return RESPONSE_BAD_REQUEST;
+        } else {
+            int row_count = 0;
+            long long matches = run_filter(program, start_day, end_day, rows, PROTOCOL_MAX_ROWS, &row_count);
+            if (matches < 0) {
+                free(program);
+                free(rows);
+                return RESPONSE_FAILED;
+            }
+            *total = matches;
+            ok = reply_readings(reply, rows, row_count);
+        }
+        free(program);
+        free(rows);
+        break;
+    }
+
+    case REQUEST_MEMORY: {
+        MemoryUsage usage;
+        get_memory_usage(&usage);
+        for (int s = 0; s < MEMORY_SUBSYSTEMS && ok; s++) {
+            char bytes[24];
+            snprintf(bytes, sizeof(bytes), "%zu", usage.bytes[s]);
+            const char *fields[] = { get_memory_subsystem_name(s), bytes };
+            ok = reply_row(reply, fields, 2);
+        }
+        *total = (int64_t)usage.total;
+        break;
+    }
+
+    default: {
+        const char *message = "unknown request kind";
+        reply_append(reply, message, strlen(message));
+        return RESPONSE_BAD_REQUEST;
+    }
+    }
+
+    if (request->kind != REQUEST_READINGS && request->kind != REQUEST_FILTER &&
+        request->kind != REQUEST_MEMORY)
+        *total = reply->rows;
+    return ok ? RESPONSE_OK : RESPONSE_FAILED;
+}
+
+static void* worker_main(void *arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&job_lock);
+        while (job_count == 0 && !workers_stopping) {
+            pthread_cond_wait(&job_ready, &job_lock);
+        }
+        if (job_count == 0) {
+            pthread_mutex_unlock(&job_lock);
+            break;
+        }
+        Job job = jobs[job_head];
+        job_head = (job_head + 1) % SERVER_QUEUE_SIZE;
+        job_count--;
+        pthread_mutex_unlock(&job_lock);
+
+        Reply reply = {0};
+        int reserved = grow_buffer(&reply.data, &reply.capacity, PROTOCOL_LENGTH_BYTES + PROTOCOL_RESPONSE_HEADER);
+        reply.length = PROTOCOL_LENGTH_BYTES + PROTOCOL_RESPONSE_HEADER;
+
+        HealthResponse response = {0};
+        response.id = job.request.id;
+        response.status = reserved ? (uint8_t)answer_request(&job, &reply, &response.total) : RESPONSE_FAILED;
+        if (response.status == RESPONSE_FAILED) reply.length = PROTOCOL_LENGTH_BYTES + PROTOCOL_RESPONSE_HEADER;
+        response.rows = response.status == RESPONSE_OK ? reply.rows : 0;
+        response.body_length = reply.length - PROTOCOL_LENGTH_BYTES - PROTOCOL_RESPONSE_HEADER;
+
+        Connection *connection = job.connection;
+        pthread_mutex_lock(&connection->lock);
+        connection->pending--;
+        if (reserved) {
+            encode_response_header(&response, reply.data);
+            queue_output(connection, reply.data, reply.length);
+        } else {
+            queue_status(connection, response.id, RESPONSE_FAILED);
+        }
+        update_events(connection);
+        int unused = connection->closed && connection->pending == 0;
+        pthread_mutex_unlock(&connection->lock);
+        if (unused) free_connection(connection);
+
+        free(reply.data);
+        free(job.text);
+    }
+    return NULL;
+}
+
+// Hands one request to the worker pool, or answers RESPONSE_BUSY when the queue or
+// the connection has too much outstanding
+static void dispatch_request(Connection *connection, const HealthRequest *request) {
+    char *text = NULL;
+    if (request->kind == REQUEST_FILTER) {
+        text = malloc(request->text_length + 1);
+        if (text) {
+            memcpy(text, request->text, request->text_length);
+            text[request->text_length] = '\0';
+        }
+    }
+
+    pthread_mutex_lock(&connection->lock);
+    int accepted = connection->pending < SERVER_MAX_PENDING && (text || request->kind != REQUEST_FILTER);
+    if (accepted) {
+        pthread_mutex_lock(&job_lock);
+        accepted = job_count < SERVER_QUEUE_SIZE;
+        if (accepted) {
+            Job *job = &jobs[(job_head + job_count) % SERVER_QUEUE_SIZE];
+            job->connection = connection;
+            job->request = *request;
+            job->request.text = NULL;
+            job->text = text;
+            job_count++;
+            pthread_cond_signal(&job_ready);
+        }
+        pthread_mutex_unlock(&job_lock);
+    }
+    if (accepted) {
+        connection->pending++;
+    } else {
+        free(text);
+        queue_status(connection, request->id, RESPONSE_BUSY);
+    }
+    pthread_mutex_unlock(&connection->lock);
+}
+
+// Reads everything available and dispatches each complete request. Returns 0 once
+// the connection should be closed (a broken frame or a read error); a client that
+// shut down its sending side is left draining.
+static int read_requests(Connection *connection) {
+    for (;;) {
+        if (!grow_buffer(&connection->in, &connection->in_capacity, connection->in_length + 4096)) return 0;
+        ssize_t received = recv(connection->fd, connection->in + connection->in_length,
+                                connection->in_capacity - connection->in_length, MSG_DONTWAIT);
+        if (received > 0) {
+            connection->in_length += (size_t)received;
+            continue;
+        }
+        if (received < 0 && errno == EINTR) continue;
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (received < 0) return 0;
+
+        pthread_mutex_lock(&connection->lock);
+        connection->draining = 1;
+        update_events(connection);
+        pthread_mutex_unlock(&connection->lock);
+        break;
+    }
+
+    size_t used = 0;
+    for (;;) {
+        const unsigned char *frame = connection->in + used;
+        long size = get_frame_size(frame, connection->in_length - used, PROTOCOL_MAX_REQUEST);
+        if (size < 0) return 0;
+        if (size == 0) break;
+
+        HealthRequest request;
+        if (!decode_request(frame + PROTOCOL_LENGTH_BYTES, size - PROTOCOL_LENGTH_BYTES, &request)) return 0;
+        dispatch_request(connection, &request);
+        used += size;
+    }
+    memmove(connection->in, connection->in + used, connection->in_length - used);
+    connection->in_length -= used;
+    return 1;
+}
+
+static void accept_connections(int listen_fd) {
+    for (;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        Connection *connection = calloc(1, sizeof(Connection));
+        if (!connection) {
+            close(fd);
+            continue;
+        }
+        connection->fd = fd;
+        connection->events = EPOLLIN;
+        pthread_mutex_init(&connection->lock, NULL);
+
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = connection };
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) free_connection(connection);
+    }
+}
+
+static void handle_connection_event(Connection *connection, uint32_t events) {
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        close_connection(connection);
+        return;
+    }
+    if ((events & EPOLLIN) && !read_requests(connection)) {
+        close_connection(connection);
+        return;
+    }
+    if (events & EPOLLOUT) {
+        pthread_mutex_lock(&connection->lock);
+        flush_output(connection);
+        int finished = connection->draining && connection->pending == 0 && connection->out_length == 0;
+        if (!finished) update_events(connection);
+        pthread_mutex_unlock(&connection->lock);
+        if (finished) close_connection(connection);
+    }
+}
+
+// Binds the listening socket, replacing a stale socket file but never a live server
+static int open_listen_socket(const char *path) {
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0) {
+        fprintf(stderr, "A server is already listening on %s\n", path);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    unlink(path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Serves the analysis API of the input.txt in the working directory on a Unix
+// socket until SIGINT or SIGTERM:
+//   health_server [-s socket] [-w workers] [-m memory budget, e.g. 256M]
+int main(int argc, char *argv[]) {
+    const char *socket_path = PROTOCOL_SOCKET;
+    int worker_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    size_t memory_budget = 0;
+
+    int option;
+    while ((option = getopt(argc, argv, "s:w:m:")) != -1) {
+        if (option == 's') {
+            socket_path = optarg;
+        } else if (option == 'w') {
+            worker_count = atoi(optarg);
+        } else if (option == 'm' && parse_memory_size(optarg, &memory_budget)) {
+            set_memory_budget(memory_budget);
+        } else {
+            fprintf(stderr, "usage: %s [-s socket] [-w workers] [-m memory budget]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (worker_count < 1) worker_count = 1;
+    if (worker_count > SERVER_MAX_WORKERS) worker_count = SERVER_MAX_WORKERS;
+
+    // Load everything up front so the first queries do not pay for it
+    load_health_checkpoint();
+    get_health_data_count();
+    refresh_stream_readings();
+    refresh_segment_store();
+    MemoryUsage usage;
+    char total[24], budget[24];
+    get_memory_usage(&usage);
+
+    int listen_fd = open_listen_socket(socket_path);
+    if (listen_fd < 0) return 1;
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event listen_event = { .events = EPOLLIN, .data.ptr = NULL };
+    if (epoll_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &listen_event) != 0) {
+        perror("epoll");
+        return 1;
+    }
+
+    struct sigaction action = {0};
+    action.sa_handler = on_stop_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_t workers[SERVER_MAX_WORKERS];
+    int started = 0;
+    while (started < worker_count && pthread_create(&workers[started], NULL, worker_main, NULL) == 0) {
+        started++;
+    }
+    if (started == 0) {
+        fprintf(stderr, "Could not start any worker threads\n");
+        return 1;
+    }
+    format_memory_size(usage.total, total, sizeof(total));
+    format_memory_size(usage.budget, budget, sizeof(budget));
+    fprintf(stderr, "Serving %s with %d workers, holding %s (budget %s)%s\n", socket_path, started,
+            total, usage.budget ? budget : "none", usage.series_streaming ? ", series streaming from input.txt" : "");
+
+    struct epoll_event events[SERVER_EVENTS];
+    while (!stop_requested) {
+        int ready = epoll_wait(epoll_fd, events, SERVER_EVENTS, -1);
+        for (int i = 0; i < ready; i++) {
+            if (events[i].data.ptr == NULL)
+                accept_connections(listen_fd);
+            else
+                handle_connection_event(events[i].data.ptr, events[i].events);
+        }
+    }
+
+    close(listen_fd);
+    unlink(socket_path);
+    pthread_mutex_lock(&job_lock);
+    workers_stopping = 1;
+    pthread_cond_broadcast(&job_ready);
+    pthread_mutex_unlock(&job_lock);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    // HEALTH_PERF_LOG=<file> dumps the collected timings on exit, as in the GUI
+    const char *perf_log = getenv("HEALTH_PERF_LOG");
+    if (perf_log) {
+        FILE *file = fopen(perf_log, "w");
+        if (file) {
+            health_perf_dump(file);
+            fclose(file);
+        }
+    }
+    return 0;
+}
+
+// Linux only (epoll). Build next to health_analyzer and run where input.txt lives:
+// gcc health_logic.c health_series.c health_stream.c health_advice.c health_memory.c health_grid.c health_perf.c health_sketch.c health_segment.c health_epoch.c health_checkpoint.c health_filter.c health_protocol.c health_server.c -o health_server -lm -pthread
+// ./health_server -w 4
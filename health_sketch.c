@@ -0,0 +1,187 @@
+#include "health_sketch.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+void tdigest_init(TDigest *digest) {
+    digest->count = 0;
+    digest->buffered = 0;
+    digest->total_weight = 0;
+    digest->min = 0;
+    digest->max = 0;
+}
+
+static int compare_centroids(const void *a, const void *b) {
+    double mean_a = ((const TDigestCentroid*)a)->mean;
+    double mean_b = ((const TDigestCentroid*)b)->mean;
+    return (mean_a > mean_b) - (mean_a < mean_b);
+}
+
+// k1 scale function: centroids near q = 0 or 1 cover fewer readings
+static double scale_k1(double q) {
+    return TDIGEST_COMPRESSION / (2 * M_PI) * asin(2 * q - 1);
+}
+
+// Sorts `merged` and folds neighbours together while a centroid spans at most one
+// unit of the k1 scale, which bounds the digest to about TDIGEST_COMPRESSION centroids
+static void compress_centroids(TDigest *digest, TDigestCentroid *merged, int count) {
+    qsort(merged, count, sizeof(TDigestCentroid), compare_centroids);
+
+    double total = 0;
+    for (int i = 0; i < count; i++) total += merged[i].weight;
+
+    int out = 0;
+    double before = 0;
+    double k_left = scale_k1(0);
+    TDigestCentroid current = merged[0];
+    for (int i = 1; i < count; i++) {
+        double q_right = (before + current.weight + merged[i].weight) / total;
+
+        if (scale_k1(q_right) - k_left <= 1 || out == TDIGEST_CAPACITY - 1) {
+            current.mean += (merged[i].mean - current.mean) * merged[i].weight / (current.weight + merged[i].weight);
+            current.weight += merged[i].weight;
+        } else {
+            before += current.weight;
+            k_left = scale_k1(before / total);
+            digest->centroids[out++] = current;
+            current = merged[i];
+        }
+    }
+    digest->centroids[out++] = current;
+    digest->count = out;
+    digest->total_weight = total;
+}
+
+static void flush_buffer(TDigest *digest) {
+    if (digest->buffered == 0) return;
+
+    TDigestCentroid merged[TDIGEST_CAPACITY + TDIGEST_BUFFER];
+    memcpy(merged, digest->centroids, digest->count * sizeof(TDigestCentroid));
+    for (int i = 0; i < digest->buffered; i++) {
+        merged[digest->count + i].mean = digest->buffer[i];
+        merged[digest->count + i].weight = 1;
+    }
+    int count = digest->count + digest->buffered;
+    digest->buffered = 0;
+    compress_centroids(digest, merged, count);
+}
+
+void tdigest_add(TDigest *digest, double value) {
+    if (digest->total_weight == 0 && digest->buffered == 0) {
+        digest->min = value;
+        digest->max = value;
+    }
+    if (value < digest->min) digest->min = value;
+    if (value > digest->max) digest->max = value;
+
+    digest->buffer[digest->buffered++] = value;
+    if (digest->buffered == TDIGEST_BUFFER) flush_buffer(digest);
+}
+
+void tdigest_merge(TDigest *into, const TDigest *from) {
+    if (from->count == 0 && from->buffered == 0) return;
+
+    for (int i = 0; i < from->buffered; i++) {
+        tdigest_add(into, from->buffer[i]);
+    }
+    if (from->count == 0) return;
+
+    int had_data = into->total_weight > 0 || into->buffered > 0;
+    flush_buffer(into);
+
+    TDigestCentroid merged[2 * TDIGEST_CAPACITY];
+    memcpy(merged, into->centroids, into->count * sizeof(TDigestCentroid));
+    memcpy(merged + into->count, from->centroids, from->count * sizeof(TDigestCentroid));
+    compress_centroids(into, merged, into->count + from->count);
+
+    if (!had_data || from->min < into->min) into->min = from->min;
+    if (!had_data || from->max > into->max) into->max = from->max;
+}
+
+// Estimated value at quantile q (0..1), interpolating between centroid centres.
+// Returns NAN for an empty digest.
+double tdigest_quantile(TDigest *digest, double q) {
+    flush_buffer(digest);
+    if (digest->count == 0) return NAN;
+    if (q <= 0) return digest->min;
+    if (q >= 1) return digest->max;
+
+    double target = q * digest->total_weight;
+    double before = 0;
+    for (int i = 0; i < digest->count; i++) {
+        const TDigestCentroid *c = &digest->centroids[i];
+        double centre = before + c->weight / 2;
+
+        if (target < centre) {
+            // Between the previous centroid's centre (or min) and this one
+            double left_value = i == 0 ? digest->min : digest->centroids[i - 1].mean;
+            double left_rank = i == 0 ? 0 : before - digest->centroids[i - 1].weight / 2;
+            if (centre == left_rank) return c->mean;
+            return left_value + (c->mean - left_value) * (target - left_rank) / (centre - left_rank);
+        }
+        before += c->weight;
+    }
+
+    const TDigestCentroid *last = &digest->centroids[digest->count - 1];
+    double last_centre = digest->total_weight - last->weight / 2;
+    if (digest->total_weight == last_centre) return digest->max;
+    return last->mean + (digest->max - last->mean) * (target - last_centre) / (digest->total_weight - last_centre);
+}
+
+// Estimated fraction of readings below `value`, counting ties as half (midrank),
+// so it can stand in for a rank. Returns NAN for an empty digest.
+double tdigest_cdf(TDigest *digest, double value) {
+    flush_buffer(digest);
+    if (digest->count == 0) return NAN;
+    if (value < digest->min) return 0;
+    if (value > digest->max) return 1;
+
+    double below = 0;
+    double prev_value = digest->min, prev_rank = 0;
+    for (int i = 0; i < digest->count; i++) {
+        const TDigestCentroid *c = &digest->centroids[i];
+
+        if (c->mean == value) {
+            double equal = 0;
+            while (i < digest->count && digest->centroids[i].mean == value) {
+                equal += digest->centroids[i++].weight;
+            }
+            return (below + equal / 2) / digest->total_weight;
+        }
+        if (c->mean > value) {
+            double rank = below + c->weight / 2;
+            return (prev_rank + (rank - prev_rank) * (value - prev_value) / (c->mean - prev_value)) / digest->total_weight;
+        }
+
+        prev_value = c->mean;
+        prev_rank = below + c->weight / 2;
+        below += c->weight;
+    }
+
+    if (digest->max == prev_value) return 1;
+    return (prev_rank + (digest->total_weight - prev_rank) * (value - prev_value) / (digest->max - prev_value)) / digest->total_weight;
+}
+
+void histogram_init(MetricHistogram *histogram, double start, double width) {
+    histogram->start = start;
+    histogram->width = width;
+    memset(histogram->bins, 0, sizeof(histogram->bins));
+}
+
+void histogram_add(MetricHistogram *histogram, double value) {
+    int bin = (int)floor((value - histogram->start) / histogram->width);
+    if (bin < 0) bin = 0;
+    if (bin >= HISTOGRAM_BINS) bin = HISTOGRAM_BINS - 1;
+    histogram->bins[bin]++;
+}
+
+// Both histograms must share the same bin layout
+void histogram_merge(MetricHistogram *into, const MetricHistogram *from) {
+    for (int b = 0; b < HISTOGRAM_BINS; b++) {
+        into->bins[b] += from->bins[b];
+    }
+}
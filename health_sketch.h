@@ -0,0 +1,49 @@
+#ifndef HEALTH_SKETCH_H
+#define HEALTH_SKETCH_H
+
+// t-digest compression: at most about this many centroids are kept; rank error is
+// around 1% in the middle of the distribution and much smaller in the tails
+#define TDIGEST_COMPRESSION 100
+#define TDIGEST_CAPACITY 128
+#define TDIGEST_BUFFER 32
+
+#define HISTOGRAM_BINS 32
+
+typedef struct {
+    double mean;
+    double weight;
+} TDigestCentroid;
+
+// Fixed-size t-digest: a bounded set of weighted centroids, finer at the tails.
+// Two digests merge into one with the same error bound, so digests built for
+// separate ranges or patients can be combined without the raw readings.
+typedef struct {
+    int count;
+    int buffered;
+    double total_weight;
+    double min;
+    double max;
+    TDigestCentroid centroids[TDIGEST_CAPACITY];
+    double buffer[TDIGEST_BUFFER];
+} TDigest;
+
+// Fixed-bin histogram over [start, start + HISTOGRAM_BINS * width); values outside
+// the range are counted in the first or last bin
+typedef struct {
+    double start;
+    double width;
+    long long bins[HISTOGRAM_BINS];
+} MetricHistogram;
+
+// Function declarations for mergeable sketches
+void tdigest_init(TDigest *digest);
+void tdigest_add(TDigest *digest, double value);
+void tdigest_merge(TDigest *into, const TDigest *from);
+double tdigest_quantile(TDigest *digest, double q);
+double tdigest_cdf(TDigest *digest, double value);
+
+void histogram_init(MetricHistogram *histogram, double start, double width);
+void histogram_add(MetricHistogram *histogram, double value);
+void histogram_merge(MetricHistogram *into, const MetricHistogram *from);
+
+#endif // HEALTH_SKETCH_H
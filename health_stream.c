@@ -0,0 +1,590 @@
+#include "health_stream.h"
+#include "health_segment.h"
+#include <pthread.h>
+#include <sys/stat.h>
+
+// Daily index of one metric. Each entry holds prefix sums over every reading
+// before the day, so the totals of any run of days take two lookups; the entry
+// after the last day closes the index with the totals of the whole series.
+typedef struct {
+    int day;
+    int first;                  // index of the day's first reading
+    long long sum_before;
+    FixedSquareSum squares_before;
+} StreamDay;
+
+// Readings of one metric sorted by time, times and values in separate arrays so
+// searches only touch the times. Values are fixed point at the column's scale.
+typedef struct {
+    HealthTime *times;
+    int32_t *values;
+    int count;
+    int capacity;
+    int scale;
+
+    StreamDay *days;            // day_count days, then the closing entry
+    int day_count;
+    int day_capacity;
+
+    TDigest *sketches;          // one per STREAM_SKETCH_BLOCK readings
+    int sketch_count;
+    int sketch_capacity;
+} StreamSeries;
+
+static StreamSeries streams[STREAM_METRICS];
+static int streams_loaded = 0;
+static long stream_offset = 0;  // bytes of readings.txt already folded in
+
+// Queries share the readings under the read lock; loading, refreshing and dropping
+// them takes the write lock. Listeners run after it is released.
+static pthread_rwlock_t stream_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static HealthSeriesListener stream_listeners[STREAM_MAX_LISTENERS];
+static int stream_listener_count = 0;
+
+static const struct {
+    const char *name;
+    int metric;
+} stream_metric_names[] = {
+    { "height", 0 },
+    { "weight", 1 },
+    { "systolic", 2 },
+    { "bp_sys", 2 },
+    { "diastolic", 3 },
+    { "bp_dia", 3 },
+    { "sugar", 4 },
+    { "glucose", 4 },
+    { "temp", 5 },
+    { "temperature", 5 }
+};
+
+// Reads two digits at `text`; returns -1 if either is not a digit
+static int two_digits(const char *text) {
+    if (text[0] < '0' || text[0] > '9' || text[1] < '0' || text[1] > '9') return -1;
+    return (text[0] - '0') * 10 + (text[1] - '0');
+}
+
+// Parses YYYY-MM-DDTHH:MM or YYYY-MM-DDTHH:MM:SS (a blank may stand for the T),
+// or a plain count of seconds since 1970-01-01 00:00. Returns 0 for anything else.
+int parse_health_time(const char *text, size_t length, HealthTime *time) {
+    size_t digits = 0;
+    while (digits < length && text[digits] >= '0' && text[digits] <= '9') digits++;
+    if (digits == length && length > 0 && length <= 18) {
+        HealthTime seconds = 0;
+        for (size_t i = 0; i < length; i++) {
+            seconds = seconds * 10 + (text[i] - '0');
+        }
+        *time = seconds;
+        return 1;
+    }
+
+    int day;
+    if ((length != 16 && length != 19) || !parse_date_digits(text, &day) ||
+        (text[10] != 'T' && text[10] != ' ') || text[13] != ':') return 0;
+
+    int hour = two_digits(text + 11), minute = two_digits(text + 14), second = 0;
+    if (length == 19) {
+        if (text[16] != ':') return 0;
+        second = two_digits(text + 17);
+    }
+    if (hour < 0 || hour > 23 || minute < 0 || minute > 59 || second < 0 || second > 59) return 0;
+
+    *time = (HealthTime)day * SECONDS_PER_DAY + hour * 3600 + minute * 60 + second;
+    return 1;
+}
+
+// Formats a time as YYYY-MM-DDTHH:MM:SS into `text` (at least TIME_TEXT_SIZE bytes)
+void format_health_time(HealthTime time, char *text) {
+    int day = get_health_time_day(time);
+    unsigned seconds = (unsigned)(time - (HealthTime)day * SECONDS_PER_DAY);
+
+    format_day_number(day, text);
+    snprintf(text + 10, TIME_TEXT_SIZE - 10, "T%02u:%02u:%02u", seconds / 3600 % 24, seconds / 60 % 60, seconds % 60);
+}
+
+int get_health_time_day(HealthTime time) {
+    HealthTime day = time / SECONDS_PER_DAY;
+    if (time % SECONDS_PER_DAY < 0) day--;
+    return (int)day;
+}
+
+// Metric index of a name as written in readings.txt, or -1
+int get_stream_metric(const char *name, size_t length) {
+    for (size_t i = 0; i < sizeof(stream_metric_names) / sizeof(stream_metric_names[0]); i++) {
+        if (strlen(stream_metric_names[i].name) == length && memcmp(stream_metric_names[i].name, name, length) == 0)
+            return stream_metric_names[i].metric;
+    }
+    return -1;
+}
+
+// Splits one readings.txt line into its time, metric and fixed-point value.
+// Returns 0 for blank and malformed lines.
+static int parse_stream_line(const char *text, size_t length, HealthTime *time, int *metric, int32_t *value) {
+    const char *end = text + length;
+    while (end > text && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t')) end--;
+
+    const char *first_comma = memchr(text, ',', end - text);
+    if (!first_comma) return 0;
+    const char *second_comma = memchr(first_comma + 1, ',', end - first_comma - 1);
+    if (!second_comma || memchr(second_comma + 1, ',', end - second_comma - 1)) return 0;
+
+    double number;
+    if (!parse_health_time(text, first_comma - text, time)) return 0;
+    *metric = get_stream_metric(first_comma + 1, second_comma - first_comma - 1);
+    if (*metric < 0 || !parse_reading(second_comma + 1, end, &number)) return 0;
+
+    double fixed = round(number * get_segment_scale(*metric + 1));
+    if (fixed < INT32_MIN || fixed > INT32_MAX) return 0;
+    *value = (int32_t)fixed;
+    return 1;
+}
+
+static void reset_streams(void) {
+    for (int m = 0; m < STREAM_METRICS; m++) {
+        StreamSeries *series = &streams[m];
+        free(series->times);
+        free(series->values);
+        free(series->days);
+        free(series->sketches);
+        memset(series, 0, sizeof(StreamSeries));
+        series->scale = get_segment_scale(m + 1);
+    }
+    stream_offset = 0;
+    streams_loaded = 0;
+}
+
+// First reading whose time is > time
+static int stream_upper_bound(const StreamSeries *series, HealthTime time) {
+    int lo = 0, hi = series->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (series->times[mid] <= time)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// First day entry whose day is >= day (day_count if none)
+static int day_lower_bound(const StreamSeries *series, int day) {
+    int lo = 0, hi = series->day_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (series->days[mid].day < day)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// First day entry whose day is > day (day_count if none)
+static int day_upper_bound(const StreamSeries *series, int day) {
+    int lo = 0, hi = series->day_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (series->days[mid].day <= day)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Insert a reading keeping the series sorted. A later reading at a time already
+// in the series replaces it (last write wins). Returns 1 for a reading added at
+// the end, 2 for one replaced or inserted earlier, 0 on failure.
+static int stream_insert(StreamSeries *series, HealthTime time, int32_t value) {
+    int pos = stream_upper_bound(series, time);
+    if (pos > 0 && series->times[pos - 1] == time) {
+        series->values[pos - 1] = value;
+        return 2;
+    }
+
+    if (series->count == series->capacity) {
+        int new_capacity = series->capacity ? series->capacity * 2 : 256;
+        HealthTime *times = realloc(series->times, new_capacity * sizeof(HealthTime));
+        if (!times) return 0;
+        series->times = times;
+        int32_t *values = realloc(series->values, new_capacity * sizeof(int32_t));
+        if (!values) return 0;
+        series->values = values;
+        series->capacity = new_capacity;
+    }
+
+    int moved = series->count - pos;
+    if (moved > 0) {
+        memmove(&series->times[pos + 1], &series->times[pos], moved * sizeof(HealthTime));
+        memmove(&series->values[pos + 1], &series->values[pos], moved * sizeof(int32_t));
+    }
+    series->times[pos] = time;
+    series->values[pos] = value;
+    series->count++;
+    return moved > 0 ? 2 : 1;
+}
+
+// Fold reading `index` into the daily index and the sketch of its block.
+// Readings have to be folded in time order.
+static int stream_summarize(StreamSeries *series, int index) {
+    int day = get_health_time_day(series->times[index]);
+    int32_t value = series->values[index];
+
+    if (series->day_count + 2 > series->day_capacity) {
+        int new_capacity = series->day_capacity ? series->day_capacity * 2 : 64;
+        StreamDay *grown = realloc(series->days, new_capacity * sizeof(StreamDay));
+        if (!grown) return 0;
+        if (series->day_capacity == 0) {
+            memset(&grown[0], 0, sizeof(StreamDay));
+            grown[0].day = INT_MAX;
+        }
+        series->days = grown;
+        series->day_capacity = new_capacity;
+    }
+
+    if (series->day_count == 0 || series->days[series->day_count - 1].day != day) {
+        series->days[series->day_count].day = day;
+        series->days[series->day_count + 1] = series->days[series->day_count];
+        series->days[++series->day_count].day = INT_MAX;
+    }
+    StreamDay *closing = &series->days[series->day_count];
+    closing->first++;
+    closing->sum_before += value;
+    closing->squares_before += (FixedSquareSum)value * value;
+
+    int b = index / STREAM_SKETCH_BLOCK;
+    if (b == series->sketch_count) {
+        if (series->sketch_count == series->sketch_capacity) {
+            int new_capacity = series->sketch_capacity ? series->sketch_capacity * 2 : 16;
+            TDigest *grown = realloc(series->sketches, new_capacity * sizeof(TDigest));
+            if (!grown) return 0;
+            series->sketches = grown;
+            series->sketch_capacity = new_capacity;
+        }
+        tdigest_init(&series->sketches[series->sketch_count++]);
+    }
+    tdigest_add(&series->sketches[b], (double)value / series->scale);
+    return 1;
+}
+
+// Rebuild the daily index and block sketches from the sorted readings
+static int rebuild_stream_summaries(StreamSeries *series) {
+    if (series->days) {
+        memset(&series->days[0], 0, sizeof(StreamDay));
+        series->days[0].day = INT_MAX;
+    }
+    series->day_count = 0;
+    series->sketch_count = 0;
+
+    for (int i = 0; i < series->count; i++) {
+        if (!stream_summarize(series, i)) return 0;
+    }
+    return 1;
+}
+
+// Runs the listeners, without any lock held so they may query the readings
+static void notify_stream_changed(int first_day, int last_day) {
+    HealthSeriesListener listeners[STREAM_MAX_LISTENERS];
+    pthread_rwlock_rdlock(&stream_lock);
+    int count = stream_listener_count;
+    memcpy(listeners, stream_listeners, count * sizeof(HealthSeriesListener));
+    pthread_rwlock_unlock(&stream_lock);
+
+    for (int i = 0; i < count; i++) {
+        listeners[i](first_day, last_day);
+    }
+}
+
+// Folds the complete lines after stream_offset into the series. Readings that
+// arrive in time order extend the summaries as they go; a metric that got one out
+// of order is rebuilt once at the end. Returns the number of readings added or
+// replaced, or -1 on failure.
+static int read_appended_readings(FILE *file, int *first_day, int *last_day) {
+    LineBuffer line = {0};
+    int rebuild[STREAM_METRICS] = {0};
+    int added = 0;
+
+    fseek(file, stream_offset, SEEK_SET);
+    while (read_line(file, &line)) {
+        if (line.text[line.length - 1] != '\n') break;
+        stream_offset += line.length;
+
+        HealthTime time;
+        int metric;
+        int32_t value;
+        if (!parse_stream_line(line.text, line.length, &time, &metric, &value)) continue;
+
+        StreamSeries *series = &streams[metric];
+        int inserted = stream_insert(series, time, value);
+        if (inserted == 2) rebuild[metric] = 1;
+        if (!inserted || (!rebuild[metric] && !stream_summarize(series, series->count - 1))) {
+            free_line(&line);
+            return -1;
+        }
+
+        int day = get_health_time_day(time);
+        if (added == 0 || day < *first_day) *first_day = day;
+        if (added == 0 || day > *last_day) *last_day = day;
+        added++;
+    }
+    free_line(&line);
+
+    for (int m = 0; m < STREAM_METRICS; m++) {
+        if (rebuild[m] && !rebuild_stream_summaries(&streams[m])) return -1;
+    }
+    return added;
+}
+
+static int ensure_streams_loaded(void) {
+    if (streams_loaded) return 1;
+    reset_streams();
+    streams_loaded = 1;
+
+    FILE *file = fopen(STREAM_FILE, "rb");
+    if (!file) return 1;
+
+    int first_day, last_day;
+    int added = read_appended_readings(file, &first_day, &last_day);
+    fclose(file);
+    if (added < 0) {
+        reset_streams();
+        return 0;
+    }
+    return 1;
+}
+
+// Takes the read lock with the readings loaded, loading them first if need be.
+// Returns 0, holding nothing, if they cannot be loaded.
+static int lock_streams_for_reading(void) {
+    pthread_rwlock_rdlock(&stream_lock);
+    while (!streams_loaded) {
+        pthread_rwlock_unlock(&stream_lock);
+        pthread_rwlock_wrlock(&stream_lock);
+        int ok = ensure_streams_loaded();
+        pthread_rwlock_unlock(&stream_lock);
+        if (!ok) return 0;
+        pthread_rwlock_rdlock(&stream_lock);
+    }
+    return 1;
+}
+
+// Drop the readings so the next query reloads them from readings.txt
+void invalidate_stream_readings(void) {
+    pthread_rwlock_wrlock(&stream_lock);
+    reset_streams();
+    pthread_rwlock_unlock(&stream_lock);
+    notify_stream_changed(INT_MIN, INT_MAX);
+}
+
+// Body of refresh_stream_readings, under the write lock. Sets the range of days
+// the listeners are to hear about, if any.
+static int refresh_locked_streams(int *first_day, int *last_day, int *changed) {
+    if (!streams_loaded) {
+        if (!ensure_streams_loaded()) return 0;
+        int total = 0;
+        for (int m = 0; m < STREAM_METRICS; m++) total += streams[m].count;
+        if (total > 0) {
+            *first_day = INT_MIN;
+            *last_day = INT_MAX;
+            *changed = 1;
+        }
+        return total;
+    }
+
+    FILE *file = fopen(STREAM_FILE, "rb");
+    if (!file) {
+        if (stream_offset == 0) return 0;
+        reset_streams();
+        *first_day = INT_MIN;
+        *last_day = INT_MAX;
+        *changed = 1;
+        return 0;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    if (size < stream_offset) {
+        fclose(file);
+        reset_streams();
+        int total = refresh_locked_streams(first_day, last_day, changed);
+        *first_day = INT_MIN;
+        *last_day = INT_MAX;
+        *changed = 1;
+        return total;
+    }
+    if (size == stream_offset) {
+        fclose(file);
+        return 0;
+    }
+
+    int added = read_appended_readings(file, first_day, last_day);
+    fclose(file);
+
+    if (added < 0) {
+        reset_streams();
+        *first_day = INT_MIN;
+        *last_day = INT_MAX;
+        *changed = 1;
+        return 0;
+    }
+    *changed = added > 0;
+    return added;
+}
+
+// Whether readings.txt still ends where the readings do. Checked under the read
+// lock, so queries that find nothing new do not queue up behind each other.
+static int streams_up_to_date(void) {
+    struct stat st;
+    long long size = stat(STREAM_FILE, &st) == 0 ? (long long)st.st_size : -1;
+
+    pthread_rwlock_rdlock(&stream_lock);
+    int current = streams_loaded && (size < 0 ? stream_offset == 0 : size == stream_offset);
+    pthread_rwlock_unlock(&stream_lock);
+    return current;
+}
+
+// Loads readings.txt on first use, then reads only the bytes appended since. A
+// file that shrank is reloaded from scratch. Listeners are told which dates
+// changed. Safe from any thread. Returns the number of readings added or replaced.
+int refresh_stream_readings(void) {
+    if (streams_up_to_date()) return 0;
+
+    int first_day = 0, last_day = 0, changed = 0;
+    pthread_rwlock_wrlock(&stream_lock);
+    int added = refresh_locked_streams(&first_day, &last_day, &changed);
+    pthread_rwlock_unlock(&stream_lock);
+
+    if (changed) notify_stream_changed(first_day, last_day);
+    return added;
+}
+
+// Registers a callback run whenever readings in [first_day, last_day] change;
+// the range is INT_MIN..INT_MAX when readings.txt was reloaded
+int add_stream_listener(HealthSeriesListener listener) {
+    pthread_rwlock_wrlock(&stream_lock);
+    int added = stream_listener_count < STREAM_MAX_LISTENERS;
+    if (added) stream_listeners[stream_listener_count++] = listener;
+    pthread_rwlock_unlock(&stream_lock);
+    return added;
+}
+
+int get_stream_reading_count(int metric) {
+    if (metric < 0 || metric >= STREAM_METRICS || !lock_streams_for_reading()) return 0;
+    int count = streams[metric].count;
+    pthread_rwlock_unlock(&stream_lock);
+    return count;
+}
+
+// Heap bytes held by the readings, daily indexes and sketches of every metric
+size_t get_stream_bytes(void) {
+    size_t bytes = 0;
+    pthread_rwlock_rdlock(&stream_lock);
+    for (int m = 0; m < STREAM_METRICS; m++) {
+        const StreamSeries *series = &streams[m];
+        bytes += (size_t)series->capacity * (sizeof(HealthTime) + sizeof(int32_t)) +
+                 (size_t)series->day_capacity * sizeof(StreamDay) +
+                 (size_t)series->sketch_capacity * sizeof(TDigest);
+    }
+    pthread_rwlock_unlock(&stream_lock);
+    return bytes;
+}
+
+// get_stream_totals for a caller that holds the read lock
+static int locked_stream_totals(int metric, int start_day, int end_day, StreamTotals *totals) {
+    const StreamSeries *series = &streams[metric];
+    if (series->count == 0 || start_day > end_day) return 0;
+
+    const StreamDay *from = &series->days[day_lower_bound(series, start_day)];
+    const StreamDay *to = &series->days[day_upper_bound(series, end_day)];
+    totals->count = to->first - from->first;
+    totals->sum = to->sum_before - from->sum_before;
+    totals->sum_squares = to->squares_before - from->squares_before;
+    return (int)totals->count;
+}
+
+// Count and fixed-point sums of a metric's readings over [start_day, end_day],
+// from the prefix sums of the daily index. Returns the number of readings.
+int get_stream_totals(int metric, int start_day, int end_day, StreamTotals *totals) {
+    memset(totals, 0, sizeof(StreamTotals));
+    if (metric < 0 || metric >= STREAM_METRICS || !lock_streams_for_reading()) return 0;
+    int count = locked_stream_totals(metric, start_day, end_day, totals);
+    pthread_rwlock_unlock(&stream_lock);
+    return count;
+}
+
+// Mean of the readings in `totals` in the metric's unit; NAN when there are none
+double get_stream_mean(int metric, const StreamTotals *totals) {
+    if (totals->count == 0) return NAN;
+    return (double)totals->sum / totals->count / get_segment_scale(metric + 1);
+}
+
+// Finds the latest day before `day` with readings of the metric. Returns 0 if
+// there is none.
+int get_stream_day_before(int metric, int day, int *found_day) {
+    if (metric < 0 || metric >= STREAM_METRICS || !lock_streams_for_reading()) return 0;
+
+    const StreamSeries *series = &streams[metric];
+    int index = day_lower_bound(series, day);
+    if (index > 0) *found_day = series->days[index - 1].day;
+    pthread_rwlock_unlock(&stream_lock);
+    return index > 0;
+}
+
+// Merges a quantile sketch of the metric's readings over [start_day, end_day]
+// into `sketch`. Whole blocks contribute their stored sketch; only the readings in
+// partial blocks at either end are added one by one. Returns the readings covered.
+int get_stream_sketch_in_range(int metric, int start_day, int end_day, TDigest *sketch) {
+    if (metric < 0 || metric >= STREAM_METRICS || !lock_streams_for_reading()) return 0;
+
+    const StreamSeries *series = &streams[metric];
+    if (series->count == 0 || start_day > end_day) {
+        pthread_rwlock_unlock(&stream_lock);
+        return 0;
+    }
+
+    int first = series->days[day_lower_bound(series, start_day)].first;
+    int last = series->days[day_upper_bound(series, end_day)].first - 1;
+
+    int i = first;
+    while (i <= last) {
+        int b = i / STREAM_SKETCH_BLOCK;
+        int block_end = (b + 1) * STREAM_SKETCH_BLOCK - 1;
+
+        if (i == b * STREAM_SKETCH_BLOCK && block_end <= last) {
+            tdigest_merge(sketch, &series->sketches[b]);
+            i = block_end + 1;
+        } else {
+            tdigest_add(sketch, (double)series->values[i] / series->scale);
+            i++;
+        }
+    }
+    pthread_rwlock_unlock(&stream_lock);
+    return last - first + 1;
+}
+
+// Replaces the systolic, diastolic and sugar values of graph points with the mean
+// of the device readings taken over the days each point covers, where there are
+// any; point i covers its day up to the day before point i + 1, the last one up
+// to end_day. Costs two index lookups per point and metric, however many readings
+// a day holds. Returns the number of points changed.
+int overlay_stream_means(HealthData *points, int count, int end_day) {
+    static const int metrics[3] = { 2, 3, 4 };
+    int changed = 0;
+    if (!lock_streams_for_reading()) return 0;
+
+    for (int i = 0; i < count; i++) {
+        int last_day = i + 1 < count ? points[i + 1].day - 1 : end_day;
+        double *values[3] = { &points[i].bp_systolic, &points[i].bp_diastolic, &points[i].blood_sugar };
+        int replaced = 0;
+
+        for (int m = 0; m < 3; m++) {
+            StreamTotals totals;
+            if (locked_stream_totals(metrics[m], points[i].day, last_day, &totals) == 0) continue;
+            *values[m] = get_stream_mean(metrics[m], &totals);
+            replaced = 1;
+        }
+        changed += replaced;
+    }
+    pthread_rwlock_unlock(&stream_lock);
+    return changed;
+}
@@ -0,0 +1,49 @@
+#ifndef HEALTH_STREAM_H
+#define HEALTH_STREAM_H
+
+#include <stdint.h>
+#include "health_logic.h"
+#include "health_series.h"
+#include "health_sketch.h"
+
+// Timestamped readings from devices (glucose monitors, BP cuffs), one reading per
+// line: time,metric,value, e.g. 2024-03-01T08:05,sugar,112
+#define STREAM_FILE "readings.txt"
+// Metrics a reading can carry, in input.txt field order (height .. temperature)
+#define STREAM_METRICS (ROW_FIELDS - 1)
+// Readings per block of stored quantile sketches
+#define STREAM_SKETCH_BLOCK 1024
+#define STREAM_MAX_LISTENERS 8
+#define SECONDS_PER_DAY 86400
+// YYYY-MM-DDTHH:MM:SS and its terminator
+#define TIME_TEXT_SIZE 20
+
+// Seconds since 1970-01-01 00:00 on the same calendar as the day numbers, so the
+// day of a reading is time / SECONDS_PER_DAY rounded down
+typedef int64_t HealthTime;
+
+// Readings of one metric over a day range, as fixed-point sums at the scale the
+// segment store uses for the column (see get_segment_scale)
+typedef struct {
+    long long count;
+    long long sum;
+    FixedSquareSum sum_squares;
+} StreamTotals;
+
+// Function declarations for the per-metric series of timestamped readings
+int parse_health_time(const char *text, size_t length, HealthTime *time);
+void format_health_time(HealthTime time, char *text);
+int get_health_time_day(HealthTime time);
+int get_stream_metric(const char *name, size_t length);
+void invalidate_stream_readings(void);
+int refresh_stream_readings(void);
+int add_stream_listener(HealthSeriesListener listener);
+int get_stream_reading_count(int metric);
+size_t get_stream_bytes(void);
+int get_stream_totals(int metric, int start_day, int end_day, StreamTotals *totals);
+double get_stream_mean(int metric, const StreamTotals *totals);
+int get_stream_day_before(int metric, int day, int *found_day);
+int get_stream_sketch_in_range(int metric, int start_day, int end_day, TDigest *sketch);
+int overlay_stream_means(HealthData *points, int count, int end_day);
+
+#endif // HEALTH_STREAM_H
@@ -0,0 +1,169 @@
+#include "health_logic.h"
+#include "health_perf.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#define STRESS_MAX_READERS 64
+// Dates the writer spreads its rows over: enough for the store to outgrow its
+// first segment array, few enough that batches supersede earlier rows
+#define STRESS_DAYS 20000
+#define STRESS_BATCH_ROWS 512
+// Every this many batches the writer compacts input.txt
+#define STRESS_COMPACT_EVERY 4
+
+typedef struct {
+    int first_day;
+    atomic_int *stop;
+    unsigned seed;
+    long long queries;
+    int failed;
+} ReaderThread;
+
+// Appends `rows` random readings dated in [first_day, first_day + STRESS_DAYS)
+static int append_random_rows(int first_day, int rows, unsigned *seed, int *low, int *high) {
+    char *batch = malloc((size_t)rows * 128);
+    if (!batch) return 0;
+
+    size_t length = 0;
+    *low = INT_MAX;
+    *high = INT_MIN;
+    for (int i = 0; i < rows; i++) {
+        int day = first_day + rand_r(seed) % STRESS_DAYS;
+        char values[6][16];
+        snprintf(values[0], 16, "%d", 150 + rand_r(seed) % 40);
+        snprintf(values[1], 16, "%d.%d", 25 + rand_r(seed) % 90, rand_r(seed) % 10);
+        snprintf(values[2], 16, "%d", 100 + rand_r(seed) % 60);
+        snprintf(values[3], 16, "%d", 60 + rand_r(seed) % 40);
+        snprintf(values[4], 16, "%d.%d", 70 + rand_r(seed) % 160, rand_r(seed) % 10);
+        snprintf(values[5], 16, "%d.%d", 34 + rand_r(seed) % 6, rand_r(seed) % 10);
+        if (!format_data_row(day, values[0], values[1], values[2], values[3], values[4], values[5],
+                             batch + length, 128)) {
+            free(batch);
+            return 0;
+        }
+        length += strlen(batch + length);
+        if (day < *low) *low = day;
+        if (day > *high) *high = day;
+    }
+
+    int ok = append_data_rows(batch, length);
+    free(batch);
+    return ok;
+}
+
+// Queries random ranges until told to stop. Every date holds at most one current
+// row, so no count may exceed the days in the range.
+static void* reader_main(void *arg) {
+    ReaderThread *reader = arg;
+    while (!atomic_load(reader->stop)) {
+        int start_day = reader->first_day + rand_r(&reader->seed) % STRESS_DAYS;
+        int end_day = start_day + rand_r(&reader->seed) % 120;
+        int days = end_day - start_day + 1;
+
+        StatsTableData *stats;
+        int rows = get_stats_table_data(start_day, end_day, &stats);
+        if (rows > 0) free(stats);
+        if (rows != 0 && rows != 6) reader->failed = 1;
+
+        int weight, bp, sugar, temp;
+        check_for_abnormalities_typewise_in_range(start_day, end_day, &weight, &bp, &sugar, &temp);
+        if (weight < 0 || weight > days || bp < 0 || bp > days || sugar < 0 || sugar > days ||
+            temp < 0 || temp > days)
+            reader->failed = 1;
+
+        reader->queries += 2;
+    }
+    return NULL;
+}
+
+static void remove_scratch_dir(const char *path) {
+    DIR *dir = opendir(".");
+    if (dir) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) unlink(entry->d_name);
+        }
+        closedir(dir);
+    }
+    if (chdir("/") == 0) rmdir(path);
+}
+
+// Races query threads against a writer that appends and compacts, to shake out
+// use-after-free and data races in the snapshot, series and cache code. Meant to
+// run under -fsanitize=address or -fsanitize=thread (see the Makefile):
+//   health_stress [-r readers] [-s seconds]
+// Works in a scratch directory of its own. Exits with 1 if a query returned an
+// impossible result or the writer failed.
+int main(int argc, char *argv[]) {
+    int reader_count = 4;
+    double seconds = 5;
+
+    int option;
+    while ((option = getopt(argc, argv, "r:s:")) != -1) {
+        switch (option) {
+        case 'r': reader_count = atoi(optarg); break;
+        case 's': seconds = atof(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-r readers] [-s seconds]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (reader_count < 1) reader_count = 1;
+    if (reader_count > STRESS_MAX_READERS) reader_count = STRESS_MAX_READERS;
+
+    char scratch[] = "/tmp/health_stress.XXXXXX";
+    if (!mkdtemp(scratch) || chdir(scratch) != 0) {
+        fprintf(stderr, "Could not create a scratch directory\n");
+        return 1;
+    }
+
+    int first_day = make_day_number(2024, 1, 1);
+    unsigned seed = 1;
+    int low, high;
+    int ok = 1;
+    for (int b = 0; b < 40 && ok; b++) {
+        ok = append_random_rows(first_day, STRESS_BATCH_ROWS, &seed, &low, &high);
+    }
+
+    atomic_int stop = 0;
+    ReaderThread readers[STRESS_MAX_READERS] = {0};
+    pthread_t ids[STRESS_MAX_READERS];
+    int started = 0;
+    for (int r = 0; r < reader_count && ok; r++) {
+        readers[r].first_day = first_day;
+        readers[r].stop = &stop;
+        readers[r].seed = 100u + r;
+        if (pthread_create(&ids[r], NULL, reader_main, &readers[r]) != 0) break;
+        started++;
+    }
+
+    long long batches = 0, compactions = 0;
+    long long deadline = health_perf_now() + (long long)(seconds * 1e9);
+    while (ok && health_perf_now() < deadline) {
+        ok = append_random_rows(first_day, STRESS_BATCH_ROWS, &seed, &low, &high);
+        if (!ok) break;
+        data_rows_appended(low, high);
+        if (++batches % STRESS_COMPACT_EVERY == 0) {
+            compact_data_file();
+            compactions++;
+        }
+    }
+
+    atomic_store(&stop, 1);
+    long long queries = 0;
+    int failed = !ok || started < reader_count;
+    for (int r = 0; r < started; r++) {
+        pthread_join(ids[r], NULL);
+        queries += readers[r].queries;
+        failed |= readers[r].failed;
+    }
+
+    printf("%d readers: %lld queries against %lld appended batches and %lld compactions: %s\n",
+           started, queries, batches, compactions, failed ? "FAILED" : "ok");
+    remove_scratch_dir(scratch);
+    return failed ? 1 : 0;
+}
+
+// gcc health_logic.c health_series.c health_stream.c health_advice.c health_memory.c health_grid.c health_perf.c health_sketch.c health_segment.c health_epoch.c health_stress.c -o health_stress -lm -pthread -fsanitize=thread
@@ -0,0 +1,563 @@
+#include "health_logic.h"
+#include "health_perf.h"
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Rows of the generated dataset the latency budgets are checked on
+#define TEST_PERF_ROWS 300000
+// Cold runs of every timed query; the budget applies to their mean
+#define TEST_PERF_RUNS 3
+
+// Deterministic generator, so datasets (and the golden files) are the same on
+// every platform
+static uint32_t next_random(uint32_t *state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+// Replaces input.txt with `text` the way an editor saves, through a new file
+static void write_input(const char *text) {
+    FILE *file = fopen("input.tmp", "w");
+    if (!file) return;
+    fputs(text, file);
+    fclose(file);
+    replace_file("input.tmp", "input.txt");
+}
+
+// Overwrites input.txt in place from `offset` and moves its mtime a second on, so
+// the change shows even on file systems with coarse timestamps
+static void edit_input(long offset, const char *text) {
+    FILE *file = fopen("input.txt", "r+");
+    if (!file) return;
+    fseek(file, offset, SEEK_SET);
+    fputs(text, file);
+    fflush(file);
+    struct stat st;
+    if (fstat(fileno(file), &st) == 0) {
+        struct timespec times[2] = { st.st_atim, st.st_mtim };
+        times[1].tv_sec++;
+        futimens(fileno(file), times);
+    }
+    fclose(file);
+}
+
+// Writes input.txt with `rows` readings from `first_day`, `days_per_row` apart on
+// average. Every `duplicate_every`-th row (0 for none) repeats the previous date.
+static void write_dataset(int rows, int first_day, int days_per_row, int duplicate_every, uint32_t seed) {
+    FILE *file = fopen("input.tmp", "w");
+    int day = first_day;
+    for (int i = 0; i < rows && file; i++) {
+        if (i > 0 && !(duplicate_every && i % duplicate_every == 0)) day += 1 + next_random(&seed) % days_per_row;
+        // Drawn one by one: the order arguments are evaluated in is unspecified
+        static const unsigned low[10] = { 150, 0, 25, 0, 95, 60, 70, 0, 34, 0 };
+        static const unsigned span[10] = { 40, 10, 85, 10, 60, 40, 150, 10, 6, 10 };
+        unsigned v[10];
+        for (int f = 0; f < 10; f++) v[f] = low[f] + next_random(&seed) % span[f];
+        char date[DATE_TEXT_SIZE];
+        format_day_number(day, date);
+        fprintf(file, "%s,%u.%u,%u.%u,%u,%u,%u.%u,%u.%u\n", date, v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7],
+                v[8], v[9]);
+    }
+    if (file) fclose(file);
+    replace_file("input.tmp", "input.txt");
+}
+
+static int day_of(const char *date) {
+    int day = 0;
+    parse_day_number(date, &day);
+    return day;
+}
+
+static void print_stats(FILE *out, int start_day, int end_day) {
+    StatsTableData *data;
+    int rows = get_stats_table_data(start_day, end_day, &data);
+    fprintf(out, "stats %d..%d: %d rows\n", start_day, end_day, rows);
+    for (int i = 0; i < rows; i++) {
+        fprintf(out, "  %s | %s | %s | %s | %s | %s | %s\n", data[i].metric, data[i].average,
+                data[i].std_deviation, data[i].median, data[i].p90, data[i].p99, data[i].status);
+    }
+    if (rows > 0) free(data);
+}
+
+static void print_abnormalities(FILE *out, int start_day, int end_day) {
+    int weight, bp, sugar, temp;
+    check_for_abnormalities_typewise_in_range(start_day, end_day, &weight, &bp, &sugar, &temp);
+    fprintf(out, "abnormal %d..%d: weight %d bp %d sugar %d temp %d\n", start_day, end_day, weight, bp, sugar, temp);
+
+    AbnormalityTableData *data;
+    int rows = get_abnormality_table_data(start_day, end_day, &data);
+    for (int i = 0; i < rows; i++) {
+        fprintf(out, "  %s | %s | %s\n", data[i].category, data[i].count, data[i].advice);
+    }
+    if (rows > 0) free(data);
+}
+
+static void print_comparison(FILE *out, int day) {
+    ComparisonTableData *data;
+    int rows = get_comparison_table_data(day, &data);
+    fprintf(out, "comparison %d: %d rows\n", day, rows);
+    for (int i = 0; i < rows; i++) {
+        fprintf(out, "  %s | %s | %s | %s | %s | %s\n", data[i].date, data[i].metric, data[i].current_value,
+                data[i].previous_value, data[i].change, data[i].status);
+    }
+    if (rows > 0) free(data);
+}
+
+static void print_recommendations(FILE *out, int start_day, int end_day) {
+    char *text = get_health_recommendations(start_day, end_day);
+    fprintf(out, "recommendations %d..%d:\n%s\n", start_day, end_day, text ? text : "(null)");
+    free(text);
+}
+
+static void print_all_data(FILE *out) {
+    HealthData *data;
+    int count = get_all_health_data(&data);
+    double sums[3] = {0, 0, 0};
+    long long days = 0;
+    for (int i = 0; i < count; i++) {
+        days += data[i].day;
+        sums[0] += data[i].bp_systolic;
+        sums[1] += data[i].bp_diastolic;
+        sums[2] += data[i].blood_sugar;
+    }
+    fprintf(out, "all data: %d readings, day sum %lld, sums %.1f %.1f %.1f\n", count, days, sums[0], sums[1], sums[2]);
+    if (count > 0) {
+        fprintf(out, "  first %d %.1f %.1f %.1f, last %d %.1f %.1f %.1f\n", data[0].day, data[0].bp_systolic,
+                data[0].bp_diastolic, data[0].blood_sugar, data[count - 1].day, data[count - 1].bp_systolic,
+                data[count - 1].bp_diastolic, data[count - 1].blood_sugar);
+        free(data);
+    }
+}
+
+// Date, number and row parsing, formatting and the abnormality rules
+static void case_parsing(FILE *out) {
+    static const char *dates[] = {
+        "2024-02-29", "2023-02-29", "2000-02-29", "1900-02-29", "1970-01-01", "2025-12-31",
+        "2025-13-01", "2025-00-10", "2025-04-31", "2025-4-01", "2025-04-01x", ""
+    };
+    for (size_t i = 0; i < sizeof(dates) / sizeof(dates[0]); i++) {
+        int day = 0;
+        int ok = parse_day_number(dates[i], &day);
+        char text[DATE_TEXT_SIZE] = "";
+        if (ok) format_day_number(day, text);
+        fprintf(out, "date '%s': %d %d %s digits %d\n", dates[i], ok, ok ? day : 0, text,
+                strlen(dates[i]) >= 10 ? parse_date_digits(dates[i], &day) : -1);
+    }
+    fprintf(out, "make_day_number 2025-04-01 %d, 1969-12-31 %d\n", make_day_number(2025, 4, 1),
+            make_day_number(1969, 12, 31));
+
+    static const char *numbers[] = {
+        "120", " 36.6 ", "-1.5", "+2", "200.6", "0.001", "1.2345", "1.2340000", "12345678901234567",
+        "999999.999", "1000000", "1.2.3", "abc", "", " ", "."
+    };
+    for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+        const char *end = numbers[i] + strlen(numbers[i]);
+        double decimal = 0, reading = 0;
+        int decimal_ok = parse_decimal(numbers[i], end, &decimal);
+        int reading_ok = parse_reading(numbers[i], end, &reading);
+        fprintf(out, "number '%s': decimal %d %.10g reading %d\n", numbers[i], decimal_ok, decimal, reading_ok);
+    }
+
+    static const char *rows[] = {
+        "2025-04-01,163,50,120,80,95,36.5\n", "2025-04-01,163,50,120,80,95,36.5  \r\n", "   \n",
+        "2025-04-01,163,50,120,80,95\n", "2025-04-01,163,50,120,80,95,36.5,1\n", "2025-04-31,163,50,120,80,95,36.5\n",
+        "2025-04-01,163,50,1x0,80,95,36.5\n", "2025-04-01,163,50,120,80,95.1234,36.5\n"
+    };
+    for (size_t i = 0; i < sizeof(rows) / sizeof(rows[0]); i++) {
+        HealthRow row;
+        RowResult result = parse_health_row(rows[i], strlen(rows[i]), &row);
+        fprintf(out, "row %zu: result %d", i, result);
+        if (result == ROW_OK) {
+            fprintf(out, " day %d values", row.day);
+            for (int f = 0; f < ROW_FIELDS - 1; f++) fprintf(out, " %g", row.values[f]);
+        }
+        fprintf(out, "\n");
+    }
+
+    char text[64];
+    int ok = format_data_row(day_of("2025-04-01"), "163", "50", "120", "80", "95", "36.5", text, sizeof(text));
+    fprintf(out, "format_data_row %d '%.*s'\n", ok, ok ? (int)strcspn(text, "\n") : 0, text);
+    fprintf(out, "format_data_row short buffer %d\n",
+            format_data_row(day_of("2025-04-01"), "163", "50", "120", "80", "95", "36.5", text, 20));
+
+    // Thresholds on both sides, with the truncation of blood pressure and sugar
+    static const double readings[][ROW_FIELDS - 1] = {
+        { 170, 29.9, 140.9, 90.9, 200.9, 34.9 },
+        { 170, 30, 141, 90, 200, 35 },
+        { 170, 100, 140, 91, 201, 38 },
+        { 170, 100.1, 120, 80, 100, 38.1 }
+    };
+    for (size_t i = 0; i < sizeof(readings) / sizeof(readings[0]); i++) {
+        long long counts[ABNORMAL_KINDS] = {0, 0, 0, 0};
+        count_reading_abnormalities(readings[i], counts);
+        fprintf(out, "abnormal reading %zu: %lld %lld %lld %lld (rules %d %d %d %d)\n", i, counts[0], counts[1],
+                counts[2], counts[3], is_weight_abnormal(readings[i][1]),
+                is_bp_abnormal((int)readings[i][2], (int)readings[i][3]), is_sugar_abnormal((int)readings[i][4]),
+                is_temp_abnormal(readings[i][5]));
+    }
+
+    FILE *file = fopen("lines.txt", "w");
+    fprintf(file, "short\n");
+    for (int i = 0; i < 1000; i++) fputc('a' + i % 26, file);
+    fprintf(file, "\nlast line without newline");
+    fclose(file);
+    file = fopen("lines.txt", "r");
+    LineBuffer line = {0};
+    while (read_line(file, &line)) fprintf(out, "line of %zu bytes\n", line.length);
+    free_line(&line);
+    fclose(file);
+}
+
+// Readings spread over two years, a few days apart
+static void case_generated(FILE *out) {
+    int first = day_of("2023-01-01");
+    write_dataset(400, first, 3, 0, 7);
+    print_all_data(out);
+    print_stats(out, first, first + 800);
+    print_stats(out, first + 100, first + 130);
+    print_abnormalities(out, first, first + 800);
+    print_abnormalities(out, first + 100, first + 130);
+    print_recommendations(out, first + 100, first + 130);
+    for (int day = first + 200; day < first + 206; day++) {
+        print_comparison(out, day);
+    }
+}
+
+// Several rows for one date: the last one written counts
+static void case_duplicate_dates(FILE *out) {
+    int first = day_of("2024-06-01");
+    write_dataset(300, first, 2, 3, 11);
+    print_all_data(out);
+    print_stats(out, first, first + 400);
+    print_abnormalities(out, first, first + 400);
+    print_comparison(out, first + 20);
+
+    FILE *file = fopen("input.txt", "a");
+    fprintf(file, "2024-06-01,170,99.9,180,120,300,39.5\n");
+    fclose(file);
+    data_rows_appended(first, first);
+    fprintf(out, "after rewriting the first date:\n");
+    print_stats(out, first, first);
+    print_abnormalities(out, first, first);
+    print_comparison(out, first);
+}
+
+// Comparisons whose previous reading is yesterday, a few days back, out of reach,
+// or missing altogether
+static void case_missing_previous_day(FILE *out) {
+    write_input("2025-03-01,170,70,120,80,100,36.6\n"
+                "2025-03-02,170,71,125,82,110,36.8\n"
+                "2025-03-06,170,72.5,130,85,150,37.2\n"
+                "2025-03-20,170,69,118,79,95,36.5\n");
+
+    static const char *days[] = {
+        "2025-03-01", "2025-03-02", "2025-03-03", "2025-03-06", "2025-03-13", "2025-03-14", "2025-03-20",
+        "2025-02-28"
+    };
+    for (size_t i = 0; i < sizeof(days) / sizeof(days[0]); i++) {
+        print_comparison(out, day_of(days[i]));
+    }
+}
+
+// Ranges with nothing in them, reversed ranges, an empty and a missing input.txt
+static void case_empty_range(FILE *out) {
+    int first = day_of("2025-01-01");
+    write_dataset(50, first, 2, 0, 5);
+    print_stats(out, first - 100, first - 1);
+    print_abnormalities(out, first - 100, first - 1);
+    print_recommendations(out, first - 100, first - 1);
+    print_stats(out, first + 10, first);
+    print_abnormalities(out, first + 10, first);
+
+    fclose(fopen("input.txt", "w"));
+    fprintf(out, "empty input.txt:\n");
+    print_all_data(out);
+    print_stats(out, first, first + 100);
+    print_abnormalities(out, first, first + 100);
+    print_comparison(out, first);
+
+    remove("input.txt");
+    fprintf(out, "missing input.txt:\n");
+    print_all_data(out);
+    print_stats(out, first, first + 100);
+    print_abnormalities(out, first, first + 100);
+    print_comparison(out, first);
+}
+
+// Writes through every entry point, then compaction: results must not change
+static void case_writes(FILE *out) {
+    int first = day_of("2025-05-01");
+    write_dataset(100, first, 2, 4, 3);
+    unsigned long version = get_health_data_version();
+    print_stats(out, first, first + 300);
+    fprintf(out, "cache holds results: %d\n", get_result_cache_bytes() > 0);
+    clear_result_cache();
+    fprintf(out, "cache after clear: %zu\n", get_result_cache_bytes());
+
+    write_data_to_file(first + 400, "170", "71.5", "135", "85", "180.5", "37.1");
+    const char *rows = "2025-05-01,170,72,128,84,140,36.9\n2026-07-01,170,73,150,95,210,38.4\n";
+    append_data_rows(rows, strlen(rows));
+    data_rows_appended(first, day_of("2026-07-01"));
+    fprintf(out, "version moved: %d\n", get_health_data_version() > version);
+    print_stats(out, first, first + 500);
+    print_abnormalities(out, first, first + 500);
+
+    print_all_data(out);
+    fprintf(out, "compacted: %d\n", compact_data_file());
+    print_all_data(out);
+    print_stats(out, first, first + 500);
+    print_abnormalities(out, first, first + 500);
+    print_comparison(out, first + 400);
+
+    FILE *file = fopen("replacement.tmp", "w");
+    fprintf(file, "2025-05-01,170,70,120,80,100,36.6\n");
+    fclose(file);
+    fprintf(out, "replace_file: %d\n", replace_file("replacement.tmp", "input.txt"));
+    print_all_data(out);
+}
+
+// input.txt changed behind the queries' back: a row edited in place without
+// and then with the file growing, an append, and a save by an editor
+static void case_edited_file(FILE *out) {
+    int first = day_of("2025-01-01");
+    write_input("2025-01-01,170,70,120,80,100,36.6\n"
+                "2025-01-02,170,71,122,81,110,36.7\n");
+    print_all_data(out);
+    print_stats(out, first, first + 1);
+
+    fprintf(out, "sugar 100 -> 300 in place:\n");
+    edit_input(25, "300,36.6\n");
+    print_all_data(out);
+    print_stats(out, first, first + 1);
+
+    fprintf(out, "sugar 300 -> 1000, file grows:\n");
+    edit_input(25, "1000,36.6\n2025-01-02,170,71,122,81,110,36.7\n");
+    print_all_data(out);
+    print_stats(out, first, first + 1);
+    print_abnormalities(out, first, first + 1);
+
+    fprintf(out, "row appended:\n");
+    FILE *file = fopen("input.txt", "a");
+    fprintf(file, "2025-01-03,170,72,150,95,120,36.8\n");
+    fclose(file);
+    print_all_data(out);
+    print_stats(out, first, first + 2);
+    print_abnormalities(out, first, first + 2);
+
+    fprintf(out, "saved by an editor:\n");
+    write_input("2025-01-01,170,70,120,80,90,36.6\n"
+                "2025-01-02,170,71,122,81,95,36.7\n"
+                "2025-01-03,170,72,121,79,99,36.8\n");
+    print_all_data(out);
+    print_stats(out, first, first + 2);
+    print_abnormalities(out, first, first + 2);
+}
+
+// Readings at the edge of what parse_reading accepts, whose squares do not fit a
+// long long once a few are summed
+static void case_extreme_readings(FILE *out) {
+    int first = day_of("2025-02-01");
+    char *rows = malloc(12 * 128);
+    size_t length = 0;
+    for (int i = 0; i < 12 && rows; i++) {
+        const char *value = i < 6 ? "999999.999" : "-999999.999";
+        format_data_row(first + i, value, value, value, value, value, value, rows + length, 128);
+        length += strlen(rows + length);
+    }
+    if (rows) write_input(rows);
+    free(rows);
+    print_stats(out, first, first + 5);
+    print_stats(out, first, first + 11);
+    print_abnormalities(out, first, first + 11);
+}
+
+typedef struct {
+    const char *name;
+    void (*run)(FILE *out);
+} TestCase;
+
+static const TestCase test_cases[] = {
+    { "parsing", case_parsing },
+    { "generated", case_generated },
+    { "duplicate_dates", case_duplicate_dates },
+    { "missing_previous_day", case_missing_previous_day },
+    { "empty_range", case_empty_range },
+    { "writes", case_writes },
+    { "edited_file", case_edited_file },
+    { "extreme_readings", case_extreme_readings }
+};
+
+static char* read_whole_file(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *text = malloc(size + 1);
+    *length = text ? fread(text, 1, size, file) : 0;
+    if (text) text[*length] = '\0';
+    fclose(file);
+    return text;
+}
+
+// Runs one case and compares its output with the golden file, or replaces the
+// golden file when updating. Returns 1 if the output matches.
+static int run_case(const TestCase *test, const char *golden_dir, int update) {
+    char *output = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&output, &length);
+    if (!out) return 0;
+    test->run(out);
+    fclose(out);
+
+    char path[PATH_MAX + 64];
+    snprintf(path, sizeof(path), "%s/%s.txt", golden_dir, test->name);
+    int ok = 1;
+    if (update) {
+        FILE *golden = fopen(path, "wb");
+        ok = golden && fwrite(output, 1, length, golden) == length;
+        if (golden) ok = fclose(golden) == 0 && ok;
+        fprintf(stderr, "%-22s %s\n", test->name, ok ? "updated" : "could not write the golden file");
+    } else {
+        size_t golden_length;
+        char *expected = read_whole_file(path, &golden_length);
+        ok = expected && golden_length == length && memcmp(expected, output, length) == 0;
+        fprintf(stderr, "%-22s %s\n", test->name, ok ? "ok" : expected ? "FAILED" : "FAILED (no golden file)");
+
+        // Point at the first line that differs
+        if (!ok && expected) {
+            int line = 1;
+            size_t i = 0;
+            while (i < length && i < golden_length && output[i] == expected[i]) line += output[i++] == '\n';
+            size_t start = i;
+            while (start > 0 && output[start - 1] != '\n') start--;
+            fprintf(stderr, "  line %d\n  expected: %.*s\n  got:      %.*s\n", line,
+                    (int)strcspn(expected + start, "\n"), expected + start,
+                    (int)strcspn(output + start, "\n"), output + start);
+        }
+        free(expected);
+    }
+    free(output);
+    return ok;
+}
+
+// Cold queries on a large dataset, timed per public function for the budgets
+static void run_perf_queries(void) {
+    int first = day_of("2000-01-01");
+    write_dataset(TEST_PERF_ROWS, first, 1, 5, 99);
+    int last = first + TEST_PERF_ROWS;
+
+    for (int run = 0; run < TEST_PERF_RUNS; run++) {
+        clear_result_cache();
+        int start_day = first + run * 1000, end_day = last - run * 1000;
+        HealthData *all;
+        StatsTableData *stats;
+        AbnormalityTableData *abnormal;
+        ComparisonTableData *comparison;
+        int weight, bp, sugar, temp;
+
+        PERF_START(perf);
+        int count = get_all_health_data(&all);
+        PERF_LAP(perf, "get_all_health_data");
+        int rows = get_stats_table_data(start_day, end_day, &stats);
+        PERF_LAP(perf, "get_stats_table_data");
+        check_for_abnormalities_typewise_in_range(start_day, end_day, &weight, &bp, &sugar, &temp);
+        PERF_LAP(perf, "check_for_abnormalities_typewise_in_range");
+        clear_result_cache();
+        PERF_START(table);
+        int abnormal_rows = get_abnormality_table_data(start_day, end_day, &abnormal);
+        PERF_LAP(table, "get_abnormality_table_data");
+        clear_result_cache();
+        PERF_START(advice);
+        char *text = get_health_recommendations(start_day, end_day);
+        PERF_LAP(advice, "get_health_recommendations");
+        int comparison_rows = get_comparison_table_data(first + 5000 + run, &comparison);
+        PERF_LAP(advice, "get_comparison_table_data");
+
+        if (count > 0) free(all);
+        if (rows > 0) free(stats);
+        if (abnormal_rows > 0) free(abnormal);
+        if (comparison_rows > 0) free(comparison);
+        free(text);
+    }
+}
+
+static void remove_scratch_dir(const char *path) {
+    DIR *dir = opendir(".");
+    if (dir) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) unlink(entry->d_name);
+        }
+        closedir(dir);
+    }
+    if (chdir("/") == 0) rmdir(path);
+}
+
+// Runs every public function of health_logic.c against generated datasets and
+// compares the results with the golden files, then times the queries on a large
+// dataset against the latency budgets:
+//   health_test [-g golden dir] [-b budget file] [-u] [-P]
+// The budget file defaults to $HEALTH_PERF_BUDGET, then health_perf_budget.txt.
+// -u rewrites the golden files from this build instead of comparing; -P skips the
+// latency check. Works in a scratch directory of its own. Exits with 1 if an
+// output differs or an operation is over budget.
+int main(int argc, char *argv[]) {
+    const char *golden_arg = "tests/golden";
+    const char *budget_arg = getenv("HEALTH_PERF_BUDGET");
+    int update = 0, check_perf = 1;
+
+    int option;
+    while ((option = getopt(argc, argv, "g:b:uP")) != -1) {
+        switch (option) {
+        case 'g': golden_arg = optarg; break;
+        case 'b': budget_arg = optarg; break;
+        case 'u': update = 1; break;
+        case 'P': check_perf = 0; break;
+        default:
+            fprintf(stderr, "usage: %s [-g golden dir] [-b budget file] [-u] [-P]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (!budget_arg) budget_arg = "health_perf_budget.txt";
+
+    // Paths are resolved before moving to the scratch directory
+    char golden_dir[PATH_MAX];
+    if (!realpath(golden_arg, golden_dir)) {
+        fprintf(stderr, "No golden directory %s\n", golden_arg);
+        return 1;
+    }
+    if (check_perf && !update && health_perf_load_budgets(budget_arg) < 0) {
+        fprintf(stderr, "Could not read the budget file %s\n", budget_arg);
+        return 1;
+    }
+
+    char scratch[] = "/tmp/health_test.XXXXXX";
+    if (!mkdtemp(scratch) || chdir(scratch) != 0) {
+        fprintf(stderr, "Could not create a scratch directory\n");
+        return 1;
+    }
+
+    // The functions under test report empty ranges on stdout; keep that out of the way
+    fflush(stdout);
+    if (!freopen("/dev/null", "w", stdout)) return 1;
+
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); i++) {
+        failed += !run_case(&test_cases[i], golden_dir, update);
+    }
+
+    if (check_perf && !update) {
+        run_perf_queries();
+        int over = health_perf_check_budgets(stderr);
+        fprintf(stderr, "%-22s %s\n", "latency budgets", over ? "FAILED" : "ok");
+        failed += over;
+    }
+
+    remove_scratch_dir(scratch);
+    return failed ? 1 : 0;
+}
+
+// gcc health_logic.c health_series.c health_stream.c health_advice.c health_memory.c health_grid.c health_perf.c health_sketch.c health_segment.c health_epoch.c health_test.c -o health_test -lm -pthread
@@ -1,12 +1,48 @@
 #include <gtk/gtk.h>
 #include <cairo.h>
 #include "health_logic.h"
+#include "health_series.h"
+#include "health_stream.h"
+#include "health_perf.h"
+#include "health_memory.h"
+#include "health_cohort.h"
+#include "health_analysis.h"
+#include "health_writer.h"
+#include "health_export.h"
+#include "health_checkpoint.h"
+#include "health_filter.h"
+#include "health_render.h"
 
 // Global variables for UI components
 GtkWidget *window;
 GtkWidget *calendar;
 GtkWidget *entry_height, *entry_weight, *entry_bp_sys, *entry_bp_dia, *entry_blood_sugar, *entry_temp;
 
+// Visible part of the series in a graph window, as fractional reading positions
+typedef struct {
+    double view_first;
+    double view_last;
+    gboolean dragging;
+    double drag_x;
+    double drag_first;
+    double drag_last;
+    GraphRenderer *renderer;
+} GraphView;
+
+// Drawing areas of the open graph windows, redrawn when input.txt or readings.txt changes
+GList *graph_areas = NULL;
+GFileMonitor *data_file_monitor = NULL;
+GFileMonitor *stream_file_monitor = NULL;
+
+// One "Export" button of a result window
+typedef struct {
+    char label[40];
+    ReportKind kind;
+    int start_day;
+    int end_day;
+    char *directory;     // Cohort exports only
+} ExportRequest;
+
 // Simple CSS styling
 void apply_clean_css() {
     GtkCssProvider *provider = gtk_css_provider_new();
@@ -35,12 +71,11 @@ void show_message(const char *message, GtkMessageType type) {
     gtk_widget_destroy(dialog);
 }
 
-// Helper function to get date from calendar in YYYY-MM-DD format
-char* get_date_from_calendar(GtkCalendar *calendar) {
+// Helper function to get the selected calendar date as a day number
+int get_day_from_calendar(GtkCalendar *calendar) {
     guint year, month, day;
     gtk_calendar_get_date(calendar, &year, &month, &day);
-    char *date = g_strdup_printf("%04u-%02u-%02u", year, month + 1, day);
-    return date;
+    return make_day_number(year, month + 1, day);
 }
 
 // Helper function to add a label to a grid
@@ -50,9 +85,9 @@ void add_label_to_grid(GtkWidget *grid, const char *text, int left, int top) {
 }
 
 // Function to create table view for comparison data
-GtkWidget* create_comparison_table(const char *current_date) {
+GtkWidget* create_comparison_table(int current_day) {
     ComparisonTableData *data;
-    int row_count = get_comparison_table_data(current_date, &data);
+    int row_count = get_comparison_table_data(current_day, &data);
     
     if (row_count == 0) {
         GtkWidget *label = gtk_label_new("No data found for the selected date.");
@@ -75,6 +110,7 @@ GtkWidget* create_comparison_table(const char *current_date) {
     gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view),
                                gtk_tree_view_column_new_with_attributes("Status", renderer, "text", 4, NULL));
 
+    PERF_START(perf);
     for (int i = 0; i < row_count; i++) {
         GtkTreeIter iter;
         gtk_list_store_append(store, &iter);
@@ -86,6 +122,7 @@ GtkWidget* create_comparison_table(const char *current_date) {
                           4, data[i].status,
                           -1);
     }
+    PERF_LAP(perf, "comparison.model_fill");
 
     GList *columns = gtk_tree_view_get_columns(GTK_TREE_VIEW(tree_view));
     gtk_tree_view_column_set_fixed_width(GTK_TREE_VIEW_COLUMN(g_list_nth_data(columns, 0)), 200);
@@ -106,16 +143,17 @@ GtkWidget* create_comparison_table(const char *current_date) {
 }
 
 // Function to create table view for statistics data
-GtkWidget* create_stats_table(const char *start_date, const char *end_date) {
+GtkWidget* create_stats_table(int start_day, int end_day) {
     StatsTableData *data;
-    int row_count = get_stats_table_data(start_date, end_date, &data);
+    int row_count = get_stats_table_data(start_day, end_day, &data);
     
     if (row_count == 0) {
         GtkWidget *label = gtk_label_new("No data found for the specified range.");
         return label;
     }
 
-    GtkListStore *store = gtk_list_store_new(4, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
+    GtkListStore *store = gtk_list_store_new(7, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING,
+                                             G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
     GtkWidget *tree_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(store));
 
     GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
@@ -127,8 +165,15 @@ GtkWidget* create_stats_table(const char *start_date, const char *end_date) {
     gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view),
                                gtk_tree_view_column_new_with_attributes("Std Deviation", renderer, "text", 2, NULL));
     gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view),
-                               gtk_tree_view_column_new_with_attributes("Status", renderer, "text", 3, NULL));
+                               gtk_tree_view_column_new_with_attributes("Median", renderer, "text", 3, NULL));
+    gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view),
+                               gtk_tree_view_column_new_with_attributes("P90", renderer, "text", 4, NULL));
+    gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view),
+                               gtk_tree_view_column_new_with_attributes("P99", renderer, "text", 5, NULL));
+    gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view),
+                               gtk_tree_view_column_new_with_attributes("Status", renderer, "text", 6, NULL));
 
+    PERF_START(perf);
     for (int i = 0; i < row_count; i++) {
         GtkTreeIter iter;
         gtk_list_store_append(store, &iter);
@@ -136,15 +181,22 @@ GtkWidget* create_stats_table(const char *start_date, const char *end_date) {
                           0, data[i].metric,
                           1, data[i].average,
                           2, data[i].std_deviation,
-                          3, data[i].status,
+                          3, data[i].median,
+                          4, data[i].p90,
+                          5, data[i].p99,
+                          6, data[i].status,
                           -1);
     }
+    PERF_LAP(perf, "stats.model_fill");
 
     GList *columns = gtk_tree_view_get_columns(GTK_TREE_VIEW(tree_view));
     gtk_tree_view_column_set_fixed_width(GTK_TREE_VIEW_COLUMN(g_list_nth_data(columns, 0)), 200);
-    gtk_tree_view_column_set_fixed_width(GTK_TREE_VIEW_COLUMN(g_list_nth_data(columns, 1)), 120);
-    gtk_tree_view_column_set_fixed_width(GTK_TREE_VIEW_COLUMN(g_list_nth_data(columns, 2)), 120);
-    gtk_tree_view_column_set_fixed_width(GTK_TREE_VIEW_COLUMN(g_list_nth_data(columns, 3)), 120);
+    gtk_tree_view_column_set_fixed_width(GTK_TREE_VIEW_COLUMN(g_list_nth_data(columns, 1)), 100);
+    gtk_tree_view_column_set_fixed_width(GTK_TREE_VIEW_COLUMN(g_list_nth_data(columns, 2)), 100);
+    gtk_tree_view_column_set_fixed_width(GTK_TREE_VIEW_COLUMN(g_list_nth_data(columns, 3)), 80);
+    gtk_tree_view_column_set_fixed_width(GTK_TREE_VIEW_COLUMN(g_list_nth_data(columns, 4)), 80);
+    gtk_tree_view_column_set_fixed_width(GTK_TREE_VIEW_COLUMN(g_list_nth_data(columns, 5)), 80);
+    gtk_tree_view_column_set_fixed_width(GTK_TREE_VIEW_COLUMN(g_list_nth_data(columns, 6)), 120);
 
     free(data);
     g_object_unref(store);
@@ -158,9 +210,9 @@ GtkWidget* create_stats_table(const char *start_date, const char *end_date) {
 }
 
 // Function to create table view for health check data
-GtkWidget* create_health_check_table(const char *start_date, const char *end_date) {
+GtkWidget* create_health_check_table(int start_day, int end_day) {
     AbnormalityTableData *data;
-    int row_count = get_abnormality_table_data(start_date, end_date, &data);
+    int row_count = get_abnormality_table_data(start_day, end_day, &data);
     
     if (row_count == 0) {
         GtkWidget *label = gtk_label_new("No data found for the specified range.");
@@ -181,6 +233,7 @@ GtkWidget* create_health_check_table(const char *start_date, const char *end_dat
     gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view),
                                gtk_tree_view_column_new_with_attributes("Status", renderer, "text", 2, NULL));
 
+    PERF_START(perf);
     for (int i = 0; i < row_count; i++) {
         GtkTreeIter iter;
         gtk_list_store_append(store, &iter);
@@ -190,6 +243,7 @@ GtkWidget* create_health_check_table(const char *start_date, const char *end_dat
                           2, data[i].advice,
                           -1);
     }
+    PERF_LAP(perf, "abnormality_table.model_fill");
 
     GList *columns = gtk_tree_view_get_columns(GTK_TREE_VIEW(tree_view));
     gtk_tree_view_column_set_fixed_width(GTK_TREE_VIEW_COLUMN(g_list_nth_data(columns, 0)), 200);
@@ -207,7 +261,7 @@ GtkWidget* create_health_check_table(const char *start_date, const char *end_dat
 
     gtk_box_pack_start(GTK_BOX(main_box), table_scrolled, FALSE, FALSE, 0);
 
-    char* recommendations = get_health_recommendations(start_date, end_date);
+    char* recommendations = get_health_recommendations(start_day, end_day);
     if (recommendations) {
         GtkWidget *recommendations_view = gtk_text_view_new();
         GtkTextBuffer *recommendations_buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(recommendations_view));
@@ -224,7 +278,9 @@ GtkWidget* create_health_check_table(const char *start_date, const char *end_dat
         gtk_text_view_set_top_margin(GTK_TEXT_VIEW(recommendations_view), 10);
         gtk_text_view_set_bottom_margin(GTK_TEXT_VIEW(recommendations_view), 10);
         
+        PERF_START(perf_text);
         gtk_text_buffer_set_text(recommendations_buffer, recommendations, -1);
+        PERF_LAP(perf_text, "recommendations.model_fill");
         
         GtkWidget *recommendations_scrolled = gtk_scrolled_window_new(NULL, NULL);
         gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(recommendations_scrolled),
@@ -242,6 +298,228 @@ GtkWidget* create_health_check_table(const char *start_date, const char *end_dat
     return main_box;
 }
 
+// Function to create table view for cohort-wide statistics
+GtkWidget* create_cohort_table(const char *directory, int start_day, int end_day) {
+    CohortTableData *data;
+    int row_count = get_cohort_table_data(directory, start_day, end_day, &data);
+
+    if (row_count == 0) {
+        GtkWidget *label = gtk_label_new("No patient data found for the specified folder and range.");
+        return label;
+    }
+
+    GtkListStore *store = gtk_list_store_new(3, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
+    GtkWidget *tree_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(store));
+
+    GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+
+    gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view),
+                               gtk_tree_view_column_new_with_attributes("Measure", renderer, "text", 0, NULL));
+    gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view),
+                               gtk_tree_view_column_new_with_attributes("Value", renderer, "text", 1, NULL));
+    gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view),
+                               gtk_tree_view_column_new_with_attributes("Details", renderer, "text", 2, NULL));
+
+    PERF_START(perf);
+    for (int i = 0; i < row_count; i++) {
+        GtkTreeIter iter;
+        gtk_list_store_append(store, &iter);
+        gtk_list_store_set(store, &iter,
+                          0, data[i].measure,
+                          1, data[i].value,
+                          2, data[i].detail,
+                          -1);
+    }
+    PERF_LAP(perf, "cohort.model_fill");
+
+    GList *columns = gtk_tree_view_get_columns(GTK_TREE_VIEW(tree_view));
+    gtk_tree_view_column_set_fixed_width(GTK_TREE_VIEW_COLUMN(g_list_nth_data(columns, 0)), 300);
+    gtk_tree_view_column_set_fixed_width(GTK_TREE_VIEW_COLUMN(g_list_nth_data(columns, 1)), 120);
+    gtk_tree_view_column_set_fixed_width(GTK_TREE_VIEW_COLUMN(g_list_nth_data(columns, 2)), 250);
+
+    free(data);
+    g_object_unref(store);
+
+    GtkWidget *scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window),
+                                  GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_container_add(GTK_CONTAINER(scrolled_window), tree_view);
+
+    return scrolled_window;
+}
+
+// Function to create table view for correlations and trends
+GtkWidget* create_correlation_table(int start_day, int end_day) {
+    CorrelationTableData *data;
+    int row_count = get_correlation_table_data(start_day, end_day, &data);
+
+    if (row_count == 0) {
+        GtkWidget *label = gtk_label_new("No data found for the specified range.");
+        return label;
+    }
+
+    GtkListStore *store = gtk_list_store_new(3, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
+    GtkWidget *tree_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(store));
+
+    GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+
+    gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view),
+                               gtk_tree_view_column_new_with_attributes("Measure", renderer, "text", 0, NULL));
+    gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view),
+                               gtk_tree_view_column_new_with_attributes("Pearson / Trend", renderer, "text", 1, NULL));
+    gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view),
+                               gtk_tree_view_column_new_with_attributes("Details", renderer, "text", 2, NULL));
+
+    for (int i = 0; i < row_count; i++) {
+        GtkTreeIter iter;
+        gtk_list_store_append(store, &iter);
+        gtk_list_store_set(store, &iter,
+                          0, data[i].measure,
+                          1, data[i].value,
+                          2, data[i].detail,
+                          -1);
+    }
+
+    GList *columns = gtk_tree_view_get_columns(GTK_TREE_VIEW(tree_view));
+    gtk_tree_view_column_set_fixed_width(GTK_TREE_VIEW_COLUMN(g_list_nth_data(columns, 0)), 260);
+    gtk_tree_view_column_set_fixed_width(GTK_TREE_VIEW_COLUMN(g_list_nth_data(columns, 1)), 180);
+    gtk_tree_view_column_set_fixed_width(GTK_TREE_VIEW_COLUMN(g_list_nth_data(columns, 2)), 320);
+
+    free(data);
+    g_object_unref(store);
+
+    GtkWidget *scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window),
+                                  GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_container_add(GTK_CONTAINER(scrolled_window), tree_view);
+
+    return scrolled_window;
+}
+
+// Function to create table view for the readings matching a filter expression.
+// Returns NULL with a message in `error` if the filter does not compile.
+GtkWidget* create_filter_table(const char *text, int start_day, int end_day, char *error, size_t error_size) {
+    FilterTableData *data;
+    long long matches;
+    int row_count = get_filter_table_data(text, start_day, end_day, &data, &matches, error, error_size);
+
+    if (row_count < 0) return NULL;
+    if (row_count == 0) {
+        free(data);
+        GtkWidget *label = gtk_label_new("No readings match the filter in the specified range.");
+        return label;
+    }
+
+    GtkListStore *store = gtk_list_store_new(7, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING,
+                                             G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
+    GtkWidget *tree_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(store));
+
+    GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+    const char *titles[] = { "Date", "Height", "Weight", "BP Systolic", "BP Diastolic", "Blood Sugar", "Temperature" };
+    for (int c = 0; c < 7; c++) {
+        gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view),
+                                   gtk_tree_view_column_new_with_attributes(titles[c], renderer, "text", c, NULL));
+    }
+
+    for (int i = 0; i < row_count; i++) {
+        GtkTreeIter iter;
+        gtk_list_store_append(store, &iter);
+        gtk_list_store_set(store, &iter,
+                          0, data[i].date,
+                          1, data[i].values[0],
+                          2, data[i].values[1],
+                          3, data[i].values[2],
+                          4, data[i].values[3],
+                          5, data[i].values[4],
+                          6, data[i].values[5],
+                          -1);
+    }
+
+    free(data);
+    g_object_unref(store);
+
+    char summary[120];
+    if (matches > row_count)
+        snprintf(summary, sizeof(summary), "%lld matching readings; showing the first %d", matches, row_count);
+    else
+        snprintf(summary, sizeof(summary), "%lld matching readings", matches);
+
+    GtkWidget *scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window),
+                                  GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_container_add(GTK_CONTAINER(scrolled_window), tree_view);
+
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
+    gtk_box_pack_start(GTK_BOX(box), gtk_label_new(summary), FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(box), scrolled_window, TRUE, TRUE, 0);
+    return box;
+}
+
+void free_export_request(gpointer data) {
+    ExportRequest *request = data;
+    g_free(request->directory);
+    g_free(request);
+}
+
+// Offers an export of the given report in the window that will show `table_widget`
+void add_table_export(GtkWidget *table_widget, const char *label, ReportKind kind,
+                      int start_day, int end_day, const char *directory) {
+    ExportRequest *request = g_new0(ExportRequest, 1);
+    snprintf(request->label, sizeof(request->label), "%s", label);
+    request->kind = kind;
+    request->start_day = start_day;
+    request->end_day = end_day;
+    request->directory = g_strdup(directory);
+
+    GList *exports = g_object_steal_data(G_OBJECT(table_widget), "exports");
+    g_object_set_data(G_OBJECT(table_widget), "exports", g_list_append(exports, request));
+}
+
+void on_export_clicked(GtkWidget *widget, gpointer data) {
+    ExportRequest *request = g_object_get_data(G_OBJECT(widget), "export");
+    GtkWidget *dialog = gtk_file_chooser_dialog_new(request->label,
+                                                    GTK_WINDOW(gtk_widget_get_toplevel(widget)),
+                                                    GTK_FILE_CHOOSER_ACTION_SAVE,
+                                                    "Cancel", GTK_RESPONSE_CANCEL,
+                                                    "Export", GTK_RESPONSE_ACCEPT,
+                                                    NULL);
+    gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(dialog), TRUE);
+    gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(dialog), "export.csv");
+
+    const char *patterns[][2] = {
+        {"CSV (*.csv)", "*.csv"}, {"JSON (*.json)", "*.json"}, {"Columnar (*.hcol)", "*.hcol"}
+    };
+    for (int i = 0; i < 3; i++) {
+        GtkFileFilter *filter = gtk_file_filter_new();
+        gtk_file_filter_set_name(filter, patterns[i][0]);
+        gtk_file_filter_add_pattern(filter, patterns[i][1]);
+        gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(dialog), filter);
+    }
+
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+        char *path = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+        int rows;
+        if (request->kind == REPORT_COHORT_READINGS)
+            rows = export_cohort_readings(path, request->directory, request->start_day, request->end_day);
+        else if (request->kind == REPORT_COHORT_RECOMMENDATIONS)
+            rows = export_cohort_recommendations(path, request->directory, request->start_day, request->end_day);
+        else
+            rows = export_report(path, request->kind, request->start_day, request->end_day);
+
+        char message[300];
+        if (rows < 0) {
+            snprintf(message, sizeof(message), "Error: Could not export to %s", path);
+            show_message(message, GTK_MESSAGE_ERROR);
+        } else {
+            snprintf(message, sizeof(message), "Exported %d rows to %s", rows, path);
+            show_message(message, GTK_MESSAGE_INFO);
+        }
+        g_free(path);
+    }
+
+    gtk_widget_destroy(dialog);
+}
+
 // Function to create and show new windows with table results
 void show_table_in_new_window(const char *title, GtkWidget *table_widget) {
     GtkWidget *result_window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
@@ -250,7 +528,7 @@ void show_table_in_new_window(const char *title, GtkWidget *table_widget) {
     if (strstr(title, "Health Check") != NULL) {
         gtk_window_set_default_size(GTK_WINDOW(result_window), 900, 700);
     } else {
-        gtk_window_set_default_size(GTK_WINDOW(result_window), 800, 400);
+        gtk_window_set_default_size(GTK_WINDOW(result_window), 900, 400);
     }
     
     gtk_window_set_keep_above(GTK_WINDOW(result_window), TRUE);
@@ -270,186 +548,270 @@ void show_table_in_new_window(const char *title, GtkWidget *table_widget) {
     gtk_box_pack_start(GTK_BOX(content_box), title_label, FALSE, FALSE, 10);
     gtk_box_pack_start(GTK_BOX(content_box), table_widget, TRUE, TRUE, 0);
 
+    // Export buttons; each one owns its request
+    GList *exports = g_object_steal_data(G_OBJECT(table_widget), "exports");
+    if (exports) {
+        GtkWidget *button_box = gtk_button_box_new(GTK_ORIENTATION_HORIZONTAL);
+        gtk_button_box_set_layout(GTK_BUTTON_BOX(button_box), GTK_BUTTONBOX_END);
+        gtk_box_set_spacing(GTK_BOX(button_box), 10);
+        for (GList *item = exports; item; item = item->next) {
+            ExportRequest *request = item->data;
+            GtkWidget *button = gtk_button_new_with_label(request->label);
+            g_object_set_data_full(G_OBJECT(button), "export", request, free_export_request);
+            g_signal_connect(button, "clicked", G_CALLBACK(on_export_clicked), NULL);
+            gtk_container_add(GTK_CONTAINER(button_box), button);
+        }
+        g_list_free(exports);
+        gtk_box_pack_start(GTK_BOX(content_box), button_box, FALSE, FALSE, 0);
+    }
+
     gtk_widget_show_all(result_window);
     g_signal_connect(result_window, "destroy", G_CALLBACK(gtk_widget_destroy), NULL);
 }
 
-// Helper function to validate that all entry fields are filled
+// Helper function to validate that every entry field holds a reading the stores
+// keep exactly (see parse_reading)
 gboolean validate_patient_entries(const char *height, const char *weight, 
                                 const char *bp_sys, const char *bp_dia,
                                 const char *blood_sugar, const char *temp) {
-    return (strlen(height) && strlen(weight) && strlen(bp_sys) && strlen(bp_dia) && 
-            strlen(blood_sugar) && strlen(temp));
+    const char *fields[] = { height, weight, bp_sys, bp_dia, blood_sugar, temp };
+    for (int f = 0; f < 6; f++) {
+        double value;
+        if (!parse_reading(fields[f], fields[f] + strlen(fields[f]), &value)) return FALSE;
+    }
+    return TRUE;
 }
 
-// Function to draw the graph
+// Keep the viewport inside the series and at least one reading wide
+void clamp_graph_view(GraphView *view, int total) {
+    double max_last = total > 1 ? total - 1 : 1;
+    double span = view->view_last - view->view_first;
+
+    if (view->view_last < 0 || span > max_last) {
+        view->view_first = 0;
+        view->view_last = max_last;
+        return;
+    }
+    if (span < 1) {
+        view->view_last = view->view_first + 1;
+    }
+    if (view->view_first < 0) {
+        view->view_last -= view->view_first;
+        view->view_first = 0;
+    }
+    if (view->view_last > max_last) {
+        view->view_first -= view->view_last - max_last;
+        view->view_last = max_last;
+    }
+}
+
+// Queries the visible date range, at roughly one point per two pixels, and hands
+// it to the render thread. Runs on the main loop, which owns the series; call it
+// whenever the data, the size or the viewport of the graph changes.
+void update_graph(GtkWidget *widget, GraphView *view) {
+    int total = get_health_data_count();
+    int width = gtk_widget_get_allocated_width(widget);
+    int height = gtk_widget_get_allocated_height(widget);
+    int graph_width = width - GRAPH_MARGIN_LEFT - GRAPH_MARGIN_RIGHT;
+
+    PERF_START(perf);
+    HealthData *data = NULL;
+    int data_count = 0;
+    int start_day, end_day;
+    clamp_graph_view(view, total);
+    if (total > 0 &&
+        get_health_day_at((int)floor(view->view_first), &start_day) &&
+        get_health_day_at(MIN((int)ceil(view->view_last), total - 1), &end_day)) {
+        data_count = get_health_data_in_range(start_day, end_day, MAX(graph_width / 2, 2), &data);
+        overlay_stream_means(data, data_count, end_day);
+    }
+    PERF_LAP(perf, "graph.query");
+
+    request_graph_render(view->renderer, width, height, data, data_count);
+}
+
+// Draw handler: only paints the latest image the render thread finished
 gboolean on_draw_graph(GtkWidget *widget, cairo_t *cr, gpointer user_data) {
-    HealthData *data;
-    int data_count = get_all_health_data(&data);
-    
-    if (data_count == 0) {
-        cairo_set_source_rgb(cr, 0, 0, 0);
-        cairo_select_font_face(cr, "Arial", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
-        cairo_set_font_size(cr, 20);
-        cairo_move_to(cr, 200, 200);
-        cairo_show_text(cr, "No data available");
-        return FALSE;
+    GraphView *view = user_data;
+
+    PERF_START(perf);
+    cairo_surface_t *surface = get_graph_surface(view->renderer);
+    if (surface) {
+        cairo_set_source_surface(cr, surface, 0, 0);
+        cairo_paint(cr);
+        cairo_surface_destroy(surface);
+    } else {
+        cairo_set_source_rgb(cr, 1, 1, 1);
+        cairo_paint(cr);
     }
+    PERF_LAP(perf, "graph.blit");
+    return FALSE;
+}
+
+// Runs on the main loop once a new image of the graph is ready
+gboolean on_graph_image_ready(gpointer user_data) {
+    GtkWidget *drawing_area = user_data;
+    gtk_widget_queue_draw(drawing_area);
+    g_object_unref(drawing_area);
+    return G_SOURCE_REMOVE;
+}
+
+// Render thread callback: the drawing area is kept alive until the main loop has
+// queued its redraw
+void on_graph_rendered(void *user_data) {
+    g_idle_add(on_graph_image_ready, g_object_ref(user_data));
+}
 
-    GtkAllocation allocation;
-    gtk_widget_get_allocation(widget, &allocation);
-    int width = allocation.width;
-    int height = allocation.height;
+void on_graph_size_allocate(GtkWidget *widget, GdkRectangle *allocation, gpointer user_data) {
+    update_graph(widget, user_data);
+}
 
-    int margin_left = 80, margin_right = 80, margin_top = 50, margin_bottom = 80;
-    int graph_width = width - margin_left - margin_right;
-    int graph_height = height - margin_top - margin_bottom;
+// Mouse wheel zooms the graph around the pointer position
+gboolean on_graph_scroll(GtkWidget *widget, GdkEventScroll *event, gpointer user_data) {
+    GraphView *view = user_data;
+    double factor;
+
+    if (event->direction == GDK_SCROLL_UP)
+        factor = 0.8;
+    else if (event->direction == GDK_SCROLL_DOWN)
+        factor = 1.25;
+    else if (event->direction == GDK_SCROLL_SMOOTH && event->delta_y != 0)
+        factor = pow(1.25, event->delta_y);
+    else
+        return FALSE;
 
-    cairo_set_source_rgb(cr, 1, 1, 1);
-    cairo_paint(cr);
+    int graph_width = gtk_widget_get_allocated_width(widget) - GRAPH_MARGIN_LEFT - GRAPH_MARGIN_RIGHT;
+    if (graph_width <= 0) return FALSE;
 
-    cairo_set_source_rgb(cr, 0, 0, 0);
-    cairo_set_line_width(cr, 2);
-    cairo_rectangle(cr, margin_left, margin_top, graph_width, graph_height);
-    cairo_stroke(cr);
+    double anchor = (event->x - GRAPH_MARGIN_LEFT) / graph_width;
+    anchor = CLAMP(anchor, 0.0, 1.0);
 
-    double min_bp = 1000, max_bp = 0, min_sugar = 1000, max_sugar = 0;
-    for (int i = 0; i < data_count; i++) {
-        if (data[i].bp_systolic < min_bp) min_bp = data[i].bp_systolic;
-        if (data[i].bp_systolic > max_bp) max_bp = data[i].bp_systolic;
-        if (data[i].bp_diastolic < min_bp) min_bp = data[i].bp_diastolic;
-        if (data[i].bp_diastolic > max_bp) max_bp = data[i].bp_diastolic;
-        if (data[i].blood_sugar < min_sugar) min_sugar = data[i].blood_sugar;
-        if (data[i].blood_sugar > max_sugar) max_sugar = data[i].blood_sugar;
-    }
+    double span = view->view_last - view->view_first;
+    double pivot = view->view_first + anchor * span;
+    span *= factor;
+    view->view_first = pivot - anchor * span;
+    view->view_last = view->view_first + span;
+    clamp_graph_view(view, get_health_data_count());
 
-    double bp_range = max_bp - min_bp;
-    double sugar_range = max_sugar - min_sugar;
-    if (bp_range > 0) {
-        min_bp -= bp_range * 0.1;
-        max_bp += bp_range * 0.1;
-    }
-    if (sugar_range > 0) {
-        min_sugar -= sugar_range * 0.1;
-        max_sugar += sugar_range * 0.1;
+    update_graph(widget, view);
+    return TRUE;
+}
+
+// Left button starts a pan; double-click goes back to the whole history
+gboolean on_graph_button_press(GtkWidget *widget, GdkEventButton *event, gpointer user_data) {
+    GraphView *view = user_data;
+    if (event->button != 1) return FALSE;
+
+    if (event->type == GDK_2BUTTON_PRESS) {
+        view->dragging = FALSE;
+        view->view_first = 0;
+        view->view_last = -1;
+        update_graph(widget, view);
+        return TRUE;
     }
 
-    cairo_set_font_size(cr, 12);
-    cairo_set_source_rgb(cr, 1, 0, 0);
-    cairo_move_to(cr, margin_left + 20, margin_top - 30);
-    cairo_show_text(cr, "Systolic BP");
-    
-    cairo_set_source_rgb(cr, 0, 0, 1);
-    cairo_move_to(cr, margin_left + 120, margin_top - 30);
-    cairo_show_text(cr, "Diastolic BP");
-    
-    cairo_set_source_rgb(cr, 0, 0.7, 0);
-    cairo_move_to(cr, margin_left + 220, margin_top - 30);
-    cairo_show_text(cr, "Blood Sugar");
-
-    cairo_set_source_rgb(cr, 0, 0, 0);
-    cairo_set_font_size(cr, 10);
-    for (int i = 0; i <= 5; i++) {
-        double bp_value = min_bp + (max_bp - min_bp) * i / 5.0;
-        int y = margin_top + graph_height - (graph_height * i / 5);
-        cairo_move_to(cr, margin_left - 50, y + 5);
-        char label[20];
-        snprintf(label, sizeof(label), "%.0f", bp_value);
-        cairo_show_text(cr, label);
-        
-        cairo_set_source_rgba(cr, 0.8, 0.8, 0.8, 0.5);
-        cairo_move_to(cr, margin_left, y);
-        cairo_line_to(cr, margin_left + graph_width, y);
-        cairo_stroke(cr);
-        cairo_set_source_rgb(cr, 0, 0, 0);
-    }
-
-    for (int i = 0; i <= 5; i++) {
-        double sugar_value = min_sugar + (max_sugar - min_sugar) * i / 5.0;
-        int y = margin_top + graph_height - (graph_height * i / 5);
-        cairo_move_to(cr, margin_left + graph_width + 10, y + 5);
-        char label[20];
-        snprintf(label, sizeof(label), "%.0f", sugar_value);
-        cairo_show_text(cr, label);
-    }
-
-    if (data_count > 1) {
-        for (int i = 0; i < data_count; i++) {
-            int x = margin_left + (graph_width * i / (data_count - 1));
-            cairo_move_to(cr, x - 20, margin_top + graph_height + 20);
-            cairo_show_text(cr, data[i].date + 5);
-        }
+    view->dragging = TRUE;
+    view->drag_x = event->x;
+    view->drag_first = view->view_first;
+    view->drag_last = view->view_last;
+    return TRUE;
+}
+
+gboolean on_graph_button_release(GtkWidget *widget, GdkEventButton *event, gpointer user_data) {
+    GraphView *view = user_data;
+    if (event->button != 1) return FALSE;
+    view->dragging = FALSE;
+    return TRUE;
+}
+
+gboolean on_graph_motion(GtkWidget *widget, GdkEventMotion *event, gpointer user_data) {
+    GraphView *view = user_data;
+    if (!view->dragging) return FALSE;
+
+    int graph_width = gtk_widget_get_allocated_width(widget) - GRAPH_MARGIN_LEFT - GRAPH_MARGIN_RIGHT;
+    if (graph_width <= 0) return FALSE;
+
+    double shift = (view->drag_x - event->x) / graph_width * (view->drag_last - view->drag_first);
+    view->view_first = view->drag_first + shift;
+    view->view_last = view->drag_last + shift;
+    clamp_graph_view(view, get_health_data_count());
+
+    update_graph(widget, view);
+    return TRUE;
+}
+
+void on_graph_area_destroy(GtkWidget *widget, gpointer data) {
+    GraphView *view = data;
+    graph_areas = g_list_remove(graph_areas, widget);
+    destroy_graph_renderer(view->renderer);
+    g_free(view);
+}
+
+// Another process appended to (or rewrote) input.txt: fold in the new readings and
+// redraw open graphs. Views showing the latest reading keep following it.
+void on_data_file_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+                          GFileMonitorEvent event_type, gpointer data) {
+    if (event_type != G_FILE_MONITOR_EVENT_CHANGED &&
+        event_type != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT &&
+        event_type != G_FILE_MONITOR_EVENT_CREATED &&
+        event_type != G_FILE_MONITOR_EVENT_DELETED) {
+        return;
     }
 
-    if (data_count > 1) {
-        cairo_set_line_width(cr, 3);
+    int old_total = get_health_data_count();
+    int changed = refresh_health_series();
+    if (changed == 0 && event_type != G_FILE_MONITOR_EVENT_DELETED) return;
+    int added = get_health_data_count() - old_total;
 
-        cairo_set_source_rgb(cr, 1, 0, 0);
-        cairo_move_to(cr, margin_left, 
-                      margin_top + graph_height - 
-                      ((data[0].bp_systolic - min_bp) / (max_bp - min_bp)) * graph_height);
-        
-        for (int i = 1; i < data_count; i++) {
-            int x = margin_left + (graph_width * i / (data_count - 1));
-            int y = margin_top + graph_height - 
-                    ((data[i].bp_systolic - min_bp) / (max_bp - min_bp)) * graph_height;
-            cairo_line_to(cr, x, y);
-        }
-        cairo_stroke(cr);
+    for (GList *item = graph_areas; item; item = item->next) {
+        GtkWidget *drawing_area = item->data;
+        GraphView *view = g_object_get_data(G_OBJECT(drawing_area), "graph-view");
 
-        cairo_set_source_rgb(cr, 0, 0, 1);
-        cairo_move_to(cr, margin_left, 
-                      margin_top + graph_height - 
-                      ((data[0].bp_diastolic - min_bp) / (max_bp - min_bp)) * graph_height);
-        
-        for (int i = 1; i < data_count; i++) {
-            int x = margin_left + (graph_width * i / (data_count - 1));
-            int y = margin_top + graph_height - 
-                    ((data[i].bp_diastolic - min_bp) / (max_bp - min_bp)) * graph_height;
-            cairo_line_to(cr, x, y);
+        if (added > 0 && view->view_last >= old_total - 1) {
+            view->view_first += added;
+            view->view_last += added;
         }
-        cairo_stroke(cr);
+        update_graph(drawing_area, view);
+    }
+}
 
-        cairo_set_source_rgb(cr, 0, 0.7, 0);
-        cairo_move_to(cr, margin_left, 
-                      margin_top + graph_height - 
-                      ((data[0].blood_sugar - min_sugar) / (max_sugar - min_sugar)) * graph_height);
-        
-        for (int i = 1; i < data_count; i++) {
-            int x = margin_left + (graph_width * i / (data_count - 1));
-            int y = margin_top + graph_height - 
-                    ((data[i].blood_sugar - min_sugar) / (max_sugar - min_sugar)) * graph_height;
-            cairo_line_to(cr, x, y);
-        }
-        cairo_stroke(cr);
+// Device readings were appended to readings.txt: fold them in and redraw open
+// graphs, whose points show the daily means of those readings
+void on_stream_file_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+                            GFileMonitorEvent event_type, gpointer data) {
+    if (event_type != G_FILE_MONITOR_EVENT_CHANGED &&
+        event_type != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT &&
+        event_type != G_FILE_MONITOR_EVENT_CREATED &&
+        event_type != G_FILE_MONITOR_EVENT_DELETED) {
+        return;
     }
 
-    cairo_set_source_rgb(cr, 0, 0, 0);
-    cairo_set_font_size(cr, 14);
-    
-    cairo_save(cr);
-    cairo_translate(cr, 20, margin_top + graph_height/2);
-    cairo_rotate(cr, -M_PI/2);
-    cairo_move_to(cr, 0, 0);
-    cairo_show_text(cr, "Blood Pressure (mmHg)");
-    cairo_restore(cr);
-    
-    cairo_save(cr);
-    cairo_translate(cr, width - 20, margin_top + graph_height/2);
-    cairo_rotate(cr, M_PI/2);
-    cairo_move_to(cr, 0, 0);
-    cairo_show_text(cr, "Blood Sugar (mg/dL)");
-    cairo_restore(cr);
-    
-    cairo_move_to(cr, margin_left + graph_width/2 - 30, height - 20);
-    cairo_show_text(cr, "Date");
+    if (refresh_stream_readings() == 0 && event_type != G_FILE_MONITOR_EVENT_DELETED) return;
+    for (GList *item = graph_areas; item; item = item->next) {
+        GtkWidget *drawing_area = item->data;
+        update_graph(drawing_area, g_object_get_data(G_OBJECT(drawing_area), "graph-view"));
+    }
+}
 
-    cairo_set_font_size(cr, 16);
-    cairo_move_to(cr, margin_left + graph_width/2 - 100, 30);
-    cairo_show_text(cr, "Health Parameter Trends");
+static GFileMonitor* watch_file(const char *path, GCallback on_changed) {
+    GFile *file = g_file_new_for_path(path);
+    GError *error = NULL;
 
-    free(data);
-    return FALSE;
+    GFileMonitor *monitor = g_file_monitor_file(file, G_FILE_MONITOR_NONE, NULL, &error);
+    if (monitor) {
+        g_signal_connect(monitor, "changed", on_changed, NULL);
+    } else {
+        g_printerr("Could not watch %s: %s\n", path, error->message);
+        g_error_free(error);
+    }
+    g_object_unref(file);
+    return monitor;
+}
+
+// Watch input.txt and readings.txt so that appends from other processes show up live
+void watch_data_file(void) {
+    data_file_monitor = watch_file("input.txt", G_CALLBACK(on_data_file_changed));
+    stream_file_monitor = watch_file(STREAM_FILE, G_CALLBACK(on_stream_file_changed));
 }
 
 // Callback for "Graphical View" button
@@ -460,13 +822,67 @@ void on_graphical_view(GtkWidget *widget, gpointer data) {
     
     GtkWidget *drawing_area = gtk_drawing_area_new();
     gtk_container_add(GTK_CONTAINER(graph_window), drawing_area);
+    gtk_widget_add_events(drawing_area, GDK_SCROLL_MASK | GDK_SMOOTH_SCROLL_MASK |
+                                        GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK |
+                                        GDK_BUTTON1_MOTION_MASK);
+
+    GraphView *view = g_new0(GraphView, 1);
+    view->view_last = -1;
+    view->renderer = create_graph_renderer(on_graph_rendered, drawing_area);
     
-    g_signal_connect(G_OBJECT(drawing_area), "draw", G_CALLBACK(on_draw_graph), NULL);
+    g_signal_connect(G_OBJECT(drawing_area), "draw", G_CALLBACK(on_draw_graph), view);
+    g_signal_connect(G_OBJECT(drawing_area), "size-allocate", G_CALLBACK(on_graph_size_allocate), view);
+    g_signal_connect(G_OBJECT(drawing_area), "scroll-event", G_CALLBACK(on_graph_scroll), view);
+    g_signal_connect(G_OBJECT(drawing_area), "button-press-event", G_CALLBACK(on_graph_button_press), view);
+    g_signal_connect(G_OBJECT(drawing_area), "button-release-event", G_CALLBACK(on_graph_button_release), view);
+    g_signal_connect(G_OBJECT(drawing_area), "motion-notify-event", G_CALLBACK(on_graph_motion), view);
+    g_signal_connect(G_OBJECT(drawing_area), "destroy", G_CALLBACK(on_graph_area_destroy), view);
+
+    g_object_set_data(G_OBJECT(drawing_area), "graph-view", view);
+    graph_areas = g_list_prepend(graph_areas, drawing_area);
     g_signal_connect(graph_window, "destroy", G_CALLBACK(gtk_widget_destroy), NULL);
     
     gtk_widget_show_all(graph_window);
 }
 
+// Outcome of a background save, handed from the writer thread to the main loop
+typedef struct {
+    int day;
+    int ok;
+} HealthWriteResult;
+
+// Saves queued whose outcome the main loop has not reported yet
+static int unfinished_saves = 0;
+
+// Runs on the main loop once a queued save is on disk (or failed)
+gboolean on_health_write_finished(gpointer user_data) {
+    HealthWriteResult *result = user_data;
+    char date[DATE_TEXT_SIZE];
+    format_day_number(result->day, date);
+
+    char message[100];
+    if (result->ok) {
+        data_rows_appended(result->day, result->day);
+        snprintf(message, sizeof(message), "Health data saved successfully for %s", date);
+        show_message(message, GTK_MESSAGE_INFO);
+    } else {
+        snprintf(message, sizeof(message), "Error: Could not save health data for %s", date);
+        show_message(message, GTK_MESSAGE_ERROR);
+    }
+
+    g_free(result);
+    unfinished_saves--;
+    return G_SOURCE_REMOVE;
+}
+
+// Writer thread callback: the main loop owns the series, cache and widgets
+void on_health_write_done(int day, int ok, void *user_data) {
+    HealthWriteResult *result = g_new(HealthWriteResult, 1);
+    result->day = day;
+    result->ok = ok;
+    g_idle_add(on_health_write_finished, result);
+}
+
 // Callback for "Input Health Data" button
 void on_input_health_data(GtkWidget *widget, gpointer data) {
     GtkWidget *dialog = gtk_dialog_new_with_buttons("Input Health Data",
@@ -507,7 +923,7 @@ void on_input_health_data(GtkWidget *widget, gpointer data) {
     gtk_widget_show_all(dialog);
 
     if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_OK) {
-        char *date = get_date_from_calendar(GTK_CALENDAR(calendar));
+        int day = get_day_from_calendar(GTK_CALENDAR(calendar));
 
         const char *height = gtk_entry_get_text(GTK_ENTRY(entry_height));
         const char *weight = gtk_entry_get_text(GTK_ENTRY(entry_weight));
@@ -517,16 +933,16 @@ void on_input_health_data(GtkWidget *widget, gpointer data) {
         const char *temp = gtk_entry_get_text(GTK_ENTRY(entry_temp));
 
         if (validate_patient_entries(height, weight, bp_sys, bp_dia, blood_sugar, temp)) {
-            write_data_to_file(date, height, weight, bp_sys, bp_dia, blood_sugar, temp);
-            
-            char success_message[100];
-            snprintf(success_message, sizeof(success_message), "Health data saved successfully for %s", date);
-            show_message(success_message, GTK_MESSAGE_INFO);
+            if (queue_health_write(day, height, weight, bp_sys, bp_dia, blood_sugar, temp,
+                                   on_health_write_done, NULL)) {
+                unfinished_saves++;
+            } else {
+                show_message("Could not queue the health data for saving. Please try again.", GTK_MESSAGE_ERROR);
+            }
         } else {
-            show_message("Please fill in all fields before saving.", GTK_MESSAGE_ERROR);
+            show_message("Please fill in every field with a number of at most 3 decimals before saving.",
+                         GTK_MESSAGE_ERROR);
         }
-        
-        g_free(date);
     }
 
     gtk_widget_destroy(dialog);
@@ -551,12 +967,11 @@ void on_daily_report(GtkWidget *widget, gpointer data) {
     gtk_widget_show_all(dialog);
 
     if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_OK) {
-        char *date = get_date_from_calendar(GTK_CALENDAR(calendar));
+        int day = get_day_from_calendar(GTK_CALENDAR(calendar));
         
-        GtkWidget *table = create_comparison_table(date);
+        GtkWidget *table = create_comparison_table(day);
+        add_table_export(table, "Export Comparison", REPORT_COMPARISON, day, day, NULL);
         show_table_in_new_window("Daily Report", table);
-        
-        g_free(date);
     }
 
     gtk_widget_destroy(dialog);
@@ -587,18 +1002,18 @@ void on_report_summary(GtkWidget *widget, gpointer data) {
     gtk_widget_show_all(dialog);
 
     if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_OK) {
-        char *start_date = get_date_from_calendar(GTK_CALENDAR(calendar_start));
-        char *end_date = get_date_from_calendar(GTK_CALENDAR(calendar_end));
-
-        if (strcmp(start_date, end_date) <= 0) {
-            GtkWidget *table = create_stats_table(start_date, end_date);
+        int start_day = get_day_from_calendar(GTK_CALENDAR(calendar_start));
+        int end_day = get_day_from_calendar(GTK_CALENDAR(calendar_end));
+
+        if (start_day <= end_day) {
+            GtkWidget *table = create_stats_table(start_day, end_day);
+            add_table_export(table, "Export Statistics", REPORT_STATS, start_day, end_day, NULL);
+            add_table_export(table, "Export Readings", REPORT_READINGS, start_day, end_day, NULL);
+            add_table_export(table, "Export Daily Series", REPORT_DAILY_READINGS, start_day, end_day, NULL);
             show_table_in_new_window("Report Summary", table);
         } else {
             show_message("Error: Start date must be before or equal to end date.", GTK_MESSAGE_ERROR);
         }
-        
-        g_free(start_date);
-        g_free(end_date);
     }
 
     gtk_widget_destroy(dialog);
@@ -628,29 +1043,368 @@ void on_health_check_advice(GtkWidget *widget, gpointer data) {
     gtk_widget_show_all(dialog);
 
     if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_OK) {
-        char *start_date = get_date_from_calendar(GTK_CALENDAR(calendar_start));
-        char *end_date = get_date_from_calendar(GTK_CALENDAR(calendar_end));
+        int start_day = get_day_from_calendar(GTK_CALENDAR(calendar_start));
+        int end_day = get_day_from_calendar(GTK_CALENDAR(calendar_end));
         
-        GtkWidget *table = create_health_check_table(start_date, end_date);
+        GtkWidget *table = create_health_check_table(start_day, end_day);
+        add_table_export(table, "Export Abnormalities", REPORT_ABNORMALITIES, start_day, end_day, NULL);
+        add_table_export(table, "Export Recommendations", REPORT_RECOMMENDATIONS, start_day, end_day, NULL);
         show_table_in_new_window("Health Check & Advice", table);
-        
-        g_free(start_date);
-        g_free(end_date);
     }
 
     gtk_widget_destroy(dialog);
 }
 
+// Callback for "Cohort Analysis" button
+void on_cohort_analysis(GtkWidget *widget, gpointer data) {
+    GtkWidget *dialog = gtk_dialog_new_with_buttons("Cohort Analysis",
+                                                    GTK_WINDOW(window),
+                                                    GTK_DIALOG_MODAL,
+                                                    "Analyze Cohort", GTK_RESPONSE_OK,
+                                                    "Cancel", GTK_RESPONSE_CANCEL,
+                                                    NULL);
+    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+    GtkWidget *grid = gtk_grid_new();
+    gtk_container_add(GTK_CONTAINER(content_area), grid);
+
+    add_label_to_grid(grid, "Patient Folder:", 0, 0);
+    add_label_to_grid(grid, "Select Start Date:", 0, 1);
+    add_label_to_grid(grid, "Select End Date:", 0, 2);
+
+    GtkWidget *folder_chooser = gtk_file_chooser_button_new("Select Patient Folder",
+                                                            GTK_FILE_CHOOSER_ACTION_SELECT_FOLDER);
+    GtkWidget *calendar_start = gtk_calendar_new();
+    GtkWidget *calendar_end = gtk_calendar_new();
+
+    gtk_grid_attach(GTK_GRID(grid), folder_chooser, 1, 0, 2, 1);
+    gtk_grid_attach(GTK_GRID(grid), calendar_start, 1, 1, 2, 1);
+    gtk_grid_attach(GTK_GRID(grid), calendar_end, 1, 2, 2, 1);
+
+    gtk_widget_show_all(dialog);
+
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_OK) {
+        char *directory = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(folder_chooser));
+        int start_day = get_day_from_calendar(GTK_CALENDAR(calendar_start));
+        int end_day = get_day_from_calendar(GTK_CALENDAR(calendar_end));
+
+        if (!directory) {
+            show_message("Please select the folder with the patient files.", GTK_MESSAGE_ERROR);
+        } else if (start_day <= end_day) {
+            GtkWidget *table = create_cohort_table(directory, start_day, end_day);
+            add_table_export(table, "Export Cohort Readings", REPORT_COHORT_READINGS, start_day, end_day, directory);
+            add_table_export(table, "Export Cohort Advice", REPORT_COHORT_RECOMMENDATIONS, start_day, end_day, directory);
+            show_table_in_new_window("Cohort Analysis", table);
+        } else {
+            show_message("Error: Start date must be before or equal to end date.", GTK_MESSAGE_ERROR);
+        }
+
+        g_free(directory);
+    }
+
+    gtk_widget_destroy(dialog);
+}
+
+// Callback for "Correlation Analysis" button
+void on_correlation_analysis(GtkWidget *widget, gpointer data) {
+    GtkWidget *dialog = gtk_dialog_new_with_buttons("Correlation Analysis",
+                                                    GTK_WINDOW(window),
+                                                    GTK_DIALOG_MODAL,
+                                                    "Analyze", GTK_RESPONSE_OK,
+                                                    "Cancel", GTK_RESPONSE_CANCEL,
+                                                    NULL);
+    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+    GtkWidget *grid = gtk_grid_new();
+    gtk_container_add(GTK_CONTAINER(content_area), grid);
+
+    add_label_to_grid(grid, "Select Start Date:", 0, 0);
+    add_label_to_grid(grid, "Select End Date:", 0, 1);
+
+    GtkWidget *calendar_start = gtk_calendar_new();
+    GtkWidget *calendar_end = gtk_calendar_new();
+
+    gtk_grid_attach(GTK_GRID(grid), calendar_start, 1, 0, 2, 1);
+    gtk_grid_attach(GTK_GRID(grid), calendar_end, 1, 1, 2, 1);
+
+    gtk_widget_show_all(dialog);
+
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_OK) {
+        int start_day = get_day_from_calendar(GTK_CALENDAR(calendar_start));
+        int end_day = get_day_from_calendar(GTK_CALENDAR(calendar_end));
+
+        if (start_day <= end_day) {
+            GtkWidget *table = create_correlation_table(start_day, end_day);
+            show_table_in_new_window("Correlation Analysis", table);
+        } else {
+            show_message("Error: Start date must be before or equal to end date.", GTK_MESSAGE_ERROR);
+        }
+    }
+
+    gtk_widget_destroy(dialog);
+}
+
+// Callback for "Query Readings" button
+void on_query_readings(GtkWidget *widget, gpointer data) {
+    GtkWidget *dialog = gtk_dialog_new_with_buttons("Query Readings",
+                                                    GTK_WINDOW(window),
+                                                    GTK_DIALOG_MODAL,
+                                                    "Run Query", GTK_RESPONSE_OK,
+                                                    "Cancel", GTK_RESPONSE_CANCEL,
+                                                    NULL);
+    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+    GtkWidget *grid = gtk_grid_new();
+    gtk_container_add(GTK_CONTAINER(content_area), grid);
+
+    add_label_to_grid(grid, "Filter:", 0, 0);
+    add_label_to_grid(grid, "Select Start Date:", 0, 1);
+    add_label_to_grid(grid, "Select End Date:", 0, 2);
+
+    GtkWidget *entry_filter = gtk_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(entry_filter), "sugar > 180 and systolic > 130 and last 90 days");
+    gtk_entry_set_width_chars(GTK_ENTRY(entry_filter), 45);
+    GtkWidget *calendar_start = gtk_calendar_new();
+    GtkWidget *calendar_end = gtk_calendar_new();
+
+    gtk_grid_attach(GTK_GRID(grid), entry_filter, 1, 0, 2, 1);
+    gtk_grid_attach(GTK_GRID(grid), calendar_start, 1, 1, 2, 1);
+    gtk_grid_attach(GTK_GRID(grid), calendar_end, 1, 2, 2, 1);
+
+    gtk_widget_show_all(dialog);
+
+    // A filter that does not compile keeps the dialog open so it can be corrected
+    while (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_OK) {
+        int start_day = get_day_from_calendar(GTK_CALENDAR(calendar_start));
+        int end_day = get_day_from_calendar(GTK_CALENDAR(calendar_end));
+
+        if (start_day > end_day) {
+            show_message("Error: Start date must be before or equal to end date.", GTK_MESSAGE_ERROR);
+            continue;
+        }
+
+        char error[200];
+        GtkWidget *table = create_filter_table(gtk_entry_get_text(GTK_ENTRY(entry_filter)),
+                                               start_day, end_day, error, sizeof(error));
+        if (!table) {
+            show_message(error, GTK_MESSAGE_ERROR);
+            continue;
+        }
+        show_table_in_new_window("Query Readings", table);
+        break;
+    }
+
+    gtk_widget_destroy(dialog);
+}
+
+// Fill the performance table with one row per timed operation, from a copy of
+// the stats, since the render thread and the writer go on recording meanwhile
+void fill_performance_store(GtkListStore *store) {
+    gtk_list_store_clear(store);
+
+    HealthPerfStats *stats;
+    int count = health_perf_snapshot(&stats);
+    for (int p = 0; p < count; p++) {
+        const HealthPerfStats *probe = &stats[p];
+        GString *history = g_string_new(NULL);
+        for (int i = 0; i < probe->history_count; i++) {
+            g_string_append_printf(history, i ? ", %.2f" : "%.2f", probe->history[i] / 1e6);
+        }
+
+        char count_text[20], mean[20], max[20], budget[30];
+        snprintf(count_text, sizeof(count_text), "%lld", probe->count);
+        snprintf(mean, sizeof(mean), "%.3f", probe->total_ns / 1e6 / probe->count);
+        snprintf(max, sizeof(max), "%.3f", probe->max_ns / 1e6);
+        if (health_perf_budget(probe->name) > 0)
+            snprintf(budget, sizeof(budget), "%.3f%s", health_perf_budget(probe->name) / 1e6,
+                     health_perf_over_budget(probe) ? " (over)" : "");
+        else
+            snprintf(budget, sizeof(budget), "-");
+
+        GtkTreeIter iter;
+        gtk_list_store_append(store, &iter);
+        gtk_list_store_set(store, &iter,
+                          0, probe->name,
+                          1, count_text,
+                          2, mean,
+                          3, max,
+                          4, budget,
+                          5, history->str,
+                          -1);
+        g_string_free(history, TRUE);
+    }
+    if (count >= 0) free(stats);
+}
+
+// How the lines of input.txt parsed, under the performance table
+void fill_parse_summary(GtkLabel *label) {
+    long long counts[ROW_RESULTS];
+    get_health_data_parse_counts(counts);
+
+    char summary[200];
+    snprintf(summary, sizeof(summary),
+             "input.txt: %lld readings, %lld malformed rows skipped (%lld wrong field count, %lld bad date, %lld bad number)",
+             counts[ROW_OK], counts[ROW_BAD_FIELD_COUNT] + counts[ROW_BAD_DATE] + counts[ROW_BAD_NUMBER],
+             counts[ROW_BAD_FIELD_COUNT], counts[ROW_BAD_DATE], counts[ROW_BAD_NUMBER]);
+    gtk_label_set_text(label, summary);
+}
+
+// Memory held per subsystem, against the budget if there is one
+void fill_memory_summary(GtkLabel *label) {
+    MemoryUsage usage;
+    get_memory_usage(&usage);
+
+    GString *summary = g_string_new("Memory: ");
+    char size[24];
+    format_memory_size(usage.total, size, sizeof(size));
+    g_string_append(summary, size);
+    if (usage.budget > 0) {
+        format_memory_size(usage.budget, size, sizeof(size));
+        g_string_append_printf(summary, " of %s budget%s", size, usage.total > usage.budget ? " (over)" : "");
+    }
+    for (int s = 0; s < MEMORY_SUBSYSTEMS; s++) {
+        format_memory_size(usage.bytes[s], size, sizeof(size));
+        g_string_append_printf(summary, "%s %s %s", s == 0 ? " (" : ",", get_memory_subsystem_name(s), size);
+    }
+    g_string_append(summary, ")");
+    if (usage.series_streaming) g_string_append(summary, "; series streaming from input.txt");
+
+    gtk_label_set_text(label, summary->str);
+    g_string_free(summary, TRUE);
+}
+
+void on_performance_refresh(GtkWidget *widget, gpointer data) {
+    fill_performance_store(GTK_LIST_STORE(data));
+    fill_parse_summary(GTK_LABEL(g_object_get_data(G_OBJECT(data), "parse-summary")));
+    fill_memory_summary(GTK_LABEL(g_object_get_data(G_OBJECT(data), "memory-summary")));
+}
+
+void on_performance_save(GtkWidget *widget, gpointer data) {
+    FILE *file = fopen("health_perf.json", "w");
+    if (!file) {
+        show_message("Error: Could not write health_perf.json", GTK_MESSAGE_ERROR);
+        return;
+    }
+    health_perf_dump_json(file);
+    fclose(file);
+    show_message("Timings saved to health_perf.json", GTK_MESSAGE_INFO);
+}
+
+// Hidden "Performance" window, opened with Ctrl+Shift+P on the main window
+void show_performance_window(void) {
+    GtkWidget *perf_window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_title(GTK_WINDOW(perf_window), "Performance");
+    gtk_window_set_default_size(GTK_WINDOW(perf_window), 900, 400);
+
+    GtkWidget *content_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 10);
+    gtk_container_set_border_width(GTK_CONTAINER(content_box), 15);
+    gtk_container_add(GTK_CONTAINER(perf_window), content_box);
+
+    GtkListStore *store = gtk_list_store_new(6, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING,
+                                             G_TYPE_STRING, G_TYPE_STRING);
+    GtkWidget *tree_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(store));
+    GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+
+    gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view),
+                               gtk_tree_view_column_new_with_attributes("Operation", renderer, "text", 0, NULL));
+    gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view),
+                               gtk_tree_view_column_new_with_attributes("Count", renderer, "text", 1, NULL));
+    gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view),
+                               gtk_tree_view_column_new_with_attributes("Mean (ms)", renderer, "text", 2, NULL));
+    gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view),
+                               gtk_tree_view_column_new_with_attributes("Max (ms)", renderer, "text", 3, NULL));
+    gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view),
+                               gtk_tree_view_column_new_with_attributes("Budget (ms)", renderer, "text", 4, NULL));
+    gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view),
+                               gtk_tree_view_column_new_with_attributes("Last Timings (ms, newest first)", renderer, "text", 5, NULL));
+
+    fill_performance_store(store);
+
+    GtkWidget *scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window),
+                                  GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_container_add(GTK_CONTAINER(scrolled_window), tree_view);
+    gtk_box_pack_start(GTK_BOX(content_box), scrolled_window, TRUE, TRUE, 0);
+
+    GtkWidget *parse_label = gtk_label_new(NULL);
+    gtk_widget_set_halign(parse_label, GTK_ALIGN_START);
+    fill_parse_summary(GTK_LABEL(parse_label));
+    g_object_set_data(G_OBJECT(store), "parse-summary", parse_label);
+    gtk_box_pack_start(GTK_BOX(content_box), parse_label, FALSE, FALSE, 0);
+
+    GtkWidget *memory_label = gtk_label_new(NULL);
+    gtk_widget_set_halign(memory_label, GTK_ALIGN_START);
+    gtk_label_set_line_wrap(GTK_LABEL(memory_label), TRUE);
+    fill_memory_summary(GTK_LABEL(memory_label));
+    g_object_set_data(G_OBJECT(store), "memory-summary", memory_label);
+    gtk_box_pack_start(GTK_BOX(content_box), memory_label, FALSE, FALSE, 0);
+
+    GtkWidget *button_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 10);
+    GtkWidget *btn_refresh = gtk_button_new_with_label("Refresh");
+    GtkWidget *btn_save = gtk_button_new_with_label("Save as JSON");
+    g_signal_connect(btn_refresh, "clicked", G_CALLBACK(on_performance_refresh), store);
+    g_signal_connect(btn_save, "clicked", G_CALLBACK(on_performance_save), NULL);
+    gtk_box_pack_end(GTK_BOX(button_box), btn_save, FALSE, FALSE, 0);
+    gtk_box_pack_end(GTK_BOX(button_box), btn_refresh, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(content_box), button_box, FALSE, FALSE, 0);
+
+    // The tree view keeps its own reference to the model
+    g_object_unref(store);
+
+    gtk_widget_show_all(perf_window);
+}
+
+// Ctrl+Shift+P opens the performance window
+// Closing the main window first writes out the saves still queued and reports
+// each one while the main loop runs, so none ends without its confirmation and
+// without data_rows_appended
+gboolean on_main_window_delete(GtkWidget *widget, GdkEvent *event, gpointer data) {
+    stop_health_writer();
+    while (unfinished_saves > 0) {
+        gtk_main_iteration();
+    }
+    return FALSE;
+}
+
+gboolean on_main_key_press(GtkWidget *widget, GdkEventKey *event, gpointer data) {
+    GdkModifierType mods = event->state & gtk_accelerator_get_default_mod_mask();
+    if (mods == (GDK_CONTROL_MASK | GDK_SHIFT_MASK) &&
+        (event->keyval == GDK_KEY_P || event->keyval == GDK_KEY_p)) {
+        show_performance_window();
+        return TRUE;
+    }
+    return FALSE;
+}
+
 // Main function - entry point of the program
 int main(int argc, char *argv[]) {
     gtk_init(&argc, &argv);
 
+    // HEALTH_PERF_BUDGET=<file> sets latency budgets; the exit status is 1 if any
+    // operation was slower than its budget (see health_perf_budget.txt)
+    const char *perf_budget = g_getenv("HEALTH_PERF_BUDGET");
+    if (perf_budget && health_perf_load_budgets(perf_budget) < 0) {
+        g_printerr("Could not read latency budgets from %s\n", perf_budget);
+    }
+
+    // HEALTH_MEMORY_BUDGET=<size> (e.g. 256M) bounds the memory held for loaded data
+    // and caches; over it the series is read back from input.txt by each query
+    const char *memory_budget = g_getenv("HEALTH_MEMORY_BUDGET");
+    size_t memory_budget_bytes;
+    if (memory_budget && parse_memory_size(memory_budget, &memory_budget_bytes)) {
+        set_memory_budget(memory_budget_bytes);
+    } else if (memory_budget) {
+        g_printerr("Could not read a memory budget from %s\n", memory_budget);
+    }
+
     apply_clean_css();
+    watch_data_file();
+    // Derived state from the last run, if input.txt still matches it
+    load_health_checkpoint();
 
     window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
     gtk_window_set_title(GTK_WINDOW(window), "Health Monitoring System");
-    gtk_window_set_default_size(GTK_WINDOW(window), 700, 450);
+    gtk_window_set_default_size(GTK_WINDOW(window), 700, 660);
+    g_signal_connect(window, "delete-event", G_CALLBACK(on_main_window_delete), NULL);
     g_signal_connect(window, "destroy", G_CALLBACK(gtk_main_quit), NULL);
+    g_signal_connect(window, "key-press-event", G_CALLBACK(on_main_key_press), NULL);
 
     GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 12);
     gtk_container_set_border_width(GTK_CONTAINER(vbox), 20);
@@ -661,30 +1415,60 @@ int main(int argc, char *argv[]) {
     GtkWidget *btn_report_summary = gtk_button_new_with_label("Report Summary");
     GtkWidget *btn_health_check_advice = gtk_button_new_with_label("Health Check & Advice");
     GtkWidget *btn_graphical_view = gtk_button_new_with_label("Graphical View");
+    GtkWidget *btn_cohort_analysis = gtk_button_new_with_label("Cohort Analysis");
+    GtkWidget *btn_correlation_analysis = gtk_button_new_with_label("Correlation Analysis");
+    GtkWidget *btn_query_readings = gtk_button_new_with_label("Query Readings");
     
     gtk_widget_set_size_request(btn_input_health_data, -1, 50);
     gtk_widget_set_size_request(btn_daily_report, -1, 50);
     gtk_widget_set_size_request(btn_report_summary, -1, 50);
     gtk_widget_set_size_request(btn_health_check_advice, -1, 50);
     gtk_widget_set_size_request(btn_graphical_view, -1, 50);
+    gtk_widget_set_size_request(btn_cohort_analysis, -1, 50);
+    gtk_widget_set_size_request(btn_correlation_analysis, -1, 50);
+    gtk_widget_set_size_request(btn_query_readings, -1, 50);
 
     g_signal_connect(btn_input_health_data, "clicked", G_CALLBACK(on_input_health_data), NULL);
     g_signal_connect(btn_daily_report, "clicked", G_CALLBACK(on_daily_report), NULL);
     g_signal_connect(btn_report_summary, "clicked", G_CALLBACK(on_report_summary), NULL);
     g_signal_connect(btn_health_check_advice, "clicked", G_CALLBACK(on_health_check_advice), NULL);
     g_signal_connect(btn_graphical_view, "clicked", G_CALLBACK(on_graphical_view), NULL);
+    g_signal_connect(btn_cohort_analysis, "clicked", G_CALLBACK(on_cohort_analysis), NULL);
+    g_signal_connect(btn_correlation_analysis, "clicked", G_CALLBACK(on_correlation_analysis), NULL);
+    g_signal_connect(btn_query_readings, "clicked", G_CALLBACK(on_query_readings), NULL);
 
     gtk_box_pack_start(GTK_BOX(vbox), btn_input_health_data, FALSE, TRUE, 10);
     gtk_box_pack_start(GTK_BOX(vbox), btn_daily_report, FALSE, TRUE, 10);
     gtk_box_pack_start(GTK_BOX(vbox), btn_report_summary, FALSE, TRUE, 10);
     gtk_box_pack_start(GTK_BOX(vbox), btn_health_check_advice, FALSE, TRUE, 10);
     gtk_box_pack_start(GTK_BOX(vbox), btn_graphical_view, FALSE, TRUE, 10);
+    gtk_box_pack_start(GTK_BOX(vbox), btn_cohort_analysis, FALSE, TRUE, 10);
+    gtk_box_pack_start(GTK_BOX(vbox), btn_correlation_analysis, FALSE, TRUE, 10);
+    gtk_box_pack_start(GTK_BOX(vbox), btn_query_readings, FALSE, TRUE, 10);
 
     gtk_widget_show_all(window);
     gtk_main();
+    stop_health_writer();
+    save_health_checkpoint();
+
+    // HEALTH_PERF_LOG=<file> dumps the collected timings on exit (JSON for *.json)
+    const char *perf_log = g_getenv("HEALTH_PERF_LOG");
+    if (perf_log) {
+        FILE *file = fopen(perf_log, "w");
+        if (file) {
+            if (g_str_has_suffix(perf_log, ".json"))
+                health_perf_dump_json(file);
+            else
+                health_perf_dump(file);
+            fclose(file);
+        }
+    }
 
+    if (perf_budget && health_perf_check_budgets(stderr) > 0) {
+        return 1;
+    }
     return 0;
 }
 
-// gcc health_logic.c health_ui.c -o health_analyzer $(pkg-config --cflags --libs gtk+-3.0)
+// gcc health_logic.c health_series.c health_stream.c health_advice.c health_memory.c health_grid.c health_perf.c health_cohort.c health_sketch.c health_segment.c health_epoch.c health_analysis.c health_writer.c health_export.c health_checkpoint.c health_filter.c health_render.c health_ui.c -o health_analyzer $(pkg-config --cflags --libs gtk+-3.0) -lm -pthread
 // ./health_analyzer
@@ -0,0 +1,105 @@
+#include "health_writer.h"
+#include <pthread.h>
+
+typedef struct {
+    int day;
+    char row[256];
+    HealthWriteCallback callback;
+    void *user_data;
+} PendingWrite;
+
+// Bounded ring of saves waiting for the writer thread
+static PendingWrite queue[WRITE_QUEUE_SIZE];
+static int queue_head = 0;
+static int queue_count = 0;
+static int writer_running = 0;
+static int writer_stopping = 0;
+static pthread_t writer_thread;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_ready = PTHREAD_COND_INITIALIZER;
+
+// Only touched by the writer thread
+static PendingWrite batch[WRITE_QUEUE_SIZE];
+static char batch_rows[WRITE_QUEUE_SIZE * sizeof(batch[0].row)];
+
+// Takes everything queued so far and stores it with one append and one flush to
+// disk, so a burst of saves costs a single sync. Callbacks run after the sync.
+static void* writer_main(void *arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&queue_lock);
+        while (queue_count == 0 && !writer_stopping) {
+            pthread_cond_wait(&queue_ready, &queue_lock);
+        }
+        if (queue_count == 0) {
+            pthread_mutex_unlock(&queue_lock);
+            break;
+        }
+
+        int count = queue_count;
+        for (int i = 0; i < count; i++) {
+            batch[i] = queue[(queue_head + i) % WRITE_QUEUE_SIZE];
+        }
+        queue_head = (queue_head + count) % WRITE_QUEUE_SIZE;
+        queue_count = 0;
+        pthread_mutex_unlock(&queue_lock);
+
+        size_t length = 0;
+        for (int i = 0; i < count; i++) {
+            size_t row_length = strlen(batch[i].row);
+            memcpy(batch_rows + length, batch[i].row, row_length);
+            length += row_length;
+        }
+        int ok = append_data_rows(batch_rows, length);
+
+        for (int i = 0; i < count; i++) {
+            if (batch[i].callback) batch[i].callback(batch[i].day, ok, batch[i].user_data);
+        }
+    }
+    return NULL;
+}
+
+// Queues one reading for the writer thread, starting it on first use. Returns 0
+// (and queues nothing) if the row is malformed, the queue is full or the thread
+// cannot be started; the caller may retry later.
+int queue_health_write(int day, const char *height, const char *weight, const char *bp_sys,
+                       const char *bp_dia, const char *blood_sugar, const char *temp,
+                       HealthWriteCallback callback, void *user_data) {
+    PendingWrite write;
+    write.day = day;
+    write.callback = callback;
+    write.user_data = user_data;
+    if (!format_data_row(day, height, weight, bp_sys, bp_dia, blood_sugar, temp, write.row, sizeof(write.row)))
+        return 0;
+
+    pthread_mutex_lock(&queue_lock);
+    if (!writer_running) {
+        writer_stopping = 0;
+        writer_running = pthread_create(&writer_thread, NULL, writer_main, NULL) == 0;
+    }
+    if (!writer_running || queue_count == WRITE_QUEUE_SIZE) {
+        pthread_mutex_unlock(&queue_lock);
+        return 0;
+    }
+
+    queue[(queue_head + queue_count) % WRITE_QUEUE_SIZE] = write;
+    queue_count++;
+    pthread_cond_signal(&queue_ready);
+    pthread_mutex_unlock(&queue_lock);
+    return 1;
+}
+
+// Writes out whatever is still queued and stops the writer thread
+void stop_health_writer(void) {
+    pthread_mutex_lock(&queue_lock);
+    if (!writer_running) {
+        pthread_mutex_unlock(&queue_lock);
+        return;
+    }
+    writer_stopping = 1;
+    pthread_cond_signal(&queue_ready);
+    pthread_mutex_unlock(&queue_lock);
+
+    pthread_join(writer_thread, NULL);
+    writer_running = 0;
+}
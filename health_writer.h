@@ -0,0 +1,18 @@
+#ifndef HEALTH_WRITER_H
+#define HEALTH_WRITER_H
+
+#include "health_logic.h"
+
+// Saves that can wait for the writer thread before queue_health_write refuses more
+#define WRITE_QUEUE_SIZE 64
+
+// Run on the writer thread once the row for `day` is on disk (ok = 1) or failed
+typedef void (*HealthWriteCallback)(int day, int ok, void *user_data);
+
+// Function declarations for the background writer of input.txt
+int queue_health_write(int day, const char *height, const char *weight, const char *bp_sys,
+                       const char *bp_dia, const char *blood_sugar, const char *temp,
+                       HealthWriteCallback callback, void *user_data);
+void stop_health_writer(void);
+
+#endif // HEALTH_WRITER_H